@@ -0,0 +1,104 @@
+/*
+ * copy benchmark - compares copying a tmpfs file through a user buffer
+ * (vfs_read + vfs_write) with vfs_copy_range, both when tmpfs can share
+ * pages (same offset within a page) and when the VFS has to copy the data
+ * itself from the mapped source pages.
+ *
+ * The sparse workload leaves most of the file as a hole, which the buffer
+ * copy reads as zeros and vfs_copy_range skips.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <vfs.h>
+#include <fs/tmpfs.h>
+
+#define MIB        (1024 * 1024ull)
+#define DENSE_SIZE (128 * MIB)
+#define BUF_SIZE   (64 * 1024)
+
+typedef ssize_t (*copy_t)(vfs_node_t src, vfs_node_t dst, u64 size);
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static ssize_t copy_buffer(vfs_node_t src, vfs_node_t dst, u64 size) {
+    static char buf[BUF_SIZE];
+    for (u64 off = 0; off < size;) {
+        ssize_t n = vfs_read(src, buf, off, BUF_SIZE);
+        if (n <= 0 || vfs_write(dst, buf, off, n) != n) return -1;
+        off += n;
+    }
+    return size;
+}
+
+static ssize_t copy_clone(vfs_node_t src, vfs_node_t dst, u64 size) {
+    return vfs_copy_range(src, 0, dst, 0, size);
+}
+
+// a one byte shift stops tmpfs from sharing pages
+static ssize_t copy_shifted(vfs_node_t src, vfs_node_t dst, u64 size) {
+    return vfs_copy_range(src, 0, dst, 1, size);
+}
+
+static vfs_node_t make_source(const char *path, u64 size, u64 data) {
+    vfs_mkfile(path);
+    vfs_node_t file = vfs_open(path);
+    char *buf = malloc(BUF_SIZE);
+    for (size_t i = 0; i < BUF_SIZE; i++) buf[i] = i * 31;
+    // data extents spread evenly over the file, the rest stays a hole
+    u64 stride = size / (data / BUF_SIZE);
+    for (u64 off = 0; off + BUF_SIZE <= size; off += stride) vfs_write(file, buf, off, BUF_SIZE);
+    vfs_truncate(file, size);
+    free(buf);
+    return file;
+}
+
+static void run(const char *workload, vfs_node_t src, const char *method, copy_t copy) {
+    static int seq = 0;
+    char path[32];
+    snprintf(path, sizeof(path), "/dst%d", seq++);
+    vfs_mkfile(path);
+    vfs_node_t dst = vfs_open(path);
+
+    u64 size = src->info->size;
+    double start = now();
+    ssize_t n = copy(src, dst, size);
+    double seconds = now() - start;
+    if (n != (ssize_t)size) {
+        printf("%-8s %-10s failed\n", workload, method);
+        exit(1);
+    }
+    vfs_close(dst); // reopen to refresh the stat
+    vfs_update(dst);
+    printf("%-8s %-10s %8llu %10.2f %10.1f %10llu\n", workload, method, (unsigned long long)(size / MIB),
+           seconds * 1000, size / seconds / 1e6, (unsigned long long)(dst->info->realsize / MIB));
+    vfs_truncate(dst, 0); // release the pages before the next run
+}
+
+int main() {
+    vfs_init();
+    tmpfs_regist();
+    vfs_mount("tmpfs", rootdir);
+
+    vfs_node_t dense = make_source("/dense", DENSE_SIZE, DENSE_SIZE);
+    vfs_node_t sparse = make_source("/sparse", 8 * DENSE_SIZE, DENSE_SIZE / 8);
+
+    printf("%-8s %-10s %8s %10s %10s %10s\n", "workload", "method", "MiB", "ms", "MB/s", "used MiB");
+    const struct {
+        const char *name;
+        copy_t fn;
+    } methods[] = {
+        {"buffer",  copy_buffer },
+        {"clone",   copy_clone  },
+        {"shifted", copy_shifted},
+    };
+    for (size_t i = 0; i < sizeof(methods) / sizeof(*methods); i++) run("dense", dense, methods[i].name, methods[i].fn);
+    for (size_t i = 0; i < sizeof(methods) / sizeof(*methods); i++) run("sparse", sparse, methods[i].name, methods[i].fn);
+    return 0;
+}
@@ -0,0 +1,144 @@
+/*
+ * elevator benchmark - drives the block request queue against a simulated
+ * disk whose cost depends on how far the head has to move, and compares
+ * dispatching in submission order with plugged, sorted and merged dispatch.
+ *
+ * The disk does not sleep; it accumulates a virtual service time, so the
+ * numbers are deterministic and only reflect the order and size of the
+ * requests the queue sends down.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vfs.h>
+#include <block.h>
+
+#define SECTOR       512
+#define DISK_SECTORS (1ull << 22) // 2 GiB
+#define REQ_SECTORS  8            // 4 KiB requests
+
+// cost model of a rotating disk, in microseconds
+#define COST_COMMAND   50.0
+#define COST_SEEK_MIN  400.0
+#define COST_SEEK_FULL 8000.0
+#define COST_PER_SECT  (SECTOR / 150.0) // 150 MB/s media rate
+
+typedef struct simdisk {
+    u64 head;
+    double time_us;
+    u64 requests;
+    u64 bytes;
+} simdisk_t;
+
+static double disk_cost(simdisk_t *disk, u64 lba, size_t count) {
+    double cost = COST_COMMAND + count * COST_PER_SECT;
+    if (lba != disk->head) {
+        u64 dist = lba > disk->head ? lba - disk->head : disk->head - lba;
+        cost += COST_SEEK_MIN + COST_SEEK_FULL * dist / DISK_SECTORS;
+    }
+    disk->head = lba + count;
+    disk->time_us += cost;
+    disk->requests++;
+    disk->bytes += count * SECTOR;
+    return cost;
+}
+
+static ssize_t sim_read(void *data, void *addr, u64 lba, size_t count) {
+    (void)addr;
+    disk_cost(data, lba, count);
+    return count;
+}
+
+static ssize_t sim_write(void *data, const void *addr, u64 lba, size_t count) {
+    (void)addr;
+    disk_cost(data, lba, count);
+    return count;
+}
+
+static unsigned char scratch[REQ_SECTORS * SECTOR];
+
+typedef void (*workload_t)(blkq_t q, bool plug);
+
+// 16 concurrent readers stream through their own region; every round each
+// of them issues the next 8 requests of its read-ahead window, interleaved
+// with the others the way concurrent threads would
+static void sequential_streams(blkq_t q, bool plug) {
+    const int streams = 16, window = 8, rounds = 32;
+    for (int r = 0; r < rounds; r++) {
+        if (plug) blkq_plug(q);
+        for (int i = 0; i < window; i++) {
+            for (int s = 0; s < streams; s++) {
+                u64 lba = (u64)s * (DISK_SECTORS / streams) + (u64)(r * window + i) * REQ_SECTORS;
+                blkq_submit(q, false, scratch, lba, REQ_SECTORS, NULL, NULL);
+            }
+        }
+        if (plug) blkq_unplug(q);
+    }
+}
+
+// write-back of 256 dirty 4 KiB blocks scattered over the disk, as a cache
+// flush would produce them (in hash order, not sorted)
+static void scattered_flush(blkq_t q, bool plug) {
+    unsigned seed = 1;
+    for (int r = 0; r < 16; r++) {
+        if (plug) blkq_plug(q);
+        for (int i = 0; i < 256; i++) {
+            seed = seed * 1103515245 + 12345;
+            u64 lba = (u64)(seed >> 8) % (DISK_SECTORS / REQ_SECTORS) * REQ_SECTORS;
+            blkq_submit(q, true, scratch, lba, REQ_SECTORS, NULL, NULL);
+        }
+        if (plug) blkq_unplug(q);
+    }
+}
+
+// mixed: a sequential writer competing with small random reads
+static void mixed(blkq_t q, bool plug) {
+    unsigned seed = 7;
+    for (int r = 0; r < 128; r++) {
+        if (plug) blkq_plug(q);
+        for (int i = 0; i < 16; i++)
+            blkq_submit(q, true, scratch, (u64)(r * 16 + i) * REQ_SECTORS, REQ_SECTORS, NULL, NULL);
+        for (int i = 0; i < 4; i++) {
+            seed = seed * 1103515245 + 12345;
+            u64 lba = (u64)(seed >> 8) % (DISK_SECTORS / REQ_SECTORS) * REQ_SECTORS;
+            blkq_submit(q, false, scratch, lba, REQ_SECTORS, NULL, NULL);
+        }
+        if (plug) blkq_unplug(q);
+    }
+}
+
+static void run(const char *name, workload_t workload, bool plug) {
+    simdisk_t disk = {0};
+    blkdev_t dev = blkdev_regist("sim", SECTOR, DISK_SECTORS, sim_read, sim_write, &disk);
+    blkq_t q = blkq_alloc(dev, 32, 128, plug ? 256 : REQ_SECTORS);
+    workload(q, plug);
+
+    struct blkq_stat st;
+    blkq_stat(q, &st);
+    blkq_free(q);
+    blkdev_unregist(dev);
+
+    double seconds = disk.time_us / 1e6;
+    printf("%-20s %-8s %8llu %8llu %8llu %10.1f %10.1f\n", name, plug ? "elevator" : "fifo",
+           (unsigned long long)st.submitted, (unsigned long long)st.merged,
+           (unsigned long long)disk.requests, disk.time_us / 1000, disk.bytes / seconds / 1e6);
+}
+
+int main() {
+    printf("%-20s %-8s %8s %8s %8s %10s %10s\n", "workload", "queue", "submit", "merged",
+           "disk req", "disk ms", "MB/s");
+    const struct {
+        const char *name;
+        workload_t fn;
+    } workloads[] = {
+        {"sequential-streams", sequential_streams},
+        {"scattered-flush",    scattered_flush   },
+        {"mixed",              mixed             },
+    };
+    for (size_t i = 0; i < sizeof(workloads) / sizeof(*workloads); i++) {
+        run(workloads[i].name, workloads[i].fn, false);
+        run(workloads[i].name, workloads[i].fn, true);
+    }
+    return 0;
+}
@@ -0,0 +1,349 @@
+/*
+ * io benchmark - a fio-style data path workload generator for any driver
+ * that vfs_mount can mount on /
+ *
+ * usage: bench-io [-m <src>] [-rw <mode>] [-mix <read%>] [-bs <size>]
+ *                 [-iodepth <n>] [-threads <n>] [-files <n>] [-size <size>]
+ *                 [-time <ms>] [-o <json>]
+ *
+ * -m        what to mount on /: "tmpfs" (default), a host directory, ...
+ * -rw       read, write, rw, randread, randwrite or randrw
+ * -mix      percentage of reads in rw and randrw jobs (default 50)
+ * -bs       block size of every request, with an optional k/m/g suffix
+ * -iodepth  requests in flight per thread
+ * -threads  threads, each with its own set of files (fio's numjobs)
+ * -files    files per thread, requests go round-robin (sequential) or to a
+ *           random file (random)
+ * -size     size of every file, laid out before the job starts
+ * -time     run time of the job
+ * -o        write the JSON report to a file instead of stdout
+ *
+ * The VFS calls are synchronous, so a queue depth of n is n threads issuing
+ * requests to the same files and, for sequential jobs, sharing one cursor.
+ * Without any job option it runs a default set of jobs on the given mount.
+ * The report has MB/s, IOPS and latency percentiles for reads and writes.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <vfs.h>
+#include <fs/hostfs.h>
+#include <fs/overlayfs.h>
+#include <fs/packfs.h>
+#include <fs/procfs.h>
+#include <fs/tmpfs.h>
+
+#define KIB (1024ull)
+#define MIB (1024 * 1024ull)
+
+// latency histogram: exact below 32 ns, then 32 buckets per power of two
+#define HIST_SUB     32
+#define HIST_SHIFT   5
+#define HIST_BUCKETS (HIST_SUB * 60)
+
+enum {
+    rw_read = 1,
+    rw_write = 2,
+    rw_rand = 4,
+};
+
+typedef struct job {
+    const char *name;
+    int rw;
+    int mix;
+    u64 bs;
+    int iodepth;
+    int threads;
+    int files;
+    u64 size;
+    int time_ms;
+} job_t;
+
+typedef struct dir_stats {
+    u64 ios, bytes, errors;
+    u64 lat_sum, lat_max;
+    u64 hist[HIST_BUCKETS];
+} dir_stats_t;
+
+// the files of one thread, shared by its iodepth workers
+typedef struct group {
+    vfs_node_t *files;
+    u64 cursor; // next sequential offset over all files
+} group_t;
+
+typedef struct worker {
+    const job_t *job;
+    group_t *group;
+    u64 seed;
+    dir_stats_t stats[2]; // reads, writes
+} worker_t;
+
+static bool stop;
+static pthread_barrier_t start;
+
+static u64 now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static u64 next_rand(u64 *seed) {
+    *seed ^= *seed << 13;
+    *seed ^= *seed >> 7;
+    *seed ^= *seed << 17;
+    return *seed;
+}
+
+static int hist_index(u64 ns) {
+    if (ns < HIST_SUB) return ns;
+    int shift = 63 - __builtin_clzll(ns) - HIST_SHIFT;
+    return (shift + 1) * HIST_SUB + (int)(ns >> shift) - HIST_SUB;
+}
+
+// middle of the bucket
+static u64 hist_value(int index) {
+    if (index < HIST_SUB) return index;
+    int shift = index / HIST_SUB - 1;
+    return ((u64)(index % HIST_SUB + HIST_SUB) << shift) + (1ull << shift >> 1);
+}
+
+static u64 hist_percentile(const dir_stats_t *st, double p) {
+    u64 want = (u64)(st->ios * p / 100.0 + 0.5), seen = 0;
+    if (want == 0) want = 1;
+    for (int i = 0; i < HIST_BUCKETS; i++)
+        if ((seen += st->hist[i]) >= want) return hist_value(i);
+    return st->lat_max;
+}
+
+static void *worker_main(void *arg) {
+    worker_t *w = arg;
+    const job_t *job = w->job;
+    u64 blocks = job->size / job->bs, total = blocks * job->files;
+    char *buf = malloc(job->bs);
+    memset(buf, 'w', job->bs);
+    pthread_barrier_wait(&start);
+    while (!atom_load(&stop)) {
+        bool read = job->rw & rw_read;
+        if ((job->rw & rw_read) && (job->rw & rw_write)) read = (int)(next_rand(&w->seed) % 100) < job->mix;
+        u64 block = job->rw & rw_rand ? next_rand(&w->seed) % total : atom_add(&w->group->cursor, 1) % total;
+        // sequential jobs go through one file after another
+        vfs_node_t file = w->group->files[block / blocks];
+        u64 offset = block % blocks * job->bs;
+        u64 t0 = now_ns();
+        ssize_t ret = read ? vfs_read(file, buf, offset, job->bs) : vfs_write(file, buf, offset, job->bs);
+        u64 lat = now_ns() - t0;
+        dir_stats_t *st = &w->stats[read ? 0 : 1];
+        if (ret != (ssize_t)job->bs) {
+            st->errors++;
+            continue;
+        }
+        st->ios++;
+        st->bytes += ret;
+        st->lat_sum += lat;
+        if (lat > st->lat_max) st->lat_max = lat;
+        st->hist[hist_index(lat)]++;
+    }
+    free(buf);
+    return NULL;
+}
+
+static void merge(dir_stats_t *into, const dir_stats_t *st) {
+    into->ios += st->ios;
+    into->bytes += st->bytes;
+    into->errors += st->errors;
+    into->lat_sum += st->lat_sum;
+    if (st->lat_max > into->lat_max) into->lat_max = st->lat_max;
+    for (int i = 0; i < HIST_BUCKETS; i++) into->hist[i] += st->hist[i];
+}
+
+static void print_dir(FILE *fp, const char *name, const dir_stats_t *st, double secs) {
+    fprintf(fp, "      \"%s\": {\n", name);
+    fprintf(fp, "        \"io_bytes\": %llu, \"ios\": %llu, \"errors\": %llu,\n", (unsigned long long)st->bytes,
+            (unsigned long long)st->ios, (unsigned long long)st->errors);
+    fprintf(fp, "        \"bw_mbs\": %.2f, \"iops\": %.1f,\n", st->bytes / secs / 1e6, st->ios / secs);
+    fprintf(fp, "        \"lat_ns\": {\"mean\": %.1f, \"max\": %llu, \"percentile\": {", st->ios ? (double)st->lat_sum / st->ios : 0.0,
+            (unsigned long long)st->lat_max);
+    const double ps[] = {50, 90, 99, 99.9};
+    for (size_t i = 0; i < sizeof(ps) / sizeof(*ps); i++)
+        fprintf(fp, "%s\"%.1f\": %llu", i ? ", " : "", ps[i], (unsigned long long)(st->ios ? hist_percentile(st, ps[i]) : 0));
+    fprintf(fp, "}}\n      }");
+}
+
+static const char *rw_name(int rw) {
+    static const char *names[] = {"", "read", "write", "rw", "", "randread", "randwrite", "randrw"};
+    return names[rw & 7];
+}
+
+// lays out the files, runs the job and prints its JSON object, printed
+// counts the objects already in the list
+static int run(const job_t *job, FILE *fp, int *printed) {
+    if (job->bs == 0 || job->size < job->bs || job->threads < 1 || job->iodepth < 1 || job->files < 1) {
+        fprintf(stderr, "%s: invalid job\n", job->name);
+        return -1;
+    }
+    vfs_mkdir("/bench-io");
+    int ngroups = job->threads, nworkers = job->threads * job->iodepth;
+    group_t *groups = calloc(ngroups, sizeof(group_t));
+    worker_t *workers = calloc(nworkers, sizeof(worker_t));
+    pthread_t *threads = calloc(nworkers, sizeof(pthread_t));
+    char path[64], *block = malloc(job->bs);
+    memset(block, 'l', job->bs);
+    for (int g = 0; g < ngroups; g++) {
+        groups[g].files = calloc(job->files, sizeof(vfs_node_t));
+        for (int f = 0; f < job->files; f++) {
+            sprintf(path, "/bench-io/%d.%d", g, f);
+            vfs_mkfile(path);
+            vfs_node_t file = groups[g].files[f] = vfs_open(path);
+            for (u64 off = 0; file && off + job->bs <= job->size; off += job->bs) vfs_write(file, block, off, job->bs);
+            if (file == NULL) {
+                fprintf(stderr, "%s: cannot create %s\n", job->name, path);
+                return -1;
+            }
+        }
+    }
+    free(block);
+
+    atom_store(&stop, false);
+    pthread_barrier_init(&start, NULL, nworkers + 1);
+    for (int i = 0; i < nworkers; i++) {
+        workers[i] = (worker_t){.job = job, .group = &groups[i / job->iodepth], .seed = 0x9e3779b97f4a7c15ull * (i + 1)};
+        pthread_create(&threads[i], NULL, worker_main, &workers[i]);
+    }
+    pthread_barrier_wait(&start);
+    u64 t0 = now_ns();
+    nanosleep(&(struct timespec){job->time_ms / 1000, job->time_ms % 1000 * 1000000}, NULL);
+    atom_store(&stop, true);
+    for (int i = 0; i < nworkers; i++) pthread_join(threads[i], NULL);
+    double secs = (now_ns() - t0) / 1e9;
+    pthread_barrier_destroy(&start);
+
+    static dir_stats_t total[2];
+    memset(total, 0, sizeof(total));
+    for (int i = 0; i < nworkers; i++) {
+        merge(&total[0], &workers[i].stats[0]);
+        merge(&total[1], &workers[i].stats[1]);
+    }
+    int mix = !(job->rw & rw_write) ? 100 : !(job->rw & rw_read) ? 0 : job->mix;
+    fprintf(fp, "%s    {\n", (*printed)++ ? ",\n" : "");
+    fprintf(fp, "      \"name\": \"%s\", \"rw\": \"%s\", \"rwmixread\": %d, \"bs\": %llu, \"iodepth\": %d,\n", job->name,
+            rw_name(job->rw), mix, (unsigned long long)job->bs, job->iodepth);
+    fprintf(fp, "      \"threads\": %d, \"files\": %d, \"size\": %llu, \"runtime_ms\": %.1f,\n", job->threads, job->files,
+            (unsigned long long)job->size, secs * 1e3);
+    print_dir(fp, "read", &total[0], secs);
+    fprintf(fp, ",\n");
+    print_dir(fp, "write", &total[1], secs);
+    fprintf(fp, "\n    }");
+
+    for (int g = 0; g < ngroups; g++) {
+        for (int f = 0; f < job->files; f++) {
+            vfs_close(groups[g].files[f]);
+            sprintf(path, "/bench-io/%d.%d", g, f);
+            vfs_unlink(path);
+        }
+        free(groups[g].files);
+    }
+    vfs_rmdir("/bench-io");
+    free(groups);
+    free(workers);
+    free(threads);
+    return total[0].errors + total[1].errors ? 1 : 0;
+}
+
+static u64 parse_size(const char *s) {
+    char *end;
+    u64 n = strtoull(s, &end, 10);
+    switch (*end) {
+    case 'k': case 'K': return n * KIB;
+    case 'm': case 'M': return n * MIB;
+    case 'g': case 'G': return n * 1024 * MIB;
+    default: return n;
+    }
+}
+
+static int parse_rw(const char *s) {
+    for (int rw = 1; rw < 8; rw++)
+        if (rw != 4 && strcmp(s, rw_name(rw)) == 0) return rw;
+    return 0;
+}
+
+static const job_t defaults[] = {
+    {"seqread-128k",      rw_read,            50, 128 * KIB, 1, 1, 4, 8 * MIB, 500},
+    {"seqwrite-128k",     rw_write,           50, 128 * KIB, 1, 1, 4, 8 * MIB, 500},
+    {"randread-4k",       rw_read | rw_rand,  50, 4 * KIB,   1, 1, 4, 8 * MIB, 500},
+    {"randwrite-4k",      rw_write | rw_rand, 50, 4 * KIB,   1, 1, 4, 8 * MIB, 500},
+    {"randrw-70-4k",      rw_read | rw_write | rw_rand, 70, 4 * KIB, 1, 1, 4, 8 * MIB, 500},
+    {"randread-4k-qd4",   rw_read | rw_rand,  50, 4 * KIB,   4, 1, 4, 8 * MIB, 500},
+    {"randread-4k-4jobs", rw_read | rw_rand,  50, 4 * KIB,   1, 4, 4, 8 * MIB, 500},
+};
+
+static void usage(const char *argv0) {
+    fprintf(stderr,
+            "usage: %s [-m <src>] [-rw <mode>] [-mix <read%%>] [-bs <size>] [-iodepth <n>]\n"
+            "       [-threads <n>] [-files <n>] [-size <size>] [-time <ms>] [-o <json>]\n",
+            argv0);
+}
+
+int main(int argc, char **argv) {
+    const char *src = "tmpfs", *out = NULL;
+    job_t custom = {"custom", rw_read | rw_rand, 50, 4 * KIB, 1, 1, 4, 8 * MIB, 1000};
+    bool has_job = false;
+    for (int i = 1; i < argc; i++) {
+        const char *opt = argv[i], *value = i + 1 < argc ? argv[i + 1] : NULL;
+        if (value == NULL) {
+            usage(argv[0]);
+            return 1;
+        }
+        i++;
+        if (strcmp(opt, "-m") == 0) {
+            src = value;
+            continue;
+        } else if (strcmp(opt, "-o") == 0) {
+            out = value;
+            continue;
+        }
+        has_job = true;
+        if (strcmp(opt, "-rw") == 0 && parse_rw(value)) custom.rw = parse_rw(value);
+        else if (strcmp(opt, "-mix") == 0) custom.mix = atoi(value);
+        else if (strcmp(opt, "-bs") == 0) custom.bs = parse_size(value);
+        else if (strcmp(opt, "-iodepth") == 0) custom.iodepth = atoi(value);
+        else if (strcmp(opt, "-threads") == 0) custom.threads = atoi(value);
+        else if (strcmp(opt, "-files") == 0) custom.files = atoi(value);
+        else if (strcmp(opt, "-size") == 0) custom.size = parse_size(value);
+        else if (strcmp(opt, "-time") == 0) custom.time_ms = atoi(value);
+        else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    vfs_init();
+    // hostfs accepts any directory, the others only their own sources
+    tmpfs_regist();
+    overlayfs_regist();
+    procfs_regist();
+    packfs_regist();
+    hostfs_regist();
+    if (vfs_mount(src, rootdir) != 0) {
+        fprintf(stderr, "cannot mount %s\n", src);
+        return 1;
+    }
+    FILE *fp = out ? fopen(out, "w") : stdout;
+    if (fp == NULL) {
+        fprintf(stderr, "cannot write %s\n", out);
+        return 1;
+    }
+
+    fprintf(fp, "{\n  \"src\": \"%s\",\n  \"jobs\": [\n", src);
+    int failed = 0, printed = 0;
+    if (has_job) {
+        failed |= run(&custom, fp, &printed) != 0;
+    } else {
+        for (size_t i = 0; i < sizeof(defaults) / sizeof(*defaults); i++) failed |= run(&defaults[i], fp, &printed) != 0;
+    }
+    fprintf(fp, "\n  ]\n}\n");
+    if (out) fclose(fp);
+    return failed;
+}
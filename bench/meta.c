@@ -0,0 +1,303 @@
+/*
+ * meta benchmark - mdtest-style metadata rates: mkdir, create (vfs_mkfile),
+ * stat (vfs_open + vfs_update), open (vfs_open + vfs_close), readdir,
+ * rename and unlink, in kops/s, across directory shapes, thread counts and
+ * name lengths.
+ *
+ * usage: bench-meta [-m <src>] [-n <files>] [-d <depth>] [-f <fanout>]
+ *                   [-t <threads>] [-l <namelen>]
+ *
+ * -m  what to mount on /: "tmpfs" (default), a host directory, ...
+ * -n  files per thread, spread evenly over the leaf directories
+ * -d  depth of the directory tree of every thread, 0 for one flat directory
+ * -f  subdirectories per directory
+ * -t  threads, each in its own tree (the VFS does not allow changing one
+ *     directory from several threads)
+ * -l  length of the file names
+ *
+ * Without options it prints the default scaling curves: a growing flat
+ * directory, which shows the cost of the linear vfs_child_find, deep trees,
+ * threads and long names. readdir counts entries, not directories.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <vfs.h>
+#include <fs/hostfs.h>
+#include <fs/overlayfs.h>
+#include <fs/packfs.h>
+#include <fs/procfs.h>
+#include <fs/tmpfs.h>
+
+#define NAME_MAX_LEN 200
+#define PATH_LEN     4096
+
+enum {
+    ph_mkdir,
+    ph_create,
+    ph_stat,
+    ph_open,
+    ph_readdir,
+    ph_rename,
+    ph_unlink,
+    ph_rmdir,
+    ph_count,
+};
+
+static const char *phase_names[ph_count] = {"mkdir", "create", "stat", "open", "readdir", "rename", "unlink", "rmdir"};
+
+typedef struct config {
+    int files;
+    int depth;
+    int fanout;
+    int threads;
+    int namelen;
+} config_t;
+
+typedef struct worker {
+    const config_t *cfg;
+    int id;
+    u64 ops[ph_count];
+    double start[ph_count], end[ph_count];
+    u64 errors;
+} worker_t;
+
+static pthread_barrier_t phase;
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int leaves(const config_t *cfg) {
+    int n = 1;
+    for (int i = 0; i < cfg->depth; i++) n *= cfg->fanout;
+    return n;
+}
+
+// the path of directory dir (0 .. fanout^level - 1) at level of the tree of
+// a thread, returns its length
+static int dir_path(char *buf, const config_t *cfg, int id, int level, int dir) {
+    int len = sprintf(buf, "/md/t%d", id);
+    int div = 1;
+    for (int i = 1; i < level; i++) div *= cfg->fanout;
+    for (int i = 0; i < level; i++, div /= cfg->fanout) len += sprintf(buf + len, "/d%d", dir / div % cfg->fanout);
+    return len;
+}
+
+// file i lives in leaf i % leaves, its name is padded to namelen
+static void file_path(char *buf, const config_t *cfg, int id, int i, char prefix) {
+    int len = dir_path(buf, cfg, id, cfg->depth, i % leaves(cfg));
+    len += sprintf(buf + len, "/%c", prefix);
+    int digits = snprintf(NULL, 0, "%d", i);
+    for (int pad = cfg->namelen - 1 - digits; pad > 0; pad--) buf[len++] = 'x';
+    sprintf(buf + len, "%d", i);
+}
+
+#define CHECK(w, expr) ((expr) ? (void)0 : (void)(w)->errors++)
+
+// creates (or removes) every directory of the tree, top-down or bottom-up
+static u64 walk_dirs(worker_t *w, bool remove) {
+    const config_t *cfg = w->cfg;
+    char path[PATH_LEN];
+    u64 n = 0;
+    for (int k = 1; k <= cfg->depth; k++) {
+        int level = remove ? cfg->depth + 1 - k : k, count = 1;
+        for (int i = 0; i < level; i++) count *= cfg->fanout;
+        for (int d = 0; d < count; d++, n++) {
+            dir_path(path, cfg, w->id, level, d);
+            CHECK(w, (remove ? vfs_rmdir(path) : vfs_mkdir(path)) == 0);
+        }
+    }
+    return n;
+}
+
+static u64 readdir_all(worker_t *w) {
+    const config_t *cfg = w->cfg;
+    char path[PATH_LEN];
+    u64 entries = 0;
+    for (int d = 0; d < leaves(cfg); d++) {
+        dir_path(path, cfg, w->id, cfg->depth, d);
+        vfs_node_t dir = vfs_open(path);
+        CHECK(w, dir != NULL);
+        if (dir == NULL) continue;
+        vfs_update(dir);
+        list_foreach(dir->info->child, it) entries += it->data != NULL;
+    }
+    return entries;
+}
+
+static void *worker_main(void *arg) {
+    worker_t *w = arg;
+    const config_t *cfg = w->cfg;
+    char path[PATH_LEN], other[PATH_LEN];
+    for (int ph = 0; ph < ph_count; ph++) {
+        pthread_barrier_wait(&phase);
+        w->start[ph] = now();
+        u64 n = 0;
+        switch (ph) {
+        case ph_mkdir: n = walk_dirs(w, false); break;
+        case ph_rmdir: n = walk_dirs(w, true); break;
+        case ph_readdir: n = readdir_all(w); break;
+        default:
+            for (int i = 0; i < cfg->files; i++, n++) {
+                file_path(path, cfg, w->id, i, ph == ph_unlink ? 'r' : 'f');
+                if (ph == ph_create) {
+                    CHECK(w, vfs_mkfile(path) == 0);
+                } else if (ph == ph_stat) {
+                    vfs_node_t node = vfs_open(path);
+                    CHECK(w, node != NULL);
+                    if (node) vfs_update(node);
+                } else if (ph == ph_open) {
+                    vfs_node_t node = vfs_open(path);
+                    CHECK(w, node != NULL && vfs_close(node) == 0);
+                } else if (ph == ph_rename) {
+                    file_path(other, cfg, w->id, i, 'r');
+                    CHECK(w, vfs_rename(path, other) == 0);
+                } else {
+                    CHECK(w, vfs_unlink(path) == 0);
+                }
+            }
+        }
+        w->end[ph] = now();
+        w->ops[ph] = n;
+        pthread_barrier_wait(&phase);
+    }
+    return NULL;
+}
+
+static void header() {
+    printf("%-6s %7s %9s %7s %7s", "shape", "threads", "files", "dirs", "namelen");
+    for (int ph = 0; ph < ph_count; ph++) printf(" %8s", phase_names[ph]);
+    printf("   (kops/s)\n");
+}
+
+// runs every phase on the trees of all threads and prints one row
+static int run(const config_t *cfg) {
+    if (cfg->files < 1 || cfg->threads < 1 || cfg->depth < 0 || (cfg->depth > 0 && cfg->fanout < 1) ||
+        cfg->namelen < 1 || cfg->namelen > NAME_MAX_LEN) {
+        fprintf(stderr, "invalid configuration\n");
+        return -1;
+    }
+    char path[PATH_LEN];
+    vfs_mkdir("/md");
+    for (int i = 0; i < cfg->threads; i++) {
+        sprintf(path, "/md/t%d", i);
+        vfs_mkdir(path);
+    }
+    worker_t *workers = calloc(cfg->threads, sizeof(worker_t));
+    pthread_t *threads = calloc(cfg->threads, sizeof(pthread_t));
+    pthread_barrier_init(&phase, NULL, cfg->threads + 1);
+    for (int i = 0; i < cfg->threads; i++) {
+        workers[i] = (worker_t){.cfg = cfg, .id = i};
+        pthread_create(&threads[i], NULL, worker_main, &workers[i]);
+    }
+    for (int ph = 0; ph < ph_count; ph++) {
+        pthread_barrier_wait(&phase);
+        pthread_barrier_wait(&phase);
+    }
+    for (int i = 0; i < cfg->threads; i++) pthread_join(threads[i], NULL);
+    pthread_barrier_destroy(&phase);
+
+    // a phase lasts from the first thread starting it to the last one done
+    u64 ops[ph_count] = {0}, errors = 0;
+    double secs[ph_count];
+    for (int ph = 0; ph < ph_count; ph++) {
+        double start = workers[0].start[ph], end = workers[0].end[ph];
+        for (int i = 0; i < cfg->threads; i++) {
+            ops[ph] += workers[i].ops[ph];
+            if (workers[i].start[ph] < start) start = workers[i].start[ph];
+            if (workers[i].end[ph] > end) end = workers[i].end[ph];
+        }
+        secs[ph] = end - start;
+    }
+    for (int i = 0; i < cfg->threads; i++) errors += workers[i].errors;
+    char shape[16];
+    if (cfg->depth == 0) sprintf(shape, "flat");
+    else sprintf(shape, "%dx%d", cfg->fanout, cfg->depth);
+    printf("%-6s %7d %9d %7llu %7d", shape, cfg->threads, cfg->files * cfg->threads, (unsigned long long)ops[ph_mkdir],
+           cfg->namelen);
+    for (int ph = 0; ph < ph_count; ph++) {
+        if (ops[ph] == 0) printf(" %8s", "-");
+        else printf(" %8.1f", ops[ph] / secs[ph] / 1e3);
+    }
+    printf(errors ? "   %llu errors\n" : "\n", (unsigned long long)errors);
+
+    for (int i = 0; i < cfg->threads; i++) {
+        sprintf(path, "/md/t%d", i);
+        vfs_rmdir(path);
+    }
+    vfs_rmdir("/md");
+    free(workers);
+    free(threads);
+    return errors ? 1 : 0;
+}
+
+static const config_t defaults[] = {
+    // a growing flat directory
+    {500, 0, 0, 1, 8},
+    {1000, 0, 0, 1, 8},
+    {2000, 0, 0, 1, 8},
+    {4000, 0, 0, 1, 8},
+    // more files in trees
+    {16000, 2, 16, 1, 8},
+    {16000, 3, 8, 1, 8},
+    {16000, 5, 4, 1, 8},
+    // threads, each with its own tree
+    {4000, 2, 8, 1, 8},
+    {4000, 2, 8, 2, 8},
+    {4000, 2, 8, 4, 8},
+    {4000, 2, 8, 8, 8},
+    // name length
+    {2000, 0, 0, 1, 32},
+    {2000, 0, 0, 1, 128},
+    {2000, 0, 0, 1, 200},
+};
+
+int main(int argc, char **argv) {
+    const char *src = "tmpfs";
+    config_t custom = {10000, 0, 8, 1, 8};
+    bool has_config = false;
+    for (int i = 1; i < argc; i++) {
+        if (i + 1 >= argc || argv[i][0] != '-' || strlen(argv[i]) != 2 || !strchr("mndftl", argv[i][1])) {
+            fprintf(stderr, "usage: %s [-m <src>] [-n <files>] [-d <depth>] [-f <fanout>] [-t <threads>] [-l <namelen>]\n",
+                    argv[0]);
+            return 1;
+        }
+        const char *arg = argv[++i];
+        has_config |= argv[i - 1][1] != 'm';
+        switch (argv[i - 1][1]) {
+        case 'm': src = arg; break;
+        case 'n': custom.files = atoi(arg); break;
+        case 'd': custom.depth = atoi(arg); break;
+        case 'f': custom.fanout = atoi(arg); break;
+        case 't': custom.threads = atoi(arg); break;
+        case 'l': custom.namelen = atoi(arg); break;
+        }
+    }
+
+    vfs_init();
+    // hostfs accepts any directory, the others only their own sources
+    tmpfs_regist();
+    overlayfs_regist();
+    procfs_regist();
+    packfs_regist();
+    hostfs_regist();
+    if (vfs_mount(src, rootdir) != 0) {
+        fprintf(stderr, "cannot mount %s\n", src);
+        return 1;
+    }
+
+    header();
+    int failed = 0;
+    if (has_config) {
+        failed |= run(&custom) != 0;
+    } else {
+        for (size_t i = 0; i < sizeof(defaults) / sizeof(*defaults); i++) failed |= run(&defaults[i]) != 0;
+    }
+    return failed;
+}
@@ -0,0 +1,363 @@
+/*
+ * perfcheck - a fixed set of micro and macro benchmarks of the VFS core on
+ * tmpfs, compared against a committed baseline so that changes to src/vfs.c
+ * and the data-structure headers cannot slow it down unnoticed.
+ *
+ * usage: perfcheck [-u] [-t <percent>] [-n <files>] <baseline.json>
+ *
+ * -u  write the results as the new baseline instead of comparing
+ * -t  allowed slowdown in percent (default 15)
+ * -n  files of the tree build (default 1000000)
+ *
+ * The process is pinned to one CPU. Every benchmark runs several rounds, each
+ * in a fresh child process; a micro benchmark warms up and keeps the best of
+ * a few batches within its round, which drops interrupts and migrations.
+ * The result is the median ns per operation over the rounds and its noise is
+ * the median absolute deviation of the rounds relative to that median. A
+ * benchmark is suspect when it is slower than the baseline by more than the
+ * tolerance plus three times the largest noise of the two runs (its own and
+ * the calibration's), but the noise term is capped at 10%, so a noisy run
+ * cannot hide a large slowdown. A suspect is measured once more before it
+ * counts as a regression. Both runs also time a fixed calibration loop that
+ * does not touch the VFS, and the baseline is scaled by the ratio of the
+ * two, so a baseline taken on another machine is still roughly comparable.
+ * The tree build is only compared against a baseline with the same -n.
+ * Exits with 1 on a regression.
+ */
+
+#define _GNU_SOURCE // sched_setaffinity
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <vfs.h>
+#include <fs/tmpfs.h>
+
+#define MAX_ROUNDS 15
+#define BATCHES    3    // batches of a micro benchmark round, the best counts
+#define NOISE_K    3    // the limit allows NOISE_K times the noise
+#define NOISE_CAP  0.10 // but at most this much
+#define PATH_LEN   256
+#define DEPTH      8
+#define SIBLINGS   32
+#define FANOUT     100
+
+typedef struct result {
+    double ns;    // median ns per operation
+    double noise; // median absolute deviation / median
+} result_t;
+
+typedef struct bench {
+    const char *name;
+    const char *what;
+    int rounds;
+    bool macro;        // measured once from a fresh heap, without warming up
+    double (*round)(); // returns ns per operation
+} bench_t;
+
+static int tree_files = 1000000;
+static char buf[4096];
+static vfs_node_t file, deep;
+static volatile u64 sink;
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// ---------------------------------------------------------------------------
+// benchmarks
+
+// hashing and small allocations only, the yardstick for the machine speed
+static double calibration() {
+    enum { n = 1000000 };
+    double start = now();
+    u64 h = 14695981039346656037ull;
+    for (int i = 0; i < n; i++) {
+        char *p = malloc(32 + (i & 63));
+        for (int j = 0; j < 32; j++) h = (h ^ (p[j] = (char)(i + j))) * 1099511628211ull;
+        free(p);
+    }
+    sink = h;
+    return (now() - start) / n;
+}
+
+// a path of DEPTH directories, each among SIBLINGS entries
+static void deep_setup() {
+    char path[PATH_LEN] = "/deep";
+    vfs_mkdir(path);
+    for (int d = 0; d < DEPTH; d++) {
+        size_t len = strlen(path);
+        for (int s = 0; s < SIBLINGS; s++) {
+            sprintf(path + len, "/d%d", s);
+            vfs_mkdir(path);
+        }
+        sprintf(path + len, "/d%d", d * 7 % SIBLINGS);
+    }
+    strcat(path, "/file");
+    vfs_mkfile(path);
+    deep = vfs_open(path);
+}
+
+static double lookup() {
+    enum { n = 200000 };
+    char *path = vfs_get_fullpath(deep);
+    double start = now();
+    for (int i = 0; i < n; i++) sink += (size_t)vfs_open(path);
+    double ns = (now() - start) / n;
+    free(path);
+    return ns;
+}
+
+static double fullpath() {
+    enum { n = 1000000 };
+    double start = now();
+    for (int i = 0; i < n; i++) {
+        char *path = vfs_get_fullpath(deep);
+        sink += path[1];
+        free(path);
+    }
+    return (now() - start) / n;
+}
+
+// files created in one directory, each one is searched for among the
+// previous ones before it is inserted; the rounds run in child processes
+// (see isolated), so neither this nor tree cleans up
+static double insert() {
+    enum { n = 4000 };
+    char path[PATH_LEN];
+    vfs_mkdir("/insert");
+    double start = now();
+    for (int i = 0; i < n; i++) {
+        sprintf(path, "/insert/f%d", i);
+        vfs_mkfile(path);
+    }
+    return (now() - start) / n;
+}
+
+static double read_4k() {
+    enum { n = 500000 };
+    double start = now();
+    for (int i = 0; i < n; i++) vfs_read(file, buf, (i * 37 & 255) * 4096, 4096);
+    return (now() - start) / n;
+}
+
+// tree_files files in a tree of FANOUT directories of FANOUT directories
+static double tree() {
+    char path[PATH_LEN];
+    vfs_mkdir("/tree");
+    double start = now();
+    for (int i = 0; i < FANOUT; i++) {
+        sprintf(path, "/tree/d%d", i);
+        vfs_mkdir(path);
+        for (int j = 0; j < FANOUT; j++) {
+            sprintf(path, "/tree/d%d/d%d", i, j);
+            vfs_mkdir(path);
+        }
+    }
+    for (int i = 0; i < tree_files; i++) {
+        sprintf(path, "/tree/d%d/d%d/f%d", i % FANOUT, i / FANOUT % FANOUT, i);
+        vfs_mkfile(path);
+    }
+    return (now() - start) / tree_files;
+}
+
+static const bench_t benches[] = {
+    {"calibration", "hash + malloc, no vfs", 15, false, calibration},
+    {"lookup", "vfs_open, 10 levels", 15, false, lookup},
+    {"insert", "vfs_mkfile, 4000 in a dir", 9, true, insert},
+    {"read_4k", "vfs_read 4 KiB, tmpfs", 15, false, read_4k},
+    {"tree", "vfs_mkfile, 100x100 dirs", 5, true, tree},
+    {"fullpath", "vfs_get_fullpath, 10 levels", 15, false, fullpath},
+};
+
+#define NBENCH (sizeof(benches) / sizeof(*benches))
+
+// ---------------------------------------------------------------------------
+// statistics
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static double median(double *v, int n) {
+    qsort(v, n, sizeof(*v), cmp_double);
+    return n % 2 ? v[n / 2] : (v[n / 2 - 1] + v[n / 2]) / 2;
+}
+
+// every round runs in a child process so that it starts from the same heap,
+// a tree freed by an earlier round makes the allocations of the next one
+// slower and scattered
+static double isolated(const bench_t *b) {
+    int fds[2];
+    double ns = -1;
+    if (pipe(fds) != 0) return -1;
+    pid_t pid = fork();
+    if (pid == 0) {
+        ns = b->round();
+        if (!b->macro) { // the first batch warmed up caches and the allocator
+            ns = b->round();
+            for (int i = 1; i < BATCHES; i++) ns = min(ns, b->round());
+        }
+        write(fds[1], &ns, sizeof(ns));
+        _exit(0);
+    }
+    close(fds[1]);
+    if (pid > 0 && read(fds[0], &ns, sizeof(ns)) != sizeof(ns)) ns = -1;
+    if (pid > 0) waitpid(pid, NULL, 0);
+    close(fds[0]);
+    return ns;
+}
+
+static result_t measure(const bench_t *b) {
+    double v[MAX_ROUNDS];
+    for (int r = 0; r < b->rounds; r++) {
+        v[r] = isolated(b);
+        if (v[r] < 0) {
+            fprintf(stderr, "%s: cannot run a round\n", b->name);
+            exit(2);
+        }
+    }
+    double mid = median(v, b->rounds);
+    for (int r = 0; r < b->rounds; r++) v[r] = v[r] > mid ? v[r] - mid : mid - v[r];
+    return (result_t){.ns = mid, .noise = median(v, b->rounds) / mid};
+}
+
+// pins the process, and so every round, to the CPU it is running on
+static void pin() {
+    cpu_set_t set;
+    int cpu = sched_getcpu();
+    CPU_ZERO(&set);
+    CPU_SET(cpu < 0 ? 0 : cpu, &set);
+    if (sched_setaffinity(0, sizeof(set), &set) != 0) fprintf(stderr, "cannot pin to a CPU, results are noisier\n");
+}
+
+// ---------------------------------------------------------------------------
+// baseline
+
+static int save(const char *path, const result_t *res) {
+    FILE *fp = fopen(path, "w");
+    if (fp == NULL) return -1;
+    fprintf(fp, "{\n  \"files\": %d,\n", tree_files);
+    for (size_t i = 0; i < NBENCH; i++) {
+        fprintf(fp, "  \"%s\": {\"ns\": %.2f, \"noise\": %.4f}%s\n", benches[i].name, res[i].ns, res[i].noise,
+                i + 1 < NBENCH ? "," : "");
+    }
+    fprintf(fp, "}\n");
+    return fclose(fp);
+}
+
+// reads the format written by save, a missing benchmark gets ns = 0
+static int load(const char *path, result_t *res, int *files) {
+    FILE *fp = fopen(path, "r");
+    if (fp == NULL) return -1;
+    char text[4096];
+    size_t len = fread(text, 1, sizeof(text) - 1, fp);
+    fclose(fp);
+    text[len] = '\0';
+    const char *p = strstr(text, "\"files\":");
+    if (p == NULL || sscanf(p + 8, "%d", files) != 1) return -1;
+    for (size_t i = 0; i < NBENCH; i++) {
+        char key[64];
+        snprintf(key, sizeof(key), "\"%s\":", benches[i].name);
+        p = strstr(text, key);
+        if (p == NULL || sscanf(p + strlen(key), " {\"ns\": %lf, \"noise\": %lf}", &res[i].ns, &res[i].noise) != 2)
+            res[i] = (result_t){0};
+    }
+    return res[0].ns > 0 ? 0 : -1;
+}
+
+// the slowdown against the baseline scaled to this machine, in percent
+static double change(const result_t *res, const result_t *base, double scale) {
+    return (res->ns / (base->ns * scale) - 1) * 100;
+}
+
+int main(int argc, char **argv) {
+    bool update = false;
+    double tolerance = 15;
+    const char *baseline = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-u") == 0) {
+            update = true;
+        } else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+            tolerance = atof(argv[++i]);
+        } else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            tree_files = atoi(argv[++i]);
+        } else if (argv[i][0] != '-' && baseline == NULL) {
+            baseline = argv[i];
+        } else {
+            baseline = NULL;
+            break;
+        }
+    }
+    if (baseline == NULL || tree_files < 1) {
+        fprintf(stderr, "usage: %s [-u] [-t <percent>] [-n <files>] <baseline.json>\n", argv[0]);
+        return 2;
+    }
+    result_t base[NBENCH] = {0};
+    int base_files = 0;
+    if (!update && load(baseline, base, &base_files) != 0) {
+        fprintf(stderr, "cannot read %s, create it with -u\n", baseline);
+        return 2;
+    }
+
+    pin();
+    vfs_init();
+    tmpfs_regist();
+    vfs_mount("tmpfs", rootdir);
+    vfs_mkfile("/file");
+    file = vfs_open("/file");
+    memset(buf, 'x', sizeof(buf));
+    for (int i = 0; i < 256; i++) vfs_write(file, buf, i * 4096, 4096);
+    deep_setup();
+
+    result_t res[NBENCH];
+    double scale = 1; // the baseline as it would be on this machine
+    int regressions = 0;
+    printf("%-12s %-28s %10s %10s %7s %8s %8s\n", "bench", "", "base ns", "ns", "noise", "change", "limit");
+    for (size_t i = 0; i < NBENCH; i++) {
+        const bench_t *b = &benches[i];
+        res[i] = measure(b);
+        printf("%-12s %-28s ", b->name, b->what);
+        if (update || base[i].ns <= 0 || (b->round == tree && base_files != tree_files)) {
+            printf("%10s %10.1f %6.1f%%%s\n", "-", res[i].ns, res[i].noise * 100, update ? "" : "   not in baseline");
+            continue;
+        }
+        if (i == 0) {
+            scale = res[0].ns / base[0].ns;
+            printf("%10.1f %10.1f %6.1f%%   machine speed x%.2f\n", base[0].ns, res[0].ns, res[0].noise * 100,
+                   1 / scale);
+            continue;
+        }
+        double noise = max(max(res[i].noise, base[i].noise), max(res[0].noise, base[0].noise));
+        double limit = tolerance + 100 * min(NOISE_K * noise, NOISE_CAP);
+        if (change(&res[i], &base[i], scale) > limit) {
+            // a suspect gets a second chance, the better of both runs counts
+            result_t again = measure(b);
+            if (again.ns < res[i].ns) res[i] = again;
+        }
+        bool slow = change(&res[i], &base[i], scale) > limit;
+        regressions += slow;
+        printf("%10.1f %10.1f %6.1f%% %+7.1f%% %7.1f%%%s\n", base[i].ns * scale, res[i].ns, res[i].noise * 100,
+               change(&res[i], &base[i], scale), limit, slow ? "   REGRESSION" : "");
+    }
+    if (update) {
+        if (save(baseline, res) != 0) {
+            fprintf(stderr, "cannot write %s\n", baseline);
+            return 2;
+        }
+        printf("baseline written to %s\n", baseline);
+        return 0;
+    }
+    if (regressions) {
+        printf("%d benchmark(s) regressed, run with -u to accept the new numbers\n", regressions);
+        return 1;
+    }
+    printf("no regressions\n");
+    return 0;
+}
@@ -0,0 +1,101 @@
+/*
+ * pipe benchmark - one producer thread writes fixed-size messages into an
+ * anonymous pipe while the main thread drains it: into its own buffer
+ * (read), through that buffer into a tmpfs file (copy), or straight from
+ * the pipe buffer into the file (splice). Small messages measure the
+ * per-call overhead, large ones the copy bandwidth.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <vfs.h>
+#include <fs/tmpfs.h>
+
+#define MIB       (1024 * 1024ull)
+#define PIPE_SIZE (1024 * 1024)
+
+struct run {
+    vfs_node_t pipe;
+    size_t msg_size;
+    u64 total;
+};
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void *producer(void *arg) {
+    struct run *r = arg;
+    char *msg = malloc(r->msg_size);
+    memset(msg, 'm', r->msg_size);
+    for (u64 sent = 0; sent < r->total; sent += r->msg_size) vfs_write(r->pipe, msg, 0, r->msg_size);
+    vfs_pipe_shutdown(r->pipe);
+    free(msg);
+    return NULL;
+}
+
+typedef ssize_t (*drain_t)(vfs_node_t pipe, vfs_node_t file, void *buf, u64 off, size_t size);
+
+static ssize_t drain_read(vfs_node_t pipe, vfs_node_t file, void *buf, u64 off, size_t size) {
+    return vfs_read(pipe, buf, 0, size);
+}
+
+static ssize_t drain_copy(vfs_node_t pipe, vfs_node_t file, void *buf, u64 off, size_t size) {
+    ssize_t n = vfs_read(pipe, buf, 0, size);
+    return n > 0 ? vfs_write(file, buf, off, n) : n;
+}
+
+static ssize_t drain_splice(vfs_node_t pipe, vfs_node_t file, void *buf, u64 off, size_t size) {
+    return vfs_splice(pipe, file, off, size);
+}
+
+static void run(const char *method, drain_t drain, size_t msg_size, u64 total, vfs_node_t file) {
+    struct run r = {vfs_pipe(PIPE_SIZE, 0), msg_size, total};
+    char *buf = malloc(msg_size);
+    pthread_t thread;
+
+    double start = now();
+    pthread_create(&thread, NULL, producer, &r);
+    u64 received = 0;
+    ssize_t n;
+    while ((n = drain(r.pipe, file, buf, received, msg_size)) > 0) received += n;
+    pthread_join(thread, NULL);
+    double seconds = now() - start;
+
+    if (received != total) {
+        printf("%-8s %8zu failed\n", method, msg_size);
+        exit(1);
+    }
+    printf("%-8s %8zu %8llu %10.2f %10.1f %12.0f\n", method, msg_size, (unsigned long long)(total / MIB),
+           seconds * 1000, total / seconds / 1e6, total / msg_size / seconds);
+    vfs_pipe_free(r.pipe);
+    vfs_truncate(file, 0); // release the pages before the next run
+    free(buf);
+}
+
+int main() {
+    vfs_init();
+    tmpfs_regist();
+    vfs_mount("tmpfs", rootdir);
+    vfs_mkfile("/sink");
+    vfs_node_t sink = vfs_open("/sink");
+
+    printf("%-8s %8s %8s %10s %10s %12s\n", "method", "msg", "MiB", "ms", "MB/s", "msgs/s");
+    const struct {
+        const char *name;
+        drain_t fn;
+    } methods[] = {
+        {"read",   drain_read  },
+        {"copy",   drain_copy  },
+        {"splice", drain_splice},
+    };
+    for (size_t i = 0; i < sizeof(methods) / sizeof(*methods); i++) run(methods[i].name, methods[i].fn, 64, 32 * MIB, sink);
+    for (size_t i = 0; i < sizeof(methods) / sizeof(*methods); i++)
+        run(methods[i].name, methods[i].fn, 64 * 1024, 512 * MIB, sink);
+    return 0;
+}
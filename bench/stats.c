@@ -0,0 +1,86 @@
+/*
+ * stats benchmark - the cost of the operation statistics on cheap tmpfs
+ * operations: 4 KiB reads, 64 byte reads and opens of a four level path,
+ * with the counters switched off at run time, with the default sampling
+ * (one in 64 operations timed) and with every operation timed. Build with
+ * USER_CFLAGS=-DVFS_STATS=0 to compare against no statistics code at all.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <vfs.h>
+#include <fs/tmpfs.h>
+
+#define ROUNDS 7
+
+static vfs_node_t file;
+static char buf[4096];
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void read_4k(int i) {
+    vfs_read(file, buf, (i & 255) * 4096, 4096);
+}
+
+static void read_64(int i) {
+    vfs_read(file, buf, (i & 255) * 64, 64);
+}
+
+static void open_path(int i) {
+    vfs_open("/a/b/c/file");
+}
+
+// sets the statistics mode: off, sampled or every operation timed
+static void set_mode(int mode) {
+    vfs_stats_enable(mode != 0);
+    vfs_stats_sample(mode == 2 ? 0 : 6);
+}
+
+// best of several rounds in ns per operation, the modes take turns so that
+// drifting machine speed affects all of them alike
+static void measure(void (*op)(int), int n, double best[3]) {
+    for (int m = 0; m < 3; m++) best[m] = 1e9;
+    for (int r = 0; r < ROUNDS; r++) {
+        for (int m = 0; m < 3; m++) {
+            set_mode(m);
+            double start = now();
+            for (int i = 0; i < n; i++) op(i);
+            best[m] = min(best[m], (now() - start) / n * 1e9);
+        }
+    }
+}
+
+int main() {
+    vfs_init();
+    tmpfs_regist();
+    vfs_mount("tmpfs", rootdir);
+    vfs_mkdir("/a/b/c");
+    vfs_mkfile("/a/b/c/file");
+    file = vfs_open("/a/b/c/file");
+    memset(buf, 'x', sizeof(buf));
+    for (int i = 0; i < 256; i++) vfs_write(file, buf, i * 4096, 4096);
+
+    const struct {
+        const char *name;
+        void (*fn)(int);
+        int n;
+    } ops[] = {
+        {"read 4k",  read_4k,   1000000},
+        {"read 64",  read_64,   2000000},
+        {"open",     open_path, 1000000},
+    };
+    printf("%-8s %10s %10s %10s %8s %8s\n", "op", "off ns", "sample ns", "all ns", "sample%", "all%");
+    for (size_t i = 0; i < sizeof(ops) / sizeof(*ops); i++) {
+        double t[3];
+        measure(ops[i].fn, ops[i].n, t);
+        printf("%-8s %10.1f %10.1f %10.1f %7.1f%% %7.1f%%\n", ops[i].name, t[0], t[1], t[2],
+               (t[1] / t[0] - 1) * 100, (t[2] / t[0] - 1) * 100);
+    }
+    return 0;
+}
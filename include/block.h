@@ -0,0 +1,304 @@
+#pragma once
+#include <vfs.h>
+
+// 块设备与共享的缓冲区缓存
+//
+// 文件系统驱动通过 bread / brelse 访问设备上的块，缓存以 (设备, 块号)
+// 为键哈希存放，未被引用的缓冲区按 LRU 顺序淘汰，脏块在淘汰或 bsync
+// 时写回设备
+
+/**
+ *\brief 从设备读取扇区
+ *
+ *\param data     注册时传入的设备数据
+ *\param addr     读取的数据
+ *\param lba      起始扇区
+ *\param count    扇区数量
+ *\return 读取的扇区数量，失败返回 -1
+ */
+typedef ssize_t (*blkdev_read_t)(void *data, void *addr, u64 lba,
+                                 size_t count);
+
+/**
+ *\brief 向设备写入扇区
+ *
+ *\param data     注册时传入的设备数据
+ *\param addr     写入的数据
+ *\param lba      起始扇区
+ *\param count    扇区数量
+ *\return 写入的扇区数量，失败返回 -1
+ */
+typedef ssize_t (*blkdev_write_t)(void *data, const void *addr, u64 lba,
+                                  size_t count);
+
+typedef struct blkdev {
+  char *name;           // 设备名称
+  u32 id;               // 设备号
+  u32 sector_size;      // 扇区大小
+  u64 sectors;          // 扇区数量
+  u32 block_size;       // 缓存块大小，为扇区大小的整数倍
+  blkdev_read_t read;   // 读取回调
+  blkdev_write_t write; // 写入回调，为 null 时设备只读
+  void *data;           // 设备数据
+  struct blkq *queue;   // 请求队列，为 null 时缓存直接访问设备
+  u64 reads;            // 发往设备的读请求数
+  u64 writes;           // 发往设备的写请求数
+} *blkdev_t;
+
+// bread 返回的缓冲区由调用者独占，直到 brelse
+typedef struct buf *buf_t;
+struct buf {
+  blkdev_t dev;   // 所属设备
+  u64 blockno;    // 块号 (以 dev->block_size 为单位)
+  byte *data;     // 块数据
+  u32 size;       // 数据缓冲区的大小
+  u32 refcnt;     // 引用计数，不为 0 时不会被淘汰
+  bool valid;     // 数据已从设备读取
+  bool dirty;     // 数据需要写回
+  spin_t busy;    // 持有者独占缓冲区
+  buf_t hnext;    // 哈希链
+  buf_t prev;     // LRU 链表，表头为最近使用的块
+  buf_t next;     // LRU 链表
+};
+
+/**
+ *\brief 初始化缓冲区缓存
+ *
+ *\param nbufs    最多缓存的块数量
+ *\return 0 成功，-1 失败
+ */
+int bcache_init(size_t nbufs);
+
+/**
+ *\brief 注册一个块设备
+ *
+ *\param name         设备名称
+ *\param sector_size  扇区大小
+ *\param sectors      扇区数量
+ *\param read         读取回调
+ *\param write        写入回调，可以为 null
+ *\param data         设备数据
+ *\return 设备，失败返回 null
+ */
+blkdev_t blkdev_regist(cstr name, u32 sector_size, u64 sectors,
+                       blkdev_read_t read, blkdev_write_t write, void *data);
+
+/**
+ *\brief 注销块设备，会先写回并丢弃该设备的所有缓存
+ *
+ *\param dev      设备
+ *\return 0 成功，-1 仍有缓冲区被引用或写回失败
+ */
+int blkdev_unregist(blkdev_t dev);
+
+/**
+ *\brief 按名称查找块设备
+ *
+ *\param name     设备名称
+ *\return 设备，不存在返回 null
+ */
+blkdev_t blkdev_get(cstr name);
+
+/**
+ *\brief 设置缓存块大小，只能在设备没有缓存块时调用
+ *
+ *\param dev        设备
+ *\param block_size 块大小，必须为扇区大小的整数倍
+ *\return 0 成功，-1 失败
+ */
+int blkdev_set_block_size(blkdev_t dev, u32 block_size);
+
+/**
+ *\brief 获取设备的一个块，返回的缓冲区需要 brelse
+ *
+ *\param dev      设备
+ *\param blockno  块号
+ *\return 缓冲区，失败返回 null
+ */
+buf_t bread(blkdev_t dev, u64 blockno);
+
+/**
+ *\brief 获取设备的一个块但不读取内容，用于将整块覆盖写入
+ *
+ *\param dev      设备
+ *\param blockno  块号
+ *\return 缓冲区，失败返回 null
+ */
+buf_t bget(blkdev_t dev, u64 blockno);
+
+/**
+ *\brief 标记缓冲区为脏，将在淘汰或 bsync 时写回
+ *
+ *\param buf      缓冲区
+ */
+void bdirty(buf_t buf);
+
+/**
+ *\brief 释放对缓冲区的引用
+ *
+ *\param buf      缓冲区
+ */
+void brelse(buf_t buf);
+
+/**
+ *\brief 写回脏块
+ *
+ *\param dev      设备，为 null 时写回所有设备
+ *\return 0 成功，-1 失败
+ */
+int bsync(blkdev_t dev);
+
+/**
+ *\brief 通过缓存按字节读取设备
+ *
+ *\param dev      设备
+ *\param addr     读取的数据
+ *\param offset   读取的偏移
+ *\param size     读取的大小
+ *\return 读取的字节数，失败返回 -1
+ */
+ssize_t blkdev_read(blkdev_t dev, void *addr, u64 offset, size_t size)
+    __nnull(1, 2);
+
+/**
+ *\brief 通过缓存按字节写入设备
+ *
+ *\param dev      设备
+ *\param addr     写入的数据
+ *\param offset   写入的偏移
+ *\param size     写入的大小
+ *\return 写入的字节数，失败返回 -1
+ */
+ssize_t blkdev_write(blkdev_t dev, const void *addr, u64 offset, size_t size)
+    __nnull(1, 2);
+
+struct bcache_stat {
+  size_t nbufs;  // 缓冲区总数
+  size_t cached; // 已分配的缓冲区数
+  size_t dirty;  // 脏块数
+  u64 hits;      // 命中次数
+  u64 misses;    // 未命中次数
+  u64 evictions; // 淘汰次数
+};
+
+/**
+ *\brief 获取缓存统计信息
+ *
+ *\param stat     统计信息
+ */
+void bcache_stat(struct bcache_stat *stat);
+
+// ---------------------------------------------------------------------------
+// 请求队列 (电梯调度)
+//
+// 位于缓存 / 驱动与块设备之间：未分发的请求以起始扇区为键存放在红黑树中，
+// 同方向相邻的请求会前向或后向合并，分发时按扇区递增的顺序扫描 (C-SCAN)，
+// 超过期限的请求优先分发。plug 期间请求只入队不分发，以便积累合并的机会
+//
+// 调用者需要保证同时在队列中的请求没有重叠 (缓冲区缓存天然满足)
+// 起始扇区超过 INT32_MAX 的请求不进入调度，直接分发
+
+/**
+ *\brief 请求完成时的回调
+ *
+ *\param data     提交时传入的数据
+ *\param result   完成的字节数，失败返回 -1
+ */
+typedef void (*bio_done_t)(void *data, ssize_t result);
+
+typedef struct blkq *blkq_t;
+
+struct blkq_stat {
+  u64 submitted;  // 提交的请求数
+  u64 merged;     // 被合并的请求数
+  u64 dispatched; // 发往设备的请求数
+  u64 expired;    // 因超过期限而被优先分发的请求数
+  size_t pending; // 等待分发的请求数
+};
+
+/**
+ *\brief 为设备创建请求队列，之后缓存对该设备的访问都经过队列
+ *
+ *\param dev          设备
+ *\param read_expire  读请求的期限 (以分发次数计)
+ *\param write_expire 写请求的期限 (以分发次数计)
+ *\param max_sectors  合并后单个请求的最大扇区数
+ *\return 队列，失败返回 null
+ */
+blkq_t blkq_alloc(blkdev_t dev, u32 read_expire, u32 write_expire,
+                  u32 max_sectors);
+
+/**
+ *\brief 分发所有请求并释放队列
+ *
+ *\param q        队列
+ */
+void blkq_free(blkq_t q);
+
+/**
+ *\brief 提交一个请求，未 plug 时会立即分发
+ *
+ *\param q        队列
+ *\param write    是否为写请求
+ *\param addr     数据
+ *\param lba      起始扇区
+ *\param count    扇区数量
+ *\param done     完成回调，可以为 null
+ *\param data     回调数据
+ *\return 0 成功，-1 失败
+ */
+int blkq_submit(blkq_t q, bool write, void *addr, u64 lba, size_t count,
+                bio_done_t done, void *data) __nnull(1, 3);
+
+/**
+ *\brief 暂停分发，可以嵌套
+ *
+ *\param q        队列
+ */
+void blkq_plug(blkq_t q);
+
+/**
+ *\brief 恢复分发，最外层的 unplug 会分发所有等待的请求
+ *
+ *\param q        队列
+ */
+void blkq_unplug(blkq_t q);
+
+/**
+ *\brief 分发所有等待的请求
+ *
+ *\param q        队列
+ *\return 发往设备的请求数
+ */
+size_t blkq_run(blkq_t q);
+
+/**
+ *\brief 睡眠直到 done 被完成回调置为 true
+ *
+ *\param q        请求所在的队列
+ *\param done     完成回调设置的标志
+ */
+void blkq_wait(blkq_t q, bool *done) __nnull(1, 2);
+
+/**
+ *\brief 同步读写，请求经过队列调度
+ *
+ * 队列被 plug 时等到最外层的 unplug 才分发，因此不能在 plug 期间调用
+ *
+ *\param q        队列
+ *\param write    是否为写请求
+ *\param addr     数据
+ *\param lba      起始扇区
+ *\param count    扇区数量
+ *\return 完成的扇区数量，失败返回 -1
+ */
+ssize_t blkq_rw(blkq_t q, bool write, void *addr, u64 lba, size_t count)
+    __nnull(1, 3);
+
+/**
+ *\brief 获取队列统计信息
+ *
+ *\param q        队列
+ *\param stat     统计信息
+ */
+void blkq_stat(blkq_t q, struct blkq_stat *stat);
@@ -20,6 +20,7 @@ extern "C" {
 #include "data-structure/ordered-set/queue.h"
 #include "data-structure/ordered-set/slist.h"
 #include "data-structure/sorted-map/avltree.h"
+#include "data-structure/sorted-map/rbtree-interval.h"
 #include "data-structure/sorted-map/rbtree-strptr.h"
 #include "data-structure/sorted-map/rbtree.h"
 #include "data-structure/sorted-map/trie.h"
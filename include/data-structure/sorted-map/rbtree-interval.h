@@ -0,0 +1,433 @@
+#pragma once
+#include "../base.h"
+
+#pragma GCC system_header
+
+#ifdef ALL_IMPLEMENTATION
+#  define RBTREE_IV_IMPLEMENTATION
+#endif
+
+#ifndef _RBTREE_ENUM_
+#  define _RBTREE_ENUM_
+enum {
+  RBT_RED,  // 红色节点
+  RBT_BLACK // 黑色节点
+};
+#endif
+
+/**
+ *\struct rbtree_iv
+ *\brief 区间树节点结构 (以区间起点为键的红黑树，节点记录子树中最大的终点)
+ *
+ * 节点由调用者分配，可以嵌入在更大的结构体的开头，起点相同的区间可以共存
+ */
+typedef struct rbtree_iv *rbtree_iv_t;
+struct rbtree_iv {
+  int32_t     color;  /**< 节点颜色，取值为 RED 或 BLACK */
+  uint64_t    start;  /**< 区间起点 (包含) */
+  uint64_t    end;    /**< 区间终点 (不包含) */
+  uint64_t    max;    /**< 子树中最大的终点 */
+  void       *value;  /**< 节点值 */
+  rbtree_iv_t left;   /**< 左子节点指针 */
+  rbtree_iv_t right;  /**< 右子节点指针 */
+  rbtree_iv_t parent; /**< 父节点指针 */
+};
+
+#ifdef RBTREE_IV_IMPLEMENTATION
+#  define extern static
+#endif
+
+/**
+ *\brief 创建一个新的区间树节点
+ *\param[in] start 区间起点 (包含)
+ *\param[in] end 区间终点 (不包含)
+ *\param[in] value 节点值指针
+ *\return 新的区间树节点指针
+ */
+extern rbtree_iv_t rbtree_iv_alloc(uint64_t start, uint64_t end, void *value) __THROW __attr_malloc;
+
+/**
+ *\brief 释放区间树
+ *\param[in] root 树的根节点
+ */
+extern void rbtree_iv_free(rbtree_iv_t root) __THROW;
+
+/**
+ *\brief 释放区间树
+ *\param[in] root 树的根节点
+ *\param[in] callback 释放节点值的回调
+ */
+extern void rbtree_iv_free_with(rbtree_iv_t root, free_t callback) __THROW;
+
+/**
+ *\brief 在区间树中插入节点
+ *\param[in] root 树的根节点
+ *\param[in] node 要插入的节点
+ *\return 插入节点后的树的根节点
+ */
+extern rbtree_iv_t rbtree_iv_insert(rbtree_iv_t root, rbtree_iv_t node) __THROW __wur;
+
+/**
+ *\brief 从区间树中移除节点 (不释放节点)
+ *\param[in] root 树的根节点
+ *\param[in] node 要移除的节点
+ *\return 移除节点后的树的根节点
+ */
+extern rbtree_iv_t rbtree_iv_remove(rbtree_iv_t root, rbtree_iv_t node) __THROW __wur;
+
+/**
+ *\brief 查找起点最小的与 [start, end) 重叠的节点
+ *\param[in] root 树的根节点
+ *\param[in] start 区间起点 (包含)
+ *\param[in] end 区间终点 (不包含)
+ *\return 找到的节点指针，未找到返回 NULL
+ */
+extern rbtree_iv_t rbtree_iv_first(rbtree_iv_t root, uint64_t start, uint64_t end) __THROW;
+
+/**
+ *\brief 按起点顺序查找下一个与 [start, end) 重叠的节点
+ *\param[in] node 当前节点
+ *\param[in] start 区间起点 (包含)
+ *\param[in] end 区间终点 (不包含)
+ *\return 找到的节点指针，未找到返回 NULL
+ */
+extern rbtree_iv_t rbtree_iv_next(rbtree_iv_t node, uint64_t start, uint64_t end) __THROW;
+
+#ifdef RBTREE_IV_IMPLEMENTATION
+#  undef extern
+#endif
+
+#ifdef RBTREE_IV_IMPLEMENTATION
+
+static rbtree_iv_t rbtree_iv_alloc(uint64_t start, uint64_t end, void *value) noexcept {
+  rbtree_iv_t node = (rbtree_iv_t)malloc(sizeof(*node));
+  if (node == null) return null;
+  node->start  = start;
+  node->end    = end;
+  node->max    = end;
+  node->value  = value;
+  node->color  = RBT_RED;
+  node->left   = null;
+  node->right  = null;
+  node->parent = null;
+  return node;
+}
+
+static void rbtree_iv_free(rbtree_iv_t root) noexcept {
+  if (root == null) return;
+  rbtree_iv_free(root->left);
+  rbtree_iv_free(root->right);
+  free(root);
+}
+
+static void rbtree_iv_free_with(rbtree_iv_t root, free_t callback) noexcept {
+  if (root == null) return;
+  rbtree_iv_free_with(root->left, callback);
+  rbtree_iv_free_with(root->right, callback);
+  callback(root->value);
+  free(root);
+}
+
+/**
+ *\brief 根据子节点重新计算节点的 max
+ *\param[in] node 节点指针
+ */
+static void rbtree_iv_update(rbtree_iv_t node) noexcept {
+  node->max = node->end;
+  if (node->left != null && node->left->max > node->max) node->max = node->left->max;
+  if (node->right != null && node->right->max > node->max) node->max = node->right->max;
+}
+
+/**
+ *\brief 从节点开始向上重新计算 max
+ *\param[in] node 节点指针
+ */
+static void rbtree_iv_update_up(rbtree_iv_t node) noexcept {
+  for (; node != null; node = node->parent)
+    rbtree_iv_update(node);
+}
+
+static rbtree_iv_t rbtree_iv_left_rotate(rbtree_iv_t root, rbtree_iv_t x) noexcept {
+  rbtree_iv_t y = x->right;
+  x->right      = y->left;
+
+  if (y->left != null) y->left->parent = x;
+
+  y->parent = x->parent;
+
+  if (x->parent == null)
+    root = y;
+  else if (x == x->parent->left)
+    x->parent->left = y;
+  else
+    x->parent->right = y;
+
+  y->left   = x;
+  x->parent = y;
+
+  // 子树包含的区间不变，只有旋转的两个节点需要更新
+  rbtree_iv_update(x);
+  rbtree_iv_update(y);
+  return root;
+}
+
+static rbtree_iv_t rbtree_iv_right_rotate(rbtree_iv_t root, rbtree_iv_t y) noexcept {
+  rbtree_iv_t x = y->left;
+  y->left       = x->right;
+
+  if (x->right != null) x->right->parent = y;
+
+  x->parent = y->parent;
+
+  if (y->parent == null)
+    root = x;
+  else if (y == y->parent->left)
+    y->parent->left = x;
+  else
+    y->parent->right = x;
+
+  x->right  = y;
+  y->parent = x;
+
+  rbtree_iv_update(y);
+  rbtree_iv_update(x);
+  return root;
+}
+
+static rbtree_iv_t rbtree_iv_transplant(rbtree_iv_t root, rbtree_iv_t u, rbtree_iv_t v) noexcept {
+  if (u->parent == null)
+    root = v;
+  else if (u == u->parent->left)
+    u->parent->left = v;
+  else
+    u->parent->right = v;
+
+  if (v != null) v->parent = u->parent;
+
+  return root;
+}
+
+static rbtree_iv_t rbtree_iv_insert_fixup(rbtree_iv_t root, rbtree_iv_t z) noexcept {
+  while (z != root && z->parent->color == RBT_RED) {
+    if (z->parent == z->parent->parent->left) {
+      rbtree_iv_t y = z->parent->parent->right;
+      if (y != null && y->color == RBT_RED) {
+        z->parent->color         = RBT_BLACK;
+        y->color                 = RBT_BLACK;
+        z->parent->parent->color = RBT_RED;
+        z                        = z->parent->parent;
+      } else {
+        if (z == z->parent->right) {
+          z    = z->parent;
+          root = rbtree_iv_left_rotate(root, z);
+        }
+        z->parent->color         = RBT_BLACK;
+        z->parent->parent->color = RBT_RED;
+        root                     = rbtree_iv_right_rotate(root, z->parent->parent);
+      }
+    } else {
+      rbtree_iv_t y = z->parent->parent->left;
+      if (y != null && y->color == RBT_RED) {
+        z->parent->color         = RBT_BLACK;
+        y->color                 = RBT_BLACK;
+        z->parent->parent->color = RBT_RED;
+        z                        = z->parent->parent;
+      } else {
+        if (z == z->parent->left) {
+          z    = z->parent;
+          root = rbtree_iv_right_rotate(root, z);
+        }
+        z->parent->color         = RBT_BLACK;
+        z->parent->parent->color = RBT_RED;
+        root                     = rbtree_iv_left_rotate(root, z->parent->parent);
+      }
+    }
+  }
+
+  root->color = RBT_BLACK;
+  return root;
+}
+
+static rbtree_iv_t rbtree_iv_insert(rbtree_iv_t root, rbtree_iv_t z) noexcept {
+  rbtree_iv_t y = null;
+  rbtree_iv_t x = root;
+
+  while (x != null) {
+    y = x;
+    if (z->start < x->start)
+      x = x->left;
+    else
+      x = x->right;
+  }
+
+  z->color  = RBT_RED;
+  z->max    = z->end;
+  z->left   = null;
+  z->right  = null;
+  z->parent = y;
+  if (y == null)
+    root = z;
+  else if (z->start < y->start)
+    y->left = z;
+  else
+    y->right = z;
+
+  rbtree_iv_update_up(y);
+  return rbtree_iv_insert_fixup(root, z);
+}
+
+static rbtree_iv_t rbtree_iv_delete_fixup(rbtree_iv_t root, rbtree_iv_t x, rbtree_iv_t x_parent) noexcept {
+  while (x != root && (x == null || x->color == RBT_BLACK)) {
+    if (x == x_parent->left) {
+      rbtree_iv_t w = x_parent->right;
+      if (w->color == RBT_RED) {
+        w->color        = RBT_BLACK;
+        x_parent->color = RBT_RED;
+        root            = rbtree_iv_left_rotate(root, x_parent);
+        w               = x_parent->right;
+      }
+      if ((w->left == null || w->left->color == RBT_BLACK) &&
+          (w->right == null || w->right->color == RBT_BLACK)) {
+        w->color = RBT_RED;
+        x        = x_parent;
+        x_parent = x_parent->parent;
+      } else {
+        if (w->right == null || w->right->color == RBT_BLACK) {
+          if (w->left != null) w->left->color = RBT_BLACK;
+          w->color = RBT_RED;
+          root     = rbtree_iv_right_rotate(root, w);
+          w        = x_parent->right;
+        }
+        w->color        = x_parent->color;
+        x_parent->color = RBT_BLACK;
+        if (w->right != null) w->right->color = RBT_BLACK;
+        root = rbtree_iv_left_rotate(root, x_parent);
+        x    = root;
+      }
+    } else {
+      rbtree_iv_t w = x_parent->left;
+      if (w->color == RBT_RED) {
+        w->color        = RBT_BLACK;
+        x_parent->color = RBT_RED;
+        root            = rbtree_iv_right_rotate(root, x_parent);
+        w               = x_parent->left;
+      }
+      if ((w->right == null || w->right->color == RBT_BLACK) &&
+          (w->left == null || w->left->color == RBT_BLACK)) {
+        w->color = RBT_RED;
+        x        = x_parent;
+        x_parent = x_parent->parent;
+      } else {
+        if (w->left == null || w->left->color == RBT_BLACK) {
+          if (w->right != null) w->right->color = RBT_BLACK;
+          w->color = RBT_RED;
+          root     = rbtree_iv_left_rotate(root, w);
+          w        = x_parent->left;
+        }
+        w->color        = x_parent->color;
+        x_parent->color = RBT_BLACK;
+        if (w->left != null) w->left->color = RBT_BLACK;
+        root = rbtree_iv_right_rotate(root, x_parent);
+        x    = root;
+      }
+    }
+  }
+
+  if (x != null) x->color = RBT_BLACK;
+  return root;
+}
+
+static rbtree_iv_t rbtree_iv_remove(rbtree_iv_t root, rbtree_iv_t z) noexcept {
+  rbtree_iv_t x;
+  rbtree_iv_t x_parent;
+  int32_t     original_color = z->color;
+
+  if (z->left == null) {
+    x        = z->right;
+    x_parent = z->parent;
+    root     = rbtree_iv_transplant(root, z, z->right);
+  } else if (z->right == null) {
+    x        = z->left;
+    x_parent = z->parent;
+    root     = rbtree_iv_transplant(root, z, z->left);
+  } else {
+    rbtree_iv_t y = z->right;
+    while (y->left != null)
+      y = y->left;
+    original_color = y->color;
+    x              = y->right;
+    if (y->parent == z) {
+      x_parent = y;
+      if (x != null) x->parent = y;
+    } else {
+      x_parent = y->parent;
+      root     = rbtree_iv_transplant(root, y, y->right);
+      y->right = z->right;
+      if (y->right != null) y->right->parent = y;
+    }
+    root            = rbtree_iv_transplant(root, z, y);
+    y->left         = z->left;
+    y->left->parent = y;
+    y->color        = z->color;
+  }
+
+  // 从结构变化的最低处向上更新，之后的旋转只影响旋转的节点
+  rbtree_iv_update_up(x_parent);
+  z->left = z->right = z->parent = null;
+
+  if (original_color == RBT_BLACK) root = rbtree_iv_delete_fixup(root, x, x_parent);
+
+  return root;
+}
+
+/**
+ *\brief 在子树中查找起点最小的重叠节点
+ */
+static rbtree_iv_t rbtree_iv_first_in(rbtree_iv_t node, uint64_t start, uint64_t end) noexcept {
+  while (node != null && node->max > start) {
+    // 左子树中有终点大于 start 的区间时，它的起点不大于当前节点，
+    // 若当前节点的起点小于 end 则它一定重叠
+    if (node->left != null && node->left->max > start) {
+      node = node->left;
+      continue;
+    }
+    if (node->start >= end) return null;
+    if (node->end > start) return node;
+    node = node->right;
+  }
+  return null;
+}
+
+static rbtree_iv_t rbtree_iv_first(rbtree_iv_t root, uint64_t start, uint64_t end) noexcept {
+  return rbtree_iv_first_in(root, start, end);
+}
+
+static rbtree_iv_t rbtree_iv_next(rbtree_iv_t node, uint64_t start, uint64_t end) noexcept {
+  rbtree_iv_t found = rbtree_iv_first_in(node->right, start, end);
+  if (found != null) return found;
+  for (rbtree_iv_t parent = node->parent; parent != null; node = parent, parent = parent->parent) {
+    if (node != parent->left) continue;
+    if (parent->start >= end) return null;
+    if (parent->end > start) return parent;
+    found = rbtree_iv_first_in(parent->right, start, end);
+    if (found != null) return found;
+  }
+  return null;
+}
+
+#  undef RBTREE_IV_IMPLEMENTATION
+#endif
+
+/**
+ *\brief 在区间树中插入节点
+ *\param[in,out] root 树的根节点
+ *\param[in] node 要插入的节点
+ */
+#define rbtree_iv_insert(root, node) ((root) = rbtree_iv_insert(root, node))
+
+/**
+ *\brief 从区间树中移除节点
+ *\param[in,out] root 树的根节点
+ *\param[in] node 要移除的节点
+ */
+#define rbtree_iv_remove(root, node) ((root) = rbtree_iv_remove(root, node))
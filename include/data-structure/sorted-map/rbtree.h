@@ -100,6 +100,22 @@ extern rbtree_t rbtree_min(rbtree_t root) __THROW;
  */
 extern rbtree_t rbtree_max(rbtree_t root) __THROW;
 
+/**
+ *\brief 查找键值大于等于 key 的最小节点
+ *\param[in] root 树的根节点
+ *\param[in] key 要查找的键值
+ *\return 找到的节点指针，未找到返回 NULL
+ */
+extern rbtree_t rbtree_ceil(rbtree_t root, int32_t key) __THROW;
+
+/**
+ *\brief 查找键值小于等于 key 的最大节点
+ *\param[in] root 树的根节点
+ *\param[in] key 要查找的键值
+ *\return 找到的节点指针，未找到返回 NULL
+ */
+extern rbtree_t rbtree_floor(rbtree_t root, int32_t key) __THROW;
+
 /**
  *\brief 在红黑树中插入节点
  *\param[in] root 树的根节点
@@ -277,6 +293,34 @@ static rbtree_t rbtree_max(rbtree_t root) noexcept {
   return root;
 }
 
+static rbtree_t rbtree_ceil(rbtree_t root, int32_t key) noexcept {
+  rbtree_t res = null;
+  while (root) {
+    if (root->key == key) return root;
+    if (root->key > key) {
+      res  = root;
+      root = root->left;
+    } else {
+      root = root->right;
+    }
+  }
+  return res;
+}
+
+static rbtree_t rbtree_floor(rbtree_t root, int32_t key) noexcept {
+  rbtree_t res = null;
+  while (root) {
+    if (root->key == key) return root;
+    if (root->key < key) {
+      res  = root;
+      root = root->right;
+    } else {
+      root = root->left;
+    }
+  }
+  return res;
+}
+
 static rbtree_t rbtree_left_rotate(rbtree_t root, rbtree_t x) noexcept {
   rbtree_t y = x->right;
   x->right   = y->left;
@@ -481,10 +525,11 @@ static rbtree_t rbtree_delete_with(rbtree_t root, int32_t key, free_t callback)
     rbtree_t y     = rbtree_min(z->right);
     original_color = y->color;
     x              = y->right;
-    x_parent       = y;
     if (y->parent == z) {
+      x_parent = y;
       if (x != null) x->parent = y;
     } else {
+      x_parent = y->parent;
       root     = rbtree_transplant(root, y, y->right);
       y->right = z->right;
       if (y->right != null) y->right->parent = y;
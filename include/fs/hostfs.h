@@ -0,0 +1,86 @@
+#pragma once
+#include <vfs.h>
+
+// hostfs: 将宿主机上的一个目录映射到 vfs 中 (仅用于用户态)
+//
+// 挂载时 src 为宿主机目录路径，例如 vfs_mount("/srv/data", node)
+// 所有的 open / stat 都通过父目录缓存的 fd 以 openat / fstatat 完成
+
+/**
+ *\brief 注册 hostfs
+ *
+ *\return 文件系统 id，失败返回 -1
+ */
+int hostfs_regist();
+
+/**
+ *\brief 获取节点在宿主机上对应的 fd
+ *
+ *\param node     文件节点
+ *\return fd，未打开返回 -1
+ */
+int hostfs_fd(vfs_node_t node);
+
+/**
+ *\brief 异步操作完成时的回调
+ *
+ *\param data     提交时传入的数据
+ *\param result   读写的字节数，失败时为负的 errno
+ */
+typedef void (*hostfs_done_t)(void *data, ssize_t result);
+
+/**
+ *\brief 初始化异步 IO 队列
+ *
+ *\param entries  队列深度
+ *\return 0 使用 io_uring，1 退化为同步 IO，-1 失败
+ */
+int hostfs_aio_init(unsigned entries);
+
+/**
+ *\brief 释放异步 IO 队列，会等待所有未完成的请求
+ */
+void hostfs_aio_exit();
+
+/**
+ *\brief 提交异步读取，不会立即进入内核，直到 hostfs_aio_submit
+ *
+ *\param file     文件节点 (必须属于 hostfs)
+ *\param addr     读取的数据
+ *\param offset   读取的偏移
+ *\param size     读取的大小
+ *\param done     完成回调
+ *\param data     回调数据
+ *\return 0 成功，-1 失败
+ */
+int hostfs_aio_read(vfs_node_t file, void *addr, size_t offset, size_t size,
+                    hostfs_done_t done, void *data) __nnull(1, 2);
+
+/**
+ *\brief 提交异步写入，不会立即进入内核，直到 hostfs_aio_submit
+ *
+ *\param file     文件节点 (必须属于 hostfs)
+ *\param addr     写入的数据
+ *\param offset   写入的偏移
+ *\param size     写入的大小
+ *\param done     完成回调
+ *\param data     回调数据
+ *\return 0 成功，-1 失败
+ */
+int hostfs_aio_write(vfs_node_t file, const void *addr, size_t offset,
+                     size_t size, hostfs_done_t done, void *data) __nnull(1, 2);
+
+/**
+ *\brief 将排队的请求提交给内核
+ *
+ *\return 提交的请求数量，失败返回 -1
+ */
+int hostfs_aio_submit();
+
+/**
+ *\brief 等待请求完成并调用回调
+ *
+ *\param min      最少等待完成的请求数量
+ *\return 处理的完成事件数量，失败返回 -1
+ */
+int hostfs_aio_wait(unsigned min);
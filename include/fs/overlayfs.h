@@ -0,0 +1,29 @@
+#pragma once
+#include <vfs.h>
+
+// overlayfs: 把 vfs 中已挂载的几个子树叠加成一个文件系统
+//
+// 挂载时 src 为 "lowerdir=/lower1:/lower2,upperdir=/upper[,sparse]"
+//   lowerdir  只读层，可以有多个，靠前的在上层
+//   upperdir  可写层，省略时整个 overlay 只读
+//   sparse    可写层的驱动支持稀疏文件时，首次写入只复制被写入的范围，
+//             其余部分在卸载时补齐；否则首次写入时复制整个文件
+//
+// 每个文件夹打开时会把各层的子项合并到一个哈希索引中，之后的查找只需一次
+// 哈希，与层数和子项数量无关
+//
+// 可写层中名为 ".wh.<name>" 的文件会隐藏下层的 <name>，包含 ".wh..wh..opq"
+// 的文件夹不会与下层的同名文件夹合并；删除只读层中的项目时会在可写层中
+// 创建对应的 whiteout
+//
+// 不支持 rename：句柄中记录了相对路径，移动文件夹需要重定向下层的路径
+
+#define OVERLAYFS_WHITEOUT ".wh."
+#define OVERLAYFS_OPAQUE   ".wh..wh..opq"
+
+/**
+ *\brief 注册 overlayfs
+ *
+ *\return 文件系统 id，失败返回 -1
+ */
+int overlayfs_regist();
@@ -0,0 +1,74 @@
+#pragma once
+#include <vfs.h>
+
+// packfs: 只读的打包镜像文件系统
+//
+// 镜像由 packfs_pack 将 vfs 中的一个子树序列化得到，挂载时只需 mmap
+// 镜像并检查文件头，之后的 open / read / stat 都直接访问映射的内存
+//
+// src 为已注册的块设备名称 (例如 loop_attach 创建的回环设备) 时，只读入
+// 数据区之前的元数据，文件数据通过缓冲区缓存从设备读取
+//
+// 镜像布局 (小端，偏移均相对于镜像开头):
+//   header | inode 表 | dentry 表 | 名称表 | 数据
+// 每个文件夹的子项在 dentry 表中连续存放并按名称排序，查找使用二分
+
+#define PACKFS_MAGIC   "PLNTPACK"
+#define PACKFS_VERSION 1
+
+enum {
+  packfs_codec_none, // 不压缩
+  packfs_codec_lz4,  // LZ4 块格式
+  packfs_codec_zstd, // zstd (需要以 PACKFS_ZSTD=1 编译并链接 libzstd)
+};
+
+struct packfs_header {
+  char magic[8];    // PACKFS_MAGIC
+  u32 version;      // PACKFS_VERSION
+  u32 block_size;   // 压缩块大小
+  u32 inode_count;  // inode 数量，0 号为根目录
+  u32 dentry_count; // dentry 数量
+  u64 inode_off;    // inode 表的偏移
+  u64 dentry_off;   // dentry 表的偏移
+  u64 name_off;     // 名称表的偏移
+  u64 data_off;     // 数据区的偏移
+  u64 image_size;   // 镜像总大小
+};
+
+struct packfs_inode {
+  u16 type;        // 文件类型
+  u16 codec;       // 数据的压缩方式
+  u32 permissions; // 权限
+  u32 owner;       // 所有者
+  u32 group;       // 所有组
+  u64 size;        // 文件大小
+  u64 createtime;  // 创建时间
+  u64 writetime;   // 最后写入时间
+  u32 child;       // 文件夹: 第一个子项在 dentry 表中的下标
+  u32 nchild;      // 文件夹: 子项数量
+  u64 data;        // 文件: 数据的偏移，压缩时指向块偏移表
+  u64 stored;      // 文件: 数据在镜像中占用的大小
+};
+
+struct packfs_dentry {
+  u32 name;  // 在名称表中的偏移
+  u32 inode; // inode 下标
+};
+
+/**
+ *\brief 注册 packfs
+ *
+ *\return 文件系统 id，失败返回 -1
+ */
+int packfs_regist();
+
+/**
+ *\brief 将 vfs 中的子树打包为镜像
+ *
+ *\param root       子树的根 (必须是文件夹)
+ *\param out        镜像写入的流
+ *\param codec      压缩方式
+ *\param block_size 压缩块大小，0 表示使用默认值
+ *\return 0 成功，-1 失败
+ */
+int packfs_pack(vfs_node_t root, mostream_t out, int codec, u32 block_size);
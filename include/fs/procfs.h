@@ -0,0 +1,20 @@
+#pragma once
+#include <vfs.h>
+
+// procfs: 只读的 vfs 统计，内容在读取时生成
+//
+// 挂载时 src 为 "proc"，例如 vfs_mount("proc", node)，其中有：
+//   ops       所有操作的统计表格 (次数、错误、字节数、耗时的分位数等) 以及
+//             路径查找的统计
+//   mounts    每行一个挂载："编号 路径"
+//   mount/N   编号为 N 的挂载的统计表格
+//   memory    vfs 自身占用的内存：各个分类和各个挂载的对象数和字节数，以及
+//             占用最多的子树 (见 vfs_mem_read 和 vfs_mem_top)
+// 从偏移 0 读取时重新生成内容，之后的读取使用同一份内容
+
+/**
+ *\brief 注册 procfs
+ *
+ *\return 文件系统 id，失败返回 -1
+ */
+int procfs_regist();
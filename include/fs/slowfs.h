@@ -0,0 +1,46 @@
+#pragma once
+#include <vfs.h>
+
+// slowfs: 把 vfs 中已挂载的一个子树包装成一个慢速设备，用于在快速的驱动
+// (例如 tmpfs) 上评估缓存、预读、回写和异步队列
+//
+// 挂载时 src 为 "slowdir=/dir[,选项...]"，所有操作转发给 /dir 中的对应项目，
+// 并在转发前注入延迟：
+//   read=<分布>    每次读取的延迟
+//   write=<分布>   每次写入的延迟
+//   meta=<分布>    打开、创建、删除、重命名和改变大小的延迟 (stat 没有
+//                  延迟，vfs 在每次路径查找时都会调用它)
+//   bw=<速率>      读写共享的带宽，例如 100M (字节每秒，可以用 k/M/G)，
+//                  请求按到达顺序占用设备传输数据
+//   qd=<n>         同时进行的请求数，更多的请求等待
+//   spike=<p>:<t>  每个请求以概率 p (例如 0.01 或 1%) 额外延迟 t
+//   seed=<n>       随机数种子，同样的种子和请求顺序产生同样的延迟
+//   virtual        不真正等待，只把延迟累加到统计中，结果与机器无关
+// 分布为 fixed:<t>、uniform:<t1>:<t2>、exp:<平均值> 或 normal:<平均值>:<标准差>，
+// 单独的 <t> 即 fixed:<t>；时间可以用 ns/us/ms/s，没有单位时为 ns
+//
+// 延迟按 延迟分布 + 尖峰 + 传输 计算，qd 限制的等待不计入统计中的 delay
+
+typedef struct slowfs_stat {
+  u64 ops;    // 注入过延迟的请求数
+  u64 bytes;  // 读写的字节数
+  u64 delay;  // 注入的延迟之和 (ns)，virtual 时为模拟的设备时间
+  u64 spikes; // 出现尖峰的请求数
+  u64 waits;  // 因为 qd 等待过的请求数
+} slowfs_stat_t;
+
+/**
+ *\brief 注册 slowfs
+ *
+ *\return 文件系统 id，失败返回 -1
+ */
+int slowfs_regist();
+
+/**
+ *\brief 读取一个 slowfs 挂载的统计
+ *
+ *\param node     挂载中的任意节点
+ *\param stat     统计
+ *\return 0 成功，-1 失败 (不在 slowfs 中)
+ */
+int slowfs_stat(vfs_node_t node, slowfs_stat_t *stat);
@@ -0,0 +1,15 @@
+#pragma once
+#include <vfs.h>
+
+// tmpfs: 数据只存放在内存中的文件系统
+//
+// 挂载时 src 为 "tmpfs"，例如 vfs_mount("tmpfs", node)
+// 文件数据按页存放在以页号为键的红黑树中，未写入过的页 (空洞) 不占用内存，
+// 读取时为 0；单个文件最大为 INT32_MAX 页
+
+/**
+ *\brief 注册 tmpfs
+ *
+ *\return 文件系统 id，失败返回 -1
+ */
+int tmpfs_regist();
@@ -0,0 +1,17 @@
+#pragma once
+#include <vfs.h>
+
+// 字节范围锁的锁表，由 vfs.c 在释放 vfs_node_info 时调用
+//
+// 每个文件一张锁表：已持有的锁按起点存放在区间树中，冲突检查只访问重叠
+// 的锁；等待的请求按到达顺序排队，释放锁时按顺序授予不再冲突的请求，
+// 与更早的请求冲突的新请求也要排队，独占锁不会被源源不断的共享锁饿死。
+// 锁表之间没有共享的锁，不同文件上的加锁互不影响，只有即将睡眠时才通过
+// 全局的等待关系检测死锁
+
+/**
+ *\brief 释放锁表，调用者需要保证没有线程在等待
+ *
+ *\param locks    锁表
+ */
+void lock_table_free(struct vfs_locks *locks);
@@ -0,0 +1,28 @@
+#pragma once
+#include <block.h>
+
+// 回环设备：把 vfs 中的一个普通文件作为块设备
+//
+// 设备的扇区读写直接转换为对文件的 vfs_read / vfs_write，回环层本身不缓存，
+// 只有挂载在设备上的文件系统通过缓冲区缓存访问它，避免同一份数据被缓存两次
+// 例如把 tmpfs 中的镜像挂载到 /mnt:
+//   blkdev_t dev = loop_attach("loop0", vfs_open("/tmp/root.pack"), 512);
+//   vfs_mount("loop0", vfs_open("/mnt"));
+
+/**
+ *\brief 将文件绑定为块设备
+ *
+ *\param name         设备名称
+ *\param file         文件节点，需要在设备解除绑定前一直有效
+ *\param sector_size  扇区大小，文件末尾不足一个扇区的部分读取为 0
+ *\return 设备，失败返回 null
+ */
+blkdev_t loop_attach(cstr name, vfs_node_t file, u32 sector_size);
+
+/**
+ *\brief 写回缓存并解除绑定
+ *
+ *\param dev      loop_attach 返回的设备
+ *\return 0 成功，-1 失败
+ */
+int loop_detach(blkdev_t dev);
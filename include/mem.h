@@ -0,0 +1,75 @@
+#pragma once
+#include <vfs.h>
+
+// 内存统计，由 vfs.c 在分配和释放节点、信息、名称、链表单元和缓存时调用
+//
+// 每个对象记入分配时所在的挂载 (stats_mount 分配的编号)，编号保存在对象
+// 中，释放时从同一个挂载中减去，所以重命名和卸载不会让计数漂移。计数用
+// 原子的加减，不需要锁
+//
+// 以 VFS_MEM=0 编译时 mem_charge 是空的内联函数，vfs_mem_read 返回 -1
+
+#ifndef VFS_MEM
+#  define VFS_MEM 1
+#endif
+
+#if VFS_MEM
+
+/**
+ *\brief 记入或减去内存
+ *
+ *\param category vfs_mem_*
+ *\param mntid    所在挂载的编号
+ *\param bytes    字节数，释放时为负数
+ *\param objects  对象数，释放时为负数
+ */
+void mem_charge(int category, u16 mntid, isize bytes, isize objects);
+/**
+ *\brief 以文本表格输出各个分类和挂载的内存以及占用最多的子树
+ *
+ *\param buf      缓冲区
+ *\param size     缓冲区大小
+ *\return 与 snprintf 一样为完整输出的长度，缓冲区不够时截断
+ */
+size_t mem_format(char *buf, size_t size);
+
+#else
+
+finline void mem_charge(int category, u16 mntid, isize bytes, isize objects) {}
+finline size_t mem_format(char *buf, size_t size) {
+  return 0;
+}
+
+#endif
+
+// 带分类的分配，释放时需要给出同样的分类、挂载和大小
+
+finline void *mem_alloc(int category, u16 mntid, size_t size) {
+  void *ptr = malloc(size);
+  if (ptr != null)
+    mem_charge(category, mntid, size, 1);
+  return ptr;
+}
+
+finline void mem_free(int category, u16 mntid, void *ptr, size_t size) {
+  if (ptr == null)
+    return;
+  mem_charge(category, mntid, -(isize)size, -1);
+  free(ptr);
+}
+
+// 记入已经由别处 (例如 strdup) 分配的字符串
+finline char *mem_adopt_str(int category, u16 mntid, char *s) {
+  if (s != null)
+    mem_charge(category, mntid, strlen(s) + 1, 1);
+  return s;
+}
+
+finline char *mem_strdup(int category, u16 mntid, cstr s) {
+  return mem_adopt_str(category, mntid, strdup(s));
+}
+
+finline void mem_free_str(int category, u16 mntid, char *s) {
+  if (s != null)
+    mem_free(category, mntid, s, strlen(s) + 1);
+}
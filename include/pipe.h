@@ -0,0 +1,75 @@
+#pragma once
+#include <vfs.h>
+
+// 管道的环形缓冲区，由 vfs.c 在 vfs_read / vfs_write 中调用
+//
+// 一个读者和一个写者之间不加锁，只通过原子的读写位置同步；多个读者 (或
+// 多个写者) 之间用互斥锁串行，所以不超过缓冲区大小的写入不会与其它写入
+// 交错。缓冲区为空 (或满) 时在条件变量上睡眠，另一端只有在有人等待时
+// 才需要唤醒
+
+typedef struct vfs_pipe *pipe_t;
+
+/**
+ *\brief 创建管道
+ *
+ *\param size     缓冲区大小，向上取整为 2 的幂，为 0 时使用 64 KiB
+ *\param flags    vfs_pipe_* 的组合
+ *\param node     管道所属的节点，用于唤醒 vfs_poll
+ *\return 管道，失败返回 null
+ */
+pipe_t pipe_alloc(size_t size, int flags, vfs_node_t node);
+
+/**
+ *\brief 释放管道，调用者需要保证没有线程在读写
+ *
+ *\param pipe     管道
+ */
+void pipe_free(pipe_t pipe);
+
+/**
+ *\brief 读取管道，阻塞直到至少读取一个字节或写端关闭
+ *
+ *\param pipe     管道
+ *\param addr     读取的数据
+ *\param size     最多读取的字节数
+ *\return 读取的字节数，写端关闭且为空时返回 0，非阻塞且为空时返回 -1
+ */
+ssize_t pipe_read(pipe_t pipe, void *addr, size_t size);
+
+/**
+ *\brief 写入管道，阻塞直到全部写入
+ *
+ *\param pipe     管道
+ *\param addr     写入的数据
+ *\param size     写入的字节数
+ *\return 写入的字节数，非阻塞时可能只写入一部分，写端已关闭或非阻塞且已满
+ *        时返回 -1
+ */
+ssize_t pipe_write(pipe_t pipe, const void *addr, size_t size);
+
+/**
+ *\brief 把管道中的数据直接从缓冲区写入文件，阻塞的方式与 pipe_read 相同
+ *
+ *\param pipe     管道
+ *\param file     文件
+ *\param offset   文件中的偏移
+ *\param size     最多移动的字节数
+ *\return 移动的字节数，失败返回 -1
+ */
+ssize_t pipe_splice(pipe_t pipe, vfs_node_t file, u64 offset, size_t size);
+
+/**
+ *\brief 关闭写端，之后的写入失败，读者读完剩余的数据后读到 0
+ *
+ *\param pipe     管道
+ */
+void pipe_shutdown(pipe_t pipe);
+
+/**
+ *\brief 获取管道的就绪状态
+ *
+ *\param pipe     管道
+ *\return vfs_poll_* 的组合
+ */
+int pipe_poll(pipe_t pipe);
@@ -0,0 +1,41 @@
+#pragma once
+#include <vfs.h>
+
+// 节点的等待队列和 pollset，由 vfs.c 在释放 vfs_node_info 时调用
+//
+// 每个节点在首次被等待时创建一个等待队列，记录驱动报告的状态和登记在它上
+// 面的 pollset。状态变化时只唤醒关心这些事件的 pollset，把对应的登记放入
+// 就绪列表，等待的代价只与就绪的节点数量有关。pollset 使用 pthread 的互斥
+// 锁和条件变量睡眠
+//
+// 以 VFS_POLL=0 编译时 poll.c 中只有返回 -1 (vfs_pollset_alloc 返回 null)
+// 的 vfs_poll / vfs_pollset_*，vfs_poll_wakeup 什么也不做，也不再需要 pthread
+
+#ifndef VFS_POLL
+#  define VFS_POLL 1
+#endif
+
+#if VFS_POLL
+
+/**
+ *\brief 释放节点的等待队列，并从登记它的 pollset 中移除
+ *
+ *\param q        等待队列，可以为 null
+ */
+void poll_queue_free(struct vfs_pollq *q);
+
+/**
+ *\brief 查询节点当前的就绪状态，由 vfs.c 提供，首次等待节点时调用
+ *
+ * 管道查询缓冲区，有 poll 接口的驱动调用驱动，其它文件总是可读写
+ *
+ *\param node     节点
+ *\return vfs_poll_* 的组合
+ */
+int vfs_poll_query(vfs_node_t node);
+
+#else
+
+finline void poll_queue_free(struct vfs_pollq *q) {}
+
+#endif
@@ -0,0 +1,85 @@
+#pragma once
+#include <vfs.h>
+
+// 负载的记录和重放，记录由 vfs.c 在 vfs_open / vfs_close / vfs_read /
+// vfs_write / vfs_mkdir / vfs_mkfile / vfs_mount 中调用，vfs_rename /
+// vfs_link / vfs_unlink / vfs_rmdir 不记录，但其中打开父目录等调用也不记录
+//
+// 只记录最外层的调用 (驱动内部再调用的 vfs 操作在重放时由驱动自己产生)。
+// 记录的格式：replay_header 之后是 count 个 replay_rec，每个之后是
+// pathlen 字节的路径，补齐到 8 字节。节点以编号表示：vfs_open 的结果
+// 产生一个编号；开始记录前就已经打开的节点第一次出现时先写入
+// replay_bind，重放时按路径打开。读写的数据不记录，重放时读写任意内容
+//
+// 以 VFS_RECORD=0 编译时记录的函数都是空的内联函数，vfs_record_* 返回 -1
+
+#ifndef VFS_RECORD
+#  define VFS_RECORD 1
+#endif
+
+#define REPLAY_MAGIC   "VFSREC\0"
+#define REPLAY_VERSION 1
+
+struct replay_header {
+  char magic[8]; // REPLAY_MAGIC
+  u32 version;   // REPLAY_VERSION
+  u32 count;     // 记录数
+};
+
+// 除了 vfs_op_* 以外的记录
+enum {
+  replay_mount = 0x80, // vfs_mount：node 为挂载点，path 为 src
+  replay_bind,         // 开始记录前就已经打开的节点 node 的路径 path
+};
+
+struct replay_rec {
+  u8 op;       // vfs_op_* 或 replay_*
+  u8 reserved;
+  u16 pathlen; // 之后的路径的长度
+  u32 thread;  // 发出调用的线程，从 1 开始
+  u64 node;    // 节点的编号，vfs_open 中为打开的结果，没有时为 0
+  u64 offset;  // 读写的偏移
+  u64 size;    // 读写请求的大小
+  i64 result;  // 返回值，vfs_open 中为 0 或 -1
+  u64 start;   // 相对于开始记录的时间 (ns)
+  u64 end;
+};
+
+#if VFS_RECORD
+
+/**
+ *\brief 开始一次调用
+ *
+ *\return 传给 record_end 的值，没有在记录时为 0
+ */
+u64 record_begin();
+/**
+ *\brief 结束一次调用并记录它
+ *
+ *\param op       vfs_op_* 或 replay_mount
+ *\param node     操作的节点，vfs_open 中为打开的结果，可以为 null
+ *\param path     路径，vfs_mount 中为 src，可以为 null
+ *\param start    record_begin 的返回值
+ *\param offset   读写的偏移
+ *\param size     读写请求的大小
+ *\param result   返回值
+ */
+void record_end(int op, vfs_node_t node, cstr path, u64 start, u64 offset,
+                u64 size, i64 result);
+/**
+ *\brief 结束一次不记录的调用，其中的 vfs 调用也不记录
+ *
+ *\param start    record_begin 的返回值
+ */
+void record_skip(u64 start);
+
+#else
+
+finline u64 record_begin() {
+  return 0;
+}
+finline void record_end(int op, vfs_node_t node, cstr path, u64 start,
+                        u64 offset, u64 size, i64 result) {}
+finline void record_skip(u64 start) {}
+
+#endif
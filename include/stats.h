@@ -0,0 +1,113 @@
+#pragma once
+#include <vfs.h>
+
+// 操作统计，由 vfs.c 和 lock.c 在各个公开的操作中调用
+//
+// 计数按线程分片：每个线程第一次操作时领取一个分片 (线程退出后由新线程
+// 复用)，只有所属的线程写入，不需要原子的读改写，读取统计时把所有分片
+// 相加。次数、错误和字节数每次都记录；计时需要读取时钟，只对每个线程中
+// 随机抽取的约 1 / 2^shift 次操作计时，落入按 2 的幂再四等分的直方图。
+// 嵌套的公开操作 (例如 vfs_rename 中的 vfs_open) 只算作外层的一次
+//
+// 以 VFS_STATS=0 编译时以下函数都是空的内联函数，vfs_stats_* 返回 -1
+
+#ifndef VFS_STATS
+#  define VFS_STATS 1
+#endif
+
+#if VFS_STATS
+
+/**
+ *\brief 开始一次操作
+ *
+ *\return 传给 stats_end 的值，不需要计时时为 0 或 1
+ */
+u64 stats_begin();
+/**
+ *\brief 结束一次操作
+ *
+ *\param op       vfs_op_*
+ *\param node     操作的节点，用于找到所在的挂载，可以为 null
+ *\param start    stats_begin 的返回值
+ *\param ok       操作是否成功
+ *\param bytes    读写的字节数
+ */
+void stats_end(int op, vfs_node_t node, u64 start, bool ok, u64 bytes);
+/**
+ *\brief 记录一次路径查找，只在有操作正在统计时记录
+ *
+ * 查找到的节点所在的挂载作为 stats_end 的 node 为 null 时操作所属的挂载
+ *
+ *\param last     找到的节点，或者查找停下的文件夹，可以为 null
+ *\param steps    经过的路径分量数
+ *\param hits     已经打开、不需要调用驱动 open 的分量数
+ *\param misses   需要调用驱动 open 的分量数
+ *\param found    是否找到
+ */
+void stats_walk(vfs_node_t last, u32 steps, u32 hits, u32 misses,
+                bool found);
+// 驱动回调的计时，只在当前操作被抽中计时时读取时钟
+extern _Thread_local bool stats_timing;
+u64 stats_callback_begin();
+void stats_callback_end(u64 start);
+/**
+ *\brief 为新的挂载分配编号，记录在 node->info->mntid 中
+ *
+ *\param node     挂载的根目录
+ */
+void stats_mount(vfs_node_t node);
+/**
+ *\brief 释放挂载的编号
+ *
+ *\param node     挂载的根目录
+ */
+void stats_unmount(vfs_node_t node);
+/**
+ *\brief 以文本表格输出统计
+ *
+ *\param mntid    挂载的编号，为 -1 时输出所有挂载的合计
+ *\param buf      缓冲区
+ *\param size     缓冲区大小
+ *\return 与 snprintf 一样为完整输出的长度，缓冲区不够时截断
+ */
+size_t stats_format(int mntid, char *buf, size_t size);
+/**
+ *\brief 获取挂载的根目录
+ *
+ *\param mntid    挂载的编号
+ *\return 根目录，编号未使用时返回 null
+ */
+vfs_node_t stats_mount_root(int mntid);
+
+// 在驱动回调的调用语句外计时，例如 stats_callback(ret = callbackof(...)(...))
+#  define stats_callback(stmt)                                                 \
+    do {                                                                       \
+      u64 __stats_start__ = stats_timing ? stats_callback_begin() : 0;         \
+      stmt;                                                                    \
+      if (__stats_start__ != 0)                                                \
+        stats_callback_end(__stats_start__);                                   \
+    } while (0)
+
+#else
+
+finline u64 stats_begin() {
+  return 0;
+}
+finline void stats_end(int op, vfs_node_t node, u64 start, bool ok, u64 bytes) {
+}
+finline void stats_walk(vfs_node_t last, u32 steps, u32 hits, u32 misses,
+                        bool found) {}
+finline void stats_mount(vfs_node_t node) {}
+finline void stats_unmount(vfs_node_t node) {}
+finline size_t stats_format(int mntid, char *buf, size_t size) {
+  return 0;
+}
+finline vfs_node_t stats_mount_root(int mntid) {
+  return null;
+}
+
+#  define stats_callback(stmt) stmt
+
+#endif
+
+#define STATS_MOUNTS 64 // 分别统计的挂载数量，超过后合并到 0 号
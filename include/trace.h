@@ -0,0 +1,105 @@
+#pragma once
+#include <vfs.h>
+
+// 操作追踪，由 vfs.c 和 lock.c 在各个公开的操作中调用
+//
+// 每个线程把事件写入自己的环形缓冲区 (cirbuf_t，head / tail 只增不减，
+// 只有所属的线程修改 tail，只有后台线程修改 head)，后台线程定期把各个
+// 缓冲区中的事件经 mostream 写入文件。缓冲区满时丢弃事件并计数。
+// 嵌套的公开操作分别记录，depth 为外层的操作数
+//
+// 文件格式：trace_header 之后是若干块，每块是 trace_chunk 和属于同一个
+// 缓冲区的 size 字节的事件；每个事件是 trace_event 和 pathlen 字节的
+// 路径，补齐到 8 字节。节点第一次出现在一次追踪中时先写入 trace_name，
+// 之后的事件只记录节点的编号
+//
+// 以 VFS_TRACE=0 编译时以下函数都是空的内联函数，vfs_trace_* 返回 -1
+
+#ifndef VFS_TRACE
+#  define VFS_TRACE 1
+#endif
+
+#define TRACE_MAGIC   "VFSTRACE"
+#define TRACE_VERSION 1
+
+struct trace_header {
+  char magic[8]; // TRACE_MAGIC
+  u32 version;   // TRACE_VERSION
+  u32 tsc;       // 时间戳是否为 TSC，否则为 ns
+};
+
+struct trace_chunk {
+  u32 thread; // 缓冲区的编号，同一个编号的事件按顺序排列
+  u32 size;   // 之后的事件的字节数
+};
+
+// 除了 vfs_op_* 以外的记录
+enum {
+  trace_name = 0x80, // 节点的路径：node, path
+  trace_driver,      // 驱动的名称：driver, path
+  trace_clock,       // 同一时刻的时间戳 start 和 CLOCK_MONOTONIC 的 ns end
+  trace_lost,        // 缓冲区满时丢弃的事件数 size
+};
+
+struct trace_event {
+  u8 op;       // vfs_op_* 或 trace_*
+  u8 depth;    // 外层的操作数
+  u16 driver;  // 驱动的 id
+  u16 pathlen; // 之后的路径的长度，没有节点时记录操作的路径
+  u16 failed;  // 操作是否失败
+  u64 node;    // 节点的编号，没有节点时为 0
+  u64 offset;  // 读写的偏移，加锁和 vfs_fallocate 中为范围的起点
+  u64 size;    // 读写的字节数 (失败时为请求的大小)，vfs_truncate 中为新的大小，
+               // 加锁和 vfs_fallocate 中为范围的长度
+  u64 start;   // 开始的时间戳
+  u64 end;     // 结束的时间戳
+};
+
+#define TRACE_PATH_MAX 4095 // 更长的路径被截断
+
+#if VFS_TRACE
+
+/**
+ *\brief 开始一次操作
+ *
+ *\return 传给 trace_end 的值，没有在追踪时为 0
+ */
+u64 trace_begin();
+/**
+ *\brief 结束一次操作并记录事件
+ *
+ *\param op       vfs_op_*
+ *\param node     操作的节点，可以为 null
+ *\param path     node 为 null 时记录的路径，可以为 null
+ *\param start    trace_begin 的返回值
+ *\param offset   读写的偏移
+ *\param size     读写的字节数
+ *\param ok       操作是否成功
+ */
+void trace_end(int op, vfs_node_t node, cstr path, u64 start, u64 offset,
+               u64 size, bool ok);
+/**
+ *\brief 记录路径查找停下的节点，node 为 null 的事件使用它所在的驱动
+ *
+ *\param last     找到的节点，或者查找停下的文件夹，可以为 null
+ */
+void trace_walk(vfs_node_t last);
+/**
+ *\brief 记录驱动的名称，每次追踪开始时写入文件
+ *
+ *\param id       驱动的 id
+ *\param name     名称
+ */
+void trace_regist(int id, cstr name);
+
+#else
+
+finline u64 trace_begin() {
+  return 0;
+}
+finline void trace_end(int op, vfs_node_t node, cstr path, u64 start,
+                       u64 offset, u64 size, bool ok) {}
+finline void trace_walk(vfs_node_t last) {}
+finline void trace_regist(int id, cstr name) {}
+
+#endif
@@ -70,8 +70,36 @@ typedef void (*vfs_close_t)(void *current);
  *
  *\param current  当前文件句柄
  *\param size     新的大小
+ *\return 0 成功，-1 失败
+ */
+typedef int (*vfs_resize_t)(void *current, u64 size);
+
+enum {
+  vfs_falloc_keep_size = 1,  // 不改变文件大小
+  vfs_falloc_zero_range = 2, // 将范围清零并分配空间
+  vfs_falloc_punch_hole = 4, // 释放范围占用的空间，之后读取为 0
+};
+
+/**
+ *\brief 为文件预留或释放空间
+ *
+ *\param file     文件句柄
+ *\param mode     vfs_falloc_* 的组合，为 0 时只预留空间
+ *\param offset   范围的偏移
+ *\param size     范围的大小
+ *\return 0 成功，-1 失败
  */
-typedef void (*vfs_resize_t)(void *current, u64 size);
+typedef int (*vfs_fallocate_t)(void *file, int mode, u64 offset, u64 size);
+
+/**
+ *\brief 查找数据或空洞
+ *
+ *\param file     文件句柄
+ *\param offset   开始查找的偏移
+ *\param hole     为 true 时查找空洞，否则查找数据
+ *\return 不小于 offset 的第一个数据 (或空洞) 的偏移，没有时返回 -1
+ */
+typedef i64 (*vfs_seek_t)(void *file, u64 offset, bool hole);
 
 /**
  *\brief 写入一个文件
@@ -107,13 +135,126 @@ typedef int (*vfs_stat_t)(void *file, vfs_node_t node);
 typedef int (*vfs_mk_t)(void *parent, cstr name, vfs_node_t node);
 
 // 映射文件从 offset 开始的 size 大小
+// 返回的内存在文件被修改前有效，范围不在内存中或不连续时返回 null
 typedef void *(*vfs_mapfile_t)(void *file, size_t offset, size_t size);
 
+/**
+ *\brief 在同一个文件系统的两个文件之间复制 (例如共享数据的克隆)
+ *
+ *\param src      源文件句柄
+ *\param src_off  源文件中的偏移
+ *\param dst      目标文件句柄
+ *\param dst_off  目标文件中的偏移
+ *\param size     复制的大小
+ *\return 复制的字节数，无法处理时返回 -1，由 vfs 逐块复制
+ */
+typedef ssize_t (*vfs_copy_t)(void *src, u64 src_off, void *dst, u64 dst_off,
+                              u64 size);
+
+/**
+ *\brief 删除一个文件或空文件夹
+ *
+ * 调用前 vfs 已关闭被删除的项目，除非它还有其它硬链接在使用同一个句柄
+ *
+ *\param parent   父目录句柄
+ *\param name     文件名
+ *\return 0 成功，-1 失败
+ */
+typedef int (*vfs_remove_t)(void *parent, cstr name);
+
+/**
+ *\brief 移动或重命名，目标已存在时原子地替换它
+ *
+ * 被移动项目的句柄 (以及其中子项的句柄) 之后必须仍然有效
+ *
+ *\param old_parent  原父目录句柄
+ *\param old_name    原名称
+ *\param new_parent  新父目录句柄
+ *\param new_name    新名称
+ *\return 0 成功，-1 失败
+ */
+typedef int (*vfs_rename_t)(void *old_parent, cstr old_name, void *new_parent,
+                            cstr new_name);
+
+/**
+ *\brief 为文件创建一个硬链接
+ *
+ *\param old_parent  文件所在的父目录句柄
+ *\param old_name    文件名
+ *\param new_parent  新名称所在的父目录句柄
+ *\param new_name    新名称
+ *\return 0 成功，-1 失败
+ */
+typedef int (*vfs_link_t)(void *old_parent, cstr old_name, void *new_parent,
+                          cstr new_name);
+
+/**
+ *\brief 读取扩展属性
+ *
+ *\param file     文件句柄
+ *\param name     属性名
+ *\param value    读取的数据，size 为 0 时为 null
+ *\param size     缓冲区大小，为 0 时只返回属性的大小
+ *\return 属性的大小，属性不存在或缓冲区不够时返回 -1
+ */
+typedef ssize_t (*vfs_getxattr_t)(void *file, cstr name, void *value,
+                                  size_t size);
+
+/**
+ *\brief 设置扩展属性，已存在时替换
+ *
+ *\param file     文件句柄
+ *\param name     属性名
+ *\param value    属性的数据
+ *\param size     属性的大小
+ *\return 0 成功，-1 失败
+ */
+typedef int (*vfs_setxattr_t)(void *file, cstr name, const void *value,
+                              size_t size);
+
+/**
+ *\brief 列出扩展属性
+ *
+ *\param file     文件句柄
+ *\param list     属性名，每个以 '\0' 结尾，size 为 0 时为 null
+ *\param size     缓冲区大小，为 0 时只返回需要的大小
+ *\return 属性名的总长度，缓冲区不够时返回 -1
+ */
+typedef ssize_t (*vfs_listxattr_t)(void *file, char *list, size_t size);
+
+enum {
+  vfs_poll_in = 1,  // 可以读取
+  vfs_poll_out = 2, // 可以写入
+  vfs_poll_err = 4, // 出错，总是报告
+  vfs_poll_hup = 8, // 对端已关闭，总是报告
+};
+
+/**
+ *\brief 查询流式设备的就绪状态
+ *
+ * vfs 只在第一次等待这个文件时调用，之后使用缓存的状态，
+ * 所以状态变化时驱动必须调用 vfs_poll_wakeup
+ *
+ *\param file     文件句柄
+ *\return vfs_poll_* 的组合
+ */
+typedef int (*vfs_poll_t)(void *file);
+
 enum {
   file_none,    // 未获取信息
   file_dir,     // 文件夹
   file_block,   // 块设备，如硬盘
   file_stream,  // 流式设备，如终端
+  file_fifo,    // 管道，数据只存在于 vfs 的缓冲区中
+};
+
+enum {
+  vfs_pipe_nonblock = 1, // 读取空管道和写入满管道时不阻塞，返回 -1
+};
+
+enum {
+  vfs_lock_shared = 1,    // 共享锁，可以与其它共享锁重叠
+  vfs_lock_exclusive = 2, // 独占锁，不能与其它线程的任何锁重叠
 };
 
 typedef struct vfs_callback {
@@ -126,6 +267,19 @@ typedef struct vfs_callback {
   vfs_mk_t mkdir;
   vfs_mk_t mkfile;
   vfs_stat_t stat;
+  // 以下为可选接口，为 null 时表示不支持
+  vfs_resize_t resize;
+  vfs_fallocate_t fallocate;
+  vfs_seek_t seek;
+  vfs_mapfile_t map;
+  vfs_copy_t copy_range;
+  vfs_remove_t remove;
+  vfs_rename_t rename;
+  vfs_link_t link;
+  vfs_getxattr_t getxattr;
+  vfs_setxattr_t setxattr;
+  vfs_listxattr_t listxattr;
+  vfs_poll_t poll;
 } *vfs_callback_t;
 struct vfs_node_info {
   u16 type;           // 类型
@@ -137,19 +291,32 @@ struct vfs_node_info {
   u32 owner;       // 所有者
   u32 group;       // 所有组
   u32 permissions; // 权限
+  u32 nlink;       // 硬链接数量 (可选)
   u16 fsid;        // 文件系统的 id
   void *handle;    // 操作文件的句柄
-  list_t childs;    // 这个文件夹可能被软链接，所以需要存储所有的子节点
+  list_t child;    // 子目录和子文件，绑定挂载的各个别名共享同一份
+  u32 refcount;    // 引用这份信息的节点数量
   vfs_node_t root; // 根目录
+  struct vfs_xattrs *xattrs; // 扩展属性的缓存，首次访问时创建
+  list_t watches;  // 监视这个节点的 vfs_watch_t
+  struct vfs_pollq *pollq; // 就绪状态和等待它的 pollset，首次等待时创建
+  struct vfs_pipe *pipe;   // 管道的缓冲区，不为 null 时读写不经过驱动
+  struct vfs_locks *locks; // 字节范围锁，首次加锁时创建
+  u16 mntid;       // 挂载的编号，用于按挂载统计 (只在挂载的根目录中有效)
+  u16 memmnt;      // 分配时所在挂载的编号，释放时从它的内存统计中减去
 }; // 用于读取文件的重要信息
-// 对于硬链接的文件，删除时真实文件系统应当注意处理同一个文件的多个分身的关系。
+// 通过 vfs_link 创建的硬链接共享同一份信息和句柄，删除其中一个名称时真实
+// 文件系统只删除这个名称，最后一个名称删除时才释放文件
 struct vfs_node {
   vfs_node_t parent;  // 父目录
   char *symlink_path; // 如果是软链接，则需要指向软链接的路径
   char *name;         // 名称
 
-  struct vfs_node_info *info; // 文件信息
-  list_t child; // 子目录和子文件
+  struct vfs_node_info *info;    // 文件信息
+  struct vfs_node_info *covered; // 绑定挂载时被覆盖的原信息
+  vfs_node_t source; // 绑定挂载的源文件夹，通过别名创建的子节点也以它为父目录
+  u32 trace_gen; // 最近一次把路径写入追踪时的追踪编号
+  u16 memmnt;    // 分配时所在挂载的编号，释放时从它的内存统计中减去
 };
 
 struct fd {
@@ -159,6 +326,90 @@ struct fd {
   bool writeable;
 };
 
+enum {
+  vfs_event_create = 1, // 创建 (包括新的硬链接和移动到这里)
+  vfs_event_write = 2,  // 写入或改变大小
+  vfs_event_close = 4,  // 关闭
+  vfs_event_delete = 8, // 删除 (包括从这里移走)
+  vfs_event_all = 15,
+};
+
+typedef struct vfs_event {
+  int type;    // vfs_event_* 中的一个
+  u64 offset;  // 写入的范围，合并后为覆盖所有写入的范围，截断时为新的大小
+  u64 size;
+  char path[]; // 发生变化的项目的完整路径
+} *vfs_event_t;
+
+typedef struct vfs_watch {
+  vfs_node_t node; // 被监视的节点，节点被释放后为 null
+  int mask;        // 关心的 vfs_event_*
+  bool subtree;    // 是否监视整个子树，否则只监视节点本身和直接子项
+  event_t events;  // 事件队列，取出的 vfs_event_t 用 free 释放
+} *vfs_watch_t;
+
+struct vfs_pollfd {
+  vfs_node_t node;
+  int events;  // 关心的 vfs_poll_*
+  int revents; // 就绪的 vfs_poll_*
+  void *data;  // 调用者的数据，vfs_pollset_wait 原样返回
+};
+
+typedef struct vfs_pollset *vfs_pollset_t;
+
+enum {
+  vfs_op_open,
+  vfs_op_close,
+  vfs_op_read,
+  vfs_op_write,
+  vfs_op_mkdir,
+  vfs_op_mkfile,
+  vfs_op_truncate,
+  vfs_op_unlink,
+  vfs_op_rmdir,
+  vfs_op_rename,
+  vfs_op_link,
+  vfs_op_mount,
+  vfs_op_unmount,
+  vfs_op_bind,
+  vfs_op_fallocate,
+  vfs_op_copy_range,
+  vfs_op_getxattr,
+  vfs_op_setxattr,
+  vfs_op_listxattr,
+  vfs_op_lock,
+  vfs_op_unlock,
+  vfs_op_poll,
+  vfs_op_splice,
+  vfs_op_count,
+};
+
+// 耗时直方图的桶数，每个 2 的幂分为 4 个桶，最后一个桶包括更长的耗时
+#define VFS_STATS_BUCKETS 160
+
+typedef struct vfs_op_stats {
+  u64 count;    // 调用次数
+  u64 errors;   // 失败的次数
+  u64 bytes;    // 读写的字节数
+  u64 sampled;  // 计时的次数，以下的耗时都只来自这些调用
+  u64 time;     // 总耗时 (ns)
+  u64 callback; // 其中在驱动回调中的耗时 (ns)
+  u64 max;      // 最长的一次 (ns)
+  u64 hist[VFS_STATS_BUCKETS]; // 耗时在 vfs_stats_bucket(i) 到
+                               // vfs_stats_bucket(i + 1) 之间的次数
+} vfs_op_stats_t;
+
+typedef struct vfs_stats {
+  vfs_op_stats_t ops[vfs_op_count];
+  // 以下只有全局的统计
+  u64 walks;         // 路径查找的次数 (包括 vfs_mkdir / vfs_mkfile)
+  u64 walk_steps;    // 经过的路径分量总数
+  u64 walk_max;      // 最深的一次查找经过的分量数
+  u64 walk_fails;    // 没有找到的次数
+  u64 lookup_hits;   // 经过的节点已经打开，不需要调用驱动的 open
+  u64 lookup_misses; // 需要调用驱动的 open
+} vfs_stats_t;
+
 extern vfs_node_t rootdir; // vfs 根目录
 
 vfs_node_t vfs_child_append(vfs_node_t parent, cstr name, void *handle);
@@ -218,6 +469,469 @@ ssize_t vfs_read(vfs_node_t file, void *addr, size_t offset, size_t size)
 ssize_t vfs_write(vfs_node_t file, const void *addr, size_t offset, size_t size)
     __nnull(1, 2) __attr_readonly(2, 4);
 
+/**
+ *\brief 截断或扩大文件，扩大的部分读取为 0
+ *
+ *\param file     文件节点
+ *\param size     新的大小
+ *\return 0 成功，-1 失败 (包括驱动不支持)
+ */
+int vfs_truncate(vfs_node_t file, u64 size);
+/**
+ *\brief 为文件预留空间、清零或打洞
+ *
+ * 不带 vfs_falloc_keep_size 时，文件会扩大到覆盖整个范围
+ * vfs_falloc_punch_hole 必须与 vfs_falloc_keep_size 一同使用
+ *
+ *\param file     文件节点
+ *\param mode     vfs_falloc_* 的组合
+ *\param offset   范围的偏移
+ *\param size     范围的大小
+ *\return 0 成功，-1 失败 (包括驱动不支持)
+ */
+int vfs_fallocate(vfs_node_t file, int mode, u64 offset, u64 size);
+
+/**
+ *\brief 查找不小于 offset 的第一个数据的偏移 (类似 SEEK_DATA)
+ *
+ * 驱动不支持时整个文件都视为数据
+ *
+ *\param file     文件节点
+ *\param offset   开始查找的偏移
+ *\return 数据的偏移，offset 之后没有数据时返回 -1
+ */
+i64 vfs_next_data(vfs_node_t file, u64 offset);
+/**
+ *\brief 查找不小于 offset 的第一个空洞的偏移 (类似 SEEK_HOLE)
+ *
+ * 文件末尾视为一个空洞，所以 offset 小于文件大小时总能找到
+ *
+ *\param file     文件节点
+ *\param offset   开始查找的偏移
+ *\return 空洞的偏移，offset 不小于文件大小时返回 -1
+ */
+i64 vfs_next_hole(vfs_node_t file, u64 offset);
+
+/**
+ *\brief 在文件之间复制数据
+ *
+ * 两个文件属于同一个文件系统时先尝试驱动的 copy_range (例如共享页的克隆)，
+ * 否则按源文件的数据和空洞分段复制：空洞不读取，数据优先从源文件驱动映射
+ * 的内存直接写入目标文件，不经过中间缓冲区
+ *
+ *\param src      源文件节点
+ *\param src_off  源文件中的偏移
+ *\param dst      目标文件节点
+ *\param dst_off  目标文件中的偏移
+ *\param size     复制的大小，超过源文件末尾的部分被忽略
+ *\return 复制的字节数，-1 失败 (同一文件中重叠的范围也会失败)
+ */
+ssize_t vfs_copy_range(vfs_node_t src, u64 src_off, vfs_node_t dst,
+                       u64 dst_off, u64 size);
+
+/**
+ *\brief 删除文件
+ *
+ *\param path     文件路径
+ *\return 0 成功，-1 失败 (包括文件夹、挂载点和驱动不支持)
+ */
+int vfs_unlink(cstr path);
+/**
+ *\brief 删除空文件夹
+ *
+ *\param path     文件夹路径
+ *\return 0 成功，-1 失败 (包括非空、挂载点和驱动不支持)
+ */
+int vfs_rmdir(cstr path);
+/**
+ *\brief 移动或重命名文件或文件夹
+ *
+ * 目标已存在时原子地替换它 (文件只能替换文件，文件夹只能替换空文件夹)
+ * 只移动节点本身，子树中的节点和已打开的句柄保持不变，代价与子树大小无关
+ * 两个路径必须在同一个文件系统的同一次挂载中
+ *
+ *\param oldpath  原路径
+ *\param newpath  新路径
+ *\return 0 成功，-1 失败
+ */
+int vfs_rename(cstr oldpath, cstr newpath);
+
+/**
+ *\brief 创建硬链接
+ *
+ * 新名称与原文件共享同一个 vfs_node_info (以及其中的句柄)，不复制任何信息
+ *
+ *\param oldpath  已存在的文件路径
+ *\param newpath  新名称的路径
+ *\return 0 成功，-1 失败 (包括文件夹、目标已存在和驱动不支持)
+ */
+int vfs_link(cstr oldpath, cstr newpath);
+
+/**
+ *\brief 读取扩展属性
+ *
+ * 读取过的属性 (包括不存在的) 缓存在文件信息中，之后的读取不再经过驱动
+ * 缓存只随 vfs_setxattr 更新，绕过 vfs 对属性的修改不可见
+ *
+ *\param node     文件节点
+ *\param name     属性名
+ *\param value    读取的数据
+ *\param size     缓冲区大小，为 0 时只返回属性的大小
+ *\return 属性的大小，-1 失败 (包括属性不存在、缓冲区不够和驱动不支持)
+ */
+ssize_t vfs_getxattr(vfs_node_t node, cstr name, void *value, size_t size);
+/**
+ *\brief 设置扩展属性，已存在时替换
+ *
+ *\param node     文件节点
+ *\param name     属性名
+ *\param value    属性的数据
+ *\param size     属性的大小
+ *\return 0 成功，-1 失败 (包括驱动不支持)
+ */
+int vfs_setxattr(vfs_node_t node, cstr name, const void *value, size_t size);
+/**
+ *\brief 列出扩展属性
+ *
+ *\param node     文件节点
+ *\param list     属性名，每个以 '\0' 结尾
+ *\param size     缓冲区大小，为 0 时只返回需要的大小
+ *\return 属性名的总长度，-1 失败 (包括缓冲区不够和驱动不支持)
+ */
+ssize_t vfs_listxattr(vfs_node_t node, char *list, size_t size);
+
+/**
+ *\brief 监视节点或子树的变化
+ *
+ * 事件在操作完成时放入 watch->events，队尾是同一个文件尚未取走的写入事件
+ * 时新的写入合并到其中，不再产生新的事件
+ * 没有任何监视时各个操作不需要额外的查找
+ *
+ *\param node     被监视的节点
+ *\param mask     关心的 vfs_event_* 组合
+ *\param subtree  是否监视整个子树
+ *\return 监视句柄，失败返回 null
+ */
+vfs_watch_t vfs_watch(vfs_node_t node, int mask, bool subtree);
+/**
+ *\brief 取消监视并释放尚未取走的事件
+ *
+ *\param watch    监视句柄
+ */
+void vfs_unwatch(vfs_watch_t watch);
+
+/**
+ *\brief 等待多个节点中的任意一个就绪 (类似 poll)
+ *
+ * 没有 poll 接口的驱动的文件总是可读写
+ * 长期等待大量节点时使用 vfs_pollset，避免每次调用都登记所有节点
+ * 以 VFS_POLL=0 编译时等待的代码完全不存在，vfs_poll 和 vfs_pollset_* 总是
+ * 失败
+ *
+ *\param fds      节点和关心的事件，revents 返回就绪的事件
+ *\param n        节点数量
+ *\param timeout  超时的毫秒数，-1 为一直等待，0 为不等待
+ *\return 就绪的节点数量，超时返回 0，-1 失败
+ */
+int vfs_poll(struct vfs_pollfd *fds, size_t n, int timeout);
+
+/**
+ *\brief 驱动报告文件的就绪状态发生变化，可以在其它线程中调用
+ *
+ * 还没有人等待过这个文件时直接返回，首次等待时 vfs 会调用驱动的 poll 接口
+ *
+ *\param node     文件节点
+ *\param events   新的状态，vfs_poll_* 的组合
+ */
+void vfs_poll_wakeup(vfs_node_t node, int events);
+
+/**
+ *\brief 创建 pollset (类似 epoll)
+ *
+ * 节点登记在各自的等待队列中，状态变化时被放入就绪列表，
+ * 等待的代价只与就绪的节点数量有关
+ *
+ *\return pollset，失败返回 null
+ */
+vfs_pollset_t vfs_pollset_alloc();
+/**
+ *\brief 释放 pollset 以及其中的登记
+ *
+ *\param set      pollset
+ */
+void vfs_pollset_free(vfs_pollset_t set);
+/**
+ *\brief 登记节点
+ *
+ *\param set      pollset
+ *\param node     文件节点
+ *\param events   关心的 vfs_poll_*
+ *\param data     就绪时返回的调用者数据
+ *\return 0 成功，-1 失败 (包括已经登记过)
+ */
+int vfs_pollset_add(vfs_pollset_t set, vfs_node_t node, int events,
+                    void *data);
+/**
+ *\brief 取消登记
+ *
+ *\param set      pollset
+ *\param node     文件节点
+ *\return 0 成功，-1 失败
+ */
+int vfs_pollset_del(vfs_pollset_t set, vfs_node_t node);
+/**
+ *\brief 等待登记的节点就绪 (水平触发，仍然就绪的节点下次还会返回)
+ *
+ *\param set      pollset
+ *\param out      就绪的节点
+ *\param max      out 的大小
+ *\param timeout  超时的毫秒数，-1 为一直等待，0 为不等待
+ *\return 就绪的节点数量，超时返回 0，-1 失败
+ */
+int vfs_pollset_wait(vfs_pollset_t set, struct vfs_pollfd *out, size_t max,
+                     int timeout);
+
+/**
+ *\brief 创建命名管道
+ *
+ * 驱动中只创建一个空文件占据名称，数据只经过 vfs 中的缓冲区，
+ * 重新挂载后管道变回普通文件
+ * 读取阻塞直到有数据，写入阻塞直到全部写入，都会忽略偏移
+ *
+ *\param path     文件路径
+ *\param size     缓冲区大小，为 0 时使用 64 KiB
+ *\param flags    vfs_pipe_* 的组合
+ *\return 0 成功，-1 失败
+ */
+int vfs_mkfifo(cstr path, size_t size, int flags);
+/**
+ *\brief 创建不在目录树中的匿名管道
+ *
+ *\param size     缓冲区大小，为 0 时使用 64 KiB
+ *\param flags    vfs_pipe_* 的组合
+ *\return 管道节点，用 vfs_pipe_free 释放，失败返回 null
+ */
+vfs_node_t vfs_pipe(size_t size, int flags);
+/**
+ *\brief 释放匿名管道
+ *
+ *\param pipe     vfs_pipe 返回的节点
+ */
+void vfs_pipe_free(vfs_node_t pipe);
+/**
+ *\brief 关闭管道的写端，读者读完剩余的数据后读到 0，vfs_poll 报告 hup
+ *
+ *\param pipe     管道节点
+ *\return 0 成功，-1 失败
+ */
+int vfs_pipe_shutdown(vfs_node_t pipe);
+/**
+ *\brief 把管道中的数据直接从缓冲区写入文件，不经过调用者的缓冲区
+ *
+ *\param pipe     管道节点
+ *\param file     文件节点
+ *\param offset   文件中的偏移
+ *\param size     最多移动的字节数
+ *\return 移动的字节数，写端关闭且为空时返回 0，-1 失败
+ */
+ssize_t vfs_splice(vfs_node_t pipe, vfs_node_t file, u64 offset, size_t size);
+
+/**
+ *\brief 对文件的一段加锁 (类似 fcntl 的 F_SETLK / F_SETLKW)
+ *
+ * 锁属于调用的线程，同一线程对重叠范围再次加锁时替换原来的锁 (可以升级或
+ * 降级)，线程退出前需要释放自己的锁
+ * 锁只是建议性的，vfs_read / vfs_write 不检查
+ * 等待的请求按到达顺序授予，与更早的请求冲突的新请求也要等待
+ *
+ *\param node     文件节点
+ *\param offset   起始偏移
+ *\param len      长度，为 0 时到文件末尾 (包括以后扩展的部分)
+ *\param type     vfs_lock_shared 或 vfs_lock_exclusive
+ *\param wait     冲突时是否等待，否则直接失败
+ *\return 0 成功，-1 失败 (冲突且不等待，或者等待会导致死锁)
+ */
+int vfs_lock(vfs_node_t node, u64 offset, u64 len, int type, bool wait);
+/**
+ *\brief 释放调用的线程在文件的一段上的锁，部分重叠的锁被切开
+ *
+ *\param node     文件节点
+ *\param offset   起始偏移
+ *\param len      长度，为 0 时到文件末尾
+ *\return 0 成功，-1 失败
+ */
+int vfs_unlock(vfs_node_t node, u64 offset, u64 len);
+
+/**
+ *\brief 开启或关闭统计，默认开启
+ *
+ * 以 VFS_STATS=0 编译时统计的代码完全不存在，这时总是返回 false
+ *
+ *\param enable   是否开启
+ *\return 之前是否开启
+ */
+bool vfs_stats_enable(bool enable);
+/**
+ *\brief 设置计时的抽样率
+ *
+ * 每个线程平均每 2^shift 次操作读取一次时钟，次数、错误和字节数不受影响
+ *
+ *\param shift    0 到 16，0 表示每次都计时，默认为 6
+ *\return 0 成功，-1 失败
+ */
+int vfs_stats_sample(int shift);
+/**
+ *\brief 读取统计
+ *
+ *\param node     为 null 时读取全局的统计，否则读取节点所在挂载的统计
+ *\param stats    读取到的统计
+ *\return 0 成功，-1 失败
+ */
+int vfs_stats_read(vfs_node_t node, vfs_stats_t *stats);
+/**
+ *\brief 清零所有统计，与并发的操作同时调用时可能留下少量计数
+ */
+void vfs_stats_reset();
+/**
+ *\brief 获取直方图的桶的下界
+ *
+ *\param i        桶的序号，0 到 VFS_STATS_BUCKETS
+ *\return 耗时 (ns)
+ */
+u64 vfs_stats_bucket(int i);
+/**
+ *\brief 由直方图估计耗时的分位数
+ *
+ *\param op       操作的统计
+ *\param p        0 到 1，例如 0.99
+ *\return 分位数所在的桶的上界 (ns)，没有计时过时返回 0
+ */
+u64 vfs_stats_percentile(const vfs_op_stats_t *op, double p);
+/**
+ *\brief 获取操作的名称
+ *
+ *\param op       vfs_op_*
+ *\return 名称，例如 "read"
+ */
+cstr vfs_stats_name(int op);
+
+/**
+ *\brief 开始把每次操作记录到文件中
+ *
+ * 每个线程的事件先写入它自己的缓冲区，由后台线程定期写入文件，缓冲区满
+ * 时丢弃事件。文件可以由 tools/vfstrace.c 转换为火焰图的折叠栈或按路径
+ * 的耗时表格。以 VFS_TRACE=0 编译时总是返回 -1
+ *
+ *\param path     宿主机上的文件路径
+ *\param size     每个线程的缓冲区大小，为 0 时使用默认的 1 MiB
+ *\return 0 成功，-1 失败 (已经在追踪或无法创建文件)
+ */
+int vfs_trace_start(cstr path, size_t size);
+/**
+ *\brief 停止追踪，写入缓冲区中剩余的事件并关闭文件
+ *
+ *\return 因缓冲区满丢弃的事件数，没有在追踪时返回 -1
+ */
+ssize_t vfs_trace_stop();
+
+enum {
+  vfs_replay_timed = 1,   // 按记录中的时间发出每个调用，否则尽快重放
+  vfs_replay_threads = 2, // 每个记录的线程由一个线程重放，否则都在一个线程中
+  vfs_replay_nomount = 4, // 跳过记录中的挂载，重放到已经挂载的文件系统上
+};
+
+typedef struct vfs_replay_result {
+  u64 ops;        // 重放的调用数
+  u64 mismatches; // 成功与否与记录不同的调用数
+  u64 elapsed;    // 重放的耗时 (ns)
+  u64 recorded;   // 记录中第一个调用开始到最后一个调用结束的时间 (ns)
+} vfs_replay_result_t;
+
+/**
+ *\brief 开始记录 vfs_open、vfs_close、vfs_read、vfs_write、vfs_mkdir、
+ *       vfs_mkfile 和 vfs_mount 的调用
+ *
+ * 只记录最外层的调用以及它们的参数、返回值和时间，不记录读写的数据。
+ * 以 VFS_RECORD=0 编译时总是返回 -1
+ *
+ *\return 0 成功，-1 失败 (已经在记录)
+ */
+int vfs_record_start();
+/**
+ *\brief 停止记录
+ *
+ *\param out      写入记录的流，为 null 时丢弃记录
+ *\return 0 成功，-1 失败
+ */
+int vfs_record_stop(mostream_t out);
+/**
+ *\brief 重放记录
+ *
+ * 多线程重放时保留调用之间的依赖：使用节点的调用在打开它的调用和之前对它
+ * 的写入或关闭之后，按路径的调用在创建路径或上级文件夹的调用之后，挂载在之前的
+ * 所有调用之后。目录树不能同时修改，所以读写以外的调用依次进行。
+ * 开始记录前就已经打开的节点在重放时按路径打开，需要事先存在
+ *
+ *\param in       vfs_record_stop 写入的记录
+ *\param flags    vfs_replay_* 的组合
+ *\param result   重放的结果，可以为 null
+ *\return 0 成功，-1 失败 (记录无效)
+ */
+int vfs_replay(mistream_t in, int flags, vfs_replay_result_t *result);
+
+enum {
+  vfs_mem_nodes,  // struct vfs_node
+  vfs_mem_infos,  // struct vfs_node_info
+  vfs_mem_names,  // 节点的名称
+  vfs_mem_links,  // 父文件夹的子节点链表中的单元
+  vfs_mem_caches, // 扩展属性的缓存，包括属性的名称和值
+  vfs_mem_count,
+};
+
+typedef struct vfs_mem_stats {
+  u64 bytes[vfs_mem_count];   // 请求分配的字节数，不包括 malloc 自身的开销
+  u64 objects[vfs_mem_count]; // 对象数
+} vfs_mem_stats_t;
+
+typedef struct vfs_mem_usage {
+  vfs_node_t node; // 子树的根目录
+  u64 bytes;       // 子树中的节点、信息、名称和链表单元的字节数
+  u64 nodes;       // 子树中的节点数
+} vfs_mem_usage_t;
+
+/**
+ *\brief 读取 vfs 自身占用的内存
+ *
+ * 节点、信息、名称、链表单元和缓存在分配时记入所在的挂载，释放时从同一个
+ * 挂载中减去；驱动的句柄和文件数据不在其中。挂载使用统计的编号，以
+ * VFS_STATS=0 编译时都记入全局。以 VFS_MEM=0 编译时总是返回 -1
+ *
+ *\param node     为 null 时读取全局的统计，否则读取节点所在挂载的统计
+ *\param stats    读取到的统计
+ *\return 0 成功，-1 失败
+ */
+int vfs_mem_read(vfs_node_t node, vfs_mem_stats_t *stats);
+/**
+ *\brief 找出占用内存最多的子树
+ *
+ * 遍历 node 下的整个树，不能与修改树的操作同时进行。按子树的字节数从大到
+ * 小返回前 n 个文件夹，所以祖先总是排在子孙之前。绑定挂载的别名只算节点
+ * 本身，硬链接共享的信息按引用数平分，缓存不计入
+ *
+ *\param node     遍历的起点，为 null 时从根目录开始
+ *\param top      结果
+ *\param n        top 的容量
+ *\return 写入 top 的项数
+ */
+size_t vfs_mem_top(vfs_node_t node, vfs_mem_usage_t *top, size_t n);
+/**
+ *\brief 获取内存分类的名称
+ *
+ *\param category vfs_mem_*
+ *\return 名称，例如 "names"
+ */
+cstr vfs_mem_name(int category);
+
 /**
  *\brief 挂载文件系统
  *
@@ -227,13 +941,26 @@ ssize_t vfs_write(vfs_node_t file, const void *addr, size_t offset, size_t size)
  */
 int vfs_mount(cstr src, vfs_node_t node);
 /**
- *\brief 卸载文件系统
+ *\brief 卸载文件系统或解除绑定挂载
  *
  *\param path     文件路径
  *\return 0 成功，-1 失败
  */
 int vfs_unmount(cstr path);
 
+/**
+ *\brief 绑定挂载
+ *
+ * 挂载点与源文件夹共享同一份文件信息和子节点列表，在任意一个别名中创建的
+ * 文件对其它别名立即可见，创建的代价与别名的数量无关
+ * 通过别名打开的子节点的 parent 仍是它被创建时所在的节点
+ *
+ *\param src      源文件夹路径
+ *\param path     挂载点路径
+ *\return 0 成功，-1 失败
+ */
+int vfs_bind(cstr src, cstr path);
+
 /**
  *\brief 关闭文件
  *
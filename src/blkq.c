@@ -0,0 +1,460 @@
+// This code is released under the MIT License
+
+// 系统头文件需要在 vfs.h 之前引入，否则会与 val / var 宏冲突
+#include <pthread.h>
+
+#define RBTREE_IMPLEMENTATION
+#include <block.h>
+
+#define BLKQ_DEFAULT_MAX_SECTORS 256
+#define BLKQ_MAX_KEY             ((u64)INT32_MAX) // 红黑树的键为 int32
+
+// 一次提交对应一个段，合并后的请求包含多个按扇区顺序排列的段
+typedef struct bio_seg {
+  void *addr;
+  size_t count;
+  bio_done_t done;
+  void *data;
+} bio_seg_t;
+
+typedef struct bio *bio_t;
+struct bio {
+  bool write;       // 是否为写请求
+  u64 lba;          // 起始扇区
+  size_t count;     // 扇区数量
+  u64 deadline;     // 期限 (逻辑时间)
+  bio_seg_t *segs;  // 段
+  size_t nsegs;     // 段数量
+  size_t capsegs;   // 段数组的容量
+  bio_t alias;      // 起始扇区相同的请求，按提交顺序排列
+  bio_t prev, next; // FIFO 链表
+};
+
+struct blkq {
+  blkdev_t dev;
+  spin_t lock;
+  rbtree_t sorted;         // 以起始扇区为键
+  bio_t head[2], tail[2];  // 按提交顺序排列，[0] 为读 [1] 为写
+  u32 expire[2];           // 期限
+  u32 max_sectors;         // 合并后单个请求的最大扇区数
+  u32 plugged;             // plug 深度
+  u64 now;                 // 逻辑时间，每分发一个请求加一
+  u64 pos;                 // 上次分发的请求结束的扇区
+  size_t pending;          // 等待分发的请求数
+  u64 submitted, merged, dispatched, expired;
+  pthread_mutex_t wait_lock; // 每完成一个请求广播 wait_cond，唤醒 blkq_wait
+  pthread_cond_t wait_cond;
+};
+
+static void sort_insert(blkq_t q, bio_t b) {
+  b->alias = null;
+  rbtree_t node = rbtree_get_node(q->sorted, b->lba);
+  if (node == null) {
+    rbtree_insert(q->sorted, b->lba, b);
+    return;
+  }
+  bio_t p = node->value;
+  while (p->alias)
+    p = p->alias;
+  p->alias = b;
+}
+
+static void sort_remove(blkq_t q, bio_t b) {
+  rbtree_t node = rbtree_get_node(q->sorted, b->lba);
+  if (node->value == b) {
+    if (b->alias)
+      node->value = b->alias;
+    else
+      rbtree_delete(q->sorted, b->lba);
+  } else {
+    bio_t p = node->value;
+    while (p->alias != b)
+      p = p->alias;
+    p->alias = b->alias;
+  }
+  b->alias = null;
+}
+
+static void fifo_push(blkq_t q, bio_t b) {
+  int d = b->write;
+  b->next = null;
+  b->prev = q->tail[d];
+  if (q->tail[d])
+    q->tail[d]->next = b;
+  else
+    q->head[d] = b;
+  q->tail[d] = b;
+}
+
+static void fifo_remove(blkq_t q, bio_t b) {
+  int d = b->write;
+  if (b->prev)
+    b->prev->next = b->next;
+  else
+    q->head[d] = b->next;
+  if (b->next)
+    b->next->prev = b->prev;
+  else
+    q->tail[d] = b->prev;
+  b->prev = b->next = null;
+}
+
+// b (已从 FIFO 中移除) 取代 old 在 FIFO 中的位置
+static void fifo_replace(blkq_t q, bio_t old, bio_t b) {
+  int d = old->write;
+  b->prev = old->prev;
+  b->next = old->next;
+  if (b->prev)
+    b->prev->next = b;
+  else
+    q->head[d] = b;
+  if (b->next)
+    b->next->prev = b;
+  else
+    q->tail[d] = b;
+  old->prev = old->next = null;
+}
+
+static bool seg_reserve(bio_t b, size_t n) {
+  if (b->nsegs + n <= b->capsegs)
+    return true;
+  size_t cap = b->capsegs ? b->capsegs * 2 : 4;
+  while (cap < b->nsegs + n)
+    cap *= 2;
+  bio_seg_t *segs = realloc(b->segs, cap * sizeof(*segs));
+  if (segs == null)
+    return false;
+  b->segs = segs;
+  b->capsegs = cap;
+  return true;
+}
+
+static bool seg_add(bio_t b, bool front, void *addr, size_t count,
+                    bio_done_t done, void *data) {
+  if (!seg_reserve(b, 1))
+    return false;
+  if (front) {
+    memmove(b->segs + 1, b->segs, b->nsegs * sizeof(*b->segs));
+    b->segs[0] = (bio_seg_t){addr, count, done, data};
+  } else {
+    b->segs[b->nsegs] = (bio_seg_t){addr, count, done, data};
+  }
+  b->nsegs++;
+  return true;
+}
+
+static void bio_free(bio_t b) {
+  free(b->segs);
+  free(b);
+}
+
+finline bool mergeable(blkq_t q, bio_t b, bool write, size_t count) {
+  return b->write == write && b->count + count <= q->max_sectors;
+}
+
+// 查找起始于 lba 且可以合并的请求
+static bio_t find_start(blkq_t q, u64 lba, bool write, size_t count) {
+  if (lba > BLKQ_MAX_KEY)
+    return null;
+  rbtree_t node = rbtree_get_node(q->sorted, lba);
+  for (bio_t b = node ? node->value : null; b; b = b->alias) {
+    if (mergeable(q, b, write, count))
+      return b;
+  }
+  return null;
+}
+
+// 查找结束于 lba 且可以合并的请求
+static bio_t find_end(blkq_t q, u64 lba, bool write, size_t count) {
+  if (lba == 0)
+    return null;
+  rbtree_t node = rbtree_floor(q->sorted, lba - 1);
+  for (bio_t b = node ? node->value : null; b; b = b->alias) {
+    if (b->lba + b->count == lba && mergeable(q, b, write, count))
+      return b;
+  }
+  return null;
+}
+
+// 将紧跟在 b 之后的 n 并入 b
+static void bio_absorb(blkq_t q, bio_t b, bio_t n) {
+  if (!seg_reserve(b, n->nsegs))
+    return;
+  memcpy(b->segs + b->nsegs, n->segs, n->nsegs * sizeof(*n->segs));
+  b->nsegs += n->nsegs;
+  b->count += n->count;
+  sort_remove(q, n);
+  // 合并后的请求继承较早的期限，并占据较早的 FIFO 位置
+  if (n->deadline < b->deadline) {
+    fifo_remove(q, b);
+    fifo_replace(q, n, b);
+    b->deadline = n->deadline;
+  } else {
+    fifo_remove(q, n);
+  }
+  bio_free(n);
+  q->pending--;
+  q->merged++;
+}
+
+static ssize_t dev_rw(blkdev_t dev, bool write, void *addr, u64 lba,
+                      size_t count) {
+  if (write) {
+    dev->writes++;
+    return dev->write(dev->data, addr, lba, count);
+  }
+  dev->reads++;
+  return dev->read(dev->data, addr, lba, count);
+}
+
+static void bio_exec(blkq_t q, bio_t b) {
+  blkdev_t dev = q->dev;
+  size_t ss = dev->sector_size;
+
+  bool contiguous = true;
+  for (size_t i = 1; i < b->nsegs; i++) {
+    bio_seg_t *prev = &b->segs[i - 1];
+    if (b->segs[i].addr != prev->addr + prev->count * ss)
+      contiguous = false;
+  }
+
+  ssize_t n;
+  if (contiguous) {
+    n = dev_rw(dev, b->write, b->segs[0].addr, b->lba, b->count);
+  } else {
+    byte *bounce = malloc(b->count * ss);
+    if (bounce == null) { // 无法合并就逐段执行
+      u64 lba = b->lba;
+      for (size_t i = 0; i < b->nsegs; lba += b->segs[i++].count) {
+        bio_seg_t *seg = &b->segs[i];
+        ssize_t r = dev_rw(dev, b->write, seg->addr, lba, seg->count);
+        if (seg->done)
+          seg->done(seg->data, r == (ssize_t)seg->count ? r * ss : -1);
+      }
+      return;
+    }
+    size_t off = 0;
+    if (b->write) {
+      for (size_t i = 0; i < b->nsegs; off += b->segs[i++].count * ss)
+        memcpy(bounce + off, b->segs[i].addr, b->segs[i].count * ss);
+    }
+    n = dev_rw(dev, b->write, bounce, b->lba, b->count);
+    if (!b->write && n > 0) {
+      size_t total = n * ss;
+      for (size_t i = 0; i < b->nsegs && off < total;
+           off += b->segs[i++].count * ss) {
+        size_t size = min(b->segs[i].count * ss, total - off);
+        memcpy(b->segs[i].addr, bounce + off, size);
+      }
+    }
+    free(bounce);
+  }
+
+  // 部分完成时，完全落在已完成范围内的段算作成功
+  size_t done = 0;
+  for (size_t i = 0; i < b->nsegs; i++) {
+    bio_seg_t *seg = &b->segs[i];
+    done += seg->count;
+    if (seg->done)
+      seg->done(seg->data, n >= (ssize_t)done ? seg->count * ss : -1);
+  }
+}
+
+// 取出下一个要分发的请求：先看读写两个 FIFO 的队首是否超过期限，
+// 否则从上次结束的位置继续向高扇区扫描，到头后回到最低的扇区
+static bio_t bio_take(blkq_t q) {
+  bio_t b = null;
+  for (int d = 0; d < 2 && b == null; d++) {
+    if (q->head[d] && q->head[d]->deadline <= q->now) {
+      b = q->head[d];
+      q->expired++;
+    }
+  }
+  if (b == null) {
+    if (q->sorted == null)
+      return null;
+    rbtree_t node = rbtree_ceil(q->sorted, min(q->pos, BLKQ_MAX_KEY));
+    if (node == null)
+      node = rbtree_min(q->sorted);
+    b = node->value;
+  }
+  sort_remove(q, b);
+  fifo_remove(q, b);
+  q->pending--;
+  q->now++;
+  q->pos = b->lba + b->count;
+  q->dispatched++;
+  return b;
+}
+
+// 在完成回调设置标志之后调用，加锁保证 blkq_wait 检查标志与睡眠之间不会错过
+static void blkq_wake(blkq_t q) {
+  pthread_mutex_lock(&q->wait_lock);
+  pthread_cond_broadcast(&q->wait_cond);
+  pthread_mutex_unlock(&q->wait_lock);
+}
+
+blkq_t blkq_alloc(blkdev_t dev, u32 read_expire, u32 write_expire,
+                  u32 max_sectors) {
+  if (dev == null || dev->queue != null)
+    return null;
+  blkq_t q = malloc(sizeof(*q));
+  if (q == null)
+    return null;
+  memset(q, 0, sizeof(*q));
+  q->dev = dev;
+  q->lock = SPIN_INIT;
+  q->expire[0] = read_expire;
+  q->expire[1] = write_expire;
+  q->max_sectors = max_sectors ? max_sectors : BLKQ_DEFAULT_MAX_SECTORS;
+  pthread_mutex_init(&q->wait_lock, null);
+  pthread_cond_init(&q->wait_cond, null);
+  dev->queue = q;
+  return q;
+}
+
+void blkq_free(blkq_t q) {
+  if (q == null)
+    return;
+  blkq_run(q);
+  q->dev->queue = null;
+  pthread_cond_destroy(&q->wait_cond);
+  pthread_mutex_destroy(&q->wait_lock);
+  free(q);
+}
+
+int blkq_submit(blkq_t q, bool write, void *addr, u64 lba, size_t count,
+                bio_done_t done, void *data) {
+  blkdev_t dev = q->dev;
+  if (count == 0 || lba >= dev->sectors || count > dev->sectors - lba)
+    return -1;
+  if (write && dev->write == null)
+    return -1;
+
+  if (lba + count > BLKQ_MAX_KEY) { // 超出红黑树键的范围，直接分发
+    bio_seg_t seg = {addr, count, done, data};
+    struct bio b = {.write = write, .lba = lba, .count = count, .segs = &seg,
+                    .nsegs = 1};
+    spin_lock(q->lock);
+    q->submitted++;
+    q->dispatched++;
+    spin_unlock(q->lock);
+    bio_exec(q, &b);
+    blkq_wake(q);
+    return 0;
+  }
+
+  spin_lock(q->lock);
+  q->submitted++;
+  bio_t b;
+  if ((b = find_end(q, lba, write, count)) &&
+      seg_add(b, false, addr, count, done, data)) {
+    // 后向合并，合并后可能正好与下一个请求相接
+    b->count += count;
+    q->merged++;
+    bio_t n = find_start(q, b->lba + b->count, write, b->count);
+    if (n)
+      bio_absorb(q, b, n);
+  } else if ((b = find_start(q, lba + count, write, count)) &&
+             seg_add(b, true, addr, count, done, data)) {
+    // 前向合并，起始扇区改变，需要重新插入
+    sort_remove(q, b);
+    b->lba = lba;
+    b->count += count;
+    sort_insert(q, b);
+    q->merged++;
+  } else {
+    b = malloc(sizeof(*b));
+    if (b == null) {
+      spin_unlock(q->lock);
+      return -1;
+    }
+    memset(b, 0, sizeof(*b));
+    b->write = write;
+    b->lba = lba;
+    b->count = count;
+    b->deadline = q->now + q->expire[write];
+    if (!seg_add(b, false, addr, count, done, data)) {
+      spin_unlock(q->lock);
+      free(b);
+      return -1;
+    }
+    sort_insert(q, b);
+    fifo_push(q, b);
+    q->pending++;
+  }
+  bool run = q->plugged == 0;
+  spin_unlock(q->lock);
+
+  if (run)
+    blkq_run(q);
+  return 0;
+}
+
+void blkq_plug(blkq_t q) {
+  spin_lock(q->lock);
+  q->plugged++;
+  spin_unlock(q->lock);
+}
+
+void blkq_unplug(blkq_t q) {
+  spin_lock(q->lock);
+  bool run = q->plugged && --q->plugged == 0;
+  spin_unlock(q->lock);
+  if (run)
+    blkq_run(q);
+}
+
+size_t blkq_run(blkq_t q) {
+  size_t n = 0;
+  while (true) {
+    spin_lock(q->lock);
+    bio_t b = bio_take(q);
+    spin_unlock(q->lock);
+    if (b == null)
+      break;
+    bio_exec(q, b);
+    bio_free(b);
+    blkq_wake(q);
+    n++;
+  }
+  return n;
+}
+
+struct blkq_wait {
+  bool done;
+  ssize_t result;
+};
+
+static void blkq_wait_done(void *data, ssize_t result) {
+  struct blkq_wait *w = data;
+  w->result = result;
+  atom_store(&w->done, true);
+}
+
+void blkq_wait(blkq_t q, bool *done) {
+  pthread_mutex_lock(&q->wait_lock);
+  while (!atom_load(done))
+    pthread_cond_wait(&q->wait_cond, &q->wait_lock);
+  pthread_mutex_unlock(&q->wait_lock);
+}
+
+ssize_t blkq_rw(blkq_t q, bool write, void *addr, u64 lba, size_t count) {
+  struct blkq_wait w = {.done = false};
+  if (blkq_submit(q, write, addr, lba, count, blkq_wait_done, &w) < 0)
+    return -1;
+  // 未 plug 时 blkq_submit 已经分发，请求仍未完成说明正由其它线程执行，
+  // 被 plug 时请求留在队列中，由最外层的 unplug 分发
+  blkq_wait(q, &w.done);
+  return w.result < 0 ? -1 : w.result / q->dev->sector_size;
+}
+
+void blkq_stat(blkq_t q, struct blkq_stat *stat) {
+  spin_lock(q->lock);
+  stat->submitted = q->submitted;
+  stat->merged = q->merged;
+  stat->dispatched = q->dispatched;
+  stat->expired = q->expired;
+  stat->pending = q->pending;
+  spin_unlock(q->lock);
+}
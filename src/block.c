@@ -0,0 +1,497 @@
+// This code is released under the MIT License
+
+#include <block.h>
+
+#define BCACHE_DEFAULT_BUFS 1024
+
+static spin_t bcache_lock = SPIN_INIT;
+static size_t bcache_max = 0;   // 最多缓存的块数量
+static size_t bcache_count = 0; // 已分配的块数量
+static size_t bcache_mask = 0;  // 哈希表大小 - 1
+static buf_t *bcache_table = null;
+static buf_t lru_head = null, lru_tail = null;
+static u64 bcache_hits = 0, bcache_misses = 0, bcache_evictions = 0;
+
+static list_t blkdevs = null;
+static u32 blkdev_nextid = 1;
+
+finline size_t bhash(blkdev_t dev, u64 blockno) {
+  u64 h = ((u64)dev->id << 48) ^ blockno;
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdull;
+  h ^= h >> 33;
+  return h & bcache_mask;
+}
+
+finline void lru_remove(buf_t b) {
+  if (b->prev)
+    b->prev->next = b->next;
+  else
+    lru_head = b->next;
+  if (b->next)
+    b->next->prev = b->prev;
+  else
+    lru_tail = b->prev;
+  b->prev = b->next = null;
+}
+
+finline void lru_push_head(buf_t b) {
+  b->prev = null;
+  b->next = lru_head;
+  if (lru_head)
+    lru_head->prev = b;
+  lru_head = b;
+  if (lru_tail == null)
+    lru_tail = b;
+}
+
+static void hash_remove(buf_t b) {
+  if (b->dev == null)
+    return;
+  for (buf_t *p = &bcache_table[bhash(b->dev, b->blockno)]; *p;
+       p = &(*p)->hnext) {
+    if (*p == b) {
+      *p = b->hnext;
+      break;
+    }
+  }
+  b->hnext = null;
+}
+
+finline void hash_insert(buf_t b) {
+  size_t idx = bhash(b->dev, b->blockno);
+  b->hnext = bcache_table[idx];
+  bcache_table[idx] = b;
+}
+
+// 调用者持有 bcache_lock
+static int bcache_setup(size_t nbufs) {
+  if (bcache_table != null || nbufs == 0)
+    return -1;
+  size_t size = 16;
+  while (size < nbufs)
+    size *= 2;
+  bcache_table = calloc(size, sizeof(buf_t));
+  if (bcache_table == null)
+    return -1;
+  bcache_mask = size - 1;
+  bcache_max = nbufs;
+  return 0;
+}
+
+int bcache_init(size_t nbufs) {
+  spin_lock(bcache_lock);
+  int ret = bcache_setup(nbufs);
+  spin_unlock(bcache_lock);
+  return ret;
+}
+
+blkdev_t blkdev_regist(cstr name, u32 sector_size, u64 sectors,
+                       blkdev_read_t read, blkdev_write_t write, void *data) {
+  if (name == null || read == null || sector_size == 0)
+    return null;
+  if (blkdev_get(name) != null)
+    return null;
+  blkdev_t dev = malloc(sizeof(*dev));
+  if (dev == null)
+    return null;
+  memset(dev, 0, sizeof(*dev));
+  dev->name = strdup(name);
+  dev->id = blkdev_nextid++;
+  dev->sector_size = sector_size;
+  dev->sectors = sectors;
+  dev->block_size = sector_size;
+  dev->read = read;
+  dev->write = write;
+  dev->data = data;
+  spin_lock(bcache_lock);
+  list_prepend(blkdevs, dev);
+  spin_unlock(bcache_lock);
+  return dev;
+}
+
+blkdev_t blkdev_get(cstr name) {
+  spin_lock(bcache_lock);
+  blkdev_t dev =
+      list_first(blkdevs, data, streq(name, ((blkdev_t)data)->name));
+  spin_unlock(bcache_lock);
+  return dev;
+}
+
+static bool blkdev_has_bufs(blkdev_t dev) {
+  for (buf_t b = lru_head; b; b = b->next) {
+    if (b->dev == dev)
+      return true;
+  }
+  return false;
+}
+
+int blkdev_set_block_size(blkdev_t dev, u32 block_size) {
+  if (dev == null || block_size == 0 || block_size % dev->sector_size != 0)
+    return -1;
+  spin_lock(bcache_lock);
+  bool used = blkdev_has_bufs(dev);
+  if (!used)
+    dev->block_size = block_size;
+  spin_unlock(bcache_lock);
+  return used ? -1 : 0;
+}
+
+// 设备有请求队列时经过队列调度，否则直接访问设备
+static ssize_t blkdev_rw(blkdev_t dev, bool write, void *addr, u64 lba,
+                         size_t count) {
+  if (dev->queue)
+    return blkq_rw(dev->queue, write, addr, lba, count);
+  if (write) {
+    dev->writes++;
+    return dev->write(dev->data, addr, lba, count);
+  }
+  dev->reads++;
+  return dev->read(dev->data, addr, lba, count);
+}
+
+finline size_t buf_sectors(buf_t b, u64 *lba) {
+  blkdev_t dev = b->dev;
+  u32 per = dev->block_size / dev->sector_size;
+  *lba = b->blockno * per;
+  return min((u64)per, dev->sectors - *lba);
+}
+
+static int buf_writeback(buf_t b) {
+  if (b->dev->write == null)
+    return -1;
+  u64 lba;
+  size_t count = buf_sectors(b, &lba);
+  if (blkdev_rw(b->dev, true, b->data, lba, count) != (ssize_t)count)
+    return -1;
+  b->dirty = false;
+  return 0;
+}
+
+static int buf_fill(buf_t b) {
+  blkdev_t dev = b->dev;
+  u64 lba;
+  size_t count = buf_sectors(b, &lba);
+  if (count * dev->sector_size < dev->block_size) // 设备末尾不完整的块
+    memset(b->data, 0, dev->block_size);
+  if (blkdev_rw(dev, false, b->data, lba, count) != (ssize_t)count)
+    return -1;
+  b->valid = true;
+  return 0;
+}
+
+// 返回一个被引用并独占的缓冲区
+static buf_t bacquire(blkdev_t dev, u64 blockno) {
+  if (dev == null || blockno * (dev->block_size / dev->sector_size) >=
+                         dev->sectors)
+    return null;
+
+  size_t failed = 0; // 写回失败而跳过的缓冲区数量
+retry:
+  spin_lock(bcache_lock);
+  // 没有调用 bcache_init 时在第一次使用时以默认大小初始化
+  if (bcache_table == null && bcache_setup(BCACHE_DEFAULT_BUFS) < 0) {
+    spin_unlock(bcache_lock);
+    return null;
+  }
+  for (buf_t b = bcache_table[bhash(dev, blockno)]; b; b = b->hnext) {
+    if (b->dev == dev && b->blockno == blockno) {
+      b->refcnt++;
+      bcache_hits++;
+      spin_unlock(bcache_lock);
+      spin_lock(b->busy);
+      return b;
+    }
+  }
+
+  buf_t b = null;
+  if (bcache_count < bcache_max) {
+    b = malloc(sizeof(*b));
+    if (b != null) {
+      memset(b, 0, sizeof(*b));
+      bcache_count++;
+      lru_push_head(b);
+    }
+  }
+  if (b == null) {
+    for (buf_t victim = lru_tail; victim; victim = victim->prev) {
+      if (victim->refcnt == 0) {
+        b = victim;
+        break;
+      }
+    }
+    if (b == null) { // 所有缓冲区都在使用中
+      spin_unlock(bcache_lock);
+      return null;
+    }
+    if (b->dirty) {
+      // 先写回，期间其它线程可能重新引用它，所以写回后重新查找
+      b->refcnt++;
+      spin_unlock(bcache_lock);
+      spin_lock(b->busy);
+      int ret = b->dirty ? buf_writeback(b) : 0;
+      spin_unlock(b->busy);
+      spin_lock(bcache_lock);
+      b->refcnt--;
+      // 写回失败 (I/O 错误或设备不可写) 时保留脏数据，移到 LRU 头部让下一次
+      // 查找选择别的缓冲区；每个缓冲区都失败过一次后放弃
+      if (ret < 0) {
+        lru_remove(b);
+        lru_push_head(b);
+        if (++failed >= bcache_count) {
+          spin_unlock(bcache_lock);
+          return null;
+        }
+      }
+      spin_unlock(bcache_lock);
+      goto retry;
+    }
+    hash_remove(b);
+    bcache_evictions++;
+  }
+
+  bcache_misses++;
+  if (b->size < dev->block_size) {
+    byte *data = realloc(b->data, dev->block_size);
+    if (data == null) {
+      b->dev = null;
+      spin_unlock(bcache_lock);
+      return null;
+    }
+    b->data = data;
+    b->size = dev->block_size;
+  }
+  b->dev = dev;
+  b->blockno = blockno;
+  b->valid = false;
+  b->dirty = false;
+  b->refcnt = 1;
+  hash_insert(b);
+  lru_remove(b);
+  lru_push_head(b);
+  spin_lock(b->busy);
+  spin_unlock(bcache_lock);
+  return b;
+}
+
+buf_t bread(blkdev_t dev, u64 blockno) {
+  buf_t b = bacquire(dev, blockno);
+  if (b == null)
+    return null;
+  if (!b->valid && buf_fill(b) < 0) {
+    brelse(b);
+    return null;
+  }
+  return b;
+}
+
+buf_t bget(blkdev_t dev, u64 blockno) {
+  buf_t b = bacquire(dev, blockno);
+  if (b == null)
+    return null;
+  if (!b->valid) {
+    memset(b->data, 0, dev->block_size);
+    b->valid = true;
+  }
+  return b;
+}
+
+void bdirty(buf_t buf) {
+  buf->dirty = true;
+}
+
+void brelse(buf_t buf) {
+  if (buf == null)
+    return;
+  spin_unlock(buf->busy);
+  spin_lock(bcache_lock);
+  if (--buf->refcnt == 0) {
+    lru_remove(buf);
+    lru_push_head(buf);
+  }
+  spin_unlock(bcache_lock);
+}
+
+static int buf_cmp(const void *a, const void *b) {
+  buf_t x = *(buf_t *)a, y = *(buf_t *)b;
+  if (x->dev != y->dev)
+    return x->dev->id < y->dev->id ? -1 : 1;
+  return x->blockno < y->blockno ? -1 : x->blockno > y->blockno;
+}
+
+struct bsync_req {
+  buf_t buf;
+  bool done;
+};
+
+static void bsync_done(void *data, ssize_t result) {
+  struct bsync_req *req = data;
+  if (result >= 0)
+    req->buf->dirty = false;
+  atom_store(&req->done, true);
+}
+
+// 独占并批量提交同一设备的脏块，返回时所有请求都已完成
+static int bsync_queued(blkq_t q, buf_t *bufs, size_t n) {
+  struct bsync_req *reqs = malloc(n * sizeof(*reqs));
+  if (reqs == null)
+    return -1;
+  blkq_plug(q);
+  for (size_t i = 0; i < n; i++) {
+    buf_t b = bufs[i];
+    reqs[i] = (struct bsync_req){b, true};
+    spin_lock(b->busy);
+    if (!b->dirty)
+      continue;
+    u64 lba;
+    size_t count = buf_sectors(b, &lba);
+    reqs[i].done = false;
+    if (blkq_submit(q, true, b->data, lba, count, bsync_done, &reqs[i]) < 0)
+      reqs[i].done = true;
+  }
+  blkq_unplug(q);
+
+  int ret = 0;
+  for (size_t i = 0; i < n; i++) {
+    blkq_wait(q, &reqs[i].done);
+    if (bufs[i]->dirty)
+      ret = -1;
+  }
+  free(reqs);
+  return ret;
+}
+
+int bsync(blkdev_t dev) {
+  spin_lock(bcache_lock);
+  size_t count = 0;
+  for (buf_t b = lru_head; b; b = b->next) {
+    if (b->dirty && (dev == null || b->dev == dev))
+      count++;
+  }
+  buf_t *dirty = count ? malloc(count * sizeof(buf_t)) : null;
+  if (count && dirty == null) {
+    spin_unlock(bcache_lock);
+    return -1;
+  }
+  size_t n = 0;
+  for (buf_t b = lru_head; b && n < count; b = b->next) {
+    if (b->dirty && (dev == null || b->dev == dev)) {
+      b->refcnt++;
+      dirty[n++] = b;
+    }
+  }
+  spin_unlock(bcache_lock);
+
+  // 按块号顺序写回，对磁盘更友好
+  if (n > 1)
+    qsort(dirty, n, sizeof(buf_t), buf_cmp);
+  int ret = 0;
+  size_t i = 0;
+  while (i < n) {
+    // 有请求队列的设备批量提交，相邻的块会合并成一个请求
+    size_t end = i + 1;
+    blkq_t q = dirty[i]->dev->queue;
+    if (q != null) {
+      while (end < n && dirty[end]->dev == dirty[i]->dev)
+        end++;
+      if (bsync_queued(q, dirty + i, end - i) < 0)
+        ret = -1;
+    } else {
+      spin_lock(dirty[i]->busy);
+      if (dirty[i]->dirty && buf_writeback(dirty[i]) < 0)
+        ret = -1;
+    }
+    for (; i < end; i++)
+      brelse(dirty[i]);
+  }
+  free(dirty);
+  return ret;
+}
+
+int blkdev_unregist(blkdev_t dev) {
+  if (dev == null)
+    return -1;
+  if (bsync(dev) < 0)
+    return -1;
+  spin_lock(bcache_lock);
+  for (buf_t b = lru_head; b; b = b->next) {
+    if (b->dev == dev && b->refcnt != 0) {
+      spin_unlock(bcache_lock);
+      return -1;
+    }
+  }
+  for (buf_t b = lru_head, next; b; b = next) {
+    next = b->next;
+    if (b->dev != dev)
+      continue;
+    hash_remove(b);
+    lru_remove(b);
+    free(b->data);
+    free(b);
+    bcache_count--;
+  }
+  list_delete(blkdevs, dev);
+  spin_unlock(bcache_lock);
+  free(dev->name);
+  free(dev);
+  return 0;
+}
+
+ssize_t blkdev_read(blkdev_t dev, void *addr, u64 offset, size_t size) {
+  u64 end = dev->sectors * dev->sector_size;
+  if (offset >= end)
+    return 0;
+  size = min((u64)size, end - offset);
+  size_t done = 0;
+  while (done < size) {
+    u64 blockno = (offset + done) / dev->block_size;
+    size_t inblk = (offset + done) % dev->block_size;
+    size_t n = min(dev->block_size - inblk, size - done);
+    buf_t b = bread(dev, blockno);
+    if (b == null)
+      return done ? (ssize_t)done : -1;
+    memcpy(addr + done, b->data + inblk, n);
+    brelse(b);
+    done += n;
+  }
+  return done;
+}
+
+ssize_t blkdev_write(blkdev_t dev, const void *addr, u64 offset, size_t size) {
+  if (dev->write == null)
+    return -1;
+  u64 end = dev->sectors * dev->sector_size;
+  if (offset >= end)
+    return 0;
+  size = min((u64)size, end - offset);
+  size_t done = 0;
+  while (done < size) {
+    u64 blockno = (offset + done) / dev->block_size;
+    size_t inblk = (offset + done) % dev->block_size;
+    size_t n = min(dev->block_size - inblk, size - done);
+    // 覆盖整块时不需要先读取
+    buf_t b = n == dev->block_size ? bget(dev, blockno) : bread(dev, blockno);
+    if (b == null)
+      return done ? (ssize_t)done : -1;
+    memcpy(b->data + inblk, addr + done, n);
+    bdirty(b);
+    brelse(b);
+    done += n;
+  }
+  return done;
+}
+
+void bcache_stat(struct bcache_stat *stat) {
+  spin_lock(bcache_lock);
+  stat->nbufs = bcache_max;
+  stat->cached = bcache_count;
+  stat->dirty = 0;
+  for (buf_t b = lru_head; b; b = b->next) {
+    if (b->dirty)
+      stat->dirty++;
+  }
+  stat->hits = bcache_hits;
+  stat->misses = bcache_misses;
+  stat->evictions = bcache_evictions;
+  spin_unlock(bcache_lock);
+}
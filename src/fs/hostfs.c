@@ -0,0 +1,632 @@
+// This code is released under the MIT License
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#  define _GNU_SOURCE // fallocate
+#endif
+
+#ifndef HOSTFS_IO_URING
+#  if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#    define HOSTFS_IO_URING 1
+#  else
+#    define HOSTFS_IO_URING 0
+#  endif
+#endif
+
+// 系统头文件需要在 vfs.h 之前引入，否则会与 val / var 宏冲突
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h> // renameat
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#ifdef __linux__
+#  include <linux/falloc.h>
+#  include <sys/xattr.h>
+#endif
+#if HOSTFS_IO_URING
+#  include <linux/io_uring.h>
+#  include <sys/mman.h>
+#  include <sys/syscall.h>
+#endif
+
+#include <fs/hostfs.h>
+
+typedef struct hostfs_file {
+  int fd;      // 目录使用 O_DIRECTORY 打开，作为子节点 openat 的基准
+  bool is_dir; // 是否是目录
+  bool rdonly; // 只能以只读方式打开
+} *hostfs_file_t;
+
+static int hostfs_id = -1;
+
+static hostfs_file_t hostfs_file_alloc(int fd, bool is_dir, bool rdonly) {
+  hostfs_file_t file = malloc(sizeof(*file));
+  if (file == null)
+    return null;
+  file->fd = fd;
+  file->is_dir = is_dir;
+  file->rdonly = rdonly;
+  return file;
+}
+
+static u16 hostfs_type(mode_t mode) {
+  if (S_ISDIR(mode))
+    return file_dir;
+  if (S_ISREG(mode) || S_ISBLK(mode))
+    return file_block;
+  return file_stream;
+}
+
+static void hostfs_fill(vfs_node_t node, const struct stat *st) {
+  node->info->type = hostfs_type(st->st_mode);
+  node->info->size = S_ISDIR(st->st_mode) ? 0 : st->st_size;
+  node->info->realsize = (u64)st->st_blocks * 512;
+  node->info->createtime = st->st_ctim.tv_sec;
+  node->info->readtime = st->st_atim.tv_sec;
+  node->info->writetime = st->st_mtim.tv_sec;
+  node->info->owner = st->st_uid;
+  node->info->group = st->st_gid;
+  node->info->permissions = st->st_mode & 07777;
+  node->info->nlink = st->st_nlink;
+}
+
+// 将宿主机目录中的项目加入 vfs 节点 (只创建节点，不打开)
+static void hostfs_scan(hostfs_file_t dir, vfs_node_t node) {
+  int fd = dup(dir->fd);
+  if (fd < 0)
+    return;
+  DIR *d = fdopendir(fd);
+  if (d == null) {
+    close(fd);
+    return;
+  }
+  bool fresh = node->info->child == null;
+  for (struct dirent *ent; (ent = readdir(d)) != null;) {
+    if (streq(ent->d_name, ".") || streq(ent->d_name, ".."))
+      continue;
+    bool exists = false;
+    // 初次打开时子节点列表为空，readdir 不会返回重名项目，无需逐个查重
+    if (!fresh) {
+      list_foreach(node->info->child, data) {
+        if (streq(((vfs_node_t)data->data)->name, ent->d_name)) {
+          exists = true;
+          break;
+        }
+      }
+    }
+    if (!exists)
+      vfs_child_append(node, ent->d_name, null);
+  }
+  closedir(d);
+}
+
+static hostfs_file_t hostfs_openat(int dirfd, cstr name, vfs_node_t node) {
+  struct stat st;
+  if (fstatat(dirfd, name, &st, 0) < 0)
+    return null;
+  int fd;
+  bool rdonly = false;
+  if (S_ISDIR(st.st_mode)) {
+    fd = openat(dirfd, name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  } else {
+    fd = openat(dirfd, name, O_RDWR | O_CLOEXEC);
+    if (fd < 0 && (errno == EACCES || errno == EROFS || errno == EISDIR)) {
+      fd = openat(dirfd, name, O_RDONLY | O_CLOEXEC);
+      rdonly = true;
+    }
+  }
+  if (fd < 0)
+    return null;
+  hostfs_file_t file = hostfs_file_alloc(fd, S_ISDIR(st.st_mode), rdonly);
+  if (file == null) {
+    close(fd);
+    return null;
+  }
+  hostfs_fill(node, &st);
+  return file;
+}
+
+static int hostfs_mount(cstr src, vfs_node_t node) {
+  if (src == null)
+    return -1;
+  int fd = open(src, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (fd < 0)
+    return -1;
+  struct stat st;
+  if (fstat(fd, &st) < 0) {
+    close(fd);
+    return -1;
+  }
+  hostfs_file_t root = hostfs_file_alloc(fd, true, false);
+  if (root == null) {
+    close(fd);
+    return -1;
+  }
+  node->info->handle = root;
+  hostfs_fill(node, &st);
+  hostfs_scan(root, node);
+  return 0;
+}
+
+static void hostfs_unmount(void *root) {
+  hostfs_file_t file = root;
+  if (file == null)
+    return;
+  close(file->fd);
+  free(file);
+}
+
+static void hostfs_open(void *parent, cstr name, vfs_node_t node) {
+  hostfs_file_t dir = parent;
+  if (dir == null || !dir->is_dir)
+    return;
+  hostfs_file_t file = hostfs_openat(dir->fd, name, node);
+  if (file == null)
+    return;
+  node->info->handle = file;
+  if (file->is_dir)
+    hostfs_scan(file, node);
+}
+
+static void hostfs_close(void *current) {
+  hostfs_file_t file = current;
+  close(file->fd);
+  free(file);
+}
+
+static ssize_t hostfs_read(void *file, void *addr, size_t offset,
+                           size_t size) {
+  hostfs_file_t f = file;
+  size_t done = 0;
+  while (done < size) {
+    ssize_t n = pread(f->fd, addr + done, size - done, offset + done);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n < 0)
+      return done ? (ssize_t)done : -1;
+    if (n == 0)
+      break;
+    done += n;
+  }
+  return done;
+}
+
+static ssize_t hostfs_write(void *file, const void *addr, size_t offset,
+                            size_t size) {
+  hostfs_file_t f = file;
+  if (f->rdonly)
+    return -1;
+  struct iovec iov = {.iov_base = (void *)addr, .iov_len = size};
+  size_t done = 0;
+  while (iov.iov_len > 0) {
+    ssize_t n = pwritev(f->fd, &iov, 1, offset + done);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return done ? (ssize_t)done : -1;
+    done += n;
+    iov.iov_base += n;
+    iov.iov_len -= n;
+  }
+  return done;
+}
+
+static int hostfs_resize(void *file, u64 size) {
+  hostfs_file_t f = file;
+  if (f->rdonly || f->is_dir)
+    return -1;
+  return ftruncate(f->fd, size) < 0 ? -1 : 0;
+}
+
+static int hostfs_fallocate(void *file, int mode, u64 offset, u64 size) {
+  hostfs_file_t f = file;
+  if (f->rdonly || f->is_dir)
+    return -1;
+#ifdef __linux__
+  int flags = 0;
+  if (mode & vfs_falloc_keep_size)
+    flags |= FALLOC_FL_KEEP_SIZE;
+  if (mode & vfs_falloc_zero_range)
+    flags |= FALLOC_FL_ZERO_RANGE;
+  if (mode & vfs_falloc_punch_hole)
+    flags |= FALLOC_FL_PUNCH_HOLE;
+  while (fallocate(f->fd, flags, offset, size) < 0) {
+    if (errno != EINTR)
+      return -1;
+  }
+  return 0;
+#else
+  // 其它系统只支持预留空间并扩大文件
+  if (mode != 0)
+    return -1;
+  return posix_fallocate(f->fd, offset, size) == 0 ? 0 : -1;
+#endif
+}
+
+static i64 hostfs_seek(void *file, u64 offset, bool hole) {
+  hostfs_file_t f = file;
+  if (f->is_dir)
+    return -1;
+#ifdef SEEK_DATA
+  off_t pos = lseek(f->fd, offset, hole ? SEEK_HOLE : SEEK_DATA);
+  if (pos >= 0 || errno == ENXIO)
+    return pos;
+#endif
+  // 宿主机的文件系统不支持时整个文件都视为数据
+  struct stat st;
+  if (fstat(f->fd, &st) < 0 || offset >= (u64)st.st_size)
+    return -1;
+  return hole ? st.st_size : (i64)offset;
+}
+
+static int hostfs_mkdir(void *parent, cstr name, vfs_node_t node) {
+  hostfs_file_t dir = parent;
+  if (mkdirat(dir->fd, name, 0755) < 0 && errno != EEXIST)
+    return -1;
+  hostfs_file_t file = hostfs_openat(dir->fd, name, node);
+  if (file == null)
+    return -1;
+  node->info->handle = file;
+  return 0;
+}
+
+static int hostfs_mkfile(void *parent, cstr name, vfs_node_t node) {
+  hostfs_file_t dir = parent;
+  int fd = openat(dir->fd, name, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+  if (fd < 0)
+    return -1;
+  struct stat st;
+  hostfs_file_t file = null;
+  if (fstat(fd, &st) < 0 ||
+      (file = hostfs_file_alloc(fd, false, false)) == null) {
+    close(fd);
+    unlinkat(dir->fd, name, 0); // 不要留下创建了一半的文件
+    return -1;
+  }
+  hostfs_fill(node, &st);
+  node->info->handle = file;
+  return 0;
+}
+
+static int hostfs_remove(void *parent, cstr name) {
+  int fd = ((hostfs_file_t)parent)->fd;
+  // 不知道是否为文件夹，先按文件删除
+  if (unlinkat(fd, name, 0) == 0)
+    return 0;
+  if (errno != EISDIR && errno != EPERM)
+    return -1;
+  return unlinkat(fd, name, AT_REMOVEDIR) < 0 ? -1 : 0;
+}
+
+static int hostfs_rename(void *old_parent, cstr old_name, void *new_parent,
+                         cstr new_name) {
+  int from = ((hostfs_file_t)old_parent)->fd;
+  int to = ((hostfs_file_t)new_parent)->fd;
+  return renameat(from, old_name, to, new_name) < 0 ? -1 : 0;
+}
+
+static int hostfs_link(void *old_parent, cstr old_name, void *new_parent,
+                       cstr new_name) {
+  int from = ((hostfs_file_t)old_parent)->fd;
+  int to = ((hostfs_file_t)new_parent)->fd;
+  return linkat(from, old_name, to, new_name, 0) < 0 ? -1 : 0;
+}
+
+#ifdef __linux__
+static ssize_t hostfs_getxattr(void *file, cstr name, void *value,
+                               size_t size) {
+  ssize_t n = fgetxattr(((hostfs_file_t)file)->fd, name, value, size);
+  return n < 0 ? -1 : n;
+}
+
+static int hostfs_setxattr(void *file, cstr name, const void *value,
+                           size_t size) {
+  int fd = ((hostfs_file_t)file)->fd;
+  return fsetxattr(fd, name, value, size, 0) < 0 ? -1 : 0;
+}
+
+static ssize_t hostfs_listxattr(void *file, char *list, size_t size) {
+  ssize_t n = flistxattr(((hostfs_file_t)file)->fd, list, size);
+  return n < 0 ? -1 : n;
+}
+#else
+#  define hostfs_getxattr  null
+#  define hostfs_setxattr  null
+#  define hostfs_listxattr null
+#endif
+
+static int hostfs_stat(void *file, vfs_node_t node) {
+  hostfs_file_t f = file;
+  struct stat st;
+  if (fstat(f->fd, &st) < 0)
+    return -1;
+  hostfs_fill(node, &st);
+  return 0;
+}
+
+static struct vfs_callback hostfs_callbacks = {
+    .mount = hostfs_mount,
+    .unmount = hostfs_unmount,
+    .open = hostfs_open,
+    .close = hostfs_close,
+    .read = hostfs_read,
+    .write = hostfs_write,
+    .mkdir = hostfs_mkdir,
+    .mkfile = hostfs_mkfile,
+    .stat = hostfs_stat,
+    .resize = hostfs_resize,
+    .fallocate = hostfs_fallocate,
+    .seek = hostfs_seek,
+    .remove = hostfs_remove,
+    .rename = hostfs_rename,
+    .link = hostfs_link,
+    .getxattr = hostfs_getxattr,
+    .setxattr = hostfs_setxattr,
+    .listxattr = hostfs_listxattr,
+};
+
+int hostfs_regist() {
+  if (hostfs_id < 0)
+    hostfs_id = vfs_regist("hostfs", &hostfs_callbacks);
+  return hostfs_id;
+}
+
+int hostfs_fd(vfs_node_t node) {
+  if (node == null || node->info->fsid != hostfs_id)
+    return -1;
+  vfs_update(node);
+  hostfs_file_t file = node->info->handle;
+  return file ? file->fd : -1;
+}
+
+// ---------------------------------------------------------------------------
+// 异步 IO
+//
+// 优先使用 io_uring，在不支持的环境下 (内核过旧或被 seccomp 禁止)
+// 退化为提交时同步执行 pread / pwritev，回调语义保持不变
+
+typedef struct hostfs_aio_req {
+  hostfs_done_t done;
+  void *data;
+} *hostfs_aio_req_t;
+
+#if HOSTFS_IO_URING
+
+static struct {
+  int fd;
+  unsigned entries;
+  unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+  unsigned *cq_head, *cq_tail, *cq_mask;
+  struct io_uring_sqe *sqes;
+  struct io_uring_cqe *cqes;
+  void *sq_ptr, *cq_ptr;
+  size_t sq_size, cq_size;
+  unsigned queued;   // 已写入 sq 但尚未 enter 的请求
+  unsigned inflight; // 已提交但尚未完成的请求
+} ring = {.fd = -1};
+
+static int io_uring_setup(unsigned entries, struct io_uring_params *p) {
+  return syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int io_uring_enter(int fd, unsigned to_submit, unsigned min_complete,
+                          unsigned flags) {
+  return syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags,
+                 null, 0);
+}
+
+static int ring_init(unsigned entries) {
+  struct io_uring_params p;
+  memset(&p, 0, sizeof(p));
+  int fd = io_uring_setup(entries, &p);
+  if (fd < 0)
+    return -1;
+  ring.sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+  ring.cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+  if (p.features & IORING_FEAT_SINGLE_MMAP)
+    ring.sq_size = ring.cq_size = max(ring.sq_size, ring.cq_size);
+  ring.sq_ptr = mmap(null, ring.sq_size, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+  if (ring.sq_ptr == MAP_FAILED)
+    goto err;
+  if (p.features & IORING_FEAT_SINGLE_MMAP) {
+    ring.cq_ptr = ring.sq_ptr;
+  } else {
+    ring.cq_ptr = mmap(null, ring.cq_size, PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+    if (ring.cq_ptr == MAP_FAILED)
+      goto err_sq;
+  }
+  ring.sqes = mmap(null, p.sq_entries * sizeof(struct io_uring_sqe),
+                   PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd,
+                   IORING_OFF_SQES);
+  if (ring.sqes == MAP_FAILED)
+    goto err_cq;
+  ring.sq_head = ring.sq_ptr + p.sq_off.head;
+  ring.sq_tail = ring.sq_ptr + p.sq_off.tail;
+  ring.sq_mask = ring.sq_ptr + p.sq_off.ring_mask;
+  ring.sq_array = ring.sq_ptr + p.sq_off.array;
+  ring.cq_head = ring.cq_ptr + p.cq_off.head;
+  ring.cq_tail = ring.cq_ptr + p.cq_off.tail;
+  ring.cq_mask = ring.cq_ptr + p.cq_off.ring_mask;
+  ring.cqes = ring.cq_ptr + p.cq_off.cqes;
+  ring.entries = p.sq_entries;
+  ring.queued = 0;
+  ring.inflight = 0;
+  ring.fd = fd;
+  return 0;
+
+err_cq:
+  if (ring.cq_ptr != ring.sq_ptr)
+    munmap(ring.cq_ptr, ring.cq_size);
+err_sq:
+  munmap(ring.sq_ptr, ring.sq_size);
+err:
+  close(fd);
+  return -1;
+}
+
+static void ring_exit() {
+  if (ring.fd < 0)
+    return;
+  munmap(ring.sqes, ring.entries * sizeof(struct io_uring_sqe));
+  if (ring.cq_ptr != ring.sq_ptr)
+    munmap(ring.cq_ptr, ring.cq_size);
+  munmap(ring.sq_ptr, ring.sq_size);
+  close(ring.fd);
+  ring.fd = -1;
+}
+
+static int ring_reap() {
+  int count = 0;
+  unsigned head = *ring.cq_head;
+  while (head != __atomic_load_n(ring.cq_tail, __ATOMIC_ACQUIRE)) {
+    struct io_uring_cqe *cqe = &ring.cqes[head & *ring.cq_mask];
+    hostfs_aio_req_t req = (hostfs_aio_req_t)(uintptr_t)cqe->user_data;
+    ssize_t res = cqe->res;
+    head++;
+    __atomic_store_n(ring.cq_head, head, __ATOMIC_RELEASE);
+    ring.inflight--;
+    count++;
+    if (req->done)
+      req->done(req->data, res);
+    free(req);
+  }
+  return count;
+}
+
+static int ring_queue(u8 opcode, int fd, void *addr, size_t offset,
+                      size_t size, hostfs_aio_req_t req) {
+  unsigned tail = *ring.sq_tail;
+  if (tail - __atomic_load_n(ring.sq_head, __ATOMIC_ACQUIRE) >=
+          ring.entries ||
+      ring.inflight + ring.queued >= ring.entries) {
+    // sq 或 cq 已满，先提交并回收一部分
+    if (hostfs_aio_submit() < 0 || hostfs_aio_wait(1) < 0)
+      return -1;
+    tail = *ring.sq_tail;
+  }
+  unsigned index = tail & *ring.sq_mask;
+  struct io_uring_sqe *sqe = &ring.sqes[index];
+  memset(sqe, 0, sizeof(*sqe));
+  sqe->opcode = opcode;
+  sqe->fd = fd;
+  sqe->addr = (u64)(uintptr_t)addr;
+  sqe->len = size;
+  sqe->off = offset;
+  sqe->user_data = (u64)(uintptr_t)req;
+  ring.sq_array[index] = index;
+  __atomic_store_n(ring.sq_tail, tail + 1, __ATOMIC_RELEASE);
+  ring.queued++;
+  return 0;
+}
+
+#endif
+
+static int aio_mode = -1; // 0 io_uring, 1 同步
+
+int hostfs_aio_init(unsigned entries) {
+  if (aio_mode >= 0)
+    return aio_mode;
+  if (entries == 0)
+    return -1;
+#if HOSTFS_IO_URING
+  aio_mode = ring_init(entries) == 0 ? 0 : 1;
+#else
+  aio_mode = 1;
+#endif
+  return aio_mode;
+}
+
+void hostfs_aio_exit() {
+  if (aio_mode < 0)
+    return;
+#if HOSTFS_IO_URING
+  if (aio_mode == 0) {
+    hostfs_aio_submit();
+    while (ring.inflight > 0)
+      hostfs_aio_wait(ring.inflight);
+    ring_exit();
+  }
+#endif
+  aio_mode = -1;
+}
+
+static int aio_queue(bool write, vfs_node_t file, void *addr, size_t offset,
+                     size_t size, hostfs_done_t done, void *data) {
+  if (aio_mode < 0)
+    return -1;
+  int fd = hostfs_fd(file);
+  if (fd < 0)
+    return -1;
+  if (aio_mode == 1) {
+    hostfs_file_t f = file->info->handle;
+    ssize_t n = write ? hostfs_write(f, addr, offset, size)
+                      : hostfs_read(f, addr, offset, size);
+    if (done)
+      done(data, n < 0 ? -errno : n);
+    return 0;
+  }
+#if HOSTFS_IO_URING
+  hostfs_aio_req_t req = malloc(sizeof(*req));
+  if (req == null)
+    return -1;
+  req->done = done;
+  req->data = data;
+  if (ring_queue(write ? IORING_OP_WRITE : IORING_OP_READ, fd, addr, offset,
+                 size, req) < 0) {
+    free(req);
+    return -1;
+  }
+#endif
+  return 0;
+}
+
+int hostfs_aio_read(vfs_node_t file, void *addr, size_t offset, size_t size,
+                    hostfs_done_t done, void *data) {
+  return aio_queue(false, file, addr, offset, size, done, data);
+}
+
+int hostfs_aio_write(vfs_node_t file, const void *addr, size_t offset,
+                     size_t size, hostfs_done_t done, void *data) {
+  return aio_queue(true, file, (void *)addr, offset, size, done, data);
+}
+
+int hostfs_aio_submit() {
+  if (aio_mode < 0)
+    return -1;
+#if HOSTFS_IO_URING
+  if (aio_mode == 0 && ring.queued > 0) {
+    int n;
+    do {
+      n = io_uring_enter(ring.fd, ring.queued, 0, 0);
+    } while (n < 0 && errno == EINTR);
+    if (n < 0)
+      return -1;
+    ring.queued -= n;
+    ring.inflight += n;
+    return n;
+  }
+#endif
+  return 0;
+}
+
+int hostfs_aio_wait(unsigned min) {
+  if (aio_mode < 0)
+    return -1;
+#if HOSTFS_IO_URING
+  if (aio_mode == 0) {
+    min = min(min, ring.inflight);
+    int count = ring_reap();
+    while ((unsigned)count < min) {
+      int n = io_uring_enter(ring.fd, 0, min - count, IORING_ENTER_GETEVENTS);
+      if (n < 0 && errno != EINTR)
+        return -1;
+      count += ring_reap();
+    }
+    return count;
+  }
+#endif
+  return 0;
+}
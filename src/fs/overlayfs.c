@@ -0,0 +1,743 @@
+// This code is released under the MIT License
+
+#include <fs/overlayfs.h>
+
+#define OVL_CHUNK (64 * 1024) // 部分 copy-up 的粒度
+
+typedef struct ovl_fs {
+  vfs_node_t *layers; // 各层的根目录，有可写层时它是第一个
+  size_t nlayers;
+  bool has_upper;     // layers[0] 是否为可写层
+  bool sparse;        // 只复制被写入的范围
+  char *upper_path;   // 可写层根目录的路径
+  st_t copyups;       // 本次挂载中 copy-up 的文件: 路径 -> ovl_copyup_t
+} *ovl_fs_t;
+
+// 合并索引中的一项
+typedef struct ovl_entry {
+  vfs_node_t top;   // 最上层的节点
+  bool upper;       // top 是否在可写层中
+  bool blocked;     // 下层出现了同名的非文件夹，更下层的文件夹不再合并
+  vfs_node_t *dirs; // 各层中参与合并的同名文件夹，从上到下
+  size_t ndirs;
+} *ovl_entry_t;
+
+typedef struct ovl_file *ovl_file_t;
+struct ovl_file {
+  ovl_fs_t fs;
+  char *path;         // 相对 overlay 根目录的路径，根目录为 ""
+  u16 type;
+  vfs_node_t upper;   // 可写层中的节点，尚未 copy-up 时为 null
+  vfs_node_t lower;   // 只读层中最上面的节点
+  vfs_node_t *layers; // 文件夹: 各层中的同名文件夹，从上到下
+  size_t nlayers;
+  bool dir_upper;     // 文件夹: layers[0] 是否在可写层中
+  st_t index;         // 文件夹: 合并后的子项，名称 -> ovl_entry_t
+};
+
+// 已 copy-up 的文件，合并索引建立时它还在只读层中，所以需要单独记录
+typedef struct ovl_copyup {
+  vfs_node_t lower;
+  vfs_node_t upper;
+  u64 size;    // 只读层中文件的大小
+  size_t left; // 尚未复制的块数
+  u64 *copied; // 已复制的块，为 null 时已全部复制
+} *ovl_copyup_t;
+
+static int ovl_id = -1;
+
+finline bool ovl_is_whiteout(cstr name) {
+  return strncmp(name, OVERLAYFS_WHITEOUT, strlen(OVERLAYFS_WHITEOUT)) == 0;
+}
+
+static char *ovl_join(cstr dir, cstr name) {
+  size_t n = strlen(dir);
+  char *path = malloc(n + strlen(name) + 2);
+  if (path == null)
+    return null;
+  strcpy(path, dir);
+  if (n != 0 && dir[n - 1] != '/')
+    path[n++] = '/';
+  strcpy(path + n, name);
+  return path;
+}
+
+static void ovl_fill(vfs_node_t src, vfs_node_t node) {
+  vfs_update(src);
+  node->info->type = src->info->type;
+  node->info->size = src->info->size;
+  node->info->realsize = src->info->realsize;
+  node->info->createtime = src->info->createtime;
+  node->info->readtime = src->info->readtime;
+  node->info->writetime = src->info->writetime;
+  node->info->owner = src->info->owner;
+  node->info->group = src->info->group;
+  node->info->permissions = src->info->permissions;
+}
+
+// ---------------------------------------------------------------------------
+// 合并索引
+
+static void ovl_entry_free(ovl_entry_t e) {
+  free(e->dirs);
+  free(e);
+}
+
+static void ovl_index_free(st_t index) {
+  if (index == null)
+    return;
+  for (usize i = 0; i <= index->mask; i++) {
+    for (st_node_t n = index->buckets[i]; n; n = n->next)
+      ovl_entry_free(n->value);
+  }
+  st_free(index);
+}
+
+static bool ovl_entry_push(ovl_entry_t e, vfs_node_t dir, size_t max) {
+  if (e->dirs == null && (e->dirs = malloc(max * sizeof(vfs_node_t))) == null)
+    return false;
+  e->dirs[e->ndirs++] = dir;
+  return true;
+}
+
+// 按从上到下的顺序把各层的子项合并到哈希索引中，每层的子项只遍历一次
+static int ovl_build_index(ovl_file_t dir) {
+  size_t total = 0;
+  for (size_t i = 0; i < dir->nlayers; i++) {
+    vfs_update(dir->layers[i]);
+    total += list_length(dir->layers[i]->info->child);
+  }
+  st_t index = st_new(total);
+  st_t hidden = st_new(); // 上层的 whiteout 隐藏的名称
+  if (index == null || hidden == null) {
+    st_free(index);
+    st_free(hidden);
+    return -1;
+  }
+
+  for (size_t i = 0; i < dir->nlayers; i++) {
+    vfs_node_t layer = dir->layers[i];
+    bool upper = dir->dir_upper && i == 0;
+    bool opaque = false;
+    list_foreach(layer->info->child, it) {
+      vfs_node_t c = it->data;
+      if (ovl_is_whiteout(c->name)) {
+        opaque |= streq(c->name, OVERLAYFS_OPAQUE);
+        continue;
+      }
+      if (st_has(hidden, c->name))
+        continue;
+      vfs_update(c);
+      bool is_dir = c->info->type == file_dir;
+      ovl_entry_t e = st_get(index, c->name);
+      if (e == null) {
+        e = malloc(sizeof(*e));
+        if (e == null)
+          continue;
+        memset(e, 0, sizeof(*e));
+        e->top = c;
+        e->upper = upper;
+        st_insert(index, c->name, e);
+      } else if (e->top->info->type != file_dir || e->blocked) {
+        continue;
+      } else if (!is_dir) {
+        e->blocked = true;
+        continue;
+      }
+      if (is_dir)
+        ovl_entry_push(e, c, dir->nlayers - i);
+    }
+    // 本层的 whiteout 只隐藏更下层的同名项
+    list_foreach(layer->info->child, it) {
+      vfs_node_t c = it->data;
+      if (ovl_is_whiteout(c->name))
+        st_insert(hidden, c->name + strlen(OVERLAYFS_WHITEOUT), null);
+    }
+    if (opaque)
+      break;
+  }
+  st_free(hidden);
+  dir->index = index;
+  return 0;
+}
+
+static ovl_entry_t ovl_lookup(ovl_file_t dir, cstr name) {
+  if (dir->index == null && ovl_build_index(dir) < 0)
+    return null;
+  return st_get(dir->index, name);
+}
+
+// 为文件夹的每个子项创建 vfs 节点 (只创建节点，不打开)
+static void ovl_scan(ovl_file_t dir, vfs_node_t node) {
+  if (node->info->child != null)
+    return;
+  if (dir->index == null && ovl_build_index(dir) < 0)
+    return;
+  for (usize i = 0; i <= dir->index->mask; i++) {
+    for (st_node_t n = dir->index->buckets[i]; n; n = n->next)
+      vfs_child_append(node, n->key, null);
+  }
+}
+
+// ---------------------------------------------------------------------------
+// 驱动
+
+static ovl_file_t ovl_file_alloc(ovl_fs_t fs, cstr path) {
+  ovl_file_t file = malloc(sizeof(*file));
+  if (file == null)
+    return null;
+  memset(file, 0, sizeof(*file));
+  file->fs = fs;
+  file->path = strdup(path);
+  return file;
+}
+
+static void ovl_close(void *current) {
+  ovl_file_t file = current;
+  ovl_index_free(file->index);
+  free(file->layers);
+  free(file->path);
+  free(file);
+}
+
+// 解析 "lowerdir=/a:/b,upperdir=/c,sparse"
+static ovl_fs_t ovl_parse(cstr src) {
+  if (src == null || strncmp(src, "lowerdir=", 9) != 0)
+    return null;
+  ovl_fs_t fs = calloc(1, sizeof(*fs));
+  char *opts = strdup(src);
+  if (fs == null || opts == null)
+    goto err;
+  fs->layers = malloc((strlen(src) / 2 + 2) * sizeof(vfs_node_t));
+  if (fs->layers == null)
+    goto err;
+  fs->nlayers = 1; // layers[0] 留给可写层
+
+  char *lower = null, *upper = null;
+  for (char *save, *opt = strtok_r(opts, ",", &save); opt;
+       opt = strtok_r(null, ",", &save)) {
+    if (strncmp(opt, "lowerdir=", 9) == 0)
+      lower = opt + 9;
+    else if (strncmp(opt, "upperdir=", 9) == 0)
+      upper = opt + 9;
+    else if (streq(opt, "sparse"))
+      fs->sparse = true;
+    else
+      goto err;
+  }
+  for (char *save, *dir = strtok_r(lower, ":", &save); dir;
+       dir = strtok_r(null, ":", &save)) {
+    vfs_node_t node = vfs_open(dir);
+    if (node == null || node->info->type != file_dir)
+      goto err;
+    fs->layers[fs->nlayers++] = node;
+  }
+  if (fs->nlayers == 1)
+    goto err;
+  if (upper) {
+    vfs_node_t node = vfs_open(upper);
+    if (node == null || node->info->type != file_dir)
+      goto err;
+    fs->layers[0] = node;
+    fs->has_upper = true;
+    fs->upper_path = vfs_get_fullpath(node);
+    fs->copyups = st_new();
+    if (fs->upper_path == null || fs->copyups == null)
+      goto err;
+  } else {
+    fs->layers++;
+    fs->nlayers--;
+  }
+  free(opts);
+  return fs;
+
+err:
+  if (fs) {
+    free(fs->layers);
+    free(fs->upper_path);
+    st_free(fs->copyups);
+  }
+  free(fs);
+  free(opts);
+  return null;
+}
+
+static int ovl_mount(cstr src, vfs_node_t node) {
+  ovl_fs_t fs = ovl_parse(src);
+  if (fs == null)
+    return -1;
+  ovl_file_t root = ovl_file_alloc(fs, "");
+  root->type = file_dir;
+  root->layers = malloc(fs->nlayers * sizeof(vfs_node_t));
+  memcpy(root->layers, fs->layers, fs->nlayers * sizeof(vfs_node_t));
+  root->nlayers = fs->nlayers;
+  root->dir_upper = fs->has_upper;
+  if (fs->has_upper)
+    root->upper = fs->layers[0];
+  node->info->handle = root;
+  ovl_fill(fs->layers[0], node);
+  ovl_scan(root, node);
+  return 0;
+}
+
+static int ovl_copyup_finish(ovl_copyup_t c);
+
+static void ovl_unmount(void *root) {
+  ovl_file_t file = root;
+  if (file == null)
+    return;
+  ovl_fs_t fs = file->fs;
+  ovl_close(file);
+  // 补齐部分 copy-up 的文件，否则重新挂载后未复制的范围会读到 0
+  if (fs->copyups) {
+    for (usize i = 0; i <= fs->copyups->mask; i++) {
+      for (st_node_t n = fs->copyups->buckets[i]; n; n = n->next) {
+        ovl_copyup_finish(n->value);
+        free(n->value);
+      }
+    }
+    st_free(fs->copyups);
+  }
+  if (!fs->has_upper)
+    fs->layers--;
+  free(fs->layers);
+  free(fs->upper_path);
+  free(fs);
+}
+
+static void ovl_open(void *parent, cstr name, vfs_node_t node) {
+  ovl_file_t dir = parent;
+  if (dir == null || dir->type != file_dir)
+    return;
+  ovl_entry_t e = ovl_lookup(dir, name);
+  if (e == null)
+    return;
+  char *path = ovl_join(dir->path, name);
+  ovl_file_t file = path ? ovl_file_alloc(dir->fs, path) : null;
+  free(path);
+  if (file == null)
+    return;
+  file->type = e->top->info->type;
+  if (e->upper) {
+    file->upper = e->top;
+  } else {
+    file->lower = e->top;
+    ovl_copyup_t c = dir->fs->copyups ? st_get(dir->fs->copyups, file->path)
+                                      : null;
+    if (c != null)
+      file->upper = c->upper;
+  }
+  if (file->type == file_dir) {
+    file->layers = malloc(e->ndirs * sizeof(vfs_node_t));
+    memcpy(file->layers, e->dirs, e->ndirs * sizeof(vfs_node_t));
+    file->nlayers = e->ndirs;
+    file->dir_upper = e->upper;
+  }
+  node->info->handle = file;
+  ovl_fill(file->upper ? file->upper : e->top, node);
+  if (file->type == file_dir)
+    ovl_scan(file, node);
+}
+
+// ---------------------------------------------------------------------------
+// copy-up
+
+// 可写层中对应的路径，并创建路径上缺少的文件夹
+static char *ovl_upper_path(ovl_file_t file) {
+  char *path = ovl_join(file->fs->upper_path, file->path);
+  if (path == null)
+    return null;
+  char *slash = strrchr(path, '/');
+  if (slash != path) {
+    *slash = '\0';
+    bool ok = vfs_open(path) != null || vfs_mkdir(path) == 0;
+    *slash = '/';
+    if (!ok) {
+      free(path);
+      return null;
+    }
+  }
+  return path;
+}
+
+static int ovl_copy(vfs_node_t from, vfs_node_t to, u64 offset, u64 size) {
+  byte *buf = malloc(OVL_CHUNK);
+  if (buf == null)
+    return -1;
+  int ret = 0;
+  for (u64 done = 0; done < size;) {
+    size_t n = min(size - done, (u64)OVL_CHUNK);
+    ssize_t r = vfs_read(from, buf, offset + done, n);
+    if (r <= 0 || vfs_write(to, buf, offset + done, r) != r) {
+      ret = -1;
+      break;
+    }
+    done += r;
+  }
+  free(buf);
+  return ret;
+}
+
+finline bool chunk_copied(ovl_copyup_t c, size_t i) {
+  return c->copied[i / 64] & (1ull << (i % 64));
+}
+
+static int ovl_copyup_chunk(ovl_copyup_t c, size_t i) {
+  if (chunk_copied(c, i))
+    return 0;
+  u64 off = (u64)i * OVL_CHUNK;
+  if (ovl_copy(c->lower, c->upper, off, min((u64)OVL_CHUNK, c->size - off)) <
+      0)
+    return -1;
+  c->copied[i / 64] |= 1ull << (i % 64);
+  c->left--;
+  return 0;
+}
+
+static int ovl_copyup_finish(ovl_copyup_t c) {
+  if (c->copied == null)
+    return 0;
+  size_t nchunks = (c->size + OVL_CHUNK - 1) / OVL_CHUNK;
+  for (size_t i = 0; i < nchunks && c->left; i++) {
+    if (ovl_copyup_chunk(c, i) < 0)
+      return -1;
+  }
+  free(c->copied);
+  c->copied = null;
+  return 0;
+}
+
+// 首次写入前把文件复制到可写层，sparse 时只创建文件并复制最后一块
+static int ovl_copyup(ovl_file_t file) {
+  ovl_fs_t fs = file->fs;
+  if (!fs->has_upper)
+    return -1;
+  char *path = ovl_upper_path(file);
+  if (path == null)
+    return -1;
+  vfs_node_t upper = vfs_mkfile(path) == 0 ? vfs_open(path) : null;
+  free(path);
+  if (upper == null)
+    return -1;
+
+  ovl_copyup_t c = malloc(sizeof(*c));
+  if (c == null)
+    return -1;
+  vfs_update(file->lower);
+  c->lower = file->lower;
+  c->upper = upper;
+  c->size = file->lower->info->size;
+  c->left = (c->size + OVL_CHUNK - 1) / OVL_CHUNK;
+  c->copied = calloc((c->left + 63) / 64 + 1, sizeof(u64));
+  if (c->copied == null) {
+    free(c);
+    return -1;
+  }
+  // 最后一块决定了文件的大小，总是先复制
+  int ret = c->left ? ovl_copyup_chunk(c, c->left - 1) : 0;
+  if (ret == 0 && !fs->sparse)
+    ret = ovl_copyup_finish(c);
+  if (ret == 0)
+    ret = st_insert(fs->copyups, file->path, c);
+  if (ret < 0) {
+    free(c->copied);
+    free(c);
+    return -1;
+  }
+  file->upper = upper;
+  return 0;
+}
+
+// ---------------------------------------------------------------------------
+// 读写
+
+static ssize_t ovl_read(void *file, void *addr, size_t offset, size_t size) {
+  ovl_file_t f = file;
+  if (f->type == file_dir)
+    return -1;
+  if (f->upper == null)
+    return vfs_read(f->lower, addr, offset, size);
+  ovl_copyup_t c = f->fs->copyups ? st_get(f->fs->copyups, f->path) : null;
+  if (c == null || c->copied == null)
+    return vfs_read(f->upper, addr, offset, size);
+
+  // 已复制的块从可写层读取，其余的从只读层读取
+  vfs_update(f->upper);
+  u64 end = min((u64)offset + size, f->upper->info->size);
+  size_t done = 0;
+  while (offset + done < end) {
+    u64 pos = offset + done;
+    size_t i = pos / OVL_CHUNK;
+    size_t n = min(end - pos, (u64)(i + 1) * OVL_CHUNK - pos);
+    bool upper = pos >= c->size || chunk_copied(c, i);
+    ssize_t r = vfs_read(upper ? c->upper : c->lower, addr + done, pos, n);
+    if (r <= 0)
+      break;
+    done += r;
+  }
+  return done;
+}
+
+static ssize_t ovl_write(void *file, const void *addr, size_t offset,
+                         size_t size) {
+  ovl_file_t f = file;
+  if (f->type == file_dir)
+    return -1;
+  if (f->upper == null && ovl_copyup(f) < 0)
+    return -1;
+  ovl_copyup_t c = f->fs->copyups ? st_get(f->fs->copyups, f->path) : null;
+  if (c != null && c->copied != null) {
+    // 只复制被写入覆盖的块
+    u64 last = min((u64)offset + size, c->size);
+    for (size_t i = offset / OVL_CHUNK; (u64)i * OVL_CHUNK < last; i++) {
+      if (ovl_copyup_chunk(c, i) < 0)
+        return -1;
+    }
+    if (c->left == 0)
+      ovl_copyup_finish(c);
+  }
+  return vfs_write(f->upper, addr, offset, size);
+}
+
+// 改变大小前先完成 copy-up，避免只读层的数据在截断后重新出现
+static vfs_node_t ovl_upper_full(ovl_file_t f) {
+  if (f->type == file_dir)
+    return null;
+  if (f->upper == null && ovl_copyup(f) < 0)
+    return null;
+  ovl_copyup_t c = f->fs->copyups ? st_get(f->fs->copyups, f->path) : null;
+  if (c != null && ovl_copyup_finish(c) < 0)
+    return null;
+  return f->upper;
+}
+
+static int ovl_resize(void *file, u64 size) {
+  vfs_node_t upper = ovl_upper_full(file);
+  return upper ? vfs_truncate(upper, size) : -1;
+}
+
+static int ovl_fallocate(void *file, int mode, u64 offset, u64 size) {
+  vfs_node_t upper = ovl_upper_full(file);
+  return upper ? vfs_fallocate(upper, mode, offset, size) : -1;
+}
+
+static i64 ovl_seek(void *file, u64 offset, bool hole) {
+  ovl_file_t f = file;
+  if (f->type == file_dir)
+    return -1;
+  if (f->upper == null)
+    return hole ? vfs_next_hole(f->lower, offset)
+                : vfs_next_data(f->lower, offset);
+  // 部分 copy-up 时数据分布在两层中，保守地视为全是数据
+  ovl_copyup_t c = f->fs->copyups ? st_get(f->fs->copyups, f->path) : null;
+  if (c != null && c->copied != null)
+    return hole ? -1 : (i64)offset;
+  return hole ? vfs_next_hole(f->upper, offset)
+              : vfs_next_data(f->upper, offset);
+}
+
+// ---------------------------------------------------------------------------
+// 创建
+
+// 文件夹在可写层中不存在时先创建
+static vfs_node_t ovl_upper_dir(ovl_file_t dir) {
+  if (dir->dir_upper)
+    return dir->layers[0];
+  if (!dir->fs->has_upper)
+    return null;
+  char *path = ovl_join(dir->fs->upper_path, dir->path);
+  if (path == null)
+    return null;
+  vfs_node_t node = vfs_open(path);
+  if (node == null && vfs_mkdir(path) == 0)
+    node = vfs_open(path);
+  free(path);
+  if (node == null)
+    return null;
+  // 可写层成为最上层，下层仍然参与合并
+  vfs_node_t *layers = malloc((dir->nlayers + 1) * sizeof(vfs_node_t));
+  if (layers == null)
+    return null;
+  layers[0] = node;
+  memcpy(layers + 1, dir->layers, dir->nlayers * sizeof(vfs_node_t));
+  free(dir->layers);
+  dir->layers = layers;
+  dir->nlayers++;
+  dir->dir_upper = true;
+  dir->upper = node;
+  return node;
+}
+
+static int ovl_mk(void *parent, cstr name, vfs_node_t node, bool is_dir) {
+  ovl_file_t dir = parent;
+  if (dir == null || dir->type != file_dir || ovl_is_whiteout(name))
+    return -1;
+  if (ovl_lookup(dir, name) != null)
+    return -1;
+  vfs_node_t upper_dir = ovl_upper_dir(dir);
+  if (upper_dir == null)
+    return -1;
+  char *dirpath = vfs_get_fullpath(upper_dir);
+  char *path = dirpath ? ovl_join(dirpath, name) : null;
+  free(dirpath);
+  if (path == null)
+    return -1;
+
+  // 下层被 whiteout 隐藏的同名文件夹不能重新出现
+  bool hidden = false;
+  if (is_dir) {
+    char *wh = malloc(strlen(name) + strlen(OVERLAYFS_WHITEOUT) + 1);
+    if (wh == null) {
+      free(path);
+      return -1;
+    }
+    sprintf(wh, "%s%s", OVERLAYFS_WHITEOUT, name);
+    hidden = list_first(upper_dir->info->child, data,
+                        streq(wh, ((vfs_node_t)data)->name)) != null;
+    free(wh);
+  }
+
+  int ret = is_dir ? vfs_mkdir(path) : vfs_mkfile(path);
+  vfs_node_t upper = ret == 0 ? vfs_open(path) : null;
+  if (upper != null && hidden) {
+    char *opq = ovl_join(path, OVERLAYFS_OPAQUE);
+    if (opq != null)
+      vfs_mkfile(opq);
+    free(opq);
+  }
+  free(path);
+  if (upper == null)
+    return -1;
+
+  ovl_entry_t e = malloc(sizeof(*e));
+  char *child = ovl_join(dir->path, name);
+  ovl_file_t file = child ? ovl_file_alloc(dir->fs, child) : null;
+  free(child);
+  if (e == null || file == null) {
+    free(e);
+    free(file);
+    return -1;
+  }
+  memset(e, 0, sizeof(*e));
+  e->top = upper;
+  e->upper = true;
+  file->type = is_dir ? file_dir : file_block;
+  file->upper = upper;
+  if (is_dir) {
+    ovl_entry_push(e, upper, 1);
+    file->layers = malloc(sizeof(vfs_node_t));
+    file->layers[0] = upper;
+    file->nlayers = 1;
+    file->dir_upper = true;
+  }
+  st_insert(dir->index, name, e);
+  node->info->handle = file;
+  ovl_fill(upper, node);
+  return 0;
+}
+
+static int ovl_mkdir(void *parent, cstr name, vfs_node_t node) {
+  return ovl_mk(parent, name, node, true);
+}
+
+static int ovl_mkfile(void *parent, cstr name, vfs_node_t node) {
+  return ovl_mk(parent, name, node, false);
+}
+
+// ---------------------------------------------------------------------------
+// 删除
+
+// 合并后为空的文件夹在可写层中只剩 whiteout，先删除它们
+static int ovl_rmdir_upper(vfs_node_t dir, cstr path) {
+  vfs_update(dir);
+  for (list_t it = dir->info->child; it; it = dir->info->child) {
+    char *wh = ovl_join(path, ((vfs_node_t)it->data)->name);
+    int ret = wh ? vfs_unlink(wh) : -1;
+    free(wh);
+    if (ret < 0)
+      return -1;
+  }
+  return vfs_rmdir(path);
+}
+
+// 可写层中的项目直接删除，只读层中有同名项时再用 whiteout 隐藏它
+static int ovl_remove(void *parent, cstr name) {
+  ovl_file_t dir = parent;
+  ovl_fs_t fs = dir->fs;
+  if (ovl_lookup(dir, name) == null)
+    return -1;
+  vfs_node_t upper_dir = ovl_upper_dir(dir);
+  if (upper_dir == null)
+    return -1;
+  char *whname = malloc(strlen(OVERLAYFS_WHITEOUT) + strlen(name) + 1);
+  char *dirpath = vfs_get_fullpath(upper_dir);
+  char *child = ovl_join(dir->path, name);
+  char *path = dirpath ? ovl_join(dirpath, name) : null;
+  char *wh = null;
+  int ret = -1;
+  if (whname == null || child == null || path == null)
+    goto out;
+  sprintf(whname, "%s%s", OVERLAYFS_WHITEOUT, name);
+  if ((wh = ovl_join(dirpath, whname)) == null)
+    goto out;
+
+  // 未完成的 copy-up 不再需要补齐
+  ovl_copyup_t c = fs->copyups ? st_remove(fs->copyups, child) : null;
+  if (c != null) {
+    free(c->copied);
+    free(c);
+  }
+  vfs_node_t upper = vfs_open(path);
+  if (upper != null) {
+    ret = upper->info->type == file_dir ? ovl_rmdir_upper(upper, path)
+                                        : vfs_unlink(path);
+    if (ret < 0)
+      goto out;
+  }
+  // ovl_upper_dir 之后 layers[0] 总是可写层
+  bool lower = false;
+  for (size_t i = 1; i < dir->nlayers && !lower; i++) {
+    lower = list_first(dir->layers[i]->info->child, data,
+                       streq(name, ((vfs_node_t)data)->name)) != null;
+  }
+  ret = lower ? vfs_mkfile(wh) : 0;
+  if (ret == 0)
+    ovl_entry_free(st_remove(dir->index, name));
+
+out:
+  free(whname);
+  free(dirpath);
+  free(child);
+  free(path);
+  free(wh);
+  return ret;
+}
+
+static int ovl_stat(void *file, vfs_node_t node) {
+  ovl_file_t f = file;
+  ovl_fill(f->upper ? f->upper : f->type == file_dir ? f->layers[0] : f->lower,
+           node);
+  return 0;
+}
+
+static struct vfs_callback ovl_callbacks = {
+    .mount = ovl_mount,
+    .unmount = ovl_unmount,
+    .open = ovl_open,
+    .close = ovl_close,
+    .read = ovl_read,
+    .write = ovl_write,
+    .mkdir = ovl_mkdir,
+    .mkfile = ovl_mkfile,
+    .stat = ovl_stat,
+    .resize = ovl_resize,
+    .fallocate = ovl_fallocate,
+    .seek = ovl_seek,
+    .remove = ovl_remove,
+};
+
+int overlayfs_regist() {
+  if (ovl_id < 0)
+    ovl_id = vfs_regist("overlayfs", &ovl_callbacks);
+  return ovl_id;
+}
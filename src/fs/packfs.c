@@ -0,0 +1,707 @@
+// This code is released under the MIT License
+
+#ifndef PACKFS_ZSTD
+#  define PACKFS_ZSTD 0
+#endif
+
+// 系统头文件需要在 vfs.h 之前引入，否则会与 val / var 宏冲突
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#if PACKFS_ZSTD
+#  include <zstd.h>
+#endif
+
+#include <block.h>
+#include <fs/packfs.h>
+
+#define PACKFS_DEFAULT_BLOCK (64 * 1024)
+
+typedef struct packfs_image {
+  const byte *base; // mmap 的镜像，或块设备上镜像的元数据部分
+  size_t size;
+  blkdev_t dev;     // 镜像所在的块设备，为 null 时整个镜像被 mmap
+  const struct packfs_header *header;
+  const struct packfs_inode *inodes;
+  const struct packfs_dentry *dentries;
+  const char *names;
+} *packfs_image_t;
+
+typedef struct packfs_file {
+  packfs_image_t image;
+  u32 ino;
+  u64 cached; // 缓存的块号 + 1，0 表示没有缓存
+  byte *cache;
+  byte *zbuf; // 块设备上的镜像: 读取压缩数据的缓冲区
+} *packfs_file_t;
+
+static int packfs_id = -1;
+
+// ---------------------------------------------------------------------------
+// LZ4 块格式
+
+#define LZ4_HASH_BITS 12
+#define LZ4_MIN_MATCH 4
+
+static bool lz4_emit(byte *dst, size_t cap, size_t *op, const byte *lit,
+                     size_t nlit, size_t offset, size_t mlen) {
+  size_t need = 1 + nlit / 255 + 1 + nlit + 2 + mlen / 255 + 1;
+  if (*op + need > cap)
+    return false;
+  byte *token = &dst[(*op)++];
+  *token = (nlit >= 15 ? 15 : nlit) << 4;
+  if (nlit >= 15) {
+    size_t n = nlit - 15;
+    for (; n >= 255; n -= 255)
+      dst[(*op)++] = 255;
+    dst[(*op)++] = n;
+  }
+  memcpy(dst + *op, lit, nlit);
+  *op += nlit;
+  if (mlen == 0) // 最后一个序列只有字面量
+    return true;
+  dst[(*op)++] = offset & 0xff;
+  dst[(*op)++] = offset >> 8;
+  mlen -= LZ4_MIN_MATCH;
+  *token |= mlen >= 15 ? 15 : mlen;
+  if (mlen >= 15) {
+    size_t n = mlen - 15;
+    for (; n >= 255; n -= 255)
+      dst[(*op)++] = 255;
+    dst[(*op)++] = n;
+  }
+  return true;
+}
+
+// 返回压缩后的大小，无法压缩到 cap 以内时返回 0
+static size_t lz4_compress(const byte *src, size_t n, byte *dst, size_t cap) {
+  u32 table[1 << LZ4_HASH_BITS] = {};
+  size_t ip = 0, anchor = 0, op = 0;
+  // 格式要求最后一个匹配在结尾 12 字节之前开始，最后 5 字节为字面量
+  for (size_t limit = n > 12 ? n - 12 : 0; ip < limit;) {
+    u32 seq;
+    memcpy(&seq, src + ip, 4);
+    u32 h = (seq * 2654435761u) >> (32 - LZ4_HASH_BITS);
+    size_t ref = table[h];
+    table[h] = ip + 1;
+    if (ref == 0 || ip - (ref - 1) > 65535 ||
+        memcmp(src + ref - 1, src + ip, 4) != 0) {
+      ip++;
+      continue;
+    }
+    ref--;
+    size_t mlen = LZ4_MIN_MATCH;
+    while (ip + mlen < n - 5 && src[ref + mlen] == src[ip + mlen])
+      mlen++;
+    if (!lz4_emit(dst, cap, &op, src + anchor, ip - anchor, ip - ref, mlen))
+      return 0;
+    ip += mlen;
+    anchor = ip;
+  }
+  if (!lz4_emit(dst, cap, &op, src + anchor, n - anchor, 0, 0))
+    return 0;
+  return op;
+}
+
+static ssize_t lz4_decompress(const byte *src, size_t n, byte *dst,
+                              size_t cap) {
+  size_t ip = 0, op = 0;
+  while (ip < n) {
+    byte token = src[ip++];
+    size_t nlit = token >> 4;
+    if (nlit == 15) {
+      byte b;
+      do {
+        if (ip >= n)
+          return -1;
+        b = src[ip++];
+        nlit += b;
+      } while (b == 255);
+    }
+    if (ip + nlit > n || op + nlit > cap)
+      return -1;
+    memcpy(dst + op, src + ip, nlit);
+    ip += nlit;
+    op += nlit;
+    if (ip >= n)
+      break;
+    if (ip + 2 > n)
+      return -1;
+    size_t offset = src[ip] | (size_t)src[ip + 1] << 8;
+    ip += 2;
+    if (offset == 0 || offset > op)
+      return -1;
+    size_t mlen = token & 15;
+    if (mlen == 15) {
+      byte b;
+      do {
+        if (ip >= n)
+          return -1;
+        b = src[ip++];
+        mlen += b;
+      } while (b == 255);
+    }
+    mlen += LZ4_MIN_MATCH;
+    if (op + mlen > cap)
+      return -1;
+    for (size_t i = 0; i < mlen; i++, op++) // 可能与自身重叠，不能用 memcpy
+      dst[op] = dst[op - offset];
+  }
+  return op;
+}
+
+static size_t codec_compress(int codec, const byte *src, size_t n, byte *dst,
+                             size_t cap) {
+  if (codec == packfs_codec_lz4)
+    return lz4_compress(src, n, dst, cap);
+#if PACKFS_ZSTD
+  if (codec == packfs_codec_zstd) {
+    size_t r = ZSTD_compress(dst, cap, src, n, 3);
+    return ZSTD_isError(r) ? 0 : r;
+  }
+#endif
+  return 0;
+}
+
+static ssize_t codec_decompress(int codec, const byte *src, size_t n,
+                                byte *dst, size_t cap) {
+  if (codec == packfs_codec_lz4)
+    return lz4_decompress(src, n, dst, cap);
+#if PACKFS_ZSTD
+  if (codec == packfs_codec_zstd) {
+    size_t r = ZSTD_decompress(dst, cap, src, n);
+    return ZSTD_isError(r) ? -1 : (ssize_t)r;
+  }
+#endif
+  return -1;
+}
+
+// ---------------------------------------------------------------------------
+// 驱动
+
+static packfs_file_t packfs_file_alloc(packfs_image_t image, u32 ino) {
+  packfs_file_t file = malloc(sizeof(*file));
+  if (file == null)
+    return null;
+  file->image = image;
+  file->ino = ino;
+  file->cached = 0;
+  file->cache = null;
+  file->zbuf = null;
+  return file;
+}
+
+finline const struct packfs_inode *inodeof(packfs_file_t file) {
+  return &file->image->inodes[file->ino];
+}
+
+static void packfs_fill(packfs_file_t file, vfs_node_t node) {
+  const struct packfs_inode *inode = inodeof(file);
+  node->info->type = inode->type;
+  node->info->size = inode->size;
+  node->info->realsize = inode->stored;
+  node->info->createtime = inode->createtime;
+  node->info->writetime = inode->writetime;
+  node->info->owner = inode->owner;
+  node->info->group = inode->group;
+  node->info->permissions = inode->permissions;
+}
+
+// 创建文件夹的子节点 (只创建节点，不打开)
+static void packfs_scan(packfs_file_t dir, vfs_node_t node) {
+  const struct packfs_inode *inode = inodeof(dir);
+  if (node->info->child != null) // 已经扫描过
+    return;
+  for (u32 i = 0; i < inode->nchild; i++) {
+    const struct packfs_dentry *d = &dir->image->dentries[inode->child + i];
+    vfs_child_append(node, dir->image->names + d->name, null);
+  }
+}
+
+// 表 [off, off + count * size) 要完整地落在头部之后、end 之前，用除法比较
+// 以免乘法和加法溢出
+static bool packfs_range_ok(u64 off, u64 count, u64 size, u64 end) {
+  return off >= sizeof(struct packfs_header) && off <= end &&
+         count <= (end - off) / size;
+}
+
+static bool packfs_header_ok(const struct packfs_header *header, u64 size) {
+  if (!memeq(header->magic, PACKFS_MAGIC, 8) ||
+      header->version != PACKFS_VERSION || header->image_size > size ||
+      header->inode_count == 0 || header->block_size == 0 ||
+      header->data_off > header->image_size)
+    return false;
+  u64 end = header->data_off;
+  return packfs_range_ok(header->inode_off, header->inode_count,
+                         sizeof(struct packfs_inode), end) &&
+         packfs_range_ok(header->dentry_off, header->dentry_count,
+                         sizeof(struct packfs_dentry), end) &&
+         packfs_range_ok(header->name_off, 0, 1, end);
+}
+
+// 检查每个 inode 和 dentry 中的引用，之后 open / read 可以直接使用
+static bool packfs_records_ok(packfs_image_t image) {
+  const struct packfs_header *header = image->header;
+  for (u32 i = 0; i < header->inode_count; i++) {
+    const struct packfs_inode *inode = &image->inodes[i];
+    if (inode->type == file_dir) {
+      if ((u64)inode->child + inode->nchild > header->dentry_count)
+        return false;
+      continue;
+    }
+    if (inode->data < header->data_off || inode->data > header->image_size ||
+        inode->stored > header->image_size - inode->data)
+      return false;
+    if (inode->codec == packfs_codec_none) {
+      if (inode->size > inode->stored)
+        return false;
+    } else {
+      // 压缩时数据以 nblk + 1 项的块偏移表开头
+      u64 nblk = inode->size / header->block_size +
+                 (inode->size % header->block_size != 0);
+      if (nblk >= inode->stored / sizeof(u64))
+        return false;
+    }
+  }
+  u64 names = header->data_off - header->name_off;
+  for (u32 i = 0; i < header->dentry_count; i++) {
+    const struct packfs_dentry *d = &image->dentries[i];
+    if (d->inode >= header->inode_count || d->name >= names ||
+        memchr(image->names + d->name, '\0', names - d->name) == null)
+      return false;
+  }
+  return true;
+}
+
+static int packfs_mount_image(packfs_image_t image, vfs_node_t node) {
+  const byte *base = image->base;
+  image->header = (const void *)base;
+  image->inodes = (const void *)(base + image->header->inode_off);
+  image->dentries = (const void *)(base + image->header->dentry_off);
+  image->names = (const char *)(base + image->header->name_off);
+  if (!packfs_records_ok(image))
+    return -1;
+  packfs_file_t root = packfs_file_alloc(image, 0);
+  if (root == null)
+    return -1;
+  node->info->handle = root;
+  packfs_fill(root, node);
+  packfs_scan(root, node);
+  return 0;
+}
+
+// 块设备上的镜像只读入数据区之前的元数据，文件数据经过缓冲区缓存读取
+static int packfs_mount_blkdev(blkdev_t dev, vfs_node_t node) {
+  struct packfs_header header;
+  u64 size = dev->sectors * dev->sector_size;
+  if (blkdev_read(dev, &header, 0, sizeof(header)) != sizeof(header) ||
+      !packfs_header_ok(&header, size))
+    return -1;
+  byte *meta = malloc(header.data_off);
+  if (meta == null)
+    return -1;
+  if (blkdev_read(dev, meta, 0, header.data_off) != (ssize_t)header.data_off) {
+    free(meta);
+    return -1;
+  }
+  packfs_image_t image = malloc(sizeof(*image));
+  if (image == null) {
+    free(meta);
+    return -1;
+  }
+  image->base = meta;
+  image->size = header.data_off;
+  image->dev = dev;
+  if (packfs_mount_image(image, node) < 0) {
+    free(meta);
+    free(image);
+    return -1;
+  }
+  return 0;
+}
+
+static int packfs_mount(cstr src, vfs_node_t node) {
+  if (src == null)
+    return -1;
+  blkdev_t dev = blkdev_get(src);
+  if (dev != null)
+    return packfs_mount_blkdev(dev, node);
+  int fd = open(src, O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return -1;
+  struct stat st;
+  if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode) ||
+      (size_t)st.st_size < sizeof(struct packfs_header)) {
+    close(fd);
+    return -1;
+  }
+  const byte *base = mmap(null, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED)
+    return -1;
+  if (!packfs_header_ok((const void *)base, st.st_size)) {
+    munmap((void *)base, st.st_size);
+    return -1;
+  }
+  packfs_image_t image = malloc(sizeof(*image));
+  if (image == null) {
+    munmap((void *)base, st.st_size);
+    return -1;
+  }
+  image->base = base;
+  image->size = st.st_size;
+  image->dev = null;
+  if (packfs_mount_image(image, node) < 0) {
+    munmap((void *)base, st.st_size);
+    free(image);
+    return -1;
+  }
+  return 0;
+}
+
+static void packfs_close(void *current) {
+  packfs_file_t file = current;
+  free(file->cache);
+  free(file->zbuf);
+  free(file);
+}
+
+static void packfs_unmount(void *root) {
+  packfs_file_t file = root;
+  if (file == null)
+    return;
+  packfs_image_t image = file->image;
+  packfs_close(file);
+  if (image->dev)
+    free((void *)image->base);
+  else
+    munmap((void *)image->base, image->size);
+  free(image);
+}
+
+static void packfs_open(void *parent, cstr name, vfs_node_t node) {
+  packfs_file_t dir = parent;
+  if (dir == null)
+    return;
+  const struct packfs_inode *inode = inodeof(dir);
+  if (inode->type != file_dir)
+    return;
+  const struct packfs_dentry *dentries = dir->image->dentries + inode->child;
+  // 子项按名称排序
+  size_t l = 0, r = inode->nchild;
+  while (l < r) {
+    size_t m = (l + r) / 2;
+    int cmp = strcmp(name, dir->image->names + dentries[m].name);
+    if (cmp == 0) {
+      packfs_file_t file = packfs_file_alloc(dir->image, dentries[m].inode);
+      if (file == null)
+        return;
+      node->info->handle = file;
+      packfs_fill(file, node);
+      if (inodeof(file)->type == file_dir)
+        packfs_scan(file, node);
+      return;
+    }
+    if (cmp < 0)
+      r = m;
+    else
+      l = m + 1;
+  }
+}
+
+// 读取镜像数据区中的内容
+static bool packfs_image_read(packfs_image_t image, void *addr, u64 off,
+                              size_t size) {
+  if (image->dev == null) {
+    memcpy(addr, image->base + off, size);
+    return true;
+  }
+  return blkdev_read(image->dev, addr, off, size) == (ssize_t)size;
+}
+
+static const byte *packfs_block(packfs_file_t file, u64 blk, size_t *len) {
+  packfs_image_t image = file->image;
+  const struct packfs_inode *inode = inodeof(file);
+  u32 bs = image->header->block_size;
+  size_t rawlen = min(inode->size - blk * bs, (u64)bs);
+  *len = rawlen;
+  if (image->dev == null && inode->codec == packfs_codec_none)
+    return image->base + inode->data + blk * bs;
+  if (file->cached == blk + 1)
+    return file->cache;
+  if (file->cache == null) {
+    file->cache = malloc(bs);
+    if (file->cache == null)
+      return null;
+  }
+  file->cached = 0;
+  if (inode->codec == packfs_codec_none) {
+    if (!packfs_image_read(image, file->cache, inode->data + blk * bs, rawlen))
+      return null;
+    file->cached = blk + 1;
+    return file->cache;
+  }
+
+  u64 table[2];
+  if (!packfs_image_read(image, table, inode->data + blk * sizeof(u64),
+                         sizeof(table)))
+    return null;
+  if (table[0] > table[1] || table[1] > inode->stored)
+    return null;
+  size_t stored = table[1] - table[0];
+  const byte *src;
+  if (image->dev == null) {
+    src = image->base + inode->data + table[0];
+    if (stored == rawlen) // 该块无法压缩，原样存放
+      return src;
+  } else {
+    // 无法压缩的块直接读入 cache，否则先读入 zbuf 再解压
+    byte *buf = stored == rawlen ? file->cache : file->zbuf;
+    if (buf == null && (buf = file->zbuf = malloc(bs)) == null)
+      return null;
+    if (stored > bs ||
+        !packfs_image_read(image, buf, inode->data + table[0], stored))
+      return null;
+    src = buf;
+  }
+  if (stored == rawlen) {
+    file->cached = blk + 1;
+    return file->cache;
+  }
+  if (codec_decompress(inode->codec, src, stored, file->cache, bs) !=
+      (ssize_t)rawlen)
+    return null;
+  file->cached = blk + 1;
+  return file->cache;
+}
+
+static ssize_t packfs_read(void *file, void *addr, size_t offset,
+                           size_t size) {
+  packfs_file_t f = file;
+  const struct packfs_inode *inode = inodeof(f);
+  if (inode->type == file_dir)
+    return -1;
+  if (offset >= inode->size)
+    return 0;
+  size = min(size, inode->size - offset);
+  if (inode->codec == packfs_codec_none) {
+    if (!packfs_image_read(f->image, addr, inode->data + offset, size))
+      return -1;
+    return size;
+  }
+  u32 bs = f->image->header->block_size;
+  size_t done = 0;
+  while (done < size) {
+    u64 blk = (offset + done) / bs;
+    size_t inblk = (offset + done) % bs, len;
+    const byte *data = packfs_block(f, blk, &len);
+    if (data == null)
+      return done ? (ssize_t)done : -1;
+    size_t n = min(len - inblk, size - done);
+    memcpy(addr + done, data + inblk, n);
+    done += n;
+  }
+  return done;
+}
+
+// 只有 mmap 的镜像中未压缩的文件可以直接映射
+static void *packfs_map(void *file, size_t offset, size_t size) {
+  packfs_file_t f = file;
+  const struct packfs_inode *inode = inodeof(f);
+  if (inode->type == file_dir || inode->codec != packfs_codec_none)
+    return null;
+  if (f->image->dev != null || offset + size > inode->size)
+    return null;
+  return (void *)(f->image->base + inode->data + offset);
+}
+
+static ssize_t packfs_write(void *file, const void *addr, size_t offset,
+                            size_t size) {
+  return -1;
+}
+
+static int packfs_mk(void *parent, cstr name, vfs_node_t node) {
+  return -1;
+}
+
+static int packfs_stat(void *file, vfs_node_t node) {
+  packfs_fill(file, node);
+  return 0;
+}
+
+static struct vfs_callback packfs_callbacks = {
+    .mount = packfs_mount,
+    .unmount = packfs_unmount,
+    .open = packfs_open,
+    .close = packfs_close,
+    .read = packfs_read,
+    .write = packfs_write,
+    .mkdir = packfs_mk,
+    .mkfile = packfs_mk,
+    .stat = packfs_stat,
+    .map = packfs_map,
+};
+
+int packfs_regist() {
+  if (packfs_id < 0)
+    packfs_id = vfs_regist("packfs", &packfs_callbacks);
+  return packfs_id;
+}
+
+// ---------------------------------------------------------------------------
+// 打包
+
+typedef struct pack_entry {
+  vfs_node_t node;
+  struct packfs_inode inode;
+  u32 name; // 在名称表中的偏移
+} *pack_entry_t;
+
+static int pack_entry_cmp(const void *a, const void *b) {
+  return strcmp(((const struct pack_entry *)a)->node->name,
+                ((const struct pack_entry *)b)->node->name);
+}
+
+finline void stream_align(mostream_t s, size_t align) {
+  static const byte zero[16];
+  if (s->size % align)
+    mostream_write(s, zero, align - s->size % align);
+}
+
+static int pack_file(pack_entry_t e, mostream_t data, int codec, u32 bs,
+                     byte *raw, byte *packed) {
+  stream_align(data, 16);
+  e->inode.data = data->size;
+  e->inode.codec = codec;
+  u64 size = e->inode.size;
+  u64 nblk = (size + bs - 1) / bs;
+  size_t table = 0;
+  if (codec != packfs_codec_none) {
+    table = data->size;
+    u64 zero = 0;
+    for (u64 i = 0; i <= nblk; i++)
+      mostream_write(data, &zero, sizeof(zero));
+  }
+  for (u64 i = 0; i < nblk; i++) {
+    size_t len = min(size - i * bs, (u64)bs);
+    if (vfs_read(e->node, raw, i * bs, len) != (ssize_t)len)
+      return -1;
+    if (codec != packfs_codec_none) {
+      ((u64 *)(data->buf + table))[i] = data->size - e->inode.data;
+      size_t clen = codec_compress(codec, raw, len, packed, len - 1);
+      if (clen > 0 && clen < len) {
+        mostream_write(data, packed, clen);
+        continue;
+      }
+    }
+    mostream_write(data, raw, len);
+  }
+  if (codec != packfs_codec_none)
+    ((u64 *)(data->buf + table))[nblk] = data->size - e->inode.data;
+  e->inode.stored = data->size - e->inode.data;
+  return 0;
+}
+
+int packfs_pack(vfs_node_t root, mostream_t out, int codec, u32 block_size) {
+  if (root == null || out == null)
+    return -1;
+  if (codec != packfs_codec_none && codec != packfs_codec_lz4 &&
+      (codec != packfs_codec_zstd || !PACKFS_ZSTD))
+    return -1;
+  vfs_update(root);
+  if (root->info->type != file_dir)
+    return -1;
+  u32 bs = block_size ? block_size : PACKFS_DEFAULT_BLOCK;
+
+  // 按层序遍历，这样每个文件夹的子项在表中连续
+  // 除根目录外每个 inode 恰好对应一个 dentry，dentry i 指向 inode i + 1
+  size_t count = 1, cap = 64;
+  pack_entry_t entries = calloc(cap, sizeof(*entries));
+  mostream_t names = mostream_alloc(4096);
+  mostream_t data = mostream_alloc(4096);
+  byte *raw = malloc(bs), *packed = malloc(bs);
+  int ret = -1;
+  if (!entries || !names || !data || !raw || !packed)
+    goto done;
+  entries[0].node = root;
+  mostream_write(names, "", 1);
+
+  for (size_t i = 0; i < count; i++) {
+    pack_entry_t e = &entries[i];
+    vfs_node_t node = e->node;
+    vfs_update(node);
+    e->inode.type = node->info->type;
+    e->inode.permissions = node->info->permissions;
+    e->inode.owner = node->info->owner;
+    e->inode.group = node->info->group;
+    e->inode.createtime = node->info->createtime;
+    e->inode.writetime = node->info->writetime;
+    if (node->info->type != file_dir) {
+      e->inode.size = node->info->size;
+      if (pack_file(e, data, codec, bs, raw, packed) < 0)
+        goto done;
+      continue;
+    }
+    size_t first = count;
+    list_foreach(node->info->child, it) {
+      if (count == cap) {
+        cap *= 2;
+        pack_entry_t n = realloc(entries, cap * sizeof(*entries));
+        if (n == null)
+          goto done;
+        entries = n;
+        e = &entries[i];
+      }
+      memset(&entries[count], 0, sizeof(*entries));
+      entries[count++].node = it->data;
+    }
+    qsort(entries + first, count - first, sizeof(*entries), pack_entry_cmp);
+    e->inode.child = first - 1;
+    e->inode.nchild = count - first;
+    for (size_t j = first; j < count; j++) {
+      entries[j].name = names->size;
+      mostream_write(names, entries[j].node->name,
+                     strlen(entries[j].node->name) + 1);
+    }
+  }
+
+  struct packfs_header header = {
+      .magic = PACKFS_MAGIC,
+      .version = PACKFS_VERSION,
+      .block_size = bs,
+      .inode_count = count,
+      .dentry_count = count - 1,
+  };
+  header.inode_off = sizeof(header);
+  header.dentry_off = header.inode_off + count * sizeof(struct packfs_inode);
+  header.name_off =
+      header.dentry_off + (count - 1) * sizeof(struct packfs_dentry);
+  header.data_off = (header.name_off + names->size + 15) / 16 * 16;
+  header.image_size = header.data_off + data->size;
+
+  size_t base = out->size;
+  mostream_write(out, &header, sizeof(header));
+  for (size_t i = 0; i < count; i++) {
+    if (entries[i].inode.type != file_dir)
+      entries[i].inode.data += header.data_off;
+    mostream_write(out, &entries[i].inode, sizeof(struct packfs_inode));
+  }
+  for (size_t i = 1; i < count; i++) {
+    struct packfs_dentry d = {.name = entries[i].name, .inode = i};
+    mostream_write(out, &d, sizeof(d));
+  }
+  mostream_write(out, names->buf, names->size);
+  while (out->size - base < header.data_off)
+    mostream_write(out, "", 1);
+  mostream_write(out, data->buf, data->size);
+  ret = out->size - base == header.image_size ? 0 : -1;
+
+done:
+  free(entries);
+  free(raw);
+  free(packed);
+  mostream_free(names);
+  mostream_free(data);
+  return ret;
+}
@@ -0,0 +1,204 @@
+// This code is released under the MIT License
+
+// 系统头文件需要在 vfs.h 之前引入，否则会与 val / var 宏冲突
+#include <stdio.h>
+
+#include <fs/procfs.h>
+#include <mem.h>
+#include <stats.h>
+
+enum {
+  procfs_kind_root,     // 根目录
+  procfs_kind_mountdir, // mount 文件夹
+  procfs_kind_ops,      // 全局的统计
+  procfs_kind_mounts,   // 挂载列表
+  procfs_kind_mount,    // 一个挂载的统计
+  procfs_kind_memory,   // 内存统计
+};
+
+typedef struct procfs_file {
+  int kind;
+  int mntid;   // procfs_kind_mount 的挂载编号
+  char *data;  // 最近一次生成的内容
+  size_t size;
+} *procfs_file_t;
+
+static int procfs_id = -1;
+
+static procfs_file_t procfs_file_alloc(int kind, int mntid) {
+  procfs_file_t file = calloc(1, sizeof(*file));
+  if (file == null)
+    return null;
+  file->kind = kind;
+  file->mntid = mntid;
+  return file;
+}
+
+static size_t procfs_mounts_format(char *buf, size_t size) {
+  size_t len = 0;
+  for (int id = 1; id < STATS_MOUNTS; id++) {
+    vfs_node_t root = stats_mount_root(id);
+    if (root == null)
+      continue;
+    char *path = vfs_get_fullpath(root);
+    len += snprintf(buf + min(len, size), size - min(len, size), "%d %s\n", id,
+                    path);
+    free(path);
+  }
+  return len;
+}
+
+static size_t procfs_format(procfs_file_t file, char *buf, size_t size) {
+  switch (file->kind) {
+  case procfs_kind_ops: return stats_format(-1, buf, size);
+  case procfs_kind_mounts: return procfs_mounts_format(buf, size);
+  case procfs_kind_memory: return mem_format(buf, size);
+  case procfs_kind_mount:
+    if (stats_mount_root(file->mntid) == null)
+      return 0;
+    return stats_format(file->mntid, buf, size);
+  }
+  return 0;
+}
+
+// 重新生成内容，缓冲区不够时按需要的长度重试
+static void procfs_generate(procfs_file_t file) {
+  size_t cap = 4096;
+  for (;;) {
+    char *buf = malloc(cap);
+    if (buf == null)
+      return;
+    size_t len = procfs_format(file, buf, cap);
+    if (len < cap) {
+      free(file->data);
+      file->data = buf;
+      file->size = len;
+      return;
+    }
+    free(buf);
+    cap = len + 1;
+  }
+}
+
+static void procfs_fill(procfs_file_t file, vfs_node_t node) {
+  bool dir =
+      file->kind == procfs_kind_root || file->kind == procfs_kind_mountdir;
+  node->info->type = dir ? file_dir : file_block;
+  node->info->size = file->size;
+  node->info->permissions = dir ? 0555 : 0444;
+}
+
+static bool procfs_has_child(vfs_node_t dir, cstr name) {
+  return list_first(dir->info->child, data,
+                    streq(name, ((vfs_node_t)data)->name)) != null;
+}
+
+// 为新的挂载创建节点，已卸载的挂载的节点保留，读取时为空
+static void procfs_scan_mounts(vfs_node_t node) {
+  for (int id = 1; id < STATS_MOUNTS; id++) {
+    char name[16];
+    sprintf(name, "%d", id);
+    if (stats_mount_root(id) != null && !procfs_has_child(node, name))
+      vfs_child_append(node, name, null);
+  }
+}
+
+static int procfs_mount(cstr src, vfs_node_t node) {
+  if (!streq(src, "proc"))
+    return -1;
+  procfs_file_t root = procfs_file_alloc(procfs_kind_root, 0);
+  if (root == null)
+    return -1;
+  node->info->handle = root;
+  procfs_fill(root, node);
+  vfs_child_append(node, "ops", null);
+  vfs_child_append(node, "mounts", null);
+  vfs_child_append(node, "mount", null);
+  vfs_child_append(node, "memory", null);
+  return 0;
+}
+
+static void procfs_close(void *current) {
+  procfs_file_t file = current;
+  free(file->data);
+  free(file);
+}
+
+static void procfs_unmount(void *root) {
+  if (root)
+    procfs_close(root);
+}
+
+static void procfs_open(void *parent, cstr name, vfs_node_t node) {
+  procfs_file_t dir = parent;
+  procfs_file_t file = null;
+  if (dir->kind == procfs_kind_root) {
+    if (streq(name, "ops"))
+      file = procfs_file_alloc(procfs_kind_ops, 0);
+    else if (streq(name, "mounts"))
+      file = procfs_file_alloc(procfs_kind_mounts, 0);
+    else if (streq(name, "mount"))
+      file = procfs_file_alloc(procfs_kind_mountdir, 0);
+    else if (streq(name, "memory"))
+      file = procfs_file_alloc(procfs_kind_memory, 0);
+  } else if (dir->kind == procfs_kind_mountdir) {
+    file = procfs_file_alloc(procfs_kind_mount, atoi(name));
+  }
+  if (file == null)
+    return;
+  node->info->handle = file;
+  if (file->kind == procfs_kind_mountdir)
+    procfs_scan_mounts(node);
+  else
+    procfs_generate(file);
+  procfs_fill(file, node);
+}
+
+static ssize_t procfs_read(void *file, void *addr, size_t offset,
+                           size_t size) {
+  procfs_file_t f = file;
+  if (f->kind == procfs_kind_root || f->kind == procfs_kind_mountdir)
+    return -1;
+  if (offset == 0)
+    procfs_generate(f);
+  if (offset >= f->size)
+    return 0;
+  size = min(size, f->size - offset);
+  memcpy(addr, f->data + offset, size);
+  return size;
+}
+
+static ssize_t procfs_write(void *file, const void *addr, size_t offset,
+                            size_t size) {
+  return -1;
+}
+
+static int procfs_mk(void *parent, cstr name, vfs_node_t node) {
+  return -1;
+}
+
+static int procfs_stat(void *file, vfs_node_t node) {
+  procfs_file_t f = file;
+  if (f->kind == procfs_kind_mountdir)
+    procfs_scan_mounts(node);
+  procfs_fill(f, node);
+  return 0;
+}
+
+static struct vfs_callback procfs_callbacks = {
+    .mount = procfs_mount,
+    .unmount = procfs_unmount,
+    .open = procfs_open,
+    .close = procfs_close,
+    .read = procfs_read,
+    .write = procfs_write,
+    .mkdir = procfs_mk,
+    .mkfile = procfs_mk,
+    .stat = procfs_stat,
+};
+
+int procfs_regist() {
+  if (procfs_id < 0)
+    procfs_id = vfs_regist("proc", &procfs_callbacks);
+  return procfs_id;
+}
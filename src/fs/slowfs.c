@@ -0,0 +1,484 @@
+// This code is released under the MIT License
+
+// 系统头文件需要在 vfs.h 之前引入，否则会与 val / var 宏冲突
+#include <pthread.h>
+#include <time.h>
+
+#include <fs/slowfs.h>
+
+enum {
+  slow_dist_fixed,
+  slow_dist_uniform,
+  slow_dist_exp,
+  slow_dist_normal,
+};
+
+typedef struct slow_dist {
+  int kind;
+  f64 a, b; // fixed: a；uniform: [a, b)；exp: 平均值 a；normal: 平均值 a，标准差 b
+} slow_dist_t;
+
+enum {
+  slow_class_read,
+  slow_class_write,
+  slow_class_meta,
+  slow_nclass,
+};
+
+typedef struct slow_fs {
+  vfs_node_t lower;              // 被包装的文件夹
+  slow_dist_t dist[slow_nclass]; // 各类请求的延迟分布 (ns)
+  u64 bw;                        // 带宽 (字节每秒)，0 为不限
+  u32 qd;                        // 同时进行的请求数，0 为不限
+  f64 spike_p;                   // 尖峰的概率
+  u64 spike;                     // 尖峰的延迟 (ns)
+  bool virtual;                  // 不等待，只累加延迟
+
+  spin_t lock;     // 保护以下字段
+  u64 seed;        // xorshift 的状态
+  u64 busy;        // 设备传输完已经到达的数据的时间
+  slowfs_stat_t stat;
+
+  pthread_mutex_t qlock; // qd 的计数
+  pthread_cond_t qcond;
+  u32 inflight;
+} *slow_fs_t;
+
+typedef struct slow_file {
+  slow_fs_t fs;
+  vfs_node_t lower;
+} *slow_file_t;
+
+static int slow_id = -1;
+
+static u64 slow_now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// ---------------------------------------------------------------------------
+// 延迟
+
+// [0, 1) 的随机数，需要持有 fs->lock
+static f64 slow_rand(slow_fs_t fs) {
+  fs->seed ^= fs->seed << 13;
+  fs->seed ^= fs->seed >> 7;
+  fs->seed ^= fs->seed << 17;
+  return (fs->seed >> 11) * (1.0 / (1ull << 53));
+}
+
+// ln(x)，x > 0：x = m * 2^e，m 在 [1, 2) 中，ln(m) = 2 atanh((m-1)/(m+1))
+static f64 slow_ln(f64 x) {
+  int e = 0;
+  for (; x >= 2; x /= 2)
+    e++;
+  for (; x < 1; x *= 2)
+    e--;
+  f64 z = (x - 1) / (x + 1), z2 = z * z, sum = 0, term = z;
+  for (int k = 1; k < 40; k += 2, term *= z2)
+    sum += term / k;
+  return 2 * sum + e * 0.69314718055994530942;
+}
+
+// 需要持有 fs->lock
+static f64 slow_sample(slow_fs_t fs, const slow_dist_t *d) {
+  switch (d->kind) {
+  case slow_dist_uniform: return d->a + (d->b - d->a) * slow_rand(fs);
+  case slow_dist_exp: return -d->a * slow_ln(1 - slow_rand(fs));
+  case slow_dist_normal: {
+    // 12 个均匀分布之和减 6 近似标准正态分布
+    f64 z = -6;
+    for (int i = 0; i < 12; i++)
+      z += slow_rand(fs);
+    return max(d->a + d->b * z, 0.0);
+  }
+  default: return d->a;
+  }
+}
+
+// 等待 qd 中的空位，计算并注入延迟；之后执行请求，再调用 slow_end
+static void slow_begin(slow_fs_t fs, int class, u64 bytes) {
+  bool waited = false;
+  if (fs->qd != 0) {
+    pthread_mutex_lock(&fs->qlock);
+    for (; fs->inflight >= fs->qd; waited = true)
+      pthread_cond_wait(&fs->qcond, &fs->qlock);
+    fs->inflight++;
+    pthread_mutex_unlock(&fs->qlock);
+  }
+
+  spin_lock(fs->lock);
+  u64 delay = slow_sample(fs, &fs->dist[class]);
+  if (fs->spike_p > 0 && slow_rand(fs) < fs->spike_p) {
+    delay += fs->spike;
+    fs->stat.spikes++;
+  }
+  if (fs->bw != 0 && bytes != 0) {
+    // 虚拟时间中设备从延迟结束时开始传输，之前的传输完成前不能开始
+    u64 now = fs->virtual ? fs->stat.delay : slow_now();
+    u64 start = max(now + delay, fs->busy);
+    fs->busy = start + bytes * 1000000000ull / fs->bw;
+    delay = fs->busy - now;
+  }
+  fs->stat.ops++;
+  fs->stat.bytes += bytes;
+  fs->stat.delay += delay;
+  fs->stat.waits += waited;
+  spin_unlock(fs->lock);
+
+  if (!fs->virtual && delay != 0) {
+    struct timespec ts = {delay / 1000000000, delay % 1000000000};
+    while (nanosleep(&ts, &ts) != 0) {}
+  }
+}
+
+static void slow_end(slow_fs_t fs) {
+  if (fs->qd == 0)
+    return;
+  pthread_mutex_lock(&fs->qlock);
+  fs->inflight--;
+  pthread_cond_signal(&fs->qcond);
+  pthread_mutex_unlock(&fs->qlock);
+}
+
+// ---------------------------------------------------------------------------
+// 选项
+
+// "100us" -> 100000，没有单位时为 ns
+static bool slow_parse_time(cstr s, f64 *ns) {
+  char *end;
+  f64 v = strtod(s, &end);
+  if (end == s || v < 0)
+    return false;
+  if (streq(end, "s"))
+    v *= 1e9;
+  else if (streq(end, "ms"))
+    v *= 1e6;
+  else if (streq(end, "us"))
+    v *= 1e3;
+  else if (*end != '\0' && !streq(end, "ns"))
+    return false;
+  *ns = v;
+  return true;
+}
+
+// "exp:100us"、"uniform:1ms:2ms" 或 "100us"
+static bool slow_parse_dist(char *s, slow_dist_t *d) {
+  static const char *kinds[] = {"fixed", "uniform", "exp", "normal"};
+  char *save, *kind = strtok_r(s, ":", &save), *a = strtok_r(null, ":", &save);
+  char *b = strtok_r(null, ":", &save);
+  if (a == null)
+    return slow_parse_time(kind, &d->a) && (d->kind = slow_dist_fixed, true);
+  for (d->kind = 0; d->kind < 4 && !streq(kind, kinds[d->kind]); d->kind++) {}
+  if (d->kind == 4 || !slow_parse_time(a, &d->a))
+    return false;
+  bool two = d->kind == slow_dist_uniform || d->kind == slow_dist_normal;
+  if (two != (b != null) || (b != null && !slow_parse_time(b, &d->b)))
+    return false;
+  return d->kind != slow_dist_uniform || d->b >= d->a;
+}
+
+static bool slow_parse_rate(cstr s, u64 *rate) {
+  char *end;
+  u64 v = strtoull(s, &end, 10);
+  switch (*end) {
+  case 'k':
+  case 'K': v *= 1024, end++; break;
+  case 'm':
+  case 'M': v *= 1024 * 1024, end++; break;
+  case 'g':
+  case 'G': v *= 1024 * 1024 * 1024, end++; break;
+  }
+  *rate = v;
+  return end != s && *end == '\0';
+}
+
+// "0.01:20ms" 或 "1%:20ms"
+static bool slow_parse_spike(char *s, slow_fs_t fs) {
+  char *end, *colon = strchr(s, ':');
+  if (colon == null)
+    return false;
+  *colon = '\0';
+  f64 p = strtod(s, &end);
+  if (*end == '%')
+    p /= 100, end++;
+  f64 t;
+  if (end == s || *end != '\0' || p < 0 || p > 1 ||
+      !slow_parse_time(colon + 1, &t))
+    return false;
+  fs->spike_p = p;
+  fs->spike = t;
+  return true;
+}
+
+static slow_fs_t slow_parse(cstr src) {
+  if (src == null || strncmp(src, "slowdir=", 8) != 0)
+    return null;
+  slow_fs_t fs = calloc(1, sizeof(*fs));
+  char *opts = strdup(src);
+  if (fs == null || opts == null)
+    goto err;
+  fs->seed = 0x9e3779b97f4a7c15ull;
+  for (char *save, *opt = strtok_r(opts, ",", &save); opt;
+       opt = strtok_r(null, ",", &save)) {
+    char *eq = strchr(opt, '=');
+    char *value = eq ? eq + 1 : null;
+    if (eq)
+      *eq = '\0';
+    bool ok = false;
+    if (streq(opt, "virtual")) {
+      ok = value == null;
+      fs->virtual = true;
+    } else if (value == null) {
+      ok = false;
+    } else if (streq(opt, "slowdir")) {
+      fs->lower = vfs_open(value);
+      ok = fs->lower != null && fs->lower->info->type == file_dir;
+    } else if (streq(opt, "read")) {
+      ok = slow_parse_dist(value, &fs->dist[slow_class_read]);
+    } else if (streq(opt, "write")) {
+      ok = slow_parse_dist(value, &fs->dist[slow_class_write]);
+    } else if (streq(opt, "meta")) {
+      ok = slow_parse_dist(value, &fs->dist[slow_class_meta]);
+    } else if (streq(opt, "bw")) {
+      ok = slow_parse_rate(value, &fs->bw);
+    } else if (streq(opt, "qd")) {
+      u64 qd;
+      ok = slow_parse_rate(value, &qd) && qd <= U32_MAX;
+      fs->qd = qd;
+    } else if (streq(opt, "spike")) {
+      ok = slow_parse_spike(value, fs);
+    } else if (streq(opt, "seed")) {
+      ok = slow_parse_rate(value, &fs->seed);
+      fs->seed |= fs->seed == 0; // xorshift 的状态不能为 0
+    }
+    if (!ok)
+      goto err;
+  }
+  free(opts);
+  pthread_mutex_init(&fs->qlock, null);
+  pthread_cond_init(&fs->qcond, null);
+  return fs;
+
+err:
+  free(fs);
+  free(opts);
+  return null;
+}
+
+// ---------------------------------------------------------------------------
+// 驱动
+
+static slow_file_t slow_file_alloc(slow_fs_t fs, vfs_node_t lower) {
+  slow_file_t file = malloc(sizeof(*file));
+  if (file == null)
+    return null;
+  file->fs = fs;
+  file->lower = lower;
+  return file;
+}
+
+static void slow_fill(vfs_node_t lower, vfs_node_t node) {
+  vfs_update(lower);
+  node->info->type = lower->info->type;
+  node->info->size = lower->info->size;
+  node->info->realsize = lower->info->realsize;
+  node->info->createtime = lower->info->createtime;
+  node->info->readtime = lower->info->readtime;
+  node->info->writetime = lower->info->writetime;
+  node->info->owner = lower->info->owner;
+  node->info->group = lower->info->group;
+  node->info->permissions = lower->info->permissions;
+}
+
+// 为文件夹的每个子项创建 vfs 节点 (只创建节点，不打开)
+static void slow_scan(slow_file_t dir, vfs_node_t node) {
+  if (node->info->child != null || node->info->type != file_dir)
+    return;
+  list_foreach(dir->lower->info->child, it) {
+    vfs_node_t child = it->data;
+    vfs_child_append(node, child->name, null);
+  }
+}
+
+// 下层中 dir 的子项 name 的路径
+static char *slow_path(slow_file_t dir, cstr name) {
+  char *base = vfs_get_fullpath(dir->lower);
+  if (base == null)
+    return null;
+  size_t n = strlen(base);
+  char *path = malloc(n + strlen(name) + 2);
+  if (path != null)
+    sprintf(path, "%s%s%s", base, n && base[n - 1] == '/' ? "" : "/", name);
+  free(base);
+  return path;
+}
+
+static int slow_mount(cstr src, vfs_node_t node) {
+  slow_fs_t fs = slow_parse(src);
+  if (fs == null)
+    return -1;
+  slow_file_t root = slow_file_alloc(fs, fs->lower);
+  if (root == null) {
+    free(fs);
+    return -1;
+  }
+  node->info->handle = root;
+  slow_fill(fs->lower, node);
+  slow_scan(root, node);
+  return 0;
+}
+
+static void slow_unmount(void *root) {
+  slow_file_t file = root;
+  if (file == null)
+    return;
+  pthread_mutex_destroy(&file->fs->qlock);
+  pthread_cond_destroy(&file->fs->qcond);
+  free(file->fs);
+  free(file);
+}
+
+static void slow_open(void *parent, cstr name, vfs_node_t node) {
+  slow_file_t dir = parent;
+  if (dir == null)
+    return;
+  char *path = slow_path(dir, name);
+  if (path == null)
+    return;
+  slow_begin(dir->fs, slow_class_meta, 0);
+  vfs_node_t lower = vfs_open(path);
+  slow_end(dir->fs);
+  free(path);
+  slow_file_t file = lower ? slow_file_alloc(dir->fs, lower) : null;
+  if (file == null)
+    return;
+  node->info->handle = file;
+  slow_fill(lower, node);
+  slow_scan(file, node);
+}
+
+static void slow_close(void *current) {
+  free(current);
+}
+
+static ssize_t slow_read(void *file, void *addr, size_t offset, size_t size) {
+  slow_file_t f = file;
+  slow_begin(f->fs, slow_class_read, size);
+  ssize_t ret = vfs_read(f->lower, addr, offset, size);
+  slow_end(f->fs);
+  return ret;
+}
+
+static ssize_t slow_write(void *file, const void *addr, size_t offset,
+                          size_t size) {
+  slow_file_t f = file;
+  slow_begin(f->fs, slow_class_write, size);
+  ssize_t ret = vfs_write(f->lower, addr, offset, size);
+  slow_end(f->fs);
+  return ret;
+}
+
+static int slow_mk(void *parent, cstr name, vfs_node_t node, bool is_dir) {
+  slow_file_t dir = parent;
+  char *path = slow_path(dir, name);
+  if (path == null)
+    return -1;
+  slow_begin(dir->fs, slow_class_meta, 0);
+  int ret = is_dir ? vfs_mkdir(path) : vfs_mkfile(path);
+  vfs_node_t lower = ret == 0 ? vfs_open(path) : null;
+  slow_end(dir->fs);
+  free(path);
+  slow_file_t file = lower ? slow_file_alloc(dir->fs, lower) : null;
+  if (file == null)
+    return -1;
+  node->info->handle = file;
+  slow_fill(lower, node);
+  return 0;
+}
+
+static int slow_mkdir(void *parent, cstr name, vfs_node_t node) {
+  return slow_mk(parent, name, node, true);
+}
+
+static int slow_mkfile(void *parent, cstr name, vfs_node_t node) {
+  return slow_mk(parent, name, node, false);
+}
+
+static int slow_stat(void *file, vfs_node_t node) {
+  slow_fill(((slow_file_t)file)->lower, node);
+  return 0;
+}
+
+static int slow_resize(void *file, u64 size) {
+  slow_file_t f = file;
+  slow_begin(f->fs, slow_class_meta, 0);
+  int ret = vfs_truncate(f->lower, size);
+  slow_end(f->fs);
+  return ret;
+}
+
+static int slow_remove(void *parent, cstr name) {
+  slow_file_t dir = parent;
+  char *path = slow_path(dir, name);
+  if (path == null)
+    return -1;
+  slow_begin(dir->fs, slow_class_meta, 0);
+  vfs_node_t lower = vfs_open(path);
+  int ret = lower == null                      ? -1
+            : lower->info->type == file_dir ? vfs_rmdir(path)
+                                             : vfs_unlink(path);
+  slow_end(dir->fs);
+  free(path);
+  return ret;
+}
+
+static int slow_rename(void *old_parent, cstr old_name, void *new_parent,
+                       cstr new_name) {
+  slow_file_t from = old_parent, to = new_parent;
+  char *oldpath = slow_path(from, old_name), *newpath = slow_path(to, new_name);
+  int ret = -1;
+  if (oldpath != null && newpath != null) {
+    slow_begin(from->fs, slow_class_meta, 0);
+    ret = vfs_rename(oldpath, newpath);
+    slow_end(from->fs);
+  }
+  free(oldpath);
+  free(newpath);
+  return ret;
+}
+
+static struct vfs_callback slow_callbacks = {
+    .mount = slow_mount,
+    .unmount = slow_unmount,
+    .open = slow_open,
+    .close = slow_close,
+    .read = slow_read,
+    .write = slow_write,
+    .mkdir = slow_mkdir,
+    .mkfile = slow_mkfile,
+    .stat = slow_stat,
+    .resize = slow_resize,
+    .remove = slow_remove,
+    .rename = slow_rename,
+};
+
+int slowfs_regist() {
+  if (slow_id < 0)
+    slow_id = vfs_regist("slowfs", &slow_callbacks);
+  return slow_id;
+}
+
+int slowfs_stat(vfs_node_t node, slowfs_stat_t *stat) {
+  if (node == null || stat == null || slow_id < 0 ||
+      node->info->fsid != slow_id || node->info->root == null)
+    return -1;
+  slow_file_t root = node->info->root->info->handle;
+  if (root == null)
+    return -1;
+  spin_lock(root->fs->lock);
+  *stat = root->fs->stat;
+  spin_unlock(root->fs->lock);
+  return 0;
+}
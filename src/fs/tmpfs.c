@@ -0,0 +1,511 @@
+// This code is released under the MIT License
+
+// 系统头文件需要在 vfs.h 之前引入，否则会与 val / var 宏冲突
+#include <time.h>
+
+#define RBTREE_IMPLEMENTATION
+#include <fs/tmpfs.h>
+
+#define TMPFS_MAX_PAGES ((u64)INT32_MAX) // 红黑树的键为 int32
+
+// 页可以被多个文件共享 (vfs_copy_range 的克隆)，写入共享的页前先复制
+typedef struct tmpfs_page {
+  u32 refs; // 共享这个页的文件数量
+  byte data[PAGE_SIZE];
+} *tmpfs_page_t;
+
+typedef struct tmpfs_file *tmpfs_file_t;
+struct tmpfs_file {
+  u16 type;            // 类型
+  u32 nlink;           // 指向这个文件的名称数量
+  u64 size;            // 文件大小
+  rbtree_t pages;      // 页号 -> 页，不存在的页是空洞
+  size_t allocated;    // 已分配的页数
+  list_t childs;       // 文件夹的子项 (tmpfs_dentry_t)
+  st_t xattrs;         // 扩展属性: 名称 -> tmpfs_xattr_t
+  u64 createtime;      // 创建时间
+  u64 writetime;       // 最后写入时间
+};
+
+// 文件夹中的一项，硬链接的各个名称指向同一个文件
+typedef struct tmpfs_dentry {
+  char *name;
+  tmpfs_file_t file;
+} *tmpfs_dentry_t;
+
+typedef struct tmpfs_xattr {
+  size_t size;
+  byte data[];
+} *tmpfs_xattr_t;
+
+static int tmpfs_id = -1;
+
+static void tmpfs_page_put(tmpfs_page_t page) {
+  if (--page->refs == 0)
+    free(page);
+}
+
+static tmpfs_file_t tmpfs_file_alloc(u16 type) {
+  tmpfs_file_t file = malloc(sizeof(*file));
+  if (file == null)
+    return null;
+  memset(file, 0, sizeof(*file));
+  file->type = type;
+  file->nlink = 1;
+  file->createtime = file->writetime = time(null);
+  return file;
+}
+
+static void tmpfs_dentry_free(tmpfs_dentry_t dentry);
+
+// 最后一个名称删除时才释放文件
+static void tmpfs_file_put(tmpfs_file_t file) {
+  if (--file->nlink > 0)
+    return;
+  list_free_with(file->childs, (free_t)tmpfs_dentry_free);
+  rbtree_free_with(file->pages, (free_t)tmpfs_page_put);
+  if (file->xattrs != null) {
+    for (usize i = 0; i <= file->xattrs->mask; i++) {
+      for (st_node_t n = file->xattrs->buckets[i]; n; n = n->next)
+        free(n->value);
+    }
+    st_free(file->xattrs);
+  }
+  free(file);
+}
+
+static tmpfs_dentry_t tmpfs_dentry_alloc(tmpfs_file_t dir, cstr name,
+                                         tmpfs_file_t file) {
+  tmpfs_dentry_t dentry = malloc(sizeof(*dentry));
+  if (dentry == null)
+    return null;
+  dentry->name = strdup(name);
+  if (dentry->name == null) {
+    free(dentry);
+    return null;
+  }
+  dentry->file = file;
+  list_prepend(dir->childs, dentry);
+  return dentry;
+}
+
+static void tmpfs_dentry_free(tmpfs_dentry_t dentry) {
+  tmpfs_file_put(dentry->file);
+  free(dentry->name);
+  free(dentry);
+}
+
+static tmpfs_dentry_t tmpfs_lookup(tmpfs_file_t dir, cstr name) {
+  return list_first(dir->childs, data,
+                    streq(name, ((tmpfs_dentry_t)data)->name));
+}
+
+static tmpfs_file_t tmpfs_find(tmpfs_file_t dir, cstr name) {
+  tmpfs_dentry_t dentry = tmpfs_lookup(dir, name);
+  return dentry ? dentry->file : null;
+}
+
+static void tmpfs_fill(tmpfs_file_t file, vfs_node_t node) {
+  node->info->type = file->type;
+  node->info->size = file->size;
+  node->info->realsize = file->allocated * PAGE_SIZE;
+  node->info->nlink = file->nlink;
+  node->info->createtime = file->createtime;
+  node->info->writetime = file->writetime;
+}
+
+static int tmpfs_mount(cstr src, vfs_node_t node) {
+  if (!streq(src, "tmpfs"))
+    return -1;
+  tmpfs_file_t root = tmpfs_file_alloc(file_dir);
+  if (root == null)
+    return -1;
+  node->info->handle = root;
+  tmpfs_fill(root, node);
+  return 0;
+}
+
+static void tmpfs_unmount(void *root) {
+  if (root)
+    tmpfs_file_put(root);
+}
+
+static void tmpfs_open(void *parent, cstr name, vfs_node_t node) {
+  tmpfs_file_t dir = parent;
+  if (dir == null || dir->type != file_dir)
+    return;
+  tmpfs_file_t file = tmpfs_find(dir, name);
+  if (file == null)
+    return;
+  node->info->handle = file;
+  tmpfs_fill(file, node);
+}
+
+// 数据属于文件系统而不是打开的节点，关闭时不需要释放
+static void tmpfs_close(void *current) {}
+
+static ssize_t tmpfs_read(void *file, void *addr, size_t offset,
+                          size_t size) {
+  tmpfs_file_t f = file;
+  if (f->type == file_dir)
+    return -1;
+  if (offset >= f->size)
+    return 0;
+  size = min(size, f->size - offset);
+  for (size_t done = 0; done < size;) {
+    size_t pg = (offset + done) / PAGE_SIZE;
+    size_t inpg = (offset + done) % PAGE_SIZE;
+    size_t n = min(PAGE_SIZE - inpg, size - done);
+    tmpfs_page_t page = rbtree_get(f->pages, pg);
+    if (page != null)
+      memcpy(addr + done, page->data + inpg, n);
+    else
+      memset(addr + done, 0, n);
+    done += n;
+  }
+  return size;
+}
+
+// 获取可以写入的页：空洞分配一个清零的页，共享的页先复制一份
+static byte *tmpfs_page(tmpfs_file_t f, u64 pg) {
+  if (pg >= TMPFS_MAX_PAGES)
+    return null;
+  rbtree_t node = rbtree_get_node(f->pages, pg);
+  tmpfs_page_t old = node ? node->value : null;
+  if (old != null && old->refs == 1)
+    return old->data;
+  tmpfs_page_t page = malloc(sizeof(*page));
+  if (page == null)
+    return null;
+  page->refs = 1;
+  if (old != null) {
+    memcpy(page->data, old->data, PAGE_SIZE);
+    tmpfs_page_put(old);
+    node->value = page;
+  } else {
+    memset(page->data, 0, PAGE_SIZE);
+    rbtree_insert(f->pages, pg, page);
+    f->allocated++;
+  }
+  return page->data;
+}
+
+// 将同一页内的 [offset, end) 清零
+static void tmpfs_zero(tmpfs_file_t f, u64 offset, u64 end) {
+  u64 pg = offset / PAGE_SIZE;
+  if (offset >= end || rbtree_get(f->pages, pg) == null)
+    return;
+  byte *page = tmpfs_page(f, pg);
+  if (page != null)
+    memset(page + offset % PAGE_SIZE, 0, end - offset);
+}
+
+// 释放范围内完整的页，不完整的页只清零
+static void tmpfs_punch(tmpfs_file_t f, u64 offset, u64 end) {
+  end = min(end, TMPFS_MAX_PAGES * PAGE_SIZE);
+  if (offset >= end)
+    return;
+  u64 first = (offset + PAGE_SIZE - 1) / PAGE_SIZE; // 第一个完整的页
+  u64 last = end / PAGE_SIZE;                        // 最后一个完整的页之后
+  if (first > last) {
+    tmpfs_zero(f, offset, end);
+    return;
+  }
+  tmpfs_zero(f, offset, first * PAGE_SIZE);
+  tmpfs_zero(f, last * PAGE_SIZE, end);
+  // 只访问已分配的页，打一个很大的洞也不需要逐页遍历
+  for (rbtree_t n; (n = rbtree_ceil(f->pages, first)) && (u64)n->key < last;) {
+    first = n->key;
+    tmpfs_page_put(n->value);
+    rbtree_delete(f->pages, first);
+    f->allocated--;
+  }
+}
+
+static ssize_t tmpfs_write(void *file, const void *addr, size_t offset,
+                           size_t size) {
+  tmpfs_file_t f = file;
+  if (f->type == file_dir)
+    return -1;
+  if (size == 0)
+    return 0;
+  size_t done = 0;
+  while (done < size) {
+    size_t pg = (offset + done) / PAGE_SIZE;
+    size_t inpg = (offset + done) % PAGE_SIZE;
+    size_t n = min(PAGE_SIZE - inpg, size - done);
+    byte *page = tmpfs_page(f, pg);
+    if (page == null)
+      break;
+    memcpy(page + inpg, addr + done, n);
+    done += n;
+  }
+  if (done == 0)
+    return -1;
+  f->size = max(f->size, offset + done);
+  f->writetime = time(null);
+  return done;
+}
+
+static int tmpfs_resize(void *file, u64 size) {
+  tmpfs_file_t f = file;
+  if (f->type == file_dir || size > TMPFS_MAX_PAGES * PAGE_SIZE)
+    return -1;
+  // 缩小时丢弃末尾之后的数据，之后再扩大时读取为 0
+  if (size < f->size)
+    tmpfs_punch(f, size, TMPFS_MAX_PAGES * PAGE_SIZE);
+  f->size = size;
+  f->writetime = time(null);
+  return 0;
+}
+
+static int tmpfs_fallocate(void *file, int mode, u64 offset, u64 size) {
+  tmpfs_file_t f = file;
+  if (f->type == file_dir)
+    return -1;
+  u64 end = offset + size;
+  if (mode & vfs_falloc_punch_hole) {
+    tmpfs_punch(f, offset, end);
+    return 0;
+  }
+  if (mode & vfs_falloc_zero_range)
+    tmpfs_punch(f, offset, end);
+  for (u64 pg = offset / PAGE_SIZE; pg * PAGE_SIZE < end; pg++) {
+    if (rbtree_get(f->pages, pg) == null && tmpfs_page(f, pg) == null)
+      return -1;
+  }
+  if (!(mode & vfs_falloc_keep_size))
+    f->size = max(f->size, end);
+  return 0;
+}
+
+static i64 tmpfs_seek(void *file, u64 offset, bool hole) {
+  tmpfs_file_t f = file;
+  if (f->type == file_dir)
+    return -1;
+  u64 pg = offset / PAGE_SIZE;
+  if (!hole) {
+    rbtree_t n = pg < TMPFS_MAX_PAGES ? rbtree_ceil(f->pages, pg) : null;
+    if (n == null)
+      return -1;
+    return (u64)n->key == pg ? offset : (u64)n->key * PAGE_SIZE;
+  }
+  // 跳过连续的已分配的页
+  u64 end = pg;
+  while (end * PAGE_SIZE < f->size && rbtree_get(f->pages, end) != null)
+    end++;
+  return end == pg ? offset : end * PAGE_SIZE;
+}
+
+static void *tmpfs_map(void *file, size_t offset, size_t size) {
+  tmpfs_file_t f = file;
+  if (f->type == file_dir || offset + size > f->size)
+    return null;
+  if (offset / PAGE_SIZE != (offset + size - 1) / PAGE_SIZE)
+    return null;
+  tmpfs_page_t page = rbtree_get(f->pages, offset / PAGE_SIZE);
+  return page ? page->data + offset % PAGE_SIZE : null;
+}
+
+// 复制不满一页的部分，范围不跨页
+static int tmpfs_copy_bytes(tmpfs_file_t src, u64 src_off, tmpfs_file_t dst,
+                            u64 dst_off, u64 size) {
+  if (size == 0)
+    return 0;
+  byte *page = tmpfs_page(dst, dst_off / PAGE_SIZE);
+  if (page == null)
+    return -1;
+  ssize_t n = tmpfs_read(src, page + dst_off % PAGE_SIZE, src_off, size);
+  return n == (ssize_t)size ? 0 : -1;
+}
+
+// 页内偏移相同时完整的页直接共享，写入时再复制
+static ssize_t tmpfs_copy_range(void *src, u64 src_off, void *dst,
+                                u64 dst_off, u64 size) {
+  tmpfs_file_t s = src, d = dst;
+  if (s->type == file_dir || d->type == file_dir)
+    return -1;
+  if (src_off % PAGE_SIZE != dst_off % PAGE_SIZE)
+    return -1;
+  size = src_off < s->size ? min(size, s->size - src_off) : 0;
+  u64 first = (src_off + PAGE_SIZE - 1) / PAGE_SIZE; // 第一个完整的页
+  u64 last = (src_off + size) / PAGE_SIZE;           // 最后一个完整的页之后
+  if (first >= last || (dst_off + size) / PAGE_SIZE >= TMPFS_MAX_PAGES)
+    return -1;
+
+  // 首尾不满一页的部分复制失败时在共享任何页之前返回，由 vfs 逐段复制
+  u64 head = first * PAGE_SIZE - src_off;
+  u64 tail = src_off + size - last * PAGE_SIZE;
+  if (tmpfs_copy_bytes(s, src_off, d, dst_off, head) < 0)
+    return -1;
+  if (tmpfs_copy_bytes(s, last * PAGE_SIZE, d, dst_off + size - tail, tail) < 0)
+    return -1;
+  u64 dst_first = (dst_off + head) / PAGE_SIZE;
+  tmpfs_punch(d, dst_first * PAGE_SIZE, (dst_first + last - first) * PAGE_SIZE);
+  // 源文件中的空洞在目标文件中也是空洞
+  for (u64 pg = first; ; pg++) {
+    rbtree_t n = rbtree_ceil(s->pages, pg);
+    if (n == null || (u64)n->key >= last)
+      break;
+    pg = n->key;
+    tmpfs_page_t page = n->value;
+    page->refs++;
+    rbtree_insert(d->pages, dst_first + (pg - first), page);
+    d->allocated++;
+  }
+  d->size = max(d->size, dst_off + size);
+  d->writetime = time(null);
+  return size;
+}
+
+static int tmpfs_mk(void *parent, cstr name, vfs_node_t node, u16 type) {
+  tmpfs_file_t dir = parent;
+  if (dir == null || dir->type != file_dir || tmpfs_find(dir, name) != null)
+    return -1;
+  tmpfs_file_t file = tmpfs_file_alloc(type);
+  if (file == null)
+    return -1;
+  if (tmpfs_dentry_alloc(dir, name, file) == null) {
+    tmpfs_file_put(file);
+    return -1;
+  }
+  node->info->handle = file;
+  tmpfs_fill(file, node);
+  return 0;
+}
+
+static int tmpfs_mkdir(void *parent, cstr name, vfs_node_t node) {
+  return tmpfs_mk(parent, name, node, file_dir);
+}
+
+static int tmpfs_mkfile(void *parent, cstr name, vfs_node_t node) {
+  return tmpfs_mk(parent, name, node, file_block);
+}
+
+static int tmpfs_remove(void *parent, cstr name) {
+  tmpfs_file_t dir = parent;
+  tmpfs_dentry_t dentry = tmpfs_lookup(dir, name);
+  if (dentry == null || dentry->file->childs != null)
+    return -1;
+  list_delete(dir->childs, dentry);
+  tmpfs_dentry_free(dentry);
+  return 0;
+}
+
+// 只是把名称移到另一个子项列表中，数据和子项都不需要复制
+static int tmpfs_rename(void *old_parent, cstr old_name, void *new_parent,
+                        cstr new_name) {
+  tmpfs_file_t from = old_parent, to = new_parent;
+  tmpfs_dentry_t dentry = tmpfs_lookup(from, old_name);
+  if (dentry == null || to->type != file_dir)
+    return -1;
+  tmpfs_dentry_t target = tmpfs_lookup(to, new_name);
+  // 两个名称指向同一个文件时什么也不做
+  if (target != null && target->file == dentry->file)
+    return 0;
+  tmpfs_file_t file = dentry->file;
+  if (target != null && ((target->file->type == file_dir) !=
+                             (file->type == file_dir) ||
+                         target->file->childs != null))
+    return -1;
+  char *name = strdup(new_name);
+  if (name == null)
+    return -1;
+  if (target != null) {
+    list_delete(to->childs, target);
+    tmpfs_dentry_free(target);
+  }
+  list_delete(from->childs, dentry);
+  free(dentry->name);
+  dentry->name = name;
+  list_prepend(to->childs, dentry);
+  return 0;
+}
+
+static int tmpfs_link(void *old_parent, cstr old_name, void *new_parent,
+                      cstr new_name) {
+  tmpfs_file_t file = tmpfs_find(old_parent, old_name);
+  if (file == null || file->type == file_dir ||
+      tmpfs_lookup(new_parent, new_name) != null)
+    return -1;
+  if (tmpfs_dentry_alloc(new_parent, new_name, file) == null)
+    return -1;
+  file->nlink++;
+  return 0;
+}
+
+static ssize_t tmpfs_getxattr(void *file, cstr name, void *value,
+                              size_t size) {
+  tmpfs_file_t f = file;
+  tmpfs_xattr_t attr = f->xattrs ? st_get(f->xattrs, name) : null;
+  if (attr == null || (size != 0 && size < attr->size))
+    return -1;
+  if (size != 0)
+    memcpy(value, attr->data, attr->size);
+  return attr->size;
+}
+
+static int tmpfs_setxattr(void *file, cstr name, const void *value,
+                          size_t size) {
+  tmpfs_file_t f = file;
+  if (f->xattrs == null && (f->xattrs = st_new()) == null)
+    return -1;
+  tmpfs_xattr_t attr = malloc(sizeof(*attr) + size);
+  if (attr == null)
+    return -1;
+  attr->size = size;
+  if (size != 0)
+    memcpy(attr->data, value, size);
+  free(st_set(f->xattrs, name, attr));
+  return 0;
+}
+
+static ssize_t tmpfs_listxattr(void *file, char *list, size_t size) {
+  tmpfs_file_t f = file;
+  size_t total = 0;
+  for (usize i = 0; f->xattrs && i <= f->xattrs->mask; i++) {
+    for (st_node_t n = f->xattrs->buckets[i]; n; n = n->next) {
+      size_t len = strlen(n->key) + 1;
+      if (size != 0 && total + len > size)
+        return -1;
+      if (size != 0)
+        memcpy(list + total, n->key, len);
+      total += len;
+    }
+  }
+  return total;
+}
+
+static int tmpfs_stat(void *file, vfs_node_t node) {
+  tmpfs_fill(file, node);
+  return 0;
+}
+
+static struct vfs_callback tmpfs_callbacks = {
+    .mount = tmpfs_mount,
+    .unmount = tmpfs_unmount,
+    .open = tmpfs_open,
+    .close = tmpfs_close,
+    .read = tmpfs_read,
+    .write = tmpfs_write,
+    .mkdir = tmpfs_mkdir,
+    .mkfile = tmpfs_mkfile,
+    .stat = tmpfs_stat,
+    .resize = tmpfs_resize,
+    .fallocate = tmpfs_fallocate,
+    .seek = tmpfs_seek,
+    .map = tmpfs_map,
+    .copy_range = tmpfs_copy_range,
+    .remove = tmpfs_remove,
+    .rename = tmpfs_rename,
+    .link = tmpfs_link,
+    .getxattr = tmpfs_getxattr,
+    .setxattr = tmpfs_setxattr,
+    .listxattr = tmpfs_listxattr,
+};
+
+int tmpfs_regist() {
+  if (tmpfs_id < 0)
+    tmpfs_id = vfs_regist("tmpfs", &tmpfs_callbacks);
+  return tmpfs_id;
+}
@@ -0,0 +1,284 @@
+// This code is released under the MIT License
+
+// 系统头文件需要在 vfs.h 之前引入，否则会与 val / var 宏冲突
+#include <pthread.h>
+
+#define RBTREE_IV_IMPLEMENTATION
+#include <lock.h>
+#include <stats.h>
+#include <trace.h>
+
+#define LOCK_DEADLOCK_DEPTH 32 // 等待关系链的最大检查长度
+
+// 锁的持有者为调用的线程
+struct lock_owner {
+  struct lock_owner *blocked_by; // 正在等待的持有者，用于检测死锁
+};
+
+// 已持有的一段锁，区间树节点在开头，可以直接转换
+typedef struct lock_range {
+  struct rbtree_iv node;
+  int type;
+  struct lock_owner *owner;
+} *lock_range_t;
+
+typedef struct lock_waiter {
+  u64 start, end;
+  int type;
+  struct lock_owner *owner;
+  pthread_cond_t cond;
+  bool granted; // 已由释放锁的线程授予
+  int result;
+  struct lock_waiter *next;
+} *lock_waiter_t;
+
+struct vfs_locks {
+  pthread_mutex_t mutex;
+  rbtree_iv_t tree;      // lock_range_t，以起点为键
+  lock_waiter_t waiters; // 按到达顺序排列
+};
+
+static _Thread_local struct lock_owner lock_self;
+static spin_t lock_graph = false;       // 保护各个线程的 blocked_by
+static spin_t lock_table_lock = false; // 保护锁表的创建
+
+static struct vfs_locks *lock_table_of(vfs_node_t node) {
+  if (atom_load(&node->info->locks) != null)
+    return node->info->locks;
+  struct vfs_locks *locks = calloc(1, sizeof(*locks));
+  if (locks == null)
+    return null;
+  pthread_mutex_init(&locks->mutex, null);
+  spin_lock(lock_table_lock);
+  if (node->info->locks == null) {
+    atom_store(&node->info->locks, locks);
+    locks = null;
+  }
+  spin_unlock(lock_table_lock);
+  if (locks != null) { // 其它线程先创建了
+    pthread_mutex_destroy(&locks->mutex);
+    free(locks);
+  }
+  return node->info->locks;
+}
+
+void lock_table_free(struct vfs_locks *locks) {
+  if (locks == null)
+    return;
+  rbtree_iv_free(locks->tree);
+  pthread_mutex_destroy(&locks->mutex);
+  free(locks);
+}
+
+static bool lock_conflicts(int a, int b) {
+  return a == vfs_lock_exclusive || b == vfs_lock_exclusive;
+}
+
+static bool lock_holds(struct vfs_locks *locks, struct lock_owner *owner,
+                       u64 start, u64 end) {
+  for (rbtree_iv_t n = rbtree_iv_first(locks->tree, start, end); n;
+       n = rbtree_iv_next(n, start, end)) {
+    if (((lock_range_t)n)->owner == owner)
+      return true;
+  }
+  return false;
+}
+
+// 返回第一个与请求冲突的持有者，upto 之前排队的请求也算在内
+// 排队的请求可能正在等待请求者自己持有的锁，这时不让请求者排在它后面
+static struct lock_owner *lock_blocker(struct vfs_locks *locks, u64 start,
+                                       u64 end, int type,
+                                       struct lock_owner *owner,
+                                       lock_waiter_t upto) {
+  for (rbtree_iv_t n = rbtree_iv_first(locks->tree, start, end); n;
+       n = rbtree_iv_next(n, start, end)) {
+    lock_range_t range = (lock_range_t)n;
+    if (range->owner != owner && lock_conflicts(range->type, type))
+      return range->owner;
+  }
+  for (lock_waiter_t w = locks->waiters; w != upto; w = w->next) {
+    if (w->owner != owner && w->start < end && start < w->end &&
+        lock_conflicts(w->type, type) &&
+        !lock_holds(locks, owner, w->start, w->end))
+      return w->owner;
+  }
+  return null;
+}
+
+static bool lock_insert(struct vfs_locks *locks, u64 start, u64 end, int type,
+                        struct lock_owner *owner) {
+  lock_range_t range = malloc(sizeof(*range));
+  if (range == null)
+    return false;
+  range->node.start = start;
+  range->node.end = end;
+  range->node.value = range;
+  range->type = type;
+  range->owner = owner;
+  rbtree_iv_insert(locks->tree, &range->node);
+  return true;
+}
+
+// 去掉 owner 在 [start, end) 中的锁，部分重叠的锁被切开
+static int lock_clear(struct vfs_locks *locks, u64 start, u64 end,
+                      struct lock_owner *owner) {
+  int ret = 0;
+  rbtree_iv_t n = rbtree_iv_first(locks->tree, start, end);
+  while (n != null) {
+    rbtree_iv_t next = rbtree_iv_next(n, start, end);
+    lock_range_t range = (lock_range_t)n;
+    if (range->owner == owner) {
+      rbtree_iv_remove(locks->tree, n);
+      // 切下的部分不与 [start, end) 重叠，不会再被遍历到
+      if (n->start < start &&
+          !lock_insert(locks, n->start, start, range->type, owner))
+        ret = -1;
+      if (n->end > end && !lock_insert(locks, end, n->end, range->type, owner))
+        ret = -1;
+      free(range);
+    }
+    n = next;
+  }
+  return ret;
+}
+
+static int lock_grant(struct vfs_locks *locks, u64 start, u64 end, int type,
+                      struct lock_owner *owner) {
+  if (lock_clear(locks, start, end, owner) < 0)
+    return -1;
+  // 与相邻的同类型锁合并，逐段加锁时树不会不断变大
+  u64 from = start ? start - 1 : 0, to = end < U64_MAX ? end + 1 : end;
+  rbtree_iv_t n = rbtree_iv_first(locks->tree, from, to);
+  while (n != null) {
+    rbtree_iv_t next = rbtree_iv_next(n, from, to);
+    lock_range_t range = (lock_range_t)n;
+    if (range->owner == owner && range->type == type) {
+      start = min(start, n->start);
+      end = max(end, n->end);
+      rbtree_iv_remove(locks->tree, n);
+      free(range);
+    }
+    n = next;
+  }
+  return lock_insert(locks, start, end, type, owner) ? 0 : -1;
+}
+
+// 沿等待关系检查 blocker 是否 (间接) 在等待 self，否则记录 self 的等待
+static bool lock_deadlock(struct lock_owner *self, struct lock_owner *blocker) {
+  spin_lock(lock_graph);
+  struct lock_owner *owner = blocker;
+  for (int i = 0; owner != null && i < LOCK_DEADLOCK_DEPTH; i++) {
+    if (owner == self) {
+      spin_unlock(lock_graph);
+      return true;
+    }
+    owner = owner->blocked_by;
+  }
+  self->blocked_by = blocker;
+  spin_unlock(lock_graph);
+  return false;
+}
+
+static void lock_set_blocker(struct lock_owner *self,
+                             struct lock_owner *blocker) {
+  spin_lock(lock_graph);
+  self->blocked_by = blocker;
+  spin_unlock(lock_graph);
+}
+
+// 按到达顺序授予不再冲突的请求，需要持有 locks->mutex
+static void lock_wake(struct vfs_locks *locks) {
+  lock_waiter_t *link = &locks->waiters;
+  while (*link != null) {
+    lock_waiter_t w = *link;
+    struct lock_owner *blocker =
+        lock_blocker(locks, w->start, w->end, w->type, w->owner, w);
+    // 等待的持有者可能变了，新的等待关系可能成环，这时让这个请求失败
+    bool deadlock = blocker != null && lock_deadlock(w->owner, blocker);
+    if (blocker != null && !deadlock) {
+      link = &w->next;
+      continue;
+    }
+    *link = w->next;
+    w->result = deadlock ? -1
+                         : lock_grant(locks, w->start, w->end, w->type,
+                                      w->owner);
+    lock_set_blocker(w->owner, null);
+    w->granted = true;
+    pthread_cond_signal(&w->cond);
+  }
+}
+
+static int vfs_do_lock(vfs_node_t node, u64 offset, u64 len, int type,
+                       bool wait) {
+  if (type != vfs_lock_shared && type != vfs_lock_exclusive)
+    return -1;
+  u64 end = len == 0 || offset + len < offset ? U64_MAX : offset + len;
+  struct vfs_locks *locks = lock_table_of(node);
+  if (locks == null)
+    return -1;
+  struct lock_owner *self = &lock_self;
+
+  pthread_mutex_lock(&locks->mutex);
+  struct lock_owner *blocker =
+      lock_blocker(locks, offset, end, type, self, null);
+  if (blocker == null) {
+    int ret = lock_grant(locks, offset, end, type, self);
+    // 换成共享锁或缩小范围后其它请求可能不再冲突
+    if (locks->waiters != null)
+      lock_wake(locks);
+    pthread_mutex_unlock(&locks->mutex);
+    return ret;
+  }
+  if (!wait || lock_deadlock(self, blocker)) {
+    pthread_mutex_unlock(&locks->mutex);
+    return -1;
+  }
+
+  struct lock_waiter w = {offset, end, type, self};
+  pthread_cond_init(&w.cond, null);
+  lock_waiter_t *link = &locks->waiters;
+  while (*link != null)
+    link = &(*link)->next;
+  *link = &w;
+  while (!w.granted)
+    pthread_cond_wait(&w.cond, &locks->mutex);
+  pthread_mutex_unlock(&locks->mutex);
+  pthread_cond_destroy(&w.cond);
+  return w.result;
+}
+
+int vfs_lock(vfs_node_t node, u64 offset, u64 len, int type, bool wait) {
+  if (node == null)
+    return -1;
+  u64 start = stats_begin();
+  u64 traced = trace_begin();
+  int ret = vfs_do_lock(node, offset, len, type, wait);
+  trace_end(vfs_op_lock, node, null, traced, offset, len, ret == 0);
+  stats_end(vfs_op_lock, node, start, ret == 0, 0);
+  return ret;
+}
+
+static int vfs_do_unlock(vfs_node_t node, u64 offset, u64 len) {
+  struct vfs_locks *locks = atom_load(&node->info->locks);
+  if (locks == null)
+    return 0;
+  u64 end = len == 0 || offset + len < offset ? U64_MAX : offset + len;
+  pthread_mutex_lock(&locks->mutex);
+  int ret = lock_clear(locks, offset, end, &lock_self);
+  if (locks->waiters != null)
+    lock_wake(locks);
+  pthread_mutex_unlock(&locks->mutex);
+  return ret;
+}
+
+int vfs_unlock(vfs_node_t node, u64 offset, u64 len) {
+  if (node == null)
+    return -1;
+  u64 start = stats_begin();
+  u64 traced = trace_begin();
+  int ret = vfs_do_unlock(node, offset, len);
+  trace_end(vfs_op_unlock, node, null, traced, offset, len, ret == 0);
+  stats_end(vfs_op_unlock, node, start, ret == 0, 0);
+  return ret;
+}
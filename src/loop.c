@@ -0,0 +1,63 @@
+// This code is released under the MIT License
+
+#include <loop.h>
+
+typedef struct loop {
+  vfs_node_t file;
+  u32 sector_size;
+} *loop_t;
+
+static ssize_t loop_read(void *data, void *addr, u64 lba, size_t count) {
+  loop_t loop = data;
+  size_t size = count * loop->sector_size;
+  ssize_t n = vfs_read(loop->file, addr, lba * loop->sector_size, size);
+  if (n < 0)
+    return -1;
+  if ((size_t)n < size) // 文件末尾
+    memset(addr + n, 0, size - n);
+  return count;
+}
+
+static ssize_t loop_write(void *data, const void *addr, u64 lba,
+                          size_t count) {
+  loop_t loop = data;
+  size_t size = count * loop->sector_size;
+  u64 offset = lba * loop->sector_size;
+  u64 end = loop->file->info->size; // 文件可能在 loop_attach 之后被截短
+  if (offset >= end)
+    return -1;
+  // 不扩展文件，最后一个扇区只写回文件范围内的部分
+  if (size > end - offset)
+    size = end - offset;
+  ssize_t n = vfs_write(loop->file, addr, offset, size);
+  return n == (ssize_t)size ? (ssize_t)count : -1;
+}
+
+blkdev_t loop_attach(cstr name, vfs_node_t file, u32 sector_size) {
+  if (file == null || sector_size == 0)
+    return null;
+  vfs_update(file);
+  if (file->info->type != file_block)
+    return null;
+  loop_t loop = malloc(sizeof(*loop));
+  if (loop == null)
+    return null;
+  loop->file = file;
+  loop->sector_size = sector_size;
+  u64 sectors = (file->info->size + sector_size - 1) / sector_size;
+  blkdev_t dev = blkdev_regist(name, sector_size, sectors, loop_read,
+                               loop_write, loop);
+  if (dev == null)
+    free(loop);
+  return dev;
+}
+
+int loop_detach(blkdev_t dev) {
+  if (dev == null || dev->read != loop_read)
+    return -1;
+  loop_t loop = dev->data;
+  if (blkdev_unregist(dev) < 0)
+    return -1;
+  free(loop);
+  return 0;
+}
@@ -0,0 +1,157 @@
+// This code is released under the MIT License
+
+// 系统头文件需要在 vfs.h 之前引入，否则会与 val / var 宏冲突
+#include <stdio.h>
+
+#include <mem.h>
+#include <stats.h>
+
+#define MEM_TOP 10 // mem_format 输出的子树数量
+
+static const char *mem_names[vfs_mem_count] = {
+    [vfs_mem_nodes] = "nodes", [vfs_mem_infos] = "infos",
+    [vfs_mem_names] = "names", [vfs_mem_links] = "links",
+    [vfs_mem_caches] = "caches",
+};
+
+cstr vfs_mem_name(int category) {
+  return category >= 0 && category < vfs_mem_count ? mem_names[category]
+                                                   : null;
+}
+
+// 节点自身的字节数，与 vfs.c 分配时记入的一致
+static u64 mem_node_bytes(vfs_node_t node) {
+  u64 bytes = sizeof(struct vfs_node) +
+              sizeof(struct vfs_node_info) / max(node->info->refcount, 1);
+  if (node->name != null)
+    bytes += strlen(node->name) + 1;
+  if (node->parent != null)
+    bytes += sizeof(struct list);
+  return bytes;
+}
+
+// 按字节数从大到小插入，已满时替换最小的一项
+static void mem_top_insert(vfs_mem_usage_t *top, size_t n, size_t *count,
+                           vfs_mem_usage_t usage) {
+  size_t i = *count < n ? (*count)++ : n;
+  for (; i > 0 && top[i - 1].bytes < usage.bytes; i--) {
+    if (i < n)
+      top[i] = top[i - 1];
+  }
+  if (i < n)
+    top[i] = usage;
+}
+
+static vfs_mem_usage_t mem_walk(vfs_node_t node, vfs_mem_usage_t *top,
+                                size_t n, size_t *count) {
+  vfs_mem_usage_t usage = {node, mem_node_bytes(node), 1};
+  // 绑定挂载的别名与源文件夹共享子节点，只在源文件夹中计算
+  if (node->covered != null)
+    return usage;
+  list_foreach(node->info->child, it) {
+    vfs_mem_usage_t child = mem_walk(it->data, top, n, count);
+    usage.bytes += child.bytes;
+    usage.nodes += child.nodes;
+  }
+  if (node->info->type == file_dir)
+    mem_top_insert(top, n, count, usage);
+  return usage;
+}
+
+size_t vfs_mem_top(vfs_node_t node, vfs_mem_usage_t *top, size_t n) {
+  if (node == null)
+    node = rootdir;
+  if (node == null || top == null || n == 0)
+    return 0;
+  size_t count = 0;
+  mem_walk(node, top, n, &count);
+  return count;
+}
+
+#if VFS_MEM
+
+static u64 mem_bytes[STATS_MOUNTS][vfs_mem_count];
+static u64 mem_objects[STATS_MOUNTS][vfs_mem_count];
+
+void mem_charge(int category, u16 mntid, isize bytes, isize objects) {
+  atom_add(&mem_bytes[mntid][category], bytes);
+  atom_add(&mem_objects[mntid][category], objects);
+}
+
+// mntid 为 -1 时为所有挂载的和
+static void mem_read(int mntid, vfs_mem_stats_t *stats) {
+  memset(stats, 0, sizeof(*stats));
+  for (int id = 0; id < STATS_MOUNTS; id++) {
+    if (mntid >= 0 && id != mntid)
+      continue;
+    for (int i = 0; i < vfs_mem_count; i++) {
+      stats->bytes[i] += atom_load(&mem_bytes[id][i]);
+      stats->objects[i] += atom_load(&mem_objects[id][i]);
+    }
+  }
+}
+
+int vfs_mem_read(vfs_node_t node, vfs_mem_stats_t *stats) {
+  if (stats == null)
+    return -1;
+  mem_read(node ? node->info->root->info->mntid : -1, stats);
+  return 0;
+}
+
+// 与 snprintf 一样返回需要的长度，缓冲区不够时截断
+#  define mem_printf(...)                                                      \
+    (len += snprintf(buf + min(len, size), size - min(len, size), __VA_ARGS__))
+
+size_t mem_format(char *buf, size_t size) {
+  size_t len = 0;
+  vfs_mem_stats_t stats;
+  mem_read(-1, &stats);
+  u64 bytes = 0, objects = 0;
+  mem_printf("%-8s %12s %14s\n", "category", "objects", "bytes");
+  for (int i = 0; i < vfs_mem_count; i++) {
+    mem_printf("%-8s %12llu %14llu\n", mem_names[i],
+               (unsigned long long)stats.objects[i],
+               (unsigned long long)stats.bytes[i]);
+    bytes += stats.bytes[i];
+    objects += stats.objects[i];
+  }
+  mem_printf("%-8s %12llu %14llu\n", "total", (unsigned long long)objects,
+             (unsigned long long)bytes);
+
+  // 编号 0 是不在任何挂载中的节点 (例如匿名管道) 和超出编号的挂载
+  mem_printf("\n%-5s %12s %14s  %s\n", "mount", "objects", "bytes", "path");
+  for (int id = 0; id < STATS_MOUNTS; id++) {
+    mem_read(id, &stats);
+    bytes = objects = 0;
+    for (int i = 0; i < vfs_mem_count; i++) {
+      bytes += stats.bytes[i];
+      objects += stats.objects[i];
+    }
+    vfs_node_t root = stats_mount_root(id);
+    if (objects == 0 && root == null)
+      continue;
+    char *path = root ? vfs_get_fullpath(root) : null;
+    mem_printf("%-5d %12llu %14llu  %s\n", id, (unsigned long long)objects,
+               (unsigned long long)bytes, path ? path : "-");
+    free(path);
+  }
+
+  vfs_mem_usage_t top[MEM_TOP];
+  size_t n = vfs_mem_top(null, top, MEM_TOP);
+  mem_printf("\n%-14s %12s  %s\n", "subtree_bytes", "nodes", "path");
+  for (size_t i = 0; i < n; i++) {
+    char *path = vfs_get_fullpath(top[i].node);
+    mem_printf("%-14llu %12llu  %s\n", (unsigned long long)top[i].bytes,
+               (unsigned long long)top[i].nodes, path ? path : "?");
+    free(path);
+  }
+  return len;
+}
+
+#else
+
+int vfs_mem_read(vfs_node_t node, vfs_mem_stats_t *stats) {
+  return -1;
+}
+
+#endif
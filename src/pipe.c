@@ -0,0 +1,204 @@
+// This code is released under the MIT License
+
+// 系统头文件需要在 vfs.h 之前引入，否则会与 val / var 宏冲突
+#include <pthread.h>
+
+#include <pipe.h>
+
+#define PIPE_DEFAULT_SIZE (64 * 1024)
+
+struct vfs_pipe {
+  byte *buf;
+  size_t mask;           // 缓冲区大小 - 1
+  size_t head;           // 下一个读取的位置，只增不减，只由读者修改
+  size_t tail;           // 下一个写入的位置，只增不减，只由写者修改
+  int flags;             // vfs_pipe_*
+  bool shutdown;         // 写端已关闭
+  pthread_mutex_t rlock; // 读者之间互斥
+  pthread_mutex_t wlock; // 写者之间互斥
+  pthread_mutex_t lock;  // 保护睡眠和唤醒
+  pthread_cond_t cond;
+  u32 waiters;           // 睡眠的线程数量，为 0 时不需要唤醒
+  spin_t poll_lock;      // 保证最后报告给 vfs_poll 的状态是最新的
+  vfs_node_t node;
+};
+
+// 从缓冲区取出数据的方式，返回取走的字节数
+typedef ssize_t (*pipe_sink_t)(void *data, const void *addr, size_t size);
+
+pipe_t pipe_alloc(size_t size, int flags, vfs_node_t node) {
+  if (size == 0)
+    size = PIPE_DEFAULT_SIZE;
+  size_t cap = 1;
+  while (cap < size)
+    cap <<= 1;
+  pipe_t pipe = calloc(1, sizeof(*pipe));
+  if (pipe == null)
+    return null;
+  pipe->buf = malloc(cap);
+  if (pipe->buf == null) {
+    free(pipe);
+    return null;
+  }
+  pipe->mask = cap - 1;
+  pipe->flags = flags;
+  pipe->node = node;
+  pthread_mutex_init(&pipe->rlock, null);
+  pthread_mutex_init(&pipe->wlock, null);
+  pthread_mutex_init(&pipe->lock, null);
+  pthread_cond_init(&pipe->cond, null);
+  return pipe;
+}
+
+void pipe_free(pipe_t pipe) {
+  if (pipe == null)
+    return;
+  pthread_cond_destroy(&pipe->cond);
+  pthread_mutex_destroy(&pipe->lock);
+  pthread_mutex_destroy(&pipe->wlock);
+  pthread_mutex_destroy(&pipe->rlock);
+  free(pipe->buf);
+  free(pipe);
+}
+
+int pipe_poll(pipe_t pipe) {
+  size_t used = atom_load(&pipe->tail) - atom_load(&pipe->head);
+  int events = used != 0 ? vfs_poll_in : 0;
+  if (atom_load(&pipe->shutdown))
+    return events | vfs_poll_hup;
+  return used <= pipe->mask ? events | vfs_poll_out : events;
+}
+
+static bool pipe_readable(pipe_t pipe) {
+  return atom_load(&pipe->tail) != atom_load(&pipe->head) ||
+         atom_load(&pipe->shutdown);
+}
+
+static bool pipe_writable(pipe_t pipe) {
+  return atom_load(&pipe->tail) - atom_load(&pipe->head) <= pipe->mask ||
+         atom_load(&pipe->shutdown);
+}
+
+// 在 pipe->lock 下重新检查条件，另一端在 waiters 不为 0 时持锁唤醒，
+// 不会丢失唤醒
+static void pipe_wait(pipe_t pipe, bool (*ready)(pipe_t)) {
+  pthread_mutex_lock(&pipe->lock);
+  atom_add(&pipe->waiters, 1);
+  while (!ready(pipe))
+    pthread_cond_wait(&pipe->cond, &pipe->lock);
+  atom_sub(&pipe->waiters, 1);
+  pthread_mutex_unlock(&pipe->lock);
+}
+
+// 读写位置变化后唤醒睡眠的线程，并更新 vfs_poll 看到的状态
+static void pipe_notify(pipe_t pipe) {
+  if (atom_load(&pipe->waiters) != 0) {
+    pthread_mutex_lock(&pipe->lock);
+    pthread_cond_broadcast(&pipe->cond);
+    pthread_mutex_unlock(&pipe->lock);
+  }
+  // 没有人等待过这个节点时没有等待队列，不需要更新
+  if (atom_load(&pipe->node->info->pollq) != null) {
+    spin_lock(pipe->poll_lock);
+    vfs_poll_wakeup(pipe->node, pipe_poll(pipe));
+    spin_unlock(pipe->poll_lock);
+  }
+}
+
+static ssize_t pipe_consume(pipe_t pipe, size_t size, pipe_sink_t sink,
+                            void *data) {
+  pthread_mutex_lock(&pipe->rlock);
+  size_t head = pipe->head, avail;
+  while ((avail = atom_load(&pipe->tail) - head) == 0 && size != 0) {
+    if (atom_load(&pipe->shutdown) || (pipe->flags & vfs_pipe_nonblock)) {
+      pthread_mutex_unlock(&pipe->rlock);
+      return atom_load(&pipe->shutdown) ? 0 : -1;
+    }
+    pipe_wait(pipe, pipe_readable);
+  }
+  size_t n = min(size, avail), done = 0;
+  ssize_t ret = 0;
+  // 数据在缓冲区中最多分为两段
+  while (done < n) {
+    size_t off = (head + done) & pipe->mask;
+    size_t len = min(n - done, pipe->mask + 1 - off);
+    ret = sink(data, pipe->buf + off, len);
+    if (ret <= 0)
+      break;
+    done += ret;
+    if ((size_t)ret < len)
+      break;
+  }
+  atom_store(&pipe->head, head + done);
+  pthread_mutex_unlock(&pipe->rlock);
+  if (done == 0)
+    return ret < 0 ? -1 : 0;
+  pipe_notify(pipe);
+  return done;
+}
+
+static ssize_t pipe_copy_out(void *data, const void *addr, size_t size) {
+  byte **dst = data;
+  memcpy(*dst, addr, size);
+  *dst += size;
+  return size;
+}
+
+ssize_t pipe_read(pipe_t pipe, void *addr, size_t size) {
+  return pipe_consume(pipe, size, pipe_copy_out, &addr);
+}
+
+struct pipe_splice {
+  vfs_node_t file;
+  u64 offset;
+};
+
+static ssize_t pipe_write_file(void *data, const void *addr, size_t size) {
+  struct pipe_splice *s = data;
+  ssize_t n = vfs_write(s->file, addr, s->offset, size);
+  if (n > 0)
+    s->offset += n;
+  return n;
+}
+
+ssize_t pipe_splice(pipe_t pipe, vfs_node_t file, u64 offset, size_t size) {
+  struct pipe_splice s = {file, offset};
+  return pipe_consume(pipe, size, pipe_write_file, &s);
+}
+
+ssize_t pipe_write(pipe_t pipe, const void *addr, size_t size) {
+  if (atom_load(&pipe->shutdown))
+    return -1;
+  pthread_mutex_lock(&pipe->wlock);
+  size_t tail = pipe->tail, done = 0;
+  while (done < size) {
+    size_t space = pipe->mask + 1 - (tail - atom_load(&pipe->head));
+    if (space == 0) {
+      if (atom_load(&pipe->shutdown) || (pipe->flags & vfs_pipe_nonblock))
+        break;
+      // 比缓冲区大的写入需要先让读者取走已写入的部分
+      if (pipe->tail != tail) {
+        atom_store(&pipe->tail, tail);
+        pipe_notify(pipe);
+      }
+      pipe_wait(pipe, pipe_writable);
+      continue;
+    }
+    size_t off = tail & pipe->mask;
+    size_t len = min(min(size - done, space), pipe->mask + 1 - off);
+    memcpy(pipe->buf + off, addr + done, len);
+    tail += len;
+    done += len;
+  }
+  bool moved = pipe->tail != tail;
+  atom_store(&pipe->tail, tail);
+  pthread_mutex_unlock(&pipe->wlock);
+  if (moved)
+    pipe_notify(pipe);
+  return done != 0 || size == 0 ? (ssize_t)done : -1;
+}
+
+void pipe_shutdown(pipe_t pipe) {
+  atom_store(&pipe->shutdown, true);
+  pipe_notify(pipe);
+}
@@ -0,0 +1,361 @@
+// This code is released under the MIT License
+
+// 系统头文件需要在 vfs.h 之前引入，否则会与 val / var 宏冲突
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
+
+#include <pollset.h>
+#include <stats.h>
+#include <trace.h>
+
+#if VFS_POLL
+
+#  define VFS_POLL_ALWAYS (vfs_poll_err | vfs_poll_hup)
+
+// 一个节点在一个 pollset 中的登记
+typedef struct vfs_pollent *vfs_pollent_t;
+struct vfs_pollent {
+  vfs_pollset_t set;
+  vfs_node_t node;
+  struct vfs_pollq *q;
+  int events;
+  void *data;
+  bool ready;                // 是否在就绪列表中
+  vfs_pollent_t prev, next;  // pollset 中的所有登记
+  vfs_pollent_t next_ready;  // 就绪列表
+};
+
+// 节点的等待队列
+struct vfs_pollq {
+  spin_t lock;
+  int events;     // 驱动报告的状态
+  bool reported;  // 驱动是否调用过 vfs_poll_wakeup
+  list_t entries; // vfs_pollent_t
+};
+
+struct vfs_pollset {
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  vfs_pollent_t entries;
+  vfs_pollent_t ready_head, ready_tail;
+};
+
+static spin_t vfs_pollq_lock = false;
+
+// 需要持有 set->lock
+static void vfs_pollset_ready(vfs_pollent_t ent) {
+  vfs_pollset_t set = ent->set;
+  if (ent->ready)
+    return;
+  ent->ready = true;
+  ent->next_ready = null;
+  if (set->ready_tail != null)
+    set->ready_tail->next_ready = ent;
+  else
+    set->ready_head = ent;
+  set->ready_tail = ent;
+  pthread_cond_signal(&set->cond);
+}
+
+// 需要持有 set->lock
+static void vfs_pollent_unlink(vfs_pollent_t ent) {
+  vfs_pollset_t set = ent->set;
+  if (ent->prev != null)
+    ent->prev->next = ent->next;
+  else
+    set->entries = ent->next;
+  if (ent->next != null)
+    ent->next->prev = ent->prev;
+  if (!ent->ready)
+    return;
+  vfs_pollent_t prev = null;
+  for (vfs_pollent_t cur = set->ready_head; cur; cur = cur->next_ready) {
+    if (cur == ent) {
+      if (prev != null)
+        prev->next_ready = cur->next_ready;
+      else
+        set->ready_head = cur->next_ready;
+      if (set->ready_tail == cur)
+        set->ready_tail = prev;
+      break;
+    }
+    prev = cur;
+  }
+}
+
+void poll_queue_free(struct vfs_pollq *q) {
+  if (q == null)
+    return;
+  list_foreach(q->entries, it) {
+    vfs_pollent_t ent = it->data;
+    pthread_mutex_lock(&ent->set->lock);
+    vfs_pollent_unlink(ent);
+    pthread_mutex_unlock(&ent->set->lock);
+    free(ent);
+  }
+  list_free(q->entries);
+  free(q);
+}
+
+// 需要持有 q->lock
+static void vfs_pollq_set(struct vfs_pollq *q, int events) {
+  atom_store(&q->events, events);
+  list_foreach(q->entries, it) {
+    vfs_pollent_t ent = it->data;
+    if (!(events & (ent->events | VFS_POLL_ALWAYS)))
+      continue;
+    pthread_mutex_lock(&ent->set->lock);
+    vfs_pollset_ready(ent);
+    pthread_mutex_unlock(&ent->set->lock);
+  }
+}
+
+static struct vfs_pollq *vfs_pollq_of(vfs_node_t node) {
+  if (atom_load(&node->info->pollq) != null)
+    return node->info->pollq;
+  struct vfs_pollq *q = calloc(1, sizeof(*q));
+  if (q == null)
+    return null;
+  spin_lock(vfs_pollq_lock);
+  if (node->info->pollq != null) {
+    spin_unlock(vfs_pollq_lock);
+    free(q);
+    return node->info->pollq;
+  }
+  atom_store(&node->info->pollq, q); // 驱动不加锁地检查是否需要唤醒
+  spin_unlock(vfs_pollq_lock);
+
+  // 先发布等待队列再查询，之后的状态变化一定会通过 vfs_poll_wakeup 报告
+  // 查询时不持有 q->lock，驱动可能在持有自己的锁时调用 vfs_poll_wakeup
+  int events = vfs_poll_query(node);
+  spin_lock(q->lock);
+  if (!q->reported) // 否则驱动报告的状态更新
+    vfs_pollq_set(q, events);
+  spin_unlock(q->lock);
+  return q;
+}
+
+void vfs_poll_wakeup(vfs_node_t node, int events) {
+  if (node == null)
+    return;
+  // 还没有人等待过时不需要记录，首次等待时会调用驱动的 poll 接口
+  struct vfs_pollq *q = atom_load(&node->info->pollq);
+  if (q == null)
+    return;
+  spin_lock(q->lock);
+  q->reported = true;
+  vfs_pollq_set(q, events);
+  spin_unlock(q->lock);
+}
+
+vfs_pollset_t vfs_pollset_alloc() {
+  vfs_pollset_t set = calloc(1, sizeof(*set));
+  if (set == null)
+    return null;
+  pthread_mutex_init(&set->lock, null);
+  pthread_cond_init(&set->cond, null);
+  return set;
+}
+
+void vfs_pollset_free(vfs_pollset_t set) {
+  if (set == null)
+    return;
+  while (set->entries != null)
+    vfs_pollset_del(set, set->entries->node);
+  pthread_cond_destroy(&set->cond);
+  pthread_mutex_destroy(&set->lock);
+  free(set);
+}
+
+static vfs_pollent_t vfs_pollset_find(vfs_pollset_t set, struct vfs_pollq *q) {
+  return list_first(q->entries, data, ((vfs_pollent_t)data)->set == set);
+}
+
+int vfs_pollset_add(vfs_pollset_t set, vfs_node_t node, int events,
+                    void *data) {
+  if (set == null || node == null)
+    return -1;
+  vfs_update(node);
+  struct vfs_pollq *q = vfs_pollq_of(node);
+  if (q == null)
+    return -1;
+  vfs_pollent_t ent = calloc(1, sizeof(*ent));
+  if (ent == null)
+    return -1;
+  ent->set = set;
+  ent->node = node;
+  ent->q = q;
+  ent->events = events;
+  ent->data = data;
+
+  spin_lock(q->lock);
+  if (vfs_pollset_find(set, q) != null) {
+    spin_unlock(q->lock);
+    free(ent);
+    return -1;
+  }
+  list_prepend(q->entries, ent);
+  pthread_mutex_lock(&set->lock);
+  ent->next = set->entries;
+  if (set->entries != null)
+    set->entries->prev = ent;
+  set->entries = ent;
+  if (atom_load(&q->events) & (events | VFS_POLL_ALWAYS))
+    vfs_pollset_ready(ent);
+  pthread_mutex_unlock(&set->lock);
+  spin_unlock(q->lock);
+  return 0;
+}
+
+int vfs_pollset_del(vfs_pollset_t set, vfs_node_t node) {
+  if (set == null || node == null || node->info->pollq == null)
+    return -1;
+  struct vfs_pollq *q = node->info->pollq;
+  spin_lock(q->lock);
+  vfs_pollent_t ent = vfs_pollset_find(set, q);
+  if (ent != null) {
+    list_delete(q->entries, ent);
+    pthread_mutex_lock(&set->lock);
+    vfs_pollent_unlink(ent);
+    pthread_mutex_unlock(&set->lock);
+  }
+  spin_unlock(q->lock);
+  free(ent);
+  return ent ? 0 : -1;
+}
+
+// 从就绪列表中取出仍然就绪的登记，报告过的放回队尾 (水平触发)
+static int vfs_pollset_collect(vfs_pollset_t set, struct vfs_pollfd *out,
+                               size_t max) {
+  vfs_pollent_t head = set->ready_head, tail = set->ready_tail;
+  vfs_pollent_t keep_head = null, keep_tail = null;
+  size_t n = 0;
+  while (head != null && n < max) {
+    vfs_pollent_t ent = head;
+    head = head->next_ready;
+    ent->next_ready = null;
+    int revents = atom_load(&ent->q->events) & (ent->events | VFS_POLL_ALWAYS);
+    if (revents == 0) {
+      ent->ready = false;
+      continue;
+    }
+    out[n++] = (struct vfs_pollfd){ent->node, ent->events, revents, ent->data};
+    if (keep_tail != null)
+      keep_tail->next_ready = ent;
+    else
+      keep_head = ent;
+    keep_tail = ent;
+  }
+  if (head != null) {
+    set->ready_head = head;
+    tail->next_ready = keep_head;
+    set->ready_tail = keep_tail ? keep_tail : tail;
+  } else {
+    set->ready_head = keep_head;
+    set->ready_tail = keep_tail;
+  }
+  return n;
+}
+
+int vfs_pollset_wait(vfs_pollset_t set, struct vfs_pollfd *out, size_t max,
+                     int timeout) {
+  if (set == null || out == null || max == 0)
+    return -1;
+  struct timespec deadline;
+  if (timeout > 0) {
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += timeout / 1000;
+    deadline.tv_nsec += (long)(timeout % 1000) * 1000000;
+    if (deadline.tv_nsec >= 1000000000) {
+      deadline.tv_sec++;
+      deadline.tv_nsec -= 1000000000;
+    }
+  }
+  pthread_mutex_lock(&set->lock);
+  int n;
+  while ((n = vfs_pollset_collect(set, out, max)) == 0 && timeout != 0) {
+    if (timeout < 0) {
+      pthread_cond_wait(&set->cond, &set->lock);
+    } else if (pthread_cond_timedwait(&set->cond, &set->lock, &deadline) ==
+               ETIMEDOUT) {
+      n = vfs_pollset_collect(set, out, max);
+      break;
+    }
+  }
+  pthread_mutex_unlock(&set->lock);
+  return n;
+}
+
+static int vfs_do_poll(struct vfs_pollfd *fds, size_t n, int timeout) {
+  // 先检查缓存的状态，已有就绪的节点时不需要登记
+  int ready = 0;
+  for (size_t i = 0; i < n; i++) {
+    vfs_update(fds[i].node);
+    struct vfs_pollq *q = vfs_pollq_of(fds[i].node);
+    if (q == null)
+      return -1;
+    fds[i].revents = atom_load(&q->events) & (fds[i].events | VFS_POLL_ALWAYS);
+    ready += fds[i].revents != 0;
+  }
+  if (ready != 0 || timeout == 0 || n == 0)
+    return ready;
+
+  vfs_pollset_t set = vfs_pollset_alloc();
+  if (set == null)
+    return -1;
+  for (size_t i = 0; i < n; i++)
+    vfs_pollset_add(set, fds[i].node, fds[i].events, null);
+  struct vfs_pollfd out;
+  int r = vfs_pollset_wait(set, &out, 1, timeout);
+  vfs_pollset_free(set);
+  if (r <= 0)
+    return r;
+  for (size_t i = 0; i < n; i++) {
+    struct vfs_pollq *q = fds[i].node->info->pollq;
+    fds[i].revents = atom_load(&q->events) & (fds[i].events | VFS_POLL_ALWAYS);
+    ready += fds[i].revents != 0;
+  }
+  return ready;
+}
+
+int vfs_poll(struct vfs_pollfd *fds, size_t n, int timeout) {
+  if (fds == null && n != 0)
+    return -1;
+  u64 start = stats_begin();
+  u64 traced = trace_begin();
+  int ret = vfs_do_poll(fds, n, timeout);
+  trace_end(vfs_op_poll, null, null, traced, 0, 0, ret >= 0);
+  stats_end(vfs_op_poll, null, start, ret >= 0, 0);
+  return ret;
+}
+
+#else
+
+int vfs_poll(struct vfs_pollfd *fds, size_t n, int timeout) {
+  return -1;
+}
+
+void vfs_poll_wakeup(vfs_node_t node, int events) {}
+
+vfs_pollset_t vfs_pollset_alloc() {
+  return null;
+}
+
+void vfs_pollset_free(vfs_pollset_t set) {}
+
+int vfs_pollset_add(vfs_pollset_t set, vfs_node_t node, int events,
+                    void *data) {
+  return -1;
+}
+
+int vfs_pollset_del(vfs_pollset_t set, vfs_node_t node) {
+  return -1;
+}
+
+int vfs_pollset_wait(vfs_pollset_t set, struct vfs_pollfd *out, size_t max,
+                     int timeout) {
+  return -1;
+}
+
+#endif
@@ -0,0 +1,529 @@
+// This code is released under the MIT License
+
+// 系统头文件需要在 vfs.h 之前引入，否则会与 val / var 宏冲突
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <time.h>
+
+#include <replay.h>
+
+#define REPLAY_NONE    ((u32)-1)
+#define REPLAY_DEPS    3         // 每个操作最多等待的其他操作数
+#define REPLAY_SPIN_NS 100000    // 按原速重放时，剩余时间少于这么多时忙等
+
+static u64 replay_now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void replay_key(char *buf, u64 node) {
+  sprintf(buf, "%llx", (unsigned long long)node);
+}
+
+#if VFS_RECORD
+
+static bool record_on = false;
+static pthread_mutex_t record_lock = PTHREAD_MUTEX_INITIALIZER;
+static mostream_t record_out; // 记录，不包括 replay_header
+static u32 record_count;
+static u64 record_t0;       // 开始记录的时间
+static st_t record_known;   // 已经有编号的节点
+static u32 record_threads;  // 已经分配的线程编号
+static u32 record_gen;      // 每次开始记录时加一，线程编号随之失效
+
+static _Thread_local u32 record_depth; // 嵌套的调用数
+static _Thread_local u32 record_thread;
+static _Thread_local u32 record_thread_gen;
+
+u64 record_begin() {
+  if (!atomic_load_explicit(&record_on, atom_relaxed))
+    return 0;
+  if (record_depth++ != 0)
+    return 1; // 嵌套的调用只需要在结束时减少层数
+  return max(replay_now(), 2);
+}
+
+// 在 record_lock 下写入一条记录
+static void record_put(struct replay_rec *r, cstr path) {
+  r->pathlen = path ? min(strlen(path), 0xffff) : 0;
+  mostream_write(record_out, r, sizeof(*r));
+  if (r->pathlen != 0)
+    mostream_write(record_out, path, r->pathlen);
+  mostream_write(record_out, (u64[1]){0}, ((r->pathlen + 7) & ~7) - r->pathlen);
+  record_count++;
+}
+
+void record_end(int op, vfs_node_t node, cstr path, u64 start, u64 offset,
+                u64 size, i64 result) {
+  if (start == 0)
+    return;
+  record_depth--;
+  if (start == 1)
+    return;
+  u64 end = replay_now();
+  pthread_mutex_lock(&record_lock);
+  // 记录在调用进行中停止或重新开始
+  if (!record_on || start < record_t0) {
+    pthread_mutex_unlock(&record_lock);
+    return;
+  }
+  if (record_thread_gen != record_gen) {
+    record_thread_gen = record_gen;
+    record_thread = ++record_threads;
+  }
+  struct replay_rec r = {
+      .op = op,
+      .thread = record_thread,
+      .node = (usize)node,
+      .offset = offset,
+      .size = size,
+      .result = result,
+      .start = start - record_t0,
+      .end = end - record_t0,
+  };
+  char key[24];
+  replay_key(key, r.node);
+  if (op == vfs_op_open) {
+    if (node != null)
+      st_insert(record_known, key, null);
+  } else if (node != null && !st_has(record_known, key)) {
+    char *full = vfs_get_fullpath(node);
+    struct replay_rec bind = {
+        .op = replay_bind,
+        .thread = r.thread,
+        .node = r.node,
+        .start = r.start,
+        .end = r.start,
+    };
+    record_put(&bind, full);
+    free(full);
+    st_insert(record_known, key, null);
+  }
+  record_put(&r, path);
+  pthread_mutex_unlock(&record_lock);
+}
+
+void record_skip(u64 start) {
+  if (start != 0)
+    record_depth--;
+}
+
+int vfs_record_start() {
+  pthread_mutex_lock(&record_lock);
+  if (record_on) {
+    pthread_mutex_unlock(&record_lock);
+    return -1;
+  }
+  record_out = mostream_alloc(64 * 1024);
+  record_known = st_new();
+  record_count = 0;
+  record_threads = 0;
+  record_gen++;
+  record_t0 = replay_now();
+  atom_store(&record_on, true);
+  pthread_mutex_unlock(&record_lock);
+  return 0;
+}
+
+int vfs_record_stop(mostream_t out) {
+  pthread_mutex_lock(&record_lock);
+  if (!record_on) {
+    pthread_mutex_unlock(&record_lock);
+    return -1;
+  }
+  atom_store(&record_on, false);
+  int ret = 0;
+  if (out != null) {
+    struct replay_header header = {.version = REPLAY_VERSION,
+                                   .count = record_count};
+    memcpy(header.magic, REPLAY_MAGIC, sizeof(header.magic));
+    if (mostream_write(out, &header, sizeof(header)) != sizeof(header) ||
+        mostream_write(out, record_out->buf, record_out->size) !=
+            record_out->size)
+      ret = -1;
+  }
+  mostream_free(record_out);
+  st_free(record_known);
+  record_out = null;
+  record_known = null;
+  pthread_mutex_unlock(&record_lock);
+  return ret;
+}
+
+#else
+
+int vfs_record_start() {
+  return -1;
+}
+
+int vfs_record_stop(mostream_t out) {
+  return -1;
+}
+
+#endif
+
+typedef struct replay_op {
+  struct replay_rec r;
+  char *path;
+  u32 slot;              // 节点在 replay->nodes 中的位置
+  u32 deps[REPLAY_DEPS]; // 需要先完成的操作
+} *replay_op_t;
+
+typedef struct replay *replay_t;
+struct replay {
+  struct replay_op *ops;
+  u32 count;
+  vfs_node_t *nodes; // 各个节点编号在重放中对应的节点
+  u32 nslots;
+  bool *done;        // 各个操作是否已经完成
+  int flags;
+  u64 t0;            // 开始重放的时间
+  u64 first;         // 记录中第一个操作开始的时间
+  u64 max_size;      // 最大的读写大小
+  byte *pattern;     // 写入的内容
+  u32 nthreads;
+  u32 **lists;       // 每个重放线程按顺序执行的操作
+  u32 *lens;
+  u32 *pos;          // 每个重放线程正在执行的操作，完成后为 REPLAY_NONE
+  bool abort;        // 无法启动所有线程，已经启动的线程停止等待
+  // 目录树的子节点列表不能同时修改，打开、创建和挂载依次进行
+  pthread_mutex_t tree;
+  u64 replayed, mismatches;
+};
+
+typedef struct replay_worker {
+  replay_t rp;
+  u32 id;
+} *replay_worker_t;
+
+static void replay_free(replay_t rp) {
+  for (u32 i = 0; i < rp->count; i++)
+    free(rp->ops[i].path);
+  for (u32 i = 0; i < rp->nthreads; i++)
+    free(rp->lists[i]);
+  free(rp->ops);
+  free(rp->nodes);
+  free(rp->done);
+  free(rp->pattern);
+  free(rp->lists);
+  free(rp->lens);
+  free(rp->pos);
+  pthread_mutex_destroy(&rp->tree);
+  free(rp);
+}
+
+static void replay_dep(replay_op_t op, u32 dep) {
+  if (dep == REPLAY_NONE)
+    return;
+  for (int i = 0; i < REPLAY_DEPS; i++) {
+    if (op->deps[i] == REPLAY_NONE || op->deps[i] == dep) {
+      op->deps[i] = dep;
+      return;
+    }
+  }
+}
+
+// 路径及其各个前缀最近一次被创建的操作，取最晚的一个
+static u32 replay_created(st_t created, cstr path) {
+  u32 dep = REPLAY_NONE;
+  char *p = strdup(path);
+  for (char *s = p + 1;; s++) {
+    if (*s == '/' || *s == '\0') {
+      char c = *s;
+      *s = '\0';
+      u32 i = (usize)st_get(created, p, null);
+      if (i != 0 && (dep == REPLAY_NONE || i - 1 > dep))
+        dep = i - 1;
+      *s = c;
+      if (c == '\0')
+        break;
+    }
+  }
+  free(p);
+  return dep;
+}
+
+// 读取记录并计算操作之间的依赖：使用节点的操作等待打开它的操作和之前对它
+// 的写入或关闭，按路径的操作等待创建路径或其上级文件夹的操作，所有操作等待之前
+// 的挂载，挂载等待之前的所有操作
+static replay_t replay_load(mistream_t in) {
+  struct replay_header header;
+  if (mistream_read(in, &header, sizeof(header)) != sizeof(header) ||
+      memcmp(header.magic, REPLAY_MAGIC, sizeof(header.magic)) != 0 ||
+      header.version != REPLAY_VERSION)
+    return null;
+  replay_t rp = calloc(1, sizeof(*rp));
+  if (rp == null)
+    return null;
+  pthread_mutex_init(&rp->tree, null);
+  rp->ops = calloc(header.count + 1, sizeof(*rp->ops));
+  rp->nodes = calloc(header.count + 1, sizeof(*rp->nodes));
+  if (rp->ops == null || rp->nodes == null)
+    goto err;
+  st_t slots = st_new(), created = st_new();
+  // 每个位置的打开操作和最后的写入或关闭
+  u32 *producer = malloc((header.count + 1) * sizeof(u32));
+  u32 *written = malloc((header.count + 1) * sizeof(u32));
+  u32 last_mount = REPLAY_NONE;
+  bool ok = producer != null && written != null;
+  for (u32 i = 0; ok && i < header.count; i++) {
+    replay_op_t op = &rp->ops[i];
+    if (mistream_read(in, &op->r, sizeof(op->r)) != sizeof(op->r) ||
+        (op->path = malloc(op->r.pathlen + 1)) == null) {
+      ok = false;
+      break;
+    }
+    rp->count = i + 1;
+    size_t pad = ((op->r.pathlen + 7) & ~7) - op->r.pathlen;
+    if (mistream_read(in, op->path, op->r.pathlen) != op->r.pathlen ||
+        mistream_read(in, (u64[1]){}, pad) != pad) {
+      ok = false;
+      break;
+    }
+    op->path[op->r.pathlen] = '\0';
+    for (int j = 0; j < REPLAY_DEPS; j++)
+      op->deps[j] = REPLAY_NONE;
+    op->slot = REPLAY_NONE;
+    if (op->r.node != 0) {
+      char key[24];
+      replay_key(key, op->r.node);
+      u32 slot = (usize)st_get(slots, key, null);
+      // 打开同一个编号的节点 (节点被释放后地址被重用) 时分配新的位置，
+      // 但之后的读写仍然在之前通过这个编号的写入之后
+      if (slot == 0 || op->r.op == vfs_op_open || op->r.op == replay_bind) {
+        u32 last = slot ? written[slot - 1] : REPLAY_NONE;
+        slot = ++rp->nslots;
+        st_insert(slots, key, (void *)(usize)slot);
+        producer[slot - 1] = REPLAY_NONE;
+        written[slot - 1] = last;
+      }
+      op->slot = slot - 1;
+    }
+    if ((op->r.op == vfs_op_read || op->r.op == vfs_op_write) &&
+        op->r.size > rp->max_size)
+      rp->max_size = op->r.size;
+
+    replay_dep(op, last_mount);
+    switch (op->r.op) {
+    case vfs_op_open:
+    case replay_bind:
+    case vfs_op_mkdir:
+    case vfs_op_mkfile:
+      replay_dep(op, replay_created(created, op->path));
+      if (op->slot != REPLAY_NONE)
+        producer[op->slot] = i;
+      if ((op->r.op == vfs_op_mkdir || op->r.op == vfs_op_mkfile) &&
+          op->r.result == 0)
+        st_insert(created, op->path, (void *)(usize)(i + 1));
+      break;
+    case vfs_op_read:
+    case vfs_op_write:
+    case vfs_op_close:
+    case replay_mount:
+      if (op->slot == REPLAY_NONE)
+        break;
+      replay_dep(op, producer[op->slot]);
+      replay_dep(op, written[op->slot]);
+      if (op->r.op == vfs_op_write || op->r.op == vfs_op_close)
+        written[op->slot] = i;
+      if (op->r.op == replay_mount)
+        last_mount = i;
+      break;
+    }
+  }
+  st_free(slots);
+  st_free(created);
+  free(producer);
+  free(written);
+  if (!ok)
+    goto err;
+  rp->done = calloc(rp->count + 1, sizeof(bool));
+  rp->pattern = malloc(rp->max_size + 1);
+  if (rp->done == null || rp->pattern == null)
+    goto err;
+  memset(rp->pattern, 'r', rp->max_size + 1);
+  return rp;
+
+err:
+  replay_free(rp);
+  return null;
+}
+
+// 把操作分给重放线程：每个记录的线程一个，或者全部在一个线程中
+static int replay_split(replay_t rp) {
+  u32 nthreads = 1;
+  if (rp->flags & vfs_replay_threads)
+    for (u32 i = 0; i < rp->count; i++)
+      nthreads = max(nthreads, rp->ops[i].r.thread);
+  rp->nthreads = nthreads;
+  rp->lists = calloc(nthreads, sizeof(*rp->lists));
+  rp->lens = calloc(nthreads, sizeof(*rp->lens));
+  rp->pos = calloc(nthreads, sizeof(*rp->pos));
+  if (rp->lists == null || rp->lens == null || rp->pos == null)
+    return -1;
+  for (u32 i = 0; i < rp->count; i++) {
+    u32 t = nthreads > 1 ? max(rp->ops[i].r.thread, 1) - 1 : 0;
+    if (rp->lists[t] == null && (rp->lists[t] = malloc(
+                                     rp->count * sizeof(u32))) == null)
+      return -1;
+    rp->lists[t][rp->lens[t]++] = i;
+  }
+  for (u32 t = 0; t < nthreads; t++)
+    rp->pos[t] = rp->lens[t] ? rp->lists[t][0] : REPLAY_NONE;
+  return 0;
+}
+
+// 挂载之前的操作都要完成，其他线程正在执行的操作都在它之后
+static bool replay_barrier(replay_t rp, u32 self, u32 index) {
+  for (u32 t = 0; t < rp->nthreads; t++) {
+    if (t == self)
+      continue;
+    while (atom_load(&rp->pos[t]) < index)
+      if (atom_load(&rp->abort))
+        return false;
+      else
+        sched_yield();
+  }
+  return true;
+}
+
+static bool replay_wait(replay_t rp, replay_op_t op) {
+  for (int i = 0; i < REPLAY_DEPS && op->deps[i] != REPLAY_NONE; i++)
+    while (!atom_load(&rp->done[op->deps[i]]))
+      if (atom_load(&rp->abort))
+        return false;
+      else
+        sched_yield();
+  if (!(rp->flags & vfs_replay_timed))
+    return true;
+  u64 at = rp->t0 + (op->r.start - rp->first);
+  for (u64 now = replay_now(); now < at; now = replay_now()) {
+    if (at - now > REPLAY_SPIN_NS) {
+      u64 ns = at - now - REPLAY_SPIN_NS / 2;
+      nanosleep(&(struct timespec){ns / 1000000000, ns % 1000000000}, null);
+    }
+  }
+  return true;
+}
+
+static void replay_exec(replay_t rp, replay_op_t op, byte *buf) {
+  vfs_node_t node = op->slot != REPLAY_NONE ? rp->nodes[op->slot] : null;
+  i64 ret = -1;
+  bool counted = op->r.op != replay_bind; // bind 不是记录的调用
+  // 读写已经关闭的节点时会重新打开它，同样要查找目录树
+  bool tree = (op->r.op != vfs_op_read && op->r.op != vfs_op_write) ||
+              (node != null && node->info->handle == null);
+  if (tree)
+    pthread_mutex_lock(&rp->tree);
+  switch (op->r.op) {
+  case vfs_op_open:
+  case replay_bind:
+    node = vfs_open(op->path);
+    if (op->slot != REPLAY_NONE)
+      rp->nodes[op->slot] = node;
+    ret = node ? 0 : -1;
+    break;
+  case vfs_op_mkdir: ret = vfs_mkdir(op->path); break;
+  case vfs_op_mkfile: ret = vfs_mkfile(op->path); break;
+  case vfs_op_close:
+    if (node != null)
+      ret = vfs_close(node);
+    break;
+  case vfs_op_read:
+    if (node != null)
+      ret = vfs_read(node, buf, op->r.offset, op->r.size);
+    break;
+  case vfs_op_write:
+    if (node != null)
+      ret = vfs_write(node, rp->pattern, op->r.offset, op->r.size);
+    break;
+  case replay_mount:
+    if (rp->flags & vfs_replay_nomount)
+      counted = false;
+    else
+      ret = vfs_mount(op->path, node);
+    break;
+  default: counted = false;
+  }
+  if (tree)
+    pthread_mutex_unlock(&rp->tree);
+  if (!counted)
+    return;
+  atom_add(&rp->replayed, 1);
+  if ((ret < 0) != (op->r.result < 0))
+    atom_add(&rp->mismatches, 1);
+}
+
+static void *replay_main(void *arg) {
+  replay_worker_t w = arg;
+  replay_t rp = w->rp;
+  byte *buf = malloc(rp->max_size + 1);
+  if (buf == null)
+    return null;
+  for (u32 k = 0; k < rp->lens[w->id]; k++) {
+    u32 i = rp->lists[w->id][k];
+    replay_op_t op = &rp->ops[i];
+    atom_store(&rp->pos[w->id], i);
+    if (!replay_wait(rp, op) ||
+        (op->r.op == replay_mount && !replay_barrier(rp, w->id, i)))
+      break;
+    replay_exec(rp, op, buf);
+    atom_store(&rp->done[i], true);
+  }
+  atom_store(&rp->pos[w->id], REPLAY_NONE);
+  free(buf);
+  return null;
+}
+
+int vfs_replay(mistream_t in, int flags, vfs_replay_result_t *result) {
+  if (in == null)
+    return -1;
+  replay_t rp = replay_load(in);
+  if (rp == null)
+    return -1;
+  rp->flags = flags;
+  if (replay_split(rp) < 0) {
+    replay_free(rp);
+    return -1;
+  }
+  u64 last = 0;
+  rp->first = rp->count ? rp->ops[0].r.start : 0;
+  for (u32 i = 0; i < rp->count; i++) {
+    rp->first = min(rp->first, rp->ops[i].r.start);
+    last = max(last, rp->ops[i].r.end);
+  }
+
+  struct replay_worker *workers = calloc(rp->nthreads, sizeof(*workers));
+  pthread_t *threads = calloc(rp->nthreads, sizeof(*threads));
+  int ret = workers && threads ? 0 : -1;
+  rp->t0 = replay_now();
+  u32 started = 0; // 成功创建的线程数，只等待这些线程
+  for (; ret == 0 && started < rp->nthreads - 1; started++) {
+    workers[started] = (struct replay_worker){rp, started};
+    if (pthread_create(&threads[started], null, replay_main,
+                       &workers[started]) != 0) {
+      ret = -1;
+      break;
+    }
+  }
+  if (ret == 0) { // 最后一个在当前线程中执行
+    workers[started] = (struct replay_worker){rp, started};
+    replay_main(&workers[started]);
+  } else {
+    atom_store(&rp->abort, true); // 已经启动的线程可能在等待没有执行的操作
+  }
+  for (u32 t = 0; t < started; t++)
+    pthread_join(threads[t], null);
+  if (ret == 0 && result != null) {
+    result->ops = rp->replayed;
+    result->mismatches = rp->mismatches;
+    result->elapsed = replay_now() - rp->t0;
+    result->recorded = last - rp->first;
+  }
+  free(workers);
+  free(threads);
+  replay_free(rp);
+  return ret;
+}
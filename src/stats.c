@@ -0,0 +1,404 @@
+// This code is released under the MIT License
+
+// 系统头文件需要在 vfs.h 之前引入，否则会与 val / var 宏冲突
+#include <pthread.h>
+#include <stdio.h>
+#include <time.h>
+
+#include <stats.h>
+
+static const char *stats_names[vfs_op_count] = {
+    [vfs_op_open] = "open",       [vfs_op_close] = "close",
+    [vfs_op_read] = "read",       [vfs_op_write] = "write",
+    [vfs_op_mkdir] = "mkdir",     [vfs_op_mkfile] = "mkfile",
+    [vfs_op_truncate] = "truncate", [vfs_op_unlink] = "unlink",
+    [vfs_op_rmdir] = "rmdir",     [vfs_op_rename] = "rename",
+    [vfs_op_link] = "link",       [vfs_op_mount] = "mount",
+    [vfs_op_unmount] = "unmount", [vfs_op_bind] = "bind",
+    [vfs_op_fallocate] = "fallocate", [vfs_op_copy_range] = "copy_range",
+    [vfs_op_getxattr] = "getxattr", [vfs_op_setxattr] = "setxattr",
+    [vfs_op_listxattr] = "listxattr", [vfs_op_lock] = "lock",
+    [vfs_op_unlock] = "unlock",   [vfs_op_poll] = "poll",
+    [vfs_op_splice] = "splice",
+};
+
+cstr vfs_stats_name(int op) {
+  return op >= 0 && op < vfs_op_count ? stats_names[op] : null;
+}
+
+u64 vfs_stats_bucket(int i) {
+  if (i < 4)
+    return i;
+  int e = i / 4 + 1;
+  return (u64)(4 + i % 4) << (e - 2);
+}
+
+// 2 的幂以下 4 个桶都是线性的，之后每个 2 的幂分为 4 个桶
+static int stats_bucket_of(u64 ns) {
+  if (ns < 4)
+    return ns;
+  int e = 63 - __builtin_clzll(ns);
+  int i = 4 * (e - 1) + ((ns >> (e - 2)) & 3);
+  return min(i, VFS_STATS_BUCKETS - 1);
+}
+
+u64 vfs_stats_percentile(const vfs_op_stats_t *op, double p) {
+  u64 total = 0;
+  for (int i = 0; i < VFS_STATS_BUCKETS; i++)
+    total += op->hist[i];
+  if (total == 0)
+    return 0;
+  u64 rank = p * total;
+  rank = min(max(rank, 1), total);
+  u64 seen = 0;
+  for (int i = 0; i < VFS_STATS_BUCKETS; i++) {
+    seen += op->hist[i];
+    if (seen >= rank)
+      return min(vfs_stats_bucket(i + 1) - 1, op->max);
+  }
+  return op->max;
+}
+
+#if VFS_STATS
+
+#  define STATS_SHIFT 6 // 默认平均每 64 次操作计时一次
+
+// 一个线程的计数，只有领取它的线程写入
+typedef struct stats_shard *stats_shard_t;
+struct stats_shard {
+  stats_shard_t next;
+  bool used; // 正在被某个线程使用
+  u64 walks, walk_steps, walk_max, walk_fails;
+  u64 lookup_hits, lookup_misses;
+  // 按挂载的统计，首次使用时分配，全局的统计是所有挂载的和
+  vfs_op_stats_t *mounts[STATS_MOUNTS];
+};
+
+static bool stats_enabled = true;
+static int stats_shift = STATS_SHIFT;
+static spin_t stats_lock = false; // 保护分片链表和挂载编号
+static stats_shard_t stats_shards;
+static vfs_node_t stats_roots[STATS_MOUNTS]; // 各个编号的挂载的根目录
+static vfs_op_stats_t stats_retired[vfs_op_count]; // 编号被重用的挂载的统计
+static pthread_key_t stats_key;
+static pthread_once_t stats_once = PTHREAD_ONCE_INIT;
+
+// 当前线程的状态
+static _Thread_local stats_shard_t stats_self;
+static _Thread_local u32 stats_depth;         // 嵌套的公开操作的层数
+static _Thread_local bool stats_active;       // 最外层的操作是否在统计
+_Thread_local bool stats_timing;              // 最外层的操作是否在计时
+static _Thread_local u32 stats_countdown = 1; // 距离下一次计时的操作数
+static _Thread_local u32 stats_seed;
+static _Thread_local u64 stats_callback_ns; // 当前操作在驱动回调中的耗时
+static _Thread_local u16 stats_mntid;       // 当前操作查找到的挂载
+
+// 只有一个线程写入，不需要原子的读改写，只要读取者不会读到撕裂的值
+#  define stats_load(ptr)  atomic_load_explicit(ptr, atom_relaxed)
+#  define stats_store(ptr, value) atomic_store_explicit(ptr, value, atom_relaxed)
+#  define stats_add(ptr, value) stats_store(ptr, stats_load(ptr) + (value))
+
+static u64 stats_now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void stats_release(void *shard) {
+  spin_lock(stats_lock);
+  ((stats_shard_t)shard)->used = false;
+  spin_unlock(stats_lock);
+}
+
+static void stats_key_init() {
+  pthread_key_create(&stats_key, stats_release);
+}
+
+// 领取一个空闲的分片，没有时分配新的，分片不会被释放
+static stats_shard_t stats_claim() {
+  pthread_once(&stats_once, stats_key_init);
+  spin_lock(stats_lock);
+  stats_shard_t shard = stats_shards;
+  while (shard != null && shard->used)
+    shard = shard->next;
+  if (shard == null) {
+    shard = calloc(1, sizeof(*shard));
+    if (shard != null) {
+      shard->next = stats_shards;
+      atom_store(&stats_shards, shard);
+    }
+  }
+  if (shard != null)
+    shard->used = true;
+  spin_unlock(stats_lock);
+  if (shard == null)
+    return null;
+  pthread_setspecific(stats_key, shard);
+  stats_seed = (u32)(usize)&stats_seed | 1;
+  return stats_self = shard;
+}
+
+// 下一次计时前的操作数，在 1 到 2^(shift+1)-1 之间均匀分布，避免与周期性
+// 的负载同步
+static u32 stats_interval() {
+  int shift = stats_load(&stats_shift);
+  if (shift == 0)
+    return 1;
+  stats_seed ^= stats_seed << 13;
+  stats_seed ^= stats_seed >> 17;
+  stats_seed ^= stats_seed << 5;
+  return stats_seed % ((2u << shift) - 1) + 1;
+}
+
+u64 stats_begin() {
+  if (stats_depth++ != 0 || !stats_load(&stats_enabled))
+    return 0;
+  if (stats_self == null && stats_claim() == null)
+    return 0;
+  stats_active = true;
+  stats_mntid = 0;
+  if (--stats_countdown != 0 && stats_load(&stats_shift) != 0)
+    return 1;
+  stats_countdown = stats_interval();
+  stats_timing = true;
+  stats_callback_ns = 0;
+  return max(stats_now(), 2);
+}
+
+static vfs_op_stats_t *stats_mount_ops(stats_shard_t shard, u16 mntid) {
+  vfs_op_stats_t *ops = stats_load(&shard->mounts[mntid]);
+  if (ops == null) {
+    ops = calloc(vfs_op_count, sizeof(*ops));
+    stats_store(&shard->mounts[mntid], ops);
+  }
+  return ops;
+}
+
+static void stats_record(vfs_op_stats_t *op, bool ok, u64 bytes, u64 start,
+                         u64 elapsed, u64 callback) {
+  stats_add(&op->count, 1);
+  if (!ok)
+    stats_add(&op->errors, 1);
+  if (bytes != 0)
+    stats_add(&op->bytes, bytes);
+  if (start < 2)
+    return;
+  stats_add(&op->sampled, 1);
+  stats_add(&op->time, elapsed);
+  stats_add(&op->callback, callback);
+  if (elapsed > op->max)
+    stats_store(&op->max, elapsed);
+  int bucket = stats_bucket_of(elapsed);
+  stats_add(&op->hist[bucket], 1);
+}
+
+void stats_end(int op, vfs_node_t node, u64 start, bool ok, u64 bytes) {
+  if (--stats_depth != 0 || start == 0)
+    return;
+  u64 elapsed = start > 1 ? stats_now() - start : 0;
+  stats_timing = false;
+  stats_active = false;
+  u16 mntid = node ? node->info->root->info->mntid : stats_mntid;
+  vfs_op_stats_t *ops = stats_mount_ops(stats_self, mntid);
+  if (ops != null)
+    stats_record(&ops[op], ok, bytes, start, elapsed, stats_callback_ns);
+}
+
+void stats_walk(vfs_node_t last, u32 steps, u32 hits, u32 misses, bool found) {
+  if (!stats_active)
+    return;
+  stats_shard_t shard = stats_self;
+  stats_add(&shard->walks, 1);
+  stats_add(&shard->walk_steps, steps);
+  if (steps > shard->walk_max)
+    stats_store(&shard->walk_max, steps);
+  if (!found)
+    stats_add(&shard->walk_fails, 1);
+  stats_add(&shard->lookup_hits, hits);
+  stats_add(&shard->lookup_misses, misses);
+  if (last != null)
+    stats_mntid = last->info->root->info->mntid;
+}
+
+u64 stats_callback_begin() {
+  return stats_now();
+}
+
+void stats_callback_end(u64 start) {
+  stats_callback_ns += stats_now() - start;
+}
+
+// 把 src 加到 dst 上，dst 可能正在被读取
+static void stats_sum(vfs_op_stats_t *dst, const vfs_op_stats_t *src) {
+  for (int i = 0; i < vfs_op_count; i++, dst++, src++) {
+    stats_add(&dst->count, stats_load(&src->count));
+    stats_add(&dst->errors, stats_load(&src->errors));
+    stats_add(&dst->bytes, stats_load(&src->bytes));
+    stats_add(&dst->sampled, stats_load(&src->sampled));
+    stats_add(&dst->time, stats_load(&src->time));
+    stats_add(&dst->callback, stats_load(&src->callback));
+    stats_store(&dst->max, max(stats_load(&dst->max), stats_load(&src->max)));
+    for (int j = 0; j < VFS_STATS_BUCKETS; j++)
+      stats_add(&dst->hist[j], stats_load(&src->hist[j]));
+  }
+}
+
+// 清零一组操作的统计，与写入同时进行时可能留下少量计数
+static void stats_clear(vfs_op_stats_t *ops) {
+  if (ops == null)
+    return;
+  for (u64 *p = (u64 *)ops; p < (u64 *)(ops + vfs_op_count); p++)
+    stats_store(p, 0);
+}
+
+void stats_mount(vfs_node_t node) {
+  spin_lock(stats_lock);
+  u16 id = 1;
+  while (id < STATS_MOUNTS && stats_roots[id] != null)
+    id++;
+  if (id < STATS_MOUNTS) {
+    atom_store(&stats_roots[id], node);
+    // 之前使用这个编号的挂载留下的统计只计入全局的统计
+    for (stats_shard_t s = stats_shards; s; s = s->next) {
+      vfs_op_stats_t *ops = stats_load(&s->mounts[id]);
+      if (ops != null) {
+        stats_sum(stats_retired, ops);
+        stats_clear(ops);
+      }
+    }
+  } else {
+    id = 0;
+  }
+  spin_unlock(stats_lock);
+  node->info->mntid = id;
+}
+
+void stats_unmount(vfs_node_t node) {
+  spin_lock(stats_lock);
+  if (node->info->mntid != 0 && stats_roots[node->info->mntid] == node)
+    atom_store(&stats_roots[node->info->mntid], null);
+  spin_unlock(stats_lock);
+  node->info->mntid = 0;
+}
+
+vfs_node_t stats_mount_root(int mntid) {
+  if (mntid <= 0 || mntid >= STATS_MOUNTS)
+    return null;
+  return atom_load(&stats_roots[mntid]);
+}
+
+bool vfs_stats_enable(bool enable) {
+  return atom_exch(&stats_enabled, enable);
+}
+
+int vfs_stats_sample(int shift) {
+  if (shift < 0 || shift > 16)
+    return -1;
+  atom_store(&stats_shift, shift);
+  return 0;
+}
+
+
+static int stats_read(int mntid, vfs_stats_t *stats) {
+  memset(stats, 0, sizeof(*stats));
+  if (mntid < 0)
+    stats_sum(stats->ops, stats_retired);
+  for (stats_shard_t s = atom_load(&stats_shards); s; s = s->next) {
+    if (mntid < 0) {
+      for (int i = 0; i < STATS_MOUNTS; i++) {
+        vfs_op_stats_t *ops = stats_load(&s->mounts[i]);
+        if (ops != null)
+          stats_sum(stats->ops, ops);
+      }
+      stats->walks += stats_load(&s->walks);
+      stats->walk_steps += stats_load(&s->walk_steps);
+      stats->walk_max = max(stats->walk_max, stats_load(&s->walk_max));
+      stats->walk_fails += stats_load(&s->walk_fails);
+      stats->lookup_hits += stats_load(&s->lookup_hits);
+      stats->lookup_misses += stats_load(&s->lookup_misses);
+    } else {
+      vfs_op_stats_t *ops = stats_load(&s->mounts[mntid]);
+      if (ops != null)
+        stats_sum(stats->ops, ops);
+    }
+  }
+  return 0;
+}
+
+int vfs_stats_read(vfs_node_t node, vfs_stats_t *stats) {
+  if (stats == null)
+    return -1;
+  return stats_read(node ? node->info->root->info->mntid : -1, stats);
+}
+
+void vfs_stats_reset() {
+  stats_clear(stats_retired);
+  for (stats_shard_t s = atom_load(&stats_shards); s; s = s->next) {
+    stats_store(&s->walks, 0);
+    stats_store(&s->walk_steps, 0);
+    stats_store(&s->walk_max, 0);
+    stats_store(&s->walk_fails, 0);
+    stats_store(&s->lookup_hits, 0);
+    stats_store(&s->lookup_misses, 0);
+    for (int i = 0; i < STATS_MOUNTS; i++)
+      stats_clear(stats_load(&s->mounts[i]));
+  }
+}
+
+// 与 snprintf 一样返回需要的长度，缓冲区不够时截断
+#  define stats_printf(...)                                                    \
+    (len += snprintf(buf + min(len, size), size - min(len, size), __VA_ARGS__))
+
+size_t stats_format(int mntid, char *buf, size_t size) {
+  vfs_stats_t *stats = malloc(sizeof(*stats));
+  if (stats == null)
+    return 0;
+  stats_read(mntid, stats);
+  size_t len = 0;
+  stats_printf("%-10s %10s %8s %14s %8s %9s %9s %9s %9s %4s\n", "op", "count",
+               "errors", "bytes", "sampled", "avg_ns", "p50_ns", "p99_ns",
+               "max_ns", "cb%");
+  for (int i = 0; i < vfs_op_count; i++) {
+    vfs_op_stats_t *op = &stats->ops[i];
+    u64 avg = op->sampled ? op->time / op->sampled : 0;
+    u64 cb = op->time ? op->callback * 100 / op->time : 0;
+    stats_printf("%-10s %10llu %8llu %14llu %8llu %9llu %9llu %9llu %9llu %4llu\n",
+                 stats_names[i], (unsigned long long)op->count,
+                 (unsigned long long)op->errors,
+                 (unsigned long long)op->bytes,
+                 (unsigned long long)op->sampled, (unsigned long long)avg,
+                 (unsigned long long)vfs_stats_percentile(op, 0.5),
+                 (unsigned long long)vfs_stats_percentile(op, 0.99),
+                 (unsigned long long)op->max, (unsigned long long)cb);
+  }
+  if (mntid < 0) {
+    stats_printf("\nwalks %llu\nwalk_steps %llu\nwalk_max %llu\n"
+                 "walk_fails %llu\nlookup_hits %llu\nlookup_misses %llu\n",
+                 (unsigned long long)stats->walks,
+                 (unsigned long long)stats->walk_steps,
+                 (unsigned long long)stats->walk_max,
+                 (unsigned long long)stats->walk_fails,
+                 (unsigned long long)stats->lookup_hits,
+                 (unsigned long long)stats->lookup_misses);
+  }
+  free(stats);
+  return len;
+}
+
+#else
+
+bool vfs_stats_enable(bool enable) {
+  return false;
+}
+
+int vfs_stats_sample(int shift) {
+  return -1;
+}
+
+int vfs_stats_read(vfs_node_t node, vfs_stats_t *stats) {
+  return -1;
+}
+
+void vfs_stats_reset() {}
+
+#endif
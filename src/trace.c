@@ -0,0 +1,388 @@
+// This code is released under the MIT License
+
+// 系统头文件需要在 vfs.h 之前引入，否则会与 val / var 宏冲突
+#include <pthread.h>
+#include <stdio.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#  include <x86intrin.h>
+#  define TRACE_TSC 1
+#else
+#  define TRACE_TSC 0
+#endif
+
+#include <trace.h>
+
+#if VFS_TRACE
+
+#  define TRACE_BUF_SIZE (1 << 20) // 默认每个线程的缓冲区大小
+#  define TRACE_INTERVAL 5         // 后台线程写入的间隔 (ms)
+#  define TRACE_FLUSH    (1 << 16) // mostream 中积累到这么多时写入文件
+
+// 一个线程的缓冲区，线程退出后由新线程复用
+typedef struct trace_buf *trace_buf_t;
+struct trace_buf {
+  trace_buf_t next;
+  u32 id;
+  bool used;    // 正在被某个线程使用
+  u32 gen;      // 缓冲区属于的追踪编号，与当前编号不同时后台线程跳过它
+  cirbuf_t ring;
+  u64 lost;     // 丢弃的事件数，只由所属的线程修改
+  u64 lost_seen; // 已经写入文件的丢弃数，只由后台线程修改
+};
+
+static bool trace_on = false;
+static u32 trace_gen = 0; // 每次开始追踪时加一，节点的 trace_gen 与之比较
+static size_t trace_size; // 这次追踪的缓冲区大小
+static u64 trace_t0;      // 这次追踪开始的时间戳，更早开始的操作不记录
+static spin_t trace_lock = false; // 保护缓冲区链表
+static trace_buf_t trace_bufs;
+static u32 trace_nbufs;
+static cstr trace_drivers[256];
+static pthread_mutex_t trace_ctl = PTHREAD_MUTEX_INITIALIZER; // 开始和停止
+static pthread_mutex_t trace_mtx = PTHREAD_MUTEX_INITIALIZER; // 唤醒后台线程
+static pthread_cond_t trace_cond = PTHREAD_COND_INITIALIZER;
+static bool trace_stopping;
+static pthread_t trace_thread;
+static FILE *trace_fp;
+static mostream_t trace_out;
+static u64 trace_nlost;
+static pthread_key_t trace_key;
+static pthread_once_t trace_once = PTHREAD_ONCE_INIT;
+
+// 当前线程的状态
+static _Thread_local trace_buf_t trace_self;
+static _Thread_local u32 trace_depth; // 正在追踪的嵌套的操作数
+static _Thread_local u16 trace_fsid;  // 最近一次路径查找停下的驱动
+
+static u64 trace_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+finline u64 trace_now() {
+#  if TRACE_TSC
+  return __rdtsc();
+#  else
+  return trace_ns();
+#  endif
+}
+
+static void trace_release(void *buf) {
+  spin_lock(trace_lock);
+  ((trace_buf_t)buf)->used = false;
+  spin_unlock(trace_lock);
+}
+
+static void trace_key_init() {
+  pthread_key_create(&trace_key, trace_release);
+}
+
+// 领取一个空闲的缓冲区，没有时分配新的，缓冲区不会被释放
+static trace_buf_t trace_claim() {
+  pthread_once(&trace_once, trace_key_init);
+  spin_lock(trace_lock);
+  trace_buf_t buf = trace_bufs;
+  while (buf != null && buf->used)
+    buf = buf->next;
+  if (buf == null) {
+    buf = calloc(1, sizeof(*buf));
+    if (buf != null) {
+      buf->id = ++trace_nbufs;
+      buf->next = trace_bufs;
+      atom_store(&trace_bufs, buf);
+    }
+  }
+  if (buf != null)
+    buf->used = true;
+  spin_unlock(trace_lock);
+  if (buf == null)
+    return null;
+  pthread_setspecific(trace_key, buf);
+  return trace_self = buf;
+}
+
+// 第一次在这次追踪中使用缓冲区时清空它，后台线程在 gen 更新之前不会读取
+static trace_buf_t trace_attach() {
+  trace_buf_t buf = trace_self;
+  if (buf == null && (buf = trace_claim()) == null)
+    return null;
+  u32 gen = atom_load(&trace_gen);
+  if (atom_load(&buf->gen) == gen)
+    return buf;
+  if (buf->ring == null || cirbuf_size(buf->ring) != trace_size) {
+    cirbuf_free(buf->ring);
+    buf->ring = cirbuf_alloc(trace_size);
+    if (buf->ring == null)
+      return null;
+  }
+  buf->ring->head = buf->ring->tail = 0;
+  buf->lost = buf->lost_seen = 0;
+  atom_store(&buf->gen, gen);
+  return buf;
+}
+
+u64 trace_begin() {
+  if (!atomic_load_explicit(&trace_on, atom_relaxed))
+    return 0;
+  if (trace_self == null || atom_load(&trace_self->gen) != trace_gen)
+    if (trace_attach() == null)
+      return 0;
+  trace_depth++;
+  return max(trace_now(), 1);
+}
+
+void trace_walk(vfs_node_t last) {
+  if (trace_depth != 0 && last != null)
+    trace_fsid = last->info->fsid;
+}
+
+// 从 pos 开始复制到环形缓冲区，可能跨过末尾
+static void trace_copy(cirbuf_t ring, size_t pos, const void *src,
+                       size_t size) {
+  if (size == 0)
+    return;
+  pos &= ring->size - 1;
+  size_t n = min(size, ring->size - pos);
+  memcpy(ring->buf + pos, src, n);
+  memcpy(ring->buf, src + n, size - n);
+}
+
+// 把一条记录写入环形缓冲区，空间不够时丢弃
+static void trace_put(trace_buf_t buf, struct trace_event *e, cstr path) {
+  cirbuf_t ring = buf->ring;
+  size_t pad = ((e->pathlen + 7) & ~7) - e->pathlen;
+  size_t len = sizeof(*e) + e->pathlen + pad;
+  size_t tail = ring->tail;
+  if (ring->size - (tail - atom_load(&ring->head)) < len) {
+    atomic_store_explicit(&buf->lost, buf->lost + 1, atom_relaxed);
+    return;
+  }
+  trace_copy(ring, tail, e, sizeof(*e));
+  trace_copy(ring, tail + sizeof(*e), path, e->pathlen);
+  trace_copy(ring, tail + sizeof(*e) + e->pathlen, (u64[1]){0}, pad);
+  atom_store(&ring->tail, tail + len);
+}
+
+static void trace_put_path(trace_buf_t buf, struct trace_event *e, cstr path) {
+  e->pathlen = path ? min(strlen(path), TRACE_PATH_MAX) : 0;
+  trace_put(buf, e, path);
+}
+
+void trace_end(int op, vfs_node_t node, cstr path, u64 start, u64 offset,
+               u64 size, bool ok) {
+  if (start == 0)
+    return;
+  trace_depth--;
+  u64 end = trace_now();
+  trace_buf_t buf = trace_self;
+  // 追踪在操作进行中停止或重新开始
+  if (start < trace_t0 || atom_load(&buf->gen) != trace_gen ||
+      !atomic_load_explicit(&trace_on, atom_relaxed))
+    return;
+  struct trace_event e = {
+      .op = op,
+      .depth = min(trace_depth, 255),
+      .failed = !ok,
+      .offset = offset,
+      .size = size,
+      .start = start,
+      .end = end,
+  };
+  if (node != null) {
+    e.node = (usize)node;
+    e.driver = node->info->fsid;
+    if (atom_load(&node->trace_gen) != trace_gen) {
+      atom_store(&node->trace_gen, trace_gen);
+      char *full = vfs_get_fullpath(node);
+      struct trace_event name = {
+          .op = trace_name,
+          .driver = e.driver,
+          .node = e.node,
+          .start = start,
+          .end = start,
+      };
+      trace_put_path(buf, &name, full);
+      free(full);
+    }
+    trace_put_path(buf, &e, null);
+  } else {
+    e.driver = trace_fsid;
+    trace_put_path(buf, &e, path);
+  }
+}
+
+void trace_regist(int id, cstr name) {
+  if (id >= 0 && id < 256)
+    trace_drivers[id] = name;
+}
+
+static void trace_write(u32 thread, const void *data, size_t size) {
+  struct trace_chunk chunk = {.thread = thread, .size = size};
+  mostream_write(trace_out, &chunk, sizeof(chunk));
+  mostream_write(trace_out, data, size);
+}
+
+static void trace_write_event(struct trace_event *e, cstr path) {
+  e->pathlen = path ? min(strlen(path), TRACE_PATH_MAX) : 0;
+  size_t len = sizeof(*e) + ((e->pathlen + 7) & ~7);
+  byte *rec = calloc(1, len);
+  if (rec == null)
+    return;
+  memcpy(rec, e, sizeof(*e));
+  if (path != null)
+    memcpy(rec + sizeof(*e), path, e->pathlen);
+  trace_write(0, rec, len);
+  free(rec);
+}
+
+static void trace_write_clock() {
+  struct trace_event e = {.op = trace_clock, .start = trace_now()};
+  e.end = trace_ns();
+  trace_write_event(&e, null);
+}
+
+// 把 mostream 中的内容写入文件
+static void trace_flush() {
+  if (trace_out->size != 0)
+    fwrite(trace_out->buf, 1, trace_out->size, trace_fp);
+  trace_out->size = 0;
+}
+
+// 取走所有缓冲区中的事件
+static void trace_drain() {
+  u32 gen = trace_gen;
+  for (trace_buf_t buf = atom_load(&trace_bufs); buf; buf = buf->next) {
+    if (atom_load(&buf->gen) != gen)
+      continue;
+    cirbuf_t ring = buf->ring;
+    size_t head = ring->head, tail = atom_load(&ring->tail);
+    if (tail != head) {
+      size_t mask = ring->size - 1, pos = head & mask;
+      size_t n = min(tail - head, ring->size - pos);
+      struct trace_chunk chunk = {.thread = buf->id, .size = tail - head};
+      mostream_write(trace_out, &chunk, sizeof(chunk));
+      mostream_write(trace_out, ring->buf + pos, n);
+      mostream_write(trace_out, ring->buf, tail - head - n);
+      atom_store(&ring->head, tail);
+    }
+    u64 lost = atomic_load_explicit(&buf->lost, atom_relaxed);
+    if (lost != buf->lost_seen) {
+      struct trace_event e = {.op = trace_lost, .size = lost - buf->lost_seen};
+      trace_nlost += e.size;
+      buf->lost_seen = lost;
+      trace_write_event(&e, null);
+    }
+    if (trace_out->size >= TRACE_FLUSH)
+      trace_flush();
+  }
+}
+
+static void *trace_main(void *arg) {
+  pthread_mutex_lock(&trace_mtx);
+  while (!trace_stopping) {
+    pthread_mutex_unlock(&trace_mtx);
+    trace_drain();
+    trace_write_clock();
+    trace_flush();
+    pthread_mutex_lock(&trace_mtx);
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_nsec += TRACE_INTERVAL * 1000000;
+    if (ts.tv_nsec >= 1000000000) {
+      ts.tv_sec++;
+      ts.tv_nsec -= 1000000000;
+    }
+    if (!trace_stopping)
+      pthread_cond_timedwait(&trace_cond, &trace_mtx, &ts);
+  }
+  pthread_mutex_unlock(&trace_mtx);
+  trace_drain();
+  trace_write_clock();
+  trace_flush();
+  return null;
+}
+
+int vfs_trace_start(cstr path, size_t size) {
+  if (path == null)
+    return -1;
+  if (size == 0)
+    size = TRACE_BUF_SIZE;
+  size_t cap = 4096;
+  while (cap < size)
+    cap <<= 1;
+  pthread_mutex_lock(&trace_ctl);
+  if (trace_fp != null)
+    goto err;
+  trace_fp = fopen(path, "wb");
+  if (trace_fp == null)
+    goto err;
+  trace_out = mostream_alloc(TRACE_FLUSH * 2);
+  if (trace_out == null) {
+    fclose(trace_fp);
+    trace_fp = null;
+    goto err;
+  }
+  struct trace_header header = {.version = TRACE_VERSION, .tsc = TRACE_TSC};
+  memcpy(header.magic, TRACE_MAGIC, sizeof(header.magic));
+  mostream_write(trace_out, &header, sizeof(header));
+  trace_write_clock();
+  for (int i = 0; i < 256; i++) {
+    if (trace_drivers[i] == null)
+      continue;
+    struct trace_event e = {.op = trace_driver, .driver = i};
+    trace_write_event(&e, trace_drivers[i]);
+  }
+  trace_size = cap;
+  trace_nlost = 0;
+  trace_stopping = false;
+  trace_t0 = trace_now();
+  atom_add(&trace_gen, 1);
+  if (pthread_create(&trace_thread, null, trace_main, null) != 0) {
+    mostream_free(trace_out);
+    fclose(trace_fp);
+    trace_fp = null;
+    goto err;
+  }
+  atom_store(&trace_on, true);
+  pthread_mutex_unlock(&trace_ctl);
+  return 0;
+
+err:
+  pthread_mutex_unlock(&trace_ctl);
+  return -1;
+}
+
+ssize_t vfs_trace_stop() {
+  pthread_mutex_lock(&trace_ctl);
+  if (trace_fp == null) {
+    pthread_mutex_unlock(&trace_ctl);
+    return -1;
+  }
+  atom_store(&trace_on, false);
+  pthread_mutex_lock(&trace_mtx);
+  trace_stopping = true;
+  pthread_cond_signal(&trace_cond);
+  pthread_mutex_unlock(&trace_mtx);
+  pthread_join(trace_thread, null);
+  fclose(trace_fp);
+  trace_fp = null;
+  mostream_free(trace_out);
+  trace_out = null;
+  ssize_t lost = trace_nlost;
+  pthread_mutex_unlock(&trace_ctl);
+  return lost;
+}
+
+#else
+
+int vfs_trace_start(cstr path, size_t size) {
+  return -1;
+}
+
+ssize_t vfs_trace_stop() {
+  return -1;
+}
+
+#endif
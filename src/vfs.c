@@ -1,6 +1,13 @@
 // This code is released under the MIT License
 
-#include <vfs.h>
+#define EVENT_IMPLEMENTATION
+#include <lock.h>
+#include <mem.h>
+#include <pipe.h>
+#include <pollset.h>
+#include <replay.h>
+#include <stats.h>
+#include <trace.h>
 
 vfs_node_t rootdir = null;
 
@@ -15,74 +22,88 @@ static int fs_nextid = 1;
 
 #define callbackof(node, _name_) (fs_callbacks[(node)->info->fsid]->_name_)
 
+// 绑定挂载的别名与源文件夹共享子节点列表，子节点的父目录总是源文件夹，
+// 这样卸载别名后子节点的路径和 ".." 仍然有效
+finline vfs_node_t vfs_dir_owner(vfs_node_t dir) {
+  return dir != null && dir->covered != null ? dir->source : dir;
+}
+
 static vfs_node_t vfs_node_alloc(vfs_node_t parent, cstr name) {
-  vfs_node_t node = malloc(sizeof(struct vfs_node));
+  parent = vfs_dir_owner(parent);
+  // 节点、信息、名称和链表单元都记入父文件夹所在的挂载
+  u16 mnt = parent ? parent->info->root->info->mntid : 0;
+  vfs_node_t node = mem_alloc(vfs_mem_nodes, mnt, sizeof(struct vfs_node));
   if (node == null)
     return null;
   memset(node, 0, sizeof(struct vfs_node));
   node->parent = parent;
-  node->name = name ? strdup(name) : null;
+  node->name = name ? mem_strdup(vfs_mem_names, mnt, name) : null;
   node->symlink_path = null;
-  node->info = malloc(sizeof(*(node->info)));
+  node->memmnt = mnt;
+  node->info = mem_alloc(vfs_mem_infos, mnt, sizeof(*(node->info)));
   memset(node->info, 0, sizeof(*(node->info)));
   node->info->type = file_none;
   node->info->fsid = parent ? parent->info->fsid : 0;
   node->info->root = parent ? parent->info->root : node;
-  if (node->info->type == file_dir) {
-    list_prepend(node->info->childs, &(node->child));
-  }
-  if (parent == null)
-    return node;
-  list_foreach(parent->info->childs, data) {
-    vfs_node_t child = (vfs_node_t)data->data;
-    list_prepend(child->child, node);
+  node->info->refcount = 1;
+  node->info->memmnt = mnt;
+  // 父节点的各个别名共享同一个子节点列表，只需要插入一次；链表单元与节点
+  // 同生共死 (移动时删除再插入)，在 vfs_free 中减去
+  if (parent != null) {
+    list_prepend(parent->info->child, node);
+    mem_charge(vfs_mem_links, mnt, sizeof(struct list), 1);
   }
   return node;
 }
 
-static void _vfs_free(vfs_node_t vfs) {
-  if (vfs == null)
-    return;
-  list_free_with(vfs->child, (free_t)_vfs_free);
-  vfs_close(vfs);
-  free(vfs->name);
-  free(vfs);
-}
 static void vfs_free(vfs_node_t vfs);
-static void vfs_free_with_lists(list_t list) {
-  list_foreach(list, data) {
-    list_t *vfs = (list_t *)data->data;
-    list_free_with(*vfs, (free_t)vfs_free);
+static void vfs_xattrs_free(struct vfs_xattrs *xattrs);
+
+static size_t vfs_nwatches = 0; // 为 0 时不需要查找监视
+
+// 最后一个引用释放时才关闭文件并释放子节点
+static void vfs_info_put(struct vfs_node_info *info) {
+  if (--info->refcount > 0)
+    return;
+  list_free_with(info->child, (free_t)vfs_free);
+  vfs_xattrs_free(info->xattrs);
+  // 监视仍需由使用者取消，只是不再有节点
+  list_foreach(info->watches, it) {
+    ((vfs_watch_t)it->data)->node = null;
+    vfs_nwatches--;
   }
-  list_free(list);
+  list_free(info->watches);
+  poll_queue_free(info->pollq);
+  pipe_free(info->pipe);
+  lock_table_free(info->locks);
+  if (info->handle != null)
+    fs_callbacks[info->fsid]->close(info->handle);
+  mem_free(vfs_mem_infos, info->memmnt, info, sizeof(*info));
 }
 
 static void vfs_free(vfs_node_t vfs) {
   if (vfs == null)
     return;
-  if (vfs->symlink_path == null) {
-    if (vfs->info->type == file_dir)
-      vfs_free_with_lists(vfs->info->childs); // 此时,vfs->child就已经被释放了
-    vfs_close(vfs);
-    free(vfs->name);
-    free(vfs->info);
-    free(vfs);
-  } else {
-    if (vfs_open(vfs->symlink_path) == null)
-      return; // 说明info肯定不合法
-    if (vfs->info->type == file_dir) {
-      list_delete(vfs->info->childs, &(vfs->child));
-      list_free_with(vfs->child, (free_t)_vfs_free);
-    }
-    vfs_close(vfs);
-    free(vfs->name);
-    free(vfs);
-  }
+  vfs_info_put(vfs->info);
+  if (vfs->covered != null)
+    vfs_info_put(vfs->covered);
+  if (vfs->parent != null)
+    mem_charge(vfs_mem_links, vfs->memmnt, -(isize)sizeof(struct list), -1);
+  mem_free_str(vfs_mem_names, vfs->memmnt, vfs->name);
+  mem_free(vfs_mem_nodes, vfs->memmnt, vfs, sizeof(*vfs));
 }
 static void vfs_free_child(vfs_node_t vfs) {
   if (vfs == null)
     return;
-  list_free_with(vfs->child, (free_t)vfs_free);
+  list_free_with(vfs->info->child, (free_t)vfs_free);
+  vfs->info->child = null;
+}
+
+// 路径查找结束，记录到统计和追踪中
+finline void walk_done(vfs_node_t last, u32 steps, u32 hits, u32 misses,
+                       bool found) {
+  stats_walk(last, steps, hits, misses, found);
+  trace_walk(last);
 }
 
 // 从字符串中提取路径
@@ -99,15 +120,22 @@ finline char *pathtok(char **_rest sp) {
 
 finline __nnull(1) void do_open(vfs_node_t file) {
   if (file->info->handle != null) {
-    callbackof(file, stat)(file->info->handle, file);
+    stats_callback(callbackof(file, stat)(file->info->handle, file));
   } else {
-    callbackof(file, open)(file->parent->info->handle, file->name, file);
+    stats_callback(callbackof(file, open)(file->parent->info->handle,
+                                          file->name, file));
   }
+  if (file->info->pipe != null) // 驱动中只是一个占据名称的普通文件
+    file->info->type = file_fifo;
 }
 
 finline void do_update(vfs_node_t file) {
   assert(file != null);
+  if (file->parent == null && file->info->pipe != null)
+    return; // 匿名管道在驱动中没有对应的文件
   assert(file->info->fsid != 0 || file->info->type != file_none);
+  if (file->info->fsid == 0)
+    return; // 不属于任何挂载的节点 (例如未挂载的根目录) 没有驱动可以查询
   if (file->info->type == file_none || file->info->handle == null ||
       file->info->type == file_dir)
     do_open(file);
@@ -123,16 +151,96 @@ vfs_node_t vfs_child_append(vfs_node_t parent, cstr name, void *handle) {
 }
 
 static vfs_node_t vfs_child_find(vfs_node_t parent, cstr name) {
-  return list_first(parent->child, data, streq(name, ((vfs_node_t)data)->name));
+  return list_first(parent->info->child, data,
+                    streq(name, ((vfs_node_t)data)->name));
 }
 
-int vfs_mkdir(cstr name) {
+vfs_watch_t vfs_watch(vfs_node_t node, int mask, bool subtree) {
+  if (node == null)
+    return null;
+  vfs_watch_t watch = malloc(sizeof(*watch));
+  if (watch == null)
+    return null;
+  watch->events = event_alloc();
+  if (watch->events == null) {
+    free(watch);
+    return null;
+  }
+  watch->node = node;
+  watch->mask = mask;
+  watch->subtree = subtree;
+  list_prepend(node->info->watches, watch);
+  vfs_nwatches++;
+  return watch;
+}
+
+void vfs_unwatch(vfs_watch_t watch) {
+  if (watch == null)
+    return;
+  if (watch->node != null) {
+    list_delete(watch->node->info->watches, watch);
+    vfs_nwatches--;
+  }
+  for (void *ev; (ev = event_pop(watch->events)) != null;)
+    free(ev);
+  event_free(watch->events);
+  free(watch);
+}
+
+static void vfs_watch_push(vfs_watch_t watch, int type, cstr path, u64 offset,
+                           u64 size) {
+  event_t q = watch->events;
+  // 队尾是同一个文件的写入时直接合并，取走之后的写入才产生新的事件
+  if (type == vfs_event_write) {
+    spin_lock(q->spin);
+    vfs_event_t last = q->tail ? q->tail->data : null;
+    if (last && last->type == vfs_event_write && streq(last->path, path)) {
+      u64 end = max(last->offset + last->size, offset + size);
+      last->offset = min(last->offset, offset);
+      last->size = end - last->offset;
+      spin_unlock(q->spin);
+      return;
+    }
+    spin_unlock(q->spin);
+  }
+  vfs_event_t ev = malloc(sizeof(*ev) + strlen(path) + 1);
+  if (ev == null)
+    return;
+  ev->type = type;
+  ev->offset = offset;
+  ev->size = size;
+  strcpy(ev->path, path);
+  event_push(q, ev);
+}
+
+// 通知节点自身、父目录以及监视整个子树的祖先
+static void vfs_notify(vfs_node_t node, int type, u64 offset, u64 size) {
+  if (vfs_nwatches == 0)
+    return;
+  char *path = null;
+  size_t depth = 0;
+  for (vfs_node_t cur = node; cur; cur = cur->parent, depth++) {
+    list_foreach(cur->info->watches, it) {
+      vfs_watch_t watch = it->data;
+      if (!(watch->mask & type) || (depth > 1 && !watch->subtree))
+        continue;
+      if (path == null && (path = vfs_get_fullpath(node)) == null)
+        return;
+      vfs_watch_push(watch, type, path, offset, size);
+    }
+  }
+  free(path);
+}
+
+static int vfs_do_mkdir(cstr name) {
   if (name[0] != '/')
     return -1;
   char *path = strdup(name + 1);
   char *save_ptr = path;
   vfs_node_t current = rootdir;
-  for (cstr buf = pathtok(&save_ptr); buf; buf = pathtok(&save_ptr)) {
+  u32 steps = 0;
+  for (cstr buf = pathtok(&save_ptr); buf;
+       buf = pathtok(&save_ptr), steps++) {
     const vfs_node_t father = current;
     if (streq(buf, "."))
       continue;
@@ -148,10 +256,11 @@ int vfs_mkdir(cstr name) {
 
   upd:
     if (current == null) {
-      // TODO: childs
       current = vfs_node_alloc(father, buf);
       current->info->type = file_dir;
-      callbackof(father, mkdir)(father->info->handle, buf, current);
+      stats_callback(
+          callbackof(father, mkdir)(father->info->handle, buf, current));
+      vfs_notify(current, vfs_event_create, 0, 0);
     } else {
       do_update(current);
       if (current->info->type != file_dir)
@@ -159,21 +268,35 @@ int vfs_mkdir(cstr name) {
     }
   }
 
+  walk_done(current, steps, 0, 0, true);
   free(path);
   return 0;
 
 err:
+  walk_done(current, steps, 0, 0, false);
   free(path);
   return -1;
 }
 
-int vfs_mkfile(cstr name) {
+int vfs_mkdir(cstr name) {
+  u64 start = stats_begin();
+  u64 traced = trace_begin();
+  u64 recorded = record_begin();
+  int ret = vfs_do_mkdir(name);
+  record_end(vfs_op_mkdir, null, name, recorded, 0, 0, ret);
+  trace_end(vfs_op_mkdir, null, name, traced, 0, 0, ret == 0);
+  stats_end(vfs_op_mkdir, null, start, ret == 0, 0);
+  return ret;
+}
+
+static int vfs_do_mkfile(cstr name) {
   if (name[0] != '/')
     return -1;
   char *path = strdup(name + 1);
   char *save_ptr = path;
   vfs_node_t current = rootdir;
   char *filename = path + strlen(path);
+  u32 steps = 0;
 
   while (*--filename != '/' && filename != path) {
   }
@@ -187,7 +310,8 @@ int vfs_mkfile(cstr name) {
     free(path);
     return -1;
   }
-  for (cstr buf = pathtok(&save_ptr); buf; buf = pathtok(&save_ptr)) {
+  for (cstr buf = pathtok(&save_ptr); buf;
+       buf = pathtok(&save_ptr), steps++) {
     if (streq(buf, "."))
       continue;
     if (streq(buf, "..")) {
@@ -204,30 +328,49 @@ int vfs_mkfile(cstr name) {
 create:
   vfs_node_t node = vfs_child_append(current, filename, null);
   node->info->type = file_block;
-  callbackof(current, mkfile)(current->info->handle, filename, node);
+  stats_callback(
+      callbackof(current, mkfile)(current->info->handle, filename, node));
+  vfs_notify(node, vfs_event_create, 0, 0);
 
+  walk_done(current, steps, 0, 0, true);
   free(path);
   return 0;
 
 err:
+  walk_done(current, steps, 0, 0, false);
   free(path);
   return -1;
 }
 
+int vfs_mkfile(cstr name) {
+  u64 start = stats_begin();
+  u64 traced = trace_begin();
+  u64 recorded = record_begin();
+  int ret = vfs_do_mkfile(name);
+  record_end(vfs_op_mkfile, null, name, recorded, 0, 0, ret);
+  trace_end(vfs_op_mkfile, null, name, traced, 0, 0, ret == 0);
+  stats_end(vfs_op_mkfile, null, start, ret == 0, 0);
+  return ret;
+}
+
 int vfs_regist(cstr name, vfs_callback_t callback) {
   if (callback == null)
     return -1;
-  for (size_t i = 0; i < sizeof(struct vfs_callback) / sizeof(void *); i++) {
+  // 只检查必须实现的接口，可选接口为 null 时对应的操作返回 -1
+  for (size_t i = 0; i < offsetof(struct vfs_callback, resize) / sizeof(void *);
+       i++) {
     if (((void **)callback)[i] == null)
       return -1;
   }
   int id = fs_nextid++;
   fs_callbacks[id] = callback;
+  trace_regist(id, name);
   return id;
 }
 
 static vfs_node_t vfs_do_search(vfs_node_t dir, cstr name) {
-  return list_first(dir->child, data, streq(name, ((vfs_node_t)data)->name));
+  return list_first(dir->info->child, data,
+                    streq(name, ((vfs_node_t)data)->name));
 }
 
 static vfs_node_t __vfs_open(cstr _path) {
@@ -269,7 +412,7 @@ err:
 static vfs_node_t _vfs_open(cstr path) {
   vfs_node_t r = __vfs_open(path);
   // 接下来是检查环节
-  if (r->symlink_path == null)
+  if (r == null || r->symlink_path == null)
     return r;
   // 如果是软链接，则需要重新打开
   char *sympath = r->symlink_path;
@@ -292,7 +435,8 @@ static vfs_node_t _vfs_open(cstr path) {
     }                                                                          \
     do_update(current);                                                        \
   } while (0)
-vfs_node_t vfs_open(cstr _path) {
+// 逐级查找路径，记录经过的分量数和其中已经打开的节点数
+static vfs_node_t vfs_lookup(cstr _path) {
   if (_path == null)
     return null;
   if (_path[1] == '\0')
@@ -303,8 +447,9 @@ vfs_node_t vfs_open(cstr _path) {
 
   char *save_ptr = path;
   vfs_node_t current = rootdir;
+  u32 steps = 0, hits = 0, misses = 0;
   for (const char *buf = pathtok(&save_ptr); buf; buf = pathtok(&save_ptr)) {
-
+    steps++;
     if (streq(buf, "."))
       continue;
     if (streq(buf, "..")) {
@@ -315,23 +460,46 @@ vfs_node_t vfs_open(cstr _path) {
       CHECK_AND_UPDATE;
       continue;
     }
+    vfs_node_t parent = current;
     current = vfs_child_find(current, buf);
-    if (current == null)
+    if (current == null) {
+      current = parent;
       goto err;
+    }
+    if (current->info->handle != null)
+      hits++;
+    else
+      misses++;
     CHECK_AND_UPDATE;
   }
 
+  walk_done(current, steps, hits, misses, true);
   free(path);
   return current;
 
 err:
+  walk_done(current, steps, hits, misses, false);
   free(path);
   return null;
 }
+
+vfs_node_t vfs_open(cstr path) {
+  u64 start = stats_begin();
+  u64 traced = trace_begin();
+  u64 recorded = record_begin();
+  vfs_node_t node = vfs_lookup(path);
+  record_end(vfs_op_open, node, path, recorded, 0, 0, node ? 0 : -1);
+  trace_end(vfs_op_open, node, path, traced, 0, 0, node != null);
+  stats_end(vfs_op_open, node, start, node != null, 0);
+  return node;
+}
+
 void vfs_update(vfs_node_t node) { do_update(node); }
 
 bool vfs_init() {
-  for (size_t i = 0; i < sizeof(struct vfs_callback) / sizeof(void *); i++) {
+  // 只填充必需的接口，可选接口保持 null，表示未挂载的节点不支持它们
+  for (size_t i = 0; i < offsetof(struct vfs_callback, resize) / sizeof(void *);
+       i++) {
     ((void **)&vfs_empty_callback)[i] = &empty_func;
   }
 
@@ -340,73 +508,896 @@ bool vfs_init() {
   return true;
 }
 
+// 删除和替换前 vfs 自己关闭句柄，不产生关闭事件
+static void do_close(vfs_node_t node) {
+  if (node->info->handle == null)
+    return;
+  stats_callback(callbackof(node, close)(node->info->handle));
+  node->info->handle = null;
+}
+
 int vfs_close(vfs_node_t node) {
   if (node == null)
     return -1;
   if (node->info->handle == null)
     return 0;
-  callbackof(node, close)(node->info->handle);
-  node->info->handle = null;
+  u64 start = stats_begin();
+  u64 traced = trace_begin();
+  u64 recorded = record_begin();
+  do_close(node);
+  vfs_notify(node, vfs_event_close, 0, 0);
+  record_end(vfs_op_close, node, null, recorded, 0, 0, 0);
+  trace_end(vfs_op_close, node, null, traced, 0, 0, true);
+  stats_end(vfs_op_close, node, start, true, 0);
   return 0;
 }
 
-int vfs_mount(cstr src, vfs_node_t node) {
-  if (node == null)
-    return -1;
+static int vfs_do_mount(cstr src, vfs_node_t node) {
   if (node->info->type != file_dir)
     return -1;
+  u16 fsid = node->info->fsid, mntid = node->info->mntid;
+  vfs_node_t root = node->info->root;
+  // 驱动可能在挂载时就创建子节点，子节点需要继承新的 fsid，内存也要记入
+  // 新的挂载，所以先分配编号
+  stats_mount(node);
   for (int i = 1; i < fs_nextid; i++) {
+    node->info->fsid = i;
+    node->info->root = node;
     if (fs_callbacks[i]->mount(src, node) == 0) {
-      node->info->fsid = i;
-      node->info->root = node;
+      vfs_xattrs_free(node->info->xattrs); // 缓存属于被覆盖的文件夹
+      node->info->xattrs = null;
       return 0;
     }
   }
+  stats_unmount(node);
+  node->info->fsid = fsid;
+  node->info->mntid = mntid;
+  node->info->root = root;
   return -1;
 }
 
+int vfs_mount(cstr src, vfs_node_t node) {
+  if (node == null)
+    return -1;
+  u64 start = stats_begin();
+  u64 traced = trace_begin();
+  u64 recorded = record_begin();
+  int ret = vfs_do_mount(src, node);
+  record_end(replay_mount, node, src, recorded, 0, 0, ret);
+  trace_end(vfs_op_mount, node, null, traced, 0, 0, ret == 0);
+  stats_end(vfs_op_mount, node, start, ret == 0, 0);
+  return ret;
+}
+
+static ssize_t vfs_do_read(vfs_node_t file, void *addr, size_t offset,
+                           size_t size) {
+  if (file->info->pipe != null)
+    return pipe_read(file->info->pipe, addr, size);
+  do_update(file);
+  if (file->info->type == file_dir)
+    return -1;
+  ssize_t read_bytes;
+  stats_callback(read_bytes = callbackof(file, read)(file->info->handle, addr,
+                                                     offset, size));
+  return read_bytes;
+}
+
 ssize_t vfs_read(vfs_node_t file, void *addr, size_t offset, size_t size) {
   assert(file != null);
   assert(addr != null);
+  u64 start = stats_begin();
+  u64 traced = trace_begin();
+  u64 recorded = record_begin();
+  ssize_t ret = vfs_do_read(file, addr, offset, size);
+  record_end(vfs_op_read, file, null, recorded, offset, size, ret);
+  trace_end(vfs_op_read, file, null, traced, offset, ret >= 0 ? ret : size,
+            ret >= 0);
+  stats_end(vfs_op_read, file, start, ret >= 0, ret > 0 ? ret : 0);
+  return ret;
+}
+
+static ssize_t vfs_do_write(vfs_node_t file, const void *addr, size_t offset,
+                            size_t size) {
+  if (file->info->pipe != null)
+    return pipe_write(file->info->pipe, addr, size);
   do_update(file);
   if (file->info->type == file_dir)
     return -1;
-  return callbackof(file, read)(file->info->handle, addr, offset, size);
+  ssize_t write_bytes;
+  stats_callback(write_bytes = callbackof(file, write)(file->info->handle,
+                                                       addr, offset, size));
+  if (write_bytes > 0) {
+    file->info->size = max(file->info->size, offset + write_bytes);
+    vfs_notify(file, vfs_event_write, offset, write_bytes);
+  }
+  return write_bytes;
 }
 
 ssize_t vfs_write(vfs_node_t file, const void *addr, size_t offset,
                   size_t size) {
   assert(file != null);
   assert(addr != null);
+  u64 start = stats_begin();
+  u64 traced = trace_begin();
+  u64 recorded = record_begin();
+  ssize_t ret = vfs_do_write(file, addr, offset, size);
+  record_end(vfs_op_write, file, null, recorded, offset, size, ret);
+  trace_end(vfs_op_write, file, null, traced, offset, ret >= 0 ? ret : size,
+            ret >= 0);
+  stats_end(vfs_op_write, file, start, ret >= 0, ret > 0 ? ret : 0);
+  return ret;
+}
+
+static int vfs_do_bind(cstr src, cstr path) {
+  vfs_node_t from = vfs_open(src);
+  vfs_node_t node = vfs_open(path);
+  if (from == null || node == null || node == rootdir)
+    return -1;
+  if (from->info->type != file_dir || node->info->type != file_dir)
+    return -1;
+  if (node->covered != null)
+    return -1;
+  // 不能绑定到源文件夹自身或它的子树中
+  for (vfs_node_t cur = node; cur; cur = cur->parent) {
+    if (cur->info == from->info)
+      return -1;
+  }
+  node->covered = node->info;
+  node->source = vfs_dir_owner(from);
+  node->info = from->info;
+  node->info->refcount++;
+  return 0;
+}
+
+int vfs_bind(cstr src, cstr path) {
+  u64 start = stats_begin();
+  u64 traced = trace_begin();
+  int ret = vfs_do_bind(src, path);
+  trace_end(vfs_op_bind, null, path, traced, 0, 0, ret == 0);
+  stats_end(vfs_op_bind, null, start, ret == 0, 0);
+  return ret;
+}
+
+static int vfs_do_truncate(vfs_node_t file, u64 size) {
   do_update(file);
-  if (file->info->type == file_dir)
+  if (file->info->type == file_dir || callbackof(file, resize) == null)
     return -1;
-  ssize_t write_bytes =
-      callbackof(file, write)(file->info->handle, addr, offset, size);
-  if (write_bytes > 0) {
-    file->info->size = max(file->info->size, offset + write_bytes);
+  int ret;
+  stats_callback(ret = callbackof(file, resize)(file->info->handle, size));
+  if (ret < 0)
+    return -1;
+  callbackof(file, stat)(file->info->handle, file);
+  vfs_notify(file, vfs_event_write, size, 0);
+  return 0;
+}
+
+int vfs_truncate(vfs_node_t file, u64 size) {
+  if (file == null)
+    return -1;
+  u64 start = stats_begin();
+  u64 traced = trace_begin();
+  int ret = vfs_do_truncate(file, size);
+  trace_end(vfs_op_truncate, file, null, traced, 0, size, ret == 0);
+  stats_end(vfs_op_truncate, file, start, ret == 0, 0);
+  return ret;
+}
+
+static int vfs_do_fallocate(vfs_node_t file, int mode, u64 offset,
+                            u64 size) {
+  if ((mode & vfs_falloc_punch_hole) &&
+      (!(mode & vfs_falloc_keep_size) || (mode & vfs_falloc_zero_range)))
+    return -1;
+  do_update(file);
+  if (file->info->type == file_dir || callbackof(file, fallocate) == null)
+    return -1;
+  int ret;
+  stats_callback(ret = callbackof(file, fallocate)(file->info->handle, mode,
+                                                   offset, size));
+  if (ret < 0)
+    return -1;
+  // 刷新大小和实际占用的空间
+  callbackof(file, stat)(file->info->handle, file);
+  vfs_notify(file, vfs_event_write, offset, size);
+  return 0;
+}
+
+int vfs_fallocate(vfs_node_t file, int mode, u64 offset, u64 size) {
+  if (file == null)
+    return -1;
+  u64 start = stats_begin();
+  u64 traced = trace_begin();
+  int ret = vfs_do_fallocate(file, mode, offset, size);
+  trace_end(vfs_op_fallocate, file, null, traced, offset, size, ret == 0);
+  stats_end(vfs_op_fallocate, file, start, ret == 0, 0);
+  return ret;
+}
+
+static i64 vfs_seek(vfs_node_t file, u64 offset, bool hole) {
+  if (file == null)
+    return -1;
+  do_update(file);
+  u64 size = file->info->size;
+  if (file->info->type == file_dir || offset >= size)
+    return -1;
+  i64 pos;
+  if (callbackof(file, seek) != null)
+    pos = callbackof(file, seek)(file->info->handle, offset, hole);
+  else
+    pos = hole ? size : offset;
+  if (hole)
+    return pos < 0 || (u64)pos > size ? (i64)size : pos;
+  return pos < 0 || (u64)pos >= size ? -1 : pos;
+}
+
+i64 vfs_next_data(vfs_node_t file, u64 offset) {
+  return vfs_seek(file, offset, false);
+}
+
+i64 vfs_next_hole(vfs_node_t file, u64 offset) {
+  return vfs_seek(file, offset, true);
+}
+
+#define VFS_COPY_CHUNK (64 * 1024) // 无法映射时每次读写的大小
+
+// 目标文件的 [offset, offset + size) 写为 0
+static int vfs_copy_zero(vfs_node_t dst, u64 offset, u64 size) {
+  static const byte zero[PAGE_SIZE];
+  if (vfs_fallocate(dst, vfs_falloc_punch_hole | vfs_falloc_keep_size, offset,
+                    size) == 0)
+    return 0;
+  for (u64 done = 0; done < size;) {
+    size_t n = min(size - done, (u64)PAGE_SIZE);
+    if (vfs_write(dst, zero, offset + done, n) != (ssize_t)n)
+      return -1;
+    done += n;
   }
-  return write_bytes;
+  return 0;
 }
 
-int vfs_unmount(cstr path) {
+static int vfs_copy_data(vfs_node_t src, u64 src_off, vfs_node_t dst,
+                         u64 dst_off, u64 size, byte **bounce) {
+  vfs_mapfile_t map = callbackof(src, map);
+  for (u64 done = 0; done < size;) {
+    u64 pos = src_off + done;
+    // 能映射时直接从源文件的内存写入，只复制一次
+    size_t n = min(size - done, (u64)(PAGE_SIZE - pos % PAGE_SIZE));
+    const void *addr = map ? map(src->info->handle, pos, n) : null;
+    if (addr == null) {
+      if (*bounce == null && (*bounce = malloc(VFS_COPY_CHUNK)) == null)
+        return -1;
+      ssize_t r = vfs_read(src, *bounce, pos, min(size - done,
+                                                 (u64)VFS_COPY_CHUNK));
+      if (r <= 0)
+        return -1;
+      n = r;
+      addr = *bounce;
+    }
+    if (vfs_write(dst, addr, dst_off + done, n) != (ssize_t)n)
+      return -1;
+    done += n;
+  }
+  return 0;
+}
+
+static ssize_t vfs_do_copy_range(vfs_node_t src, u64 src_off, vfs_node_t dst,
+                                 u64 dst_off, u64 size) {
+  do_update(src);
+  do_update(dst);
+  if (src->info->type == file_dir || dst->info->type == file_dir)
+    return -1;
+  if (src_off >= src->info->size)
+    return 0;
+  size = min(size, src->info->size - src_off);
+  if (src->info == dst->info && src_off < dst_off + size &&
+      dst_off < src_off + size)
+    return -1;
+
+  if (src->info->fsid == dst->info->fsid &&
+      callbackof(dst, copy_range) != null) {
+    ssize_t r;
+    stats_callback(r = callbackof(dst, copy_range)(
+                       src->info->handle, src_off, dst->info->handle, dst_off,
+                       size));
+    if (r >= 0) {
+      callbackof(dst, stat)(dst->info->handle, dst);
+      vfs_notify(dst, vfs_event_write, dst_off, r);
+      return r;
+    }
+  }
+
+  // 按源文件的数据和空洞分段复制
+  u64 end = src_off + size;
+  byte *bounce = null;
+  int ret = 0;
+  for (u64 pos = src_off; pos < end && ret == 0;) {
+    i64 data = vfs_next_data(src, pos);
+    u64 next = data < 0 ? end : min((u64)data, end);
+    u64 to = dst_off + (pos - src_off);
+    if (next > pos) {
+      // 目标文件末尾之后的部分在最后扩大文件时自然为 0
+      if (to < dst->info->size)
+        ret = vfs_copy_zero(dst, to, min(next - pos, dst->info->size - to));
+    } else {
+      i64 hole = vfs_next_hole(src, pos);
+      next = hole <= (i64)pos ? end : min((u64)hole, end);
+      ret = vfs_copy_data(src, pos, dst, to, next - pos, &bounce);
+    }
+    pos = next;
+  }
+  free(bounce);
+  if (ret < 0)
+    return -1;
+  // 源文件末尾是空洞时目标文件还需要扩大，驱动不支持截断时写入最后一个字节
+  u64 dst_end = dst_off + size;
+  if (dst->info->size < dst_end && vfs_truncate(dst, dst_end) < 0 &&
+      vfs_write(dst, &(byte){0}, dst_end - 1, 1) != 1)
+    return -1;
+  return size;
+}
+
+ssize_t vfs_copy_range(vfs_node_t src, u64 src_off, vfs_node_t dst,
+                       u64 dst_off, u64 size) {
+  if (src == null || dst == null)
+    return -1;
+  u64 start = stats_begin();
+  u64 traced = trace_begin();
+  ssize_t ret = vfs_do_copy_range(src, src_off, dst, dst_off, size);
+  trace_end(vfs_op_copy_range, dst, null, traced, dst_off,
+            ret >= 0 ? ret : size, ret >= 0);
+  stats_end(vfs_op_copy_range, dst, start, ret >= 0, ret > 0 ? ret : 0);
+  return ret;
+}
+
+// 打开路径的父目录，*name 为最后一级的名称 (需要 free)
+static vfs_node_t vfs_open_parent(cstr path, char **name) {
+  if (path == null || path[0] != '/')
+    return null;
+  char *dir = strdup(path);
+  if (dir == null)
+    return null;
+  size_t len = strlen(dir);
+  while (len > 1 && dir[len - 1] == '/')
+    dir[--len] = '\0';
+  char *slash = strrchr(dir, '/');
+  if (slash[1] == '\0' || streq(slash + 1, ".") || streq(slash + 1, "..")) {
+    free(dir);
+    return null;
+  }
+  *name = strdup(slash + 1);
+  slash[slash == dir ? 1 : 0] = '\0';
+  vfs_node_t parent = vfs_open(dir);
+  free(dir);
+  if (*name == null || parent == null || parent->info->type != file_dir ||
+      parent->info->fsid == 0) {
+    free(*name);
+    *name = null;
+    return null;
+  }
+  return parent;
+}
+
+// 挂载点和绑定挂载的两端不能被删除或移动 (文件共享信息是因为硬链接)
+finline bool vfs_busy(vfs_node_t node) {
+  return node->info->root == node || node->covered != null ||
+         (node->info->type == file_dir && node->info->refcount > 1);
+}
+
+static int vfs_remove(cstr path, bool dir) {
+  char *name;
+  vfs_node_t parent = vfs_open_parent(path, &name);
+  if (parent == null)
+    return -1;
+  int ret = -1;
+  vfs_node_t node = vfs_child_find(parent, name);
+  if (node == null || vfs_busy(node) || callbackof(parent, remove) == null)
+    goto out;
+  do_update(node);
+  if ((node->info->type == file_dir) != dir)
+    goto out;
+  if (dir && node->info->child != null)
+    goto out;
+  // 硬链接的其它名称仍在使用句柄
+  if (node->info->refcount == 1)
+    do_close(node);
+  int removed;
+  stats_callback(removed = callbackof(parent, remove)(parent->info->handle,
+                                                      name));
+  if (removed < 0)
+    goto out;
+  vfs_notify(node, vfs_event_delete, 0, 0);
+  list_delete(parent->info->child, node);
+  vfs_free(node);
+  ret = 0;
+
+out:
+  free(name);
+  return ret;
+}
+
+int vfs_unlink(cstr path) {
+  u64 start = stats_begin();
+  u64 traced = trace_begin();
+  u64 recorded = record_begin();
+  int ret = vfs_remove(path, false);
+  record_skip(recorded);
+  trace_end(vfs_op_unlink, null, path, traced, 0, 0, ret == 0);
+  stats_end(vfs_op_unlink, null, start, ret == 0, 0);
+  return ret;
+}
+
+int vfs_rmdir(cstr path) {
+  u64 start = stats_begin();
+  u64 traced = trace_begin();
+  u64 recorded = record_begin();
+  int ret = vfs_remove(path, true);
+  record_skip(recorded);
+  trace_end(vfs_op_rmdir, null, path, traced, 0, 0, ret == 0);
+  stats_end(vfs_op_rmdir, null, start, ret == 0, 0);
+  return ret;
+}
+
+static int vfs_do_rename(cstr oldpath, cstr newpath) {
+  char *oldname = null, *newname = null;
+  vfs_node_t oldparent = vfs_open_parent(oldpath, &oldname);
+  vfs_node_t newparent = vfs_open_parent(newpath, &newname);
+  vfs_node_t node = oldparent ? vfs_child_find(oldparent, oldname) : null;
+  int ret = -1;
+  if (node == null || newparent == null || vfs_busy(node))
+    goto out;
+  if (oldparent->info->fsid != newparent->info->fsid ||
+      oldparent->info->root != newparent->info->root ||
+      callbackof(oldparent, rename) == null)
+    goto out;
+  do_update(node);
+  // 不能移动到自身的子树中
+  for (vfs_node_t cur = newparent; cur; cur = cur->parent) {
+    if (cur->info == node->info)
+      goto out;
+  }
+
+  vfs_node_t target = vfs_child_find(newparent, newname);
+  // 同一个文件的两个名称之间什么也不做
+  if (target != null && target->info == node->info) {
+    ret = 0;
+    goto out;
+  }
+  if (target != null) {
+    if (vfs_busy(target))
+      goto out;
+    do_update(target);
+    bool is_dir = node->info->type == file_dir;
+    if ((target->info->type == file_dir) != is_dir)
+      goto out;
+    if (is_dir && target->info->child != null)
+      goto out;
+    if (target->info->refcount == 1)
+      do_close(target);
+  }
+  int renamed;
+  stats_callback(renamed = callbackof(oldparent, rename)(
+                     oldparent->info->handle, oldname,
+                     newparent->info->handle, newname));
+  if (renamed < 0)
+    goto out;
+  if (target != null) {
+    list_delete(newparent->info->child, target);
+    vfs_free(target);
+  }
+  // 完整路径由 parent 链得到，只需移动节点本身，子树原样跟随
+  vfs_notify(node, vfs_event_delete, 0, 0);
+  list_delete(oldparent->info->child, node);
+  mem_free_str(vfs_mem_names, node->memmnt, node->name);
+  node->name = mem_adopt_str(vfs_mem_names, node->memmnt, newname);
+  newname = null;
+  node->parent = vfs_dir_owner(newparent);
+  list_prepend(newparent->info->child, node);
+  vfs_notify(node, vfs_event_create, 0, 0);
+  ret = 0;
+
+out:
+  free(oldname);
+  free(newname);
+  return ret;
+}
+
+int vfs_rename(cstr oldpath, cstr newpath) {
+  u64 start = stats_begin();
+  u64 traced = trace_begin();
+  u64 recorded = record_begin();
+  int ret = vfs_do_rename(oldpath, newpath);
+  record_skip(recorded);
+  trace_end(vfs_op_rename, null, oldpath, traced, 0, 0, ret == 0);
+  stats_end(vfs_op_rename, null, start, ret == 0, 0);
+  return ret;
+}
+
+static int vfs_do_link(cstr oldpath, cstr newpath) {
+  char *oldname = null, *newname = null;
+  vfs_node_t oldparent = vfs_open_parent(oldpath, &oldname);
+  vfs_node_t newparent = vfs_open_parent(newpath, &newname);
+  vfs_node_t node = oldparent ? vfs_child_find(oldparent, oldname) : null;
+  int ret = -1;
+  if (node == null || newparent == null ||
+      vfs_child_find(newparent, newname) != null)
+    goto out;
+  if (oldparent->info->fsid != newparent->info->fsid ||
+      oldparent->info->root != newparent->info->root ||
+      callbackof(oldparent, link) == null)
+    goto out;
+  do_update(node);
+  if (node->info->type == file_dir)
+    goto out;
+  int linked;
+  stats_callback(linked = callbackof(oldparent, link)(
+                     oldparent->info->handle, oldname,
+                     newparent->info->handle, newname));
+  if (linked < 0)
+    goto out;
+  vfs_node_t alias = vfs_node_alloc(newparent, newname);
+  if (alias == null)
+    goto out;
+  // 新名称直接引用原文件的信息，不再单独打开
+  mem_free(vfs_mem_infos, alias->memmnt, alias->info, sizeof(*alias->info));
+  alias->info = node->info;
+  alias->info->refcount++;
+  callbackof(node, stat)(node->info->handle, node);
+  vfs_notify(alias, vfs_event_create, 0, 0);
+  ret = 0;
+
+out:
+  free(oldname);
+  free(newname);
+  return ret;
+}
+
+int vfs_link(cstr oldpath, cstr newpath) {
+  u64 start = stats_begin();
+  u64 traced = trace_begin();
+  u64 recorded = record_begin();
+  int ret = vfs_do_link(oldpath, newpath);
+  record_skip(recorded);
+  trace_end(vfs_op_link, null, oldpath, traced, 0, 0, ret == 0);
+  stats_end(vfs_op_link, null, start, ret == 0, 0);
+  return ret;
+}
+
+#define VFS_XATTR_INLINE 4 // 直接存放在缓存中的属性数量，更多的放入哈希表
+
+typedef struct vfs_xattr {
+  char *name;
+  bool exists; // 为 false 时缓存的是驱动中没有这个属性
+  void *value;
+  size_t size;
+} *vfs_xattr_t;
+
+struct vfs_xattrs {
+  size_t count; // inline 中已使用的项数
+  struct vfs_xattr inline_attrs[VFS_XATTR_INLINE];
+  st_t spill;   // 名称 -> vfs_xattr_t
+  char *list;   // listxattr 的结果，为 null 时尚未缓存
+  size_t list_size;
+  size_t bytes; // 记入内存统计的字节数
+  u16 memmnt;   // 记入的挂载
+};
+
+static void vfs_xattrs_charge(struct vfs_xattrs *xattrs, isize bytes) {
+  xattrs->bytes += bytes;
+  mem_charge(vfs_mem_caches, xattrs->memmnt, bytes, 0);
+}
+
+static void vfs_xattrs_free(struct vfs_xattrs *xattrs) {
+  if (xattrs == null)
+    return;
+  for (size_t i = 0; i < xattrs->count; i++) {
+    free(xattrs->inline_attrs[i].name);
+    free(xattrs->inline_attrs[i].value);
+  }
+  if (xattrs->spill != null) {
+    for (usize i = 0; i <= xattrs->spill->mask; i++) {
+      for (st_node_t n = xattrs->spill->buckets[i]; n; n = n->next) {
+        vfs_xattr_t attr = n->value;
+        free(attr->name);
+        free(attr->value);
+        free(attr);
+      }
+    }
+    st_free(xattrs->spill);
+  }
+  free(xattrs->list);
+  mem_charge(vfs_mem_caches, xattrs->memmnt, -(isize)xattrs->bytes, -1);
+  free(xattrs);
+}
+
+static struct vfs_xattrs *vfs_xattrs_of(vfs_node_t node) {
+  if (node->info->xattrs == null) {
+    struct vfs_xattrs *xattrs = calloc(1, sizeof(struct vfs_xattrs));
+    if (xattrs == null)
+      return null;
+    xattrs->memmnt = node->info->memmnt;
+    mem_charge(vfs_mem_caches, xattrs->memmnt, 0, 1);
+    vfs_xattrs_charge(xattrs, sizeof(*xattrs));
+    node->info->xattrs = xattrs;
+  }
+  return node->info->xattrs;
+}
+
+static vfs_xattr_t vfs_xattr_find(struct vfs_xattrs *xattrs, cstr name) {
+  for (size_t i = 0; i < xattrs->count; i++) {
+    if (streq(xattrs->inline_attrs[i].name, name))
+      return &xattrs->inline_attrs[i];
+  }
+  return xattrs->spill ? st_get(xattrs->spill, name) : null;
+}
+
+static vfs_xattr_t vfs_xattr_add(struct vfs_xattrs *xattrs, cstr name) {
+  char *copy = strdup(name);
+  if (copy == null)
+    return null;
+  vfs_xattr_t attr;
+  if (xattrs->count < VFS_XATTR_INLINE) {
+    attr = &xattrs->inline_attrs[xattrs->count++];
+  } else {
+    if (xattrs->spill == null && (xattrs->spill = st_new()) == null)
+      goto err;
+    if ((attr = malloc(sizeof(*attr))) == null)
+      goto err;
+    if (st_insert(xattrs->spill, name, attr) < 0) {
+      free(attr);
+      goto err;
+    }
+    vfs_xattrs_charge(xattrs, sizeof(*attr));
+  }
+  vfs_xattrs_charge(xattrs, strlen(copy) + 1);
+  attr->name = copy;
+  attr->exists = false;
+  attr->value = null;
+  attr->size = 0;
+  return attr;
+
+err:
+  free(copy);
+  return null;
+}
+
+static ssize_t vfs_do_getxattr(vfs_node_t node, cstr name, void *value,
+                               size_t size) {
+  do_update(node);
+  struct vfs_xattrs *xattrs = vfs_xattrs_of(node);
+  if (xattrs == null)
+    return -1;
+  vfs_xattr_t attr = vfs_xattr_find(xattrs, name);
+  if (attr == null) {
+    vfs_getxattr_t get = callbackof(node, getxattr);
+    if (get == null)
+      return -1;
+    // 先取得大小再读取，不存在的属性也缓存下来
+    void *handle = node->info->handle;
+    ssize_t n;
+    stats_callback(n = get(handle, name, null, 0));
+    void *buf = n > 0 ? malloc(n) : null;
+    if (n > 0 && buf != null)
+      stats_callback(n = get(handle, name, buf, n));
+    if (buf == null ? n > 0 : n < 0) {
+      free(buf);
+      return -1;
+    }
+    if ((attr = vfs_xattr_add(xattrs, name)) == null) {
+      free(buf);
+      return -1;
+    }
+    attr->exists = n >= 0;
+    attr->value = buf;
+    attr->size = n > 0 ? n : 0;
+    vfs_xattrs_charge(xattrs, attr->size);
+  }
+  if (!attr->exists)
+    return -1;
+  if (size == 0)
+    return attr->size;
+  if (size < attr->size)
+    return -1;
+  if (attr->size != 0)
+    memcpy(value, attr->value, attr->size);
+  return attr->size;
+}
+
+ssize_t vfs_getxattr(vfs_node_t node, cstr name, void *value, size_t size) {
+  if (node == null || name == null || (value == null && size != 0))
+    return -1;
+  u64 start = stats_begin();
+  u64 traced = trace_begin();
+  ssize_t ret = vfs_do_getxattr(node, name, value, size);
+  trace_end(vfs_op_getxattr, node, null, traced, 0, ret >= 0 ? ret : size,
+            ret >= 0);
+  stats_end(vfs_op_getxattr, node, start, ret >= 0, 0);
+  return ret;
+}
+
+static int vfs_do_setxattr(vfs_node_t node, cstr name, const void *value,
+                           size_t size) {
+  do_update(node);
+  if (callbackof(node, setxattr) == null)
+    return -1;
+  int ret;
+  stats_callback(ret = callbackof(node, setxattr)(node->info->handle, name,
+                                                  value, size));
+  if (ret < 0)
+    return -1;
+  // 直接更新缓存，内存不足时丢弃整个缓存
+  struct vfs_xattrs *xattrs = vfs_xattrs_of(node);
+  if (xattrs == null)
+    return 0;
+  vfs_xattr_t attr = vfs_xattr_find(xattrs, name);
+  void *copy = size ? malloc(size) : null;
+  if ((size && copy == null) ||
+      (attr == null && (attr = vfs_xattr_add(xattrs, name)) == null)) {
+    free(copy);
+    vfs_xattrs_free(xattrs);
+    node->info->xattrs = null;
+    return 0;
+  }
+  if (!attr->exists && xattrs->list != null) {
+    vfs_xattrs_charge(xattrs, -(isize)(xattrs->list_size + 1));
+    free(xattrs->list);
+    xattrs->list = null;
+  }
+  if (size)
+    memcpy(copy, value, size);
+  vfs_xattrs_charge(xattrs, (isize)size - (isize)attr->size);
+  free(attr->value);
+  attr->exists = true;
+  attr->value = copy;
+  attr->size = size;
+  return 0;
+}
+
+int vfs_setxattr(vfs_node_t node, cstr name, const void *value, size_t size) {
+  if (node == null || name == null || (value == null && size != 0))
+    return -1;
+  u64 start = stats_begin();
+  u64 traced = trace_begin();
+  int ret = vfs_do_setxattr(node, name, value, size);
+  trace_end(vfs_op_setxattr, node, null, traced, 0, size, ret == 0);
+  stats_end(vfs_op_setxattr, node, start, ret == 0, 0);
+  return ret;
+}
+
+static ssize_t vfs_do_listxattr(vfs_node_t node, char *list, size_t size) {
+  do_update(node);
+  struct vfs_xattrs *xattrs = vfs_xattrs_of(node);
+  if (xattrs == null)
+    return -1;
+  if (xattrs->list == null) {
+    vfs_listxattr_t lst = callbackof(node, listxattr);
+    if (lst == null)
+      return -1;
+    ssize_t n;
+    stats_callback(n = lst(node->info->handle, null, 0));
+    char *buf = n >= 0 ? malloc(n + 1) : null;
+    if (buf != null)
+      stats_callback(n = lst(node->info->handle, buf, n));
+    if (buf == null || n < 0) {
+      free(buf);
+      return -1;
+    }
+    xattrs->list = buf;
+    xattrs->list_size = n;
+    vfs_xattrs_charge(xattrs, n + 1);
+  }
+  if (size == 0)
+    return xattrs->list_size;
+  if (size < xattrs->list_size)
+    return -1;
+  memcpy(list, xattrs->list, xattrs->list_size);
+  return xattrs->list_size;
+}
+
+ssize_t vfs_listxattr(vfs_node_t node, char *list, size_t size) {
+  if (node == null || (list == null && size != 0))
+    return -1;
+  u64 start = stats_begin();
+  u64 traced = trace_begin();
+  ssize_t ret = vfs_do_listxattr(node, list, size);
+  trace_end(vfs_op_listxattr, node, null, traced, 0, ret >= 0 ? ret : size,
+            ret >= 0);
+  stats_end(vfs_op_listxattr, node, start, ret >= 0, 0);
+  return ret;
+}
+
+#if VFS_POLL
+int vfs_poll_query(vfs_node_t node) {
+  if (node->info->pipe != null)
+    return pipe_poll(node->info->pipe);
+  vfs_poll_t poll = callbackof(node, poll);
+  if (poll == null)
+    return vfs_poll_in | vfs_poll_out; // 没有 poll 接口的文件总是可读写
+  int events;
+  stats_callback(events = poll(node->info->handle));
+  return events;
+}
+#endif
+
+int vfs_mkfifo(cstr path, size_t size, int flags) {
+  if (vfs_open(path) != null) // 不能把已有的文件变成管道
+    return -1;
+  if (vfs_mkfile(path) < 0)
+    return -1;
+  vfs_node_t node = vfs_open(path);
+  if (node == null)
+    return -1;
+  node->info->pipe = pipe_alloc(size, flags, node);
+  if (node->info->pipe == null)
+    return -1;
+  node->info->type = file_fifo;
+  return 0;
+}
+
+vfs_node_t vfs_pipe(size_t size, int flags) {
+  vfs_node_t node = vfs_node_alloc(null, null);
+  if (node == null)
+    return null;
+  node->info->type = file_fifo;
+  node->info->pipe = pipe_alloc(size, flags, node);
+  if (node->info->pipe == null) {
+    vfs_free(node);
+    return null;
+  }
+  return node;
+}
+
+void vfs_pipe_free(vfs_node_t pipe) {
+  if (pipe != null && pipe->parent == null && pipe != rootdir)
+    vfs_free(pipe);
+}
+
+int vfs_pipe_shutdown(vfs_node_t pipe) {
+  if (pipe == null || pipe->info->pipe == null)
+    return -1;
+  pipe_shutdown(pipe->info->pipe);
+  return 0;
+}
+
+ssize_t vfs_splice(vfs_node_t pipe, vfs_node_t file, u64 offset, size_t size) {
+  if (pipe == null || file == null || pipe->info->pipe == null)
+    return -1;
+  if (file->info->pipe != null)
+    return -1;
+  u64 start = stats_begin();
+  u64 traced = trace_begin();
+  ssize_t ret = pipe_splice(pipe->info->pipe, file, offset, size);
+  trace_end(vfs_op_splice, file, null, traced, offset, ret >= 0 ? ret : size,
+            ret >= 0);
+  stats_end(vfs_op_splice, file, start, ret >= 0, ret > 0 ? ret : 0);
+  return ret;
+}
+
+static int vfs_do_unmount(cstr path) {
   vfs_node_t node = vfs_open(path);
   if (node == null)
     return -1;
   if (node->info->type != file_dir)
     return -1;
+  if (node->covered != null) {
+    vfs_info_put(node->info);
+    node->info = node->covered;
+    node->covered = null;
+    node->source = null;
+    return 0;
+  }
   if (node->info->fsid == 0)
     return -1;
   if (node->parent) {
     vfs_node_t cur = node;
     node = node->parent;
     if (cur->info->root == cur) {
+      stats_unmount(cur);
       vfs_free_child(cur);
+      vfs_xattrs_free(cur->info->xattrs);
+      cur->info->xattrs = null;
       callbackof(cur, unmount)(cur->info->handle);
       cur->info->fsid = node->info->fsid; // 交给上级
       cur->info->root = node->info->root;
       cur->info->handle = null;
-      cur->child = null;
       // cur->info->type   = file_none;
       if (cur->info->fsid)
         do_update(cur);
@@ -416,6 +1407,15 @@ int vfs_unmount(cstr path) {
   return -1;
 }
 
+int vfs_unmount(cstr path) {
+  u64 start = stats_begin();
+  u64 traced = trace_begin();
+  int ret = vfs_do_unmount(path);
+  trace_end(vfs_op_unmount, null, path, traced, 0, 0, ret == 0);
+  stats_end(vfs_op_unmount, null, start, ret == 0, 0);
+  return ret;
+}
+
 // 使用请记得free掉返回的buff
 char *vfs_get_fullpath(vfs_node_t node) {
   if (node == null)
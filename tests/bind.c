@@ -0,0 +1,133 @@
+/*
+ * bind test - binds one tmpfs directory onto several mount points and
+ * checks that all aliases share a single child list, so creating a file
+ * through any of them is visible everywhere without per-alias work. Entries
+ * created through an alias belong to the source directory, so their paths
+ * and ".." stay valid after the alias is unbound and removed.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vfs.h>
+#include <fs/tmpfs.h>
+
+#define RESET   "\033[0m"
+#define RED     "\033[31m"
+#define GREEN   "\033[32m"
+#define BLUE    "\033[34m"
+#define BOLD    "\033[1m"
+
+#define ALIASES 64
+
+static int failures = 0;
+
+static void check(bool ok, const char *what) {
+    printf("%s %s\n", ok ? GREEN "[ OK ]" RESET : RED "[FAIL]" RESET, what);
+    if (!ok) failures++;
+}
+
+static void print_separator(const char *title) {
+    printf("\n" BOLD BLUE "=== %s ===" RESET "\n", title);
+}
+
+static bool fullpath_is(vfs_node_t node, const char *expect) {
+    char *path = vfs_get_fullpath(node);
+    bool ok = path && strcmp(path, expect) == 0;
+    free(path);
+    return ok;
+}
+
+static void test_bind() {
+    print_separator("Bind");
+
+    vfs_init();
+    tmpfs_regist();
+    check(vfs_mount("tmpfs", rootdir) == 0, "mount tmpfs on /");
+    vfs_mkdir("/data/sub");
+    vfs_mkfile("/data/file");
+    vfs_write(vfs_open("/data/file"), "shared", 0, 6);
+    vfs_mkfile("/plain");
+
+    char path[64];
+    bool ok = true;
+    for (int i = 0; i < ALIASES; i++) {
+        snprintf(path, sizeof(path), "/alias%d", i);
+        vfs_mkdir(path);
+        ok = ok && vfs_bind("/data", path) == 0;
+    }
+    check(ok, "bind /data onto 64 mount points");
+    check(vfs_open("/data")->info->refcount == ALIASES + 1, "all aliases share one info");
+    check(vfs_open("/alias7")->info->child == vfs_open("/data")->info->child, "aliases share the child list");
+
+    check(vfs_bind("/data", "/alias0") != 0, "cannot bind twice onto the same node");
+    check(vfs_bind("/data", "/data/sub") != 0, "cannot bind into its own subtree");
+    check(vfs_bind("/plain", "/alias1") != 0, "source must be a directory");
+    check(vfs_bind("/missing", "/alias1") != 0, "source must exist");
+
+    char buf[16] = {0};
+    vfs_node_t file = vfs_open("/alias3/file");
+    check(file && vfs_read(file, buf, 0, sizeof(buf)) == 6 && strcmp(buf, "shared") == 0,
+          "read through an alias");
+    check(file == vfs_open("/data/file"), "aliases resolve to the same node");
+}
+
+static void test_create() {
+    print_separator("Create through an alias");
+
+    size_t before = list_length(vfs_open("/data")->info->child);
+    check(vfs_mkfile("/alias42/new") == 0, "create a file in an alias");
+    check(list_length(vfs_open("/data")->info->child) == before + 1, "child inserted once");
+    check(vfs_open("/data/new") != NULL, "visible in the source");
+    check(vfs_open("/alias0/new") != NULL && vfs_open("/alias63/new") != NULL, "visible in every alias");
+
+    check(vfs_mkdir("/data/sub/deep") == 0, "create a directory in the source");
+    check(vfs_open("/alias9/sub/deep") != NULL, "visible through an alias");
+
+    check(fullpath_is(vfs_open("/alias42/new"), "/data/new"), "full path of an entry created in an alias");
+    check(vfs_mkdir("/alias42/made") == 0, "create a directory in an alias");
+    check(vfs_open("/alias42/made/..") == vfs_open("/data"), "its .. is the source");
+    check(fullpath_is(vfs_open("/alias1/made"), "/data/made"), "and its path goes through the source");
+    check(vfs_rename("/plain", "/alias3/moved") == 0, "move a file into an alias");
+    check(fullpath_is(vfs_open("/data/moved"), "/data/moved"), "moved under the source");
+}
+
+static void test_unbind() {
+    print_separator("Unbind");
+
+    check(vfs_unmount("/alias5") == 0, "unbind an alias");
+    vfs_node_t dir = vfs_open("/alias5");
+    check(dir && dir->info->child == NULL, "mount point shows its own empty directory again");
+    check(vfs_open("/data")->info->refcount == ALIASES, "reference dropped");
+    check(vfs_open("/alias6/new") != NULL, "other aliases are untouched");
+
+    char path[64];
+    bool ok = true;
+    for (int i = 0; i < ALIASES; i++) {
+        if (i == 5) continue;
+        snprintf(path, sizeof(path), "/alias%d", i);
+        ok = ok && vfs_unmount(path) == 0;
+    }
+    check(ok, "unbind the rest");
+    check(vfs_open("/data")->info->refcount == 1, "only the source is left");
+    check(vfs_open("/data/new") != NULL, "source keeps its entries");
+
+    check(vfs_rmdir("/alias42") == 0, "remove an unbound mount point");
+    check(fullpath_is(vfs_open("/data/new"), "/data/new"), "entries it created keep their path");
+    check(vfs_open("/data/made/..") == vfs_open("/data"), "and their ..");
+}
+
+int main() {
+    printf(BOLD "bind test" RESET "\n");
+
+    test_bind();
+    test_create();
+    test_unbind();
+
+    if (failures) {
+        printf("\n" RED "%d check(s) failed" RESET "\n", failures);
+        return 1;
+    }
+    printf("\n" GREEN "bind test completed successfully!" RESET "\n");
+    return 0;
+}
@@ -0,0 +1,351 @@
+/*
+ * block test - registers RAM disks as block devices and checks that the
+ * shared buffer cache hits, evicts in LRU order and writes dirty blocks back
+ * (skipping blocks whose write-back fails), then puts a request queue in front
+ * of a disk and checks merging, sorting and deadlines, and that a synchronous
+ * request on a plugged queue sleeps until the unplug.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <vfs.h>
+#include <block.h>
+
+#define RESET   "\033[0m"
+#define RED     "\033[31m"
+#define GREEN   "\033[32m"
+#define BLUE    "\033[34m"
+#define BOLD    "\033[1m"
+
+#define SECTOR  512
+#define SECTORS 64
+
+static int failures = 0;
+
+typedef struct ramdisk {
+    unsigned char data[SECTOR * SECTORS];
+    int reads;
+    int writes;
+    u64 log[32];    // start sector of each request, writes are negated
+    size_t logsize[32];
+    int nlog;
+} ramdisk_t;
+
+static void check(bool ok, const char *what) {
+    printf("%s %s\n", ok ? GREEN "[ OK ]" RESET : RED "[FAIL]" RESET, what);
+    if (!ok) failures++;
+}
+
+static void print_separator(const char *title) {
+    printf("\n" BOLD BLUE "=== %s ===" RESET "\n", title);
+}
+
+static ssize_t ramdisk_read(void *data, void *addr, u64 lba, size_t count) {
+    ramdisk_t *disk = data;
+    memcpy(addr, disk->data + lba * SECTOR, count * SECTOR);
+    disk->reads++;
+    if (disk->nlog < 32) {
+        disk->log[disk->nlog] = lba;
+        disk->logsize[disk->nlog++] = count;
+    }
+    return count;
+}
+
+static ssize_t ramdisk_write(void *data, const void *addr, u64 lba, size_t count) {
+    ramdisk_t *disk = data;
+    memcpy(disk->data + lba * SECTOR, addr, count * SECTOR);
+    disk->writes++;
+    if (disk->nlog < 32) {
+        disk->log[disk->nlog] = lba;
+        disk->logsize[disk->nlog++] = count;
+    }
+    return count;
+}
+
+static bool broken; // ramdisk_broken_write fails while set
+
+static ssize_t ramdisk_broken_write(void *data, const void *addr, u64 lba, size_t count) {
+    return broken ? -1 : ramdisk_write(data, addr, lba, count);
+}
+
+static ramdisk_t disk_a, disk_b, disk_c;
+static blkdev_t dev_a, dev_b;
+
+static void test_regist() {
+    print_separator("Register devices");
+
+    for (int i = 0; i < SECTOR * SECTORS; i++) {
+        disk_a.data[i] = i / SECTOR;
+        disk_b.data[i] = 0xff - i / SECTOR;
+    }
+
+    check(bcache_init(8) == 0, "initialize cache with 8 buffers");
+    dev_a = blkdev_regist("ram0", SECTOR, SECTORS, ramdisk_read, ramdisk_write, &disk_a);
+    dev_b = blkdev_regist("ram1", SECTOR, SECTORS, ramdisk_read, ramdisk_write, &disk_b);
+    check(dev_a != NULL && dev_b != NULL, "register ram0 and ram1");
+    check(blkdev_regist("ram0", SECTOR, SECTORS, ramdisk_read, NULL, NULL) == NULL, "reject duplicate name");
+    check(blkdev_get("ram1") == dev_b, "look up device by name");
+    check(blkdev_set_block_size(dev_a, 1000) != 0, "reject block size that is not a sector multiple");
+}
+
+static void test_hits() {
+    print_separator("Cache hits keyed by (dev, blockno)");
+
+    buf_t b = bread(dev_a, 3);
+    check(b != NULL && b->data[0] == 3, "read block 3 of ram0");
+    brelse(b);
+    b = bread(dev_b, 3);
+    check(b != NULL && b->data[0] == 0xff - 3, "same block number on ram1 is distinct");
+    brelse(b);
+    check(disk_a.reads == 1 && disk_b.reads == 1, "one device read each");
+
+    for (int i = 0; i < 10; i++) {
+        b = bread(dev_a, 3);
+        brelse(b);
+    }
+    check(disk_a.reads == 1, "repeated reads hit the cache");
+
+    struct bcache_stat st;
+    bcache_stat(&st);
+    check(st.hits == 10 && st.misses == 2, "hit and miss counters");
+}
+
+static void test_lru() {
+    print_separator("LRU eviction");
+
+    // fill the cache: ram0 block 3 and ram1 block 3 are already cached
+    for (int i = 10; i < 16; i++) {
+        buf_t b = bread(dev_a, i);
+        brelse(b);
+    }
+    // touch block 3 so that ram1 block 3 becomes the least recently used
+    brelse(bread(dev_a, 3));
+    int before = disk_b.reads;
+    brelse(bread(dev_a, 20)); // evicts ram1 block 3
+    brelse(bread(dev_a, 3));
+    check(disk_a.reads == 8, "recently used block survived eviction");
+    brelse(bread(dev_b, 3));
+    check(disk_b.reads == before + 1, "least recently used block was evicted");
+
+    // pinned buffers are never evicted
+    buf_t pinned[8];
+    int n = 0;
+    for (int i = 30; i < 38; i++) {
+        pinned[n] = bread(dev_a, i);
+        if (pinned[n]) n++;
+    }
+    check(n == 8, "pin every buffer");
+    check(bread(dev_a, 40) == NULL, "no buffer available while all are pinned");
+    for (int i = 0; i < n; i++) brelse(pinned[i]);
+}
+
+static void test_writeback() {
+    print_separator("Write-back");
+
+    int writes = disk_a.writes;
+    const char msg[] = "written through the buffer cache";
+    check(blkdev_write(dev_a, msg, SECTOR * 5 + 100, sizeof(msg)) == sizeof(msg), "partial block write");
+    check(disk_a.writes == writes, "write is not sent to the device yet");
+
+    struct bcache_stat st;
+    bcache_stat(&st);
+    check(st.dirty == 1, "one dirty buffer");
+
+    char buf[64];
+    check(blkdev_read(dev_a, buf, SECTOR * 5 + 100, sizeof(msg)) == sizeof(msg), "read back through cache");
+    check(memcmp(buf, msg, sizeof(msg)) == 0, "read sees dirty data");
+
+    check(bsync(dev_a) == 0, "bsync ram0");
+    check(disk_a.writes == writes + 1, "dirty block written once");
+    check(memcmp(disk_a.data + SECTOR * 5 + 100, msg, sizeof(msg)) == 0, "device has the data");
+
+    // a dirty block is written back when it is evicted
+    unsigned char full[SECTOR];
+    memset(full, 0xab, sizeof(full));
+    int reads = disk_a.reads;
+    check(blkdev_write(dev_a, full, SECTOR * 50, SECTOR) == SECTOR, "full block write");
+    check(disk_a.reads == reads, "full block write does not read the block");
+    for (int i = 0; i < 8; i++) brelse(bread(dev_b, 40 + i));
+    check(disk_a.data[SECTOR * 50] == 0xab, "evicted dirty block was written back");
+}
+
+static void test_block_size() {
+    print_separator("Unregister and larger blocks");
+
+    check(blkdev_unregist(dev_a) == 0, "unregister ram0");
+    check(blkdev_get("ram0") == NULL, "ram0 is gone");
+
+    dev_a = blkdev_regist("ram0", SECTOR, SECTORS, ramdisk_read, ramdisk_write, &disk_a);
+    check(blkdev_set_block_size(dev_a, SECTOR * 4) == 0, "use 2 KiB blocks");
+    int reads = disk_a.reads;
+    buf_t b = bread(dev_a, 1);
+    check(b && b->data[0] == 4 && b->data[SECTOR * 3] == 7, "block 1 covers sectors 4-7");
+    brelse(b);
+    check(disk_a.reads == reads + 1, "one device request per block");
+    check(blkdev_set_block_size(dev_a, SECTOR) != 0, "block size is fixed once cached");
+}
+
+static int completed;
+static ssize_t completed_bytes;
+
+static void count_done(void *data, ssize_t result) {
+    (void)data;
+    completed++;
+    if (result > 0) completed_bytes += result;
+}
+
+struct rw_arg {
+    blkq_t q;
+    unsigned char buf[SECTOR];
+    ssize_t result;
+    bool done;
+};
+
+static void *rw_thread(void *data) {
+    struct rw_arg *arg = data;
+    arg->result = blkq_rw(arg->q, false, arg->buf, 5, 1);
+    __atomic_store_n(&arg->done, true, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+static void test_queue() {
+    print_separator("Request queue");
+
+    blkdev_t dev = blkdev_regist("ram2", SECTOR, SECTORS, ramdisk_read, ramdisk_write, &disk_b);
+    blkq_t q = blkq_alloc(dev, 4, 8, 16);
+    check(q != NULL && dev->queue == q, "attach a queue");
+    check(blkq_alloc(dev, 4, 8, 16) == NULL, "one queue per device");
+
+    // back merge, front merge and a request that fills the gap between them
+    static unsigned char out[8][SECTOR];
+    for (int i = 0; i < 8; i++) memset(out[i], 'a' + i, SECTOR);
+    completed = 0, completed_bytes = 0;
+    disk_b.nlog = 0;
+    blkq_plug(q);
+    blkq_submit(q, true, out[2], 2, 1, count_done, NULL);
+    blkq_submit(q, true, out[3], 3, 1, count_done, NULL); // back merge
+    blkq_submit(q, true, out[6], 6, 1, count_done, NULL);
+    blkq_submit(q, true, out[5], 5, 1, count_done, NULL); // front merge
+    blkq_submit(q, true, out[4], 4, 1, count_done, NULL); // joins both
+    blkq_submit(q, false, out[0], 20, 1, count_done, NULL);
+    blkq_submit(q, false, out[1], 10, 1, count_done, NULL);
+    check(disk_b.nlog == 0, "nothing dispatched while plugged");
+    blkq_unplug(q);
+    check(completed == 7 && completed_bytes == 7 * SECTOR, "every request completed");
+    check(disk_b.nlog == 3, "five adjacent writes merged into one request");
+    check(disk_b.log[0] == 2 && disk_b.logsize[0] == 5, "merged request covers sectors 2-6");
+    check(disk_b.log[1] == 10 && disk_b.log[2] == 20, "requests dispatched in sector order");
+    bool same = true;
+    for (int i = 2; i < 7; i++) same = same && memcmp(disk_b.data + i * SECTOR, out[i], SECTOR) == 0;
+    check(same, "merged write scattered the right data");
+
+    struct blkq_stat st;
+    blkq_stat(q, &st);
+    check(st.submitted == 7 && st.merged == 4 && st.dispatched == 3, "queue counters");
+
+    // max_sectors caps merging
+    disk_b.nlog = 0;
+    static unsigned char big[20][SECTOR];
+    blkq_plug(q);
+    for (int i = 0; i < 20; i++) blkq_submit(q, false, big[i], 30 + i, 1, NULL, NULL);
+    blkq_unplug(q);
+    check(disk_b.nlog == 2 && disk_b.logsize[0] == 16 && disk_b.logsize[1] == 4, "merge limited to 16 sectors");
+
+    // a request far below the sweep position expires instead of starving
+    disk_b.nlog = 0;
+    blkq_plug(q);
+    blkq_submit(q, false, out[0], 1, 1, NULL, NULL);
+    for (int i = 0; i < 12; i++) blkq_submit(q, false, big[i], 40 + i * 2, 1, NULL, NULL);
+    blkq_unplug(q);
+    check(disk_b.nlog == 13, "thirteen separate requests");
+    int pos = -1;
+    for (int i = 0; i < disk_b.nlog; i++) if (disk_b.log[i] == 1) pos = i;
+    check(pos == 4, "expired request dispatched before the sweep wrapped around");
+
+    // the buffer cache goes through the queue and bsync merges adjacent blocks
+    disk_b.nlog = 0;
+    for (int i = 0; i < 4; i++) {
+        buf_t b = bget(dev, 56 + i);
+        memset(b->data, 'x', SECTOR);
+        bdirty(b);
+        brelse(b);
+    }
+    check(bsync(dev) == 0, "bsync through the queue");
+    check(disk_b.nlog == 1 && disk_b.log[0] == 56 && disk_b.logsize[0] == 4, "four dirty blocks written in one request");
+    buf_t b = bread(dev, 60);
+    check(b && b->data[0] == disk_b.data[60 * SECTOR], "bread through the queue");
+    brelse(b);
+
+    // a synchronous read waits for the unplug instead of dispatching past the plug
+    disk_b.nlog = 0;
+    struct rw_arg arg = {.q = q};
+    blkq_plug(q);
+    pthread_t thread;
+    pthread_create(&thread, NULL, rw_thread, &arg);
+    usleep(50 * 1000);
+    check(!__atomic_load_n(&arg.done, __ATOMIC_ACQUIRE) && disk_b.nlog == 0, "blkq_rw waits while plugged");
+    blkq_unplug(q);
+    pthread_join(thread, NULL);
+    check(arg.result == 1 && memcmp(arg.buf, disk_b.data + 5 * SECTOR, SECTOR) == 0, "and completes after the unplug");
+
+    blkq_free(q);
+    check(dev->queue == NULL, "detach the queue");
+    check(blkdev_unregist(dev) == 0, "unregister ram2");
+}
+
+static void test_writeback_error() {
+    print_separator("Write-back errors");
+
+    blkdev_t dev = blkdev_regist("ram3", SECTOR, SECTORS, ramdisk_read, ramdisk_broken_write, &disk_c);
+    broken = true;
+    const char msg[] = "cannot be written back";
+    check(blkdev_write(dev, msg, 0, sizeof(msg)) == sizeof(msg), "dirty a block on a failing device");
+    int n = 0;
+    for (int i = 0; i < 8; i++) {
+        buf_t b = bread(dev_b, 20 + i);
+        if (b) n++;
+        brelse(b);
+    }
+    check(n == 8, "eviction skips the buffer that fails to write back");
+    char buf[64];
+    check(blkdev_read(dev, buf, 0, sizeof(msg)) == sizeof(msg) && memcmp(buf, msg, sizeof(msg)) == 0,
+          "and keeps its data");
+
+    unsigned char full[SECTOR];
+    memset(full, 0xcd, sizeof(full));
+    for (int i = 0; i < 7; i++) blkdev_write(dev, full, SECTOR * (10 + i), SECTOR);
+    struct bcache_stat st;
+    bcache_stat(&st);
+    check(st.dirty == 8, "every buffer is dirty");
+    check(bread(dev_b, 30) == NULL, "bread fails instead of retrying forever");
+
+    broken = false;
+    check(bsync(dev) == 0, "write back once the device recovers");
+    check(memcmp(disk_c.data, msg, sizeof(msg)) == 0 && disk_c.data[SECTOR * 16] == 0xcd, "device has the data");
+    buf_t b = bread(dev_b, 30);
+    check(b != NULL, "buffers can be evicted again");
+    brelse(b);
+    check(blkdev_unregist(dev) == 0, "unregister ram3");
+}
+
+int main() {
+    printf(BOLD "block test" RESET "\n");
+
+    test_regist();
+    test_hits();
+    test_lru();
+    test_writeback();
+    test_block_size();
+    test_queue();
+    test_writeback_error();
+
+    if (failures) {
+        printf("\n" RED "%d check(s) failed" RESET "\n", failures);
+        return 1;
+    }
+    printf("\n" GREEN "block test completed successfully!" RESET "\n");
+    return 0;
+}
@@ -0,0 +1,244 @@
+/*
+ * hostfs test - mounts a temporary host directory into the VFS and checks
+ * that lookups, reads, writes and creation are passed through to the host.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/xattr.h>
+#include <vfs.h>
+#include <fs/hostfs.h>
+
+#define RESET   "\033[0m"
+#define RED     "\033[31m"
+#define GREEN   "\033[32m"
+#define BLUE    "\033[34m"
+#define BOLD    "\033[1m"
+
+static int failures = 0;
+static char host_root[64];
+
+static void check(bool ok, const char *what) {
+    printf("%s %s\n", ok ? GREEN "[ OK ]" RESET : RED "[FAIL]" RESET, what);
+    if (!ok) failures++;
+}
+
+static void print_separator(const char *title) {
+    printf("\n" BOLD BLUE "=== %s ===" RESET "\n", title);
+}
+
+static void host_write(const char *rel, const char *data) {
+    char path[256];
+    snprintf(path, sizeof(path), "%s/%s", host_root, rel);
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    write(fd, data, strlen(data));
+    close(fd);
+}
+
+static void host_read(const char *rel, char *buf, size_t size) {
+    char path[256];
+    snprintf(path, sizeof(path), "%s/%s", host_root, rel);
+    memset(buf, 0, size);
+    int fd = open(path, O_RDONLY);
+    if (fd >= 0) {
+        read(fd, buf, size - 1);
+        close(fd);
+    }
+}
+
+static void test_mount() {
+    print_separator("Mount host directory");
+
+    strcpy(host_root, "/tmp/hostfs-XXXXXX");
+    check(mkdtemp(host_root) != NULL, "create temporary host directory");
+
+    char path[256];
+    snprintf(path, sizeof(path), "%s/etc", host_root);
+    mkdir(path, 0755);
+    host_write("etc/hosts", "127.0.0.1 localhost\n");
+    host_write("readme", "hello hostfs");
+
+    vfs_init();
+    check(hostfs_regist() > 0, "register hostfs");
+    check(vfs_mount("/nonexistent-hostfs-dir", rootdir) != 0, "reject missing host directory");
+    check(vfs_mount(host_root, rootdir) == 0, "mount host directory on /");
+}
+
+static void test_lookup_read() {
+    print_separator("Lookup and read existing files");
+
+    vfs_node_t readme = vfs_open("/readme");
+    check(readme != NULL, "open /readme");
+    check(readme && readme->info->size == 12, "size of /readme comes from fstatat");
+
+    char buf[64] = {0};
+    check(readme && vfs_read(readme, buf, 0, sizeof(buf)) == 12, "read /readme");
+    check(strcmp(buf, "hello hostfs") == 0, "content of /readme");
+
+    vfs_node_t hosts = vfs_open("/etc/hosts");
+    check(hosts != NULL, "open nested /etc/hosts");
+    memset(buf, 0, sizeof(buf));
+    check(hosts && vfs_read(hosts, buf, 10, 9) == 9, "pread at an offset");
+    check(strcmp(buf, "localhost") == 0, "offset content of /etc/hosts");
+
+    check(vfs_open("/etc/missing") == NULL, "missing file is not found");
+}
+
+static void test_create_write() {
+    print_separator("Create and write through to the host");
+
+    check(vfs_mkdir("/var/log") == 0, "vfs_mkdir /var/log");
+    check(vfs_mkfile("/var/log/app.log") == 0, "vfs_mkfile /var/log/app.log");
+
+    vfs_node_t log = vfs_open("/var/log/app.log");
+    check(log != NULL, "open created file");
+    check(log && vfs_write(log, "line 1\n", 0, 7) == 7, "write first line");
+    check(log && vfs_write(log, "line 2\n", 7, 7) == 7, "append second line");
+    check(log && log->info->size == 14, "size updated after write");
+
+    char buf[64];
+    host_read("var/log/app.log", buf, sizeof(buf));
+    check(strcmp(buf, "line 1\nline 2\n") == 0, "host sees written data");
+
+    check(log && vfs_close(log) == 0, "close file");
+    log = vfs_open("/var/log/app.log");
+    memset(buf, 0, sizeof(buf));
+    check(log && vfs_read(log, buf, 0, sizeof(buf)) == 14, "reopen through cached parent fd");
+}
+
+static void test_resize() {
+    print_separator("Truncate and fallocate on the host");
+
+    check(vfs_mkfile("/var/log/prealloc.log") == 0, "create a log file");
+    vfs_node_t log = vfs_open("/var/log/prealloc.log");
+    check(log && vfs_write(log, "line 1\nline 2\n", 0, 14) == 14, "write two lines");
+    check(log && vfs_truncate(log, 7) == 0 && log->info->size == 7, "truncate to the first line");
+    char buf[64];
+    host_read("var/log/prealloc.log", buf, sizeof(buf));
+    check(strcmp(buf, "line 1\n") == 0, "host file truncated");
+
+    check(log && vfs_fallocate(log, vfs_falloc_keep_size, 0, 1 << 20) == 0, "preallocate 1 MiB");
+    check(log && log->info->size == 7 && log->info->realsize >= 1 << 20, "space reserved on the host");
+    check(log && vfs_fallocate(log, 0, 0, 4096) == 0 && log->info->size == 4096, "extend with fallocate");
+
+    vfs_node_t readme = vfs_open("/readme");
+    check(readme && vfs_next_data(readme, 0) == 0, "dense file starts with data");
+    check(readme && vfs_next_hole(readme, 0) == (i64)readme->info->size, "only hole is at the end");
+}
+
+static void test_rename() {
+    print_separator("Rename and remove on the host");
+
+    check(vfs_mkfile("/var/log/app.log.tmp") == 0, "create a temporary file");
+    vfs_write(vfs_open("/var/log/app.log.tmp"), "new\n", 0, 4);
+    check(vfs_rename("/var/log/app.log.tmp", "/var/log/rotated.log") == 0, "rename it");
+    char buf[64];
+    host_read("var/log/rotated.log", buf, sizeof(buf));
+    check(strcmp(buf, "new\n") == 0, "host sees the new name");
+
+    check(vfs_rename("/var/log", "/etc/log") == 0, "move a directory");
+    vfs_node_t file = vfs_open("/etc/log/rotated.log");
+    memset(buf, 0, sizeof(buf));
+    check(file && vfs_read(file, buf, 0, sizeof(buf)) == 4, "read through the moved directory");
+    check(vfs_rename("/etc/log", "/var/log") == 0, "move it back");
+
+    check(vfs_unlink("/var/log/rotated.log") == 0, "unlink a file");
+    host_read("var/log/rotated.log", buf, sizeof(buf));
+    check(buf[0] == '\0' && vfs_open("/var/log/rotated.log") == NULL, "removed on the host");
+    check(vfs_mkdir("/var/empty") == 0 && vfs_rmdir("/var/empty") == 0, "remove an empty directory");
+    check(vfs_rmdir("/var/log") != 0, "non-empty directory is kept");
+
+    check(vfs_link("/readme", "/etc/readme") == 0, "hard link a file");
+    struct stat st;
+    char path[256];
+    snprintf(path, sizeof(path), "%s/etc/readme", host_root);
+    check(stat(path, &st) == 0 && st.st_nlink == 2, "linked on the host");
+    check(vfs_open("/etc/readme")->info == vfs_open("/readme")->info, "names share one info");
+    check(vfs_unlink("/readme") == 0 && vfs_open("/etc/readme")->info->size == 12, "other name survives");
+    check(vfs_rename("/etc/readme", "/readme") == 0, "move it back");
+}
+
+static void test_xattr() {
+    print_separator("Extended attributes on the host");
+
+    vfs_node_t readme = vfs_open("/readme");
+    check(vfs_setxattr(readme, "user.hash", "abc123", 6) == 0, "set an attribute");
+    char path[256], buf[64] = {0};
+    snprintf(path, sizeof(path), "%s/readme", host_root);
+    check(getxattr(path, "user.hash", buf, sizeof(buf)) == 6 && strcmp(buf, "abc123") == 0, "host sees it");
+
+    // the cache answers without asking the host again
+    setxattr(path, "user.hash", "zzz", 3, 0);
+    memset(buf, 0, sizeof(buf));
+    check(vfs_getxattr(readme, "user.hash", buf, sizeof(buf)) == 6 && strcmp(buf, "abc123") == 0,
+          "repeated reads come from the cache");
+    check(vfs_listxattr(readme, buf, sizeof(buf)) == 10 && strcmp(buf, "user.hash") == 0, "list attributes");
+}
+
+static int aio_done_count = 0;
+static ssize_t aio_last_result = 0;
+
+static void aio_done(void *data, ssize_t result) {
+    (void)data;
+    aio_done_count++;
+    aio_last_result = result;
+}
+
+static void test_aio() {
+    print_separator("Asynchronous IO");
+
+    int mode = hostfs_aio_init(8);
+    printf("aio backend: %s\n", mode == 0 ? "io_uring" : "synchronous fallback");
+    check(mode == 0 || mode == 1, "initialize aio");
+
+    vfs_node_t readme = vfs_open("/readme");
+    char buf[4][8];
+    memset(buf, 0, sizeof(buf));
+    for (int i = 0; i < 4; i++) {
+        check(hostfs_aio_read(readme, buf[i], i * 3, 3, aio_done, NULL) == 0, "queue read");
+    }
+    hostfs_aio_submit();
+    hostfs_aio_wait(4);
+    check(aio_done_count == 4, "all reads completed");
+    check(aio_last_result == 3, "read result");
+    check(memcmp(buf[0], "hel", 3) == 0 && memcmp(buf[3], "tfs", 3) == 0, "read content");
+
+    vfs_node_t log = vfs_open("/var/log/app.log");
+    check(hostfs_aio_write(log, "line 3\n", 14, 7, aio_done, NULL) == 0, "queue write");
+    hostfs_aio_submit();
+    hostfs_aio_wait(1);
+    check(aio_done_count == 5 && aio_last_result == 7, "write completed");
+
+    char host[64];
+    host_read("var/log/app.log", host, sizeof(host));
+    check(strcmp(host, "line 1\nline 2\nline 3\n") == 0, "host sees async write");
+
+    hostfs_aio_exit();
+}
+
+int main() {
+    printf(BOLD "hostfs test" RESET "\n");
+
+    test_mount();
+    test_lookup_read();
+    test_create_write();
+    test_resize();
+    test_rename();
+    test_xattr();
+    test_aio();
+
+    char cmd[128];
+    snprintf(cmd, sizeof(cmd), "rm -rf %s", host_root);
+    system(cmd);
+
+    if (failures) {
+        printf("\n" RED "%d check(s) failed" RESET "\n", failures);
+        return 1;
+    }
+    printf("\n" GREEN "hostfs test completed successfully!" RESET "\n");
+    return 0;
+}
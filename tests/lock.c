@@ -0,0 +1,285 @@
+/*
+ * lock test - byte-range locks on a tmpfs file: shared and exclusive
+ * conflicts between threads, splitting on unlock, blocking waits, deadlock
+ * detection (also when a waiter's blocker changes while it waits),
+ * first-come-first-served ordering, mutual exclusion and threads on disjoint
+ * ranges running side by side.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <vfs.h>
+#include <fs/tmpfs.h>
+
+#define RESET   "\033[0m"
+#define RED     "\033[31m"
+#define GREEN   "\033[32m"
+#define BLUE    "\033[34m"
+#define BOLD    "\033[1m"
+
+#define WORKERS    4
+#define REGION     4096
+#define ITERATIONS 20000
+
+static int failures = 0;
+static vfs_node_t file;
+
+static void check(bool ok, const char *what) {
+    printf("%s %s\n", ok ? GREEN "[ OK ]" RESET : RED "[FAIL]" RESET, what);
+    if (!ok) failures++;
+}
+
+static void print_separator(const char *title) {
+    printf("\n" BOLD BLUE "=== %s ===" RESET "\n", title);
+}
+
+static void sleep_ms(int ms) {
+    struct timespec ts = {0, ms * 1000000L};
+    nanosleep(&ts, NULL);
+}
+
+struct request {
+    u64 offset, len;
+    int type;
+    bool wait;
+    int result;
+    bool done;
+};
+
+// locks and unlocks the range from another thread
+static void *try_lock_thread(void *arg) {
+    struct request *r = arg;
+    r->result = vfs_lock(file, r->offset, r->len, r->type, r->wait);
+    if (r->result == 0) vfs_unlock(file, r->offset, r->len);
+    atom_store(&r->done, true);
+    return NULL;
+}
+
+static bool other_can_lock(u64 offset, u64 len, int type) {
+    struct request r = {offset, len, type, false};
+    pthread_t thread;
+    pthread_create(&thread, NULL, try_lock_thread, &r);
+    pthread_join(thread, NULL);
+    return r.result == 0;
+}
+
+static void test_conflicts() {
+    print_separator("Conflicts");
+
+    vfs_init();
+    tmpfs_regist();
+    check(vfs_mount("tmpfs", rootdir) == 0, "mount tmpfs on /");
+    vfs_mkfile("/data");
+    file = vfs_open("/data");
+
+    check(vfs_lock(file, 0, 100, vfs_lock_exclusive, false) == 0, "lock [0, 100) exclusively");
+    check(!other_can_lock(10, 5, vfs_lock_shared), "another thread cannot share it");
+    check(other_can_lock(100, 10, vfs_lock_exclusive), "the range after it is free");
+    check(vfs_lock(file, 50, 10, vfs_lock_shared, false) == 0, "downgrade [50, 60) to shared");
+    check(other_can_lock(50, 10, vfs_lock_shared), "the shared part can be shared");
+    check(!other_can_lock(50, 10, vfs_lock_exclusive), "but not taken exclusively");
+    check(vfs_unlock(file, 20, 10) == 0, "unlock [20, 30)");
+    check(other_can_lock(20, 10, vfs_lock_exclusive), "the hole is free");
+    check(!other_can_lock(15, 10, vfs_lock_exclusive) && !other_can_lock(30, 1, vfs_lock_shared),
+          "both sides are still locked");
+    check(vfs_lock(file, 0, 0, vfs_lock_shared, false) == 0, "lock to the end of the file");
+    check(!other_can_lock(1ull << 40, 1, vfs_lock_exclusive), "covers far offsets");
+    check(vfs_unlock(file, 0, 0) == 0, "unlock everything");
+    check(other_can_lock(0, 0, vfs_lock_exclusive), "the whole file is free");
+    check(vfs_lock(file, 0, 1, 0, false) != 0, "reject an unknown lock type");
+}
+
+static void test_many() {
+    print_separator("Many ranges");
+
+    bool ok = true;
+    for (u64 i = 0; i < 1000; i++) ok &= vfs_lock(file, i * 20, 10, vfs_lock_exclusive, false) == 0;
+    check(ok, "lock 1000 separate ranges");
+    check(other_can_lock(10, 10, vfs_lock_exclusive) && other_can_lock(19990, 10, vfs_lock_exclusive),
+          "the gaps are free");
+    check(!other_can_lock(9995, 10, vfs_lock_shared), "a range across a lock conflicts");
+    ok = true;
+    for (u64 i = 0; i < 1000; i++) ok &= vfs_lock(file, i * 20 + 10, 10, vfs_lock_exclusive, false) == 0;
+    check(ok, "fill the gaps");
+    check(!other_can_lock(15, 1, vfs_lock_shared) && other_can_lock(20000, 1, vfs_lock_exclusive),
+          "the merged range ends at 20000");
+    vfs_unlock(file, 0, 0);
+}
+
+static void test_wait() {
+    print_separator("Waiting");
+
+    vfs_lock(file, 0, 10, vfs_lock_exclusive, false);
+    struct request r = {5, 10, vfs_lock_exclusive, true};
+    pthread_t thread;
+    pthread_create(&thread, NULL, try_lock_thread, &r);
+    sleep_ms(20);
+    check(!atom_load(&r.done), "the other thread waits");
+    vfs_unlock(file, 0, 10);
+    pthread_join(thread, NULL);
+    check(atom_load(&r.done) && r.result == 0, "and gets the lock after the unlock");
+}
+
+static bool holding;
+
+static void *deadlock_thread(void *arg) {
+    struct request *r = arg;
+    vfs_lock(file, 10, 10, vfs_lock_exclusive, false);
+    atom_store(&holding, true);
+    r->result = vfs_lock(file, 0, 10, vfs_lock_exclusive, true);
+    vfs_unlock(file, 0, 0);
+    return NULL;
+}
+
+static void test_deadlock() {
+    print_separator("Deadlock");
+
+    vfs_lock(file, 0, 10, vfs_lock_exclusive, false);
+    struct request r = {0};
+    pthread_t thread;
+    pthread_create(&thread, NULL, deadlock_thread, &r);
+    while (!atom_load(&holding)) sleep_ms(1);
+    sleep_ms(20); // let it block on [0, 10)
+    check(vfs_lock(file, 10, 10, vfs_lock_exclusive, true) == -1, "waiting for each other is refused");
+    check(vfs_lock(file, 20, 10, vfs_lock_exclusive, true) == 0, "unrelated ranges still work");
+    vfs_unlock(file, 0, 0);
+    pthread_join(thread, NULL);
+    check(r.result == 0, "the other thread gets its lock");
+}
+
+struct chain {
+    u64 hold;         // locked first without waiting
+    int hold_type;
+    u64 want;         // then waited for exclusively
+    int result;
+    bool holding, go, done;
+};
+
+static void *chain_thread(void *arg) {
+    struct chain *c = arg;
+    vfs_lock(file, c->hold, 10, c->hold_type, false);
+    atom_store(&c->holding, true);
+    while (!atom_load(&c->go)) sleep_ms(1);
+    c->result = vfs_lock(file, c->want, 10, vfs_lock_exclusive, true);
+    vfs_unlock(file, 0, 0);
+    atom_store(&c->done, true);
+    return NULL;
+}
+
+// a waits on one of two readers, the other reader then waits on a; once the
+// first reader leaves, a waits on the second and the two wait on each other
+static void test_deadlock_later() {
+    print_separator("Deadlock after the blocker changes");
+
+    vfs_lock(file, 20, 10, vfs_lock_shared, false);
+    struct chain a = {0, vfs_lock_exclusive, 20}, b = {20, vfs_lock_shared, 0};
+    pthread_t ta, tb;
+    pthread_create(&ta, NULL, chain_thread, &a);
+    pthread_create(&tb, NULL, chain_thread, &b);
+    while (!atom_load(&a.holding) || !atom_load(&b.holding)) sleep_ms(1);
+    atom_store(&a.go, true);
+    sleep_ms(20); // let a block on [20, 30)
+    atom_store(&b.go, true);
+    sleep_ms(20); // let b block on [0, 10)
+    vfs_unlock(file, 0, 0);
+
+    for (int i = 0; i < 2000 && !(atom_load(&a.done) && atom_load(&b.done)); i++) sleep_ms(1);
+    bool finished = atom_load(&a.done) && atom_load(&b.done);
+    check(finished, "neither thread waits forever");
+    if (!finished) exit(1); // the file stays locked, later tests would hang
+    pthread_join(ta, NULL);
+    pthread_join(tb, NULL);
+    check((a.result == -1) != (b.result == -1), "one request is refused");
+    check(a.result == 0 || b.result == 0, "the other gets its lock");
+}
+
+static void test_fairness() {
+    print_separator("Fairness");
+
+    vfs_lock(file, 0, 100, vfs_lock_shared, false);
+    struct request writer = {0, 100, vfs_lock_exclusive, true};
+    pthread_t thread;
+    pthread_create(&thread, NULL, try_lock_thread, &writer);
+    sleep_ms(20);
+    check(!atom_load(&writer.done), "a writer queues behind the reader");
+    check(!other_can_lock(0, 10, vfs_lock_shared), "later readers queue behind the writer");
+    check(other_can_lock(100, 10, vfs_lock_shared), "readers of other ranges do not");
+    check(vfs_lock(file, 0, 10, vfs_lock_shared, false) == 0, "the holder can still relock its range");
+    vfs_unlock(file, 0, 0);
+    pthread_join(thread, NULL);
+    check(writer.result == 0, "the writer gets the lock");
+}
+
+static u64 counters[WORKERS];
+static u64 shared_counter;
+
+// every worker increments a counter that only the range lock protects
+static void *exclusive_thread(void *arg) {
+    for (int i = 0; i < ITERATIONS; i++) {
+        if (vfs_lock(file, 0, 100, vfs_lock_exclusive, true) != 0) return (void *)1;
+        shared_counter++;
+        vfs_unlock(file, 0, 100);
+    }
+    return NULL;
+}
+
+static void *region_thread(void *arg) {
+    intptr_t id = (intptr_t)arg;
+    for (int i = 0; i < ITERATIONS; i++) {
+        if (vfs_lock(file, id * REGION, REGION, vfs_lock_exclusive, true) != 0) return (void *)1;
+        counters[id]++;
+        vfs_unlock(file, id * REGION, REGION);
+    }
+    return NULL;
+}
+
+static bool run_workers(void *(*fn)(void *), int first) {
+    pthread_t threads[WORKERS];
+    for (intptr_t i = first; i < WORKERS; i++) pthread_create(&threads[i], NULL, fn, (void *)i);
+    bool ok = true;
+    for (int i = first; i < WORKERS; i++) {
+        void *ret;
+        pthread_join(threads[i], &ret);
+        ok &= ret == NULL;
+    }
+    return ok;
+}
+
+static void test_parallel() {
+    print_separator("Mutual exclusion");
+
+    check(run_workers(exclusive_thread, 0), "every lock granted");
+    check(shared_counter == WORKERS * ITERATIONS, "no increment lost");
+
+    print_separator("Disjoint ranges");
+
+    // region 0 stays locked the whole time, the other workers must not care
+    vfs_lock(file, 0, REGION, vfs_lock_exclusive, false);
+    check(run_workers(region_thread, 1), "workers on other regions finish");
+    bool ok = true;
+    for (int i = 1; i < WORKERS; i++) ok &= counters[i] == ITERATIONS;
+    check(ok, "each did all its iterations");
+    vfs_unlock(file, 0, 0);
+}
+
+int main() {
+    printf(BOLD "lock test" RESET "\n");
+
+    test_conflicts();
+    test_many();
+    test_wait();
+    test_deadlock();
+    test_deadlock_later();
+    test_fairness();
+    test_parallel();
+
+    if (failures) {
+        printf("\n" RED "%d check(s) failed" RESET "\n", failures);
+        return 1;
+    }
+    printf("\n" GREEN "lock test completed successfully!" RESET "\n");
+    return 0;
+}
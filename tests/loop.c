@@ -0,0 +1,153 @@
+/*
+ * loop test - packs a tree stored in tmpfs into an image, keeps the image in
+ * tmpfs as a regular file, binds it to a loop device and mounts the device
+ * with packfs without copying the image out of the VFS. Writes past a backing
+ * file that shrank after attach fail instead of overrunning the buffer.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vfs.h>
+#include <loop.h>
+#include <fs/packfs.h>
+#include <fs/tmpfs.h>
+
+#define RESET   "\033[0m"
+#define RED     "\033[31m"
+#define GREEN   "\033[32m"
+#define BLUE    "\033[34m"
+#define BOLD    "\033[1m"
+
+#define BIG_SIZE (200 * 1024)
+
+static int failures = 0;
+static unsigned char *big_data;
+
+static void check(bool ok, const char *what) {
+    printf("%s %s\n", ok ? GREEN "[ OK ]" RESET : RED "[FAIL]" RESET, what);
+    if (!ok) failures++;
+}
+
+static void print_separator(const char *title) {
+    printf("\n" BOLD BLUE "=== %s ===" RESET "\n", title);
+}
+
+static void put(const char *path, const void *data, size_t size) {
+    vfs_mkfile(path);
+    vfs_write(vfs_open(path), data, 0, size);
+}
+
+static void setup() {
+    print_separator("Build image in tmpfs");
+
+    vfs_init();
+    tmpfs_regist();
+    packfs_regist();
+    check(vfs_mount("tmpfs", rootdir) == 0, "mount tmpfs on /");
+    vfs_mkdir("/src");
+    vfs_mkdir("/src/etc");
+    vfs_mkdir("/images");
+    put("/src/etc/motd", "hello from a loop device\n", 25);
+
+    big_data = malloc(BIG_SIZE);
+    unsigned seed = 42;
+    for (size_t i = 0; i < BIG_SIZE; i++) {
+        seed = seed * 1103515245 + 12345;
+        big_data[i] = i % 3 ? "loopback"[i % 8] : seed >> 16;
+    }
+    put("/src/blob", big_data, BIG_SIZE);
+
+    const int codecs[2] = {packfs_codec_none, packfs_codec_lz4};
+    const char *images[2] = {"/images/plain.pack", "/images/lz4.pack"};
+    for (int i = 0; i < 2; i++) {
+        mostream_t image = mostream_alloc(4096);
+        check(packfs_pack(vfs_open("/src"), image, codecs[i], 16384) == 0, "pack /src");
+        put(images[i], image->buf, image->size);
+        vfs_node_t file = vfs_open(images[i]);
+        check(file && file->info->size == image->size, "image stored in tmpfs");
+        mostream_free(image);
+    }
+}
+
+static void check_image(const char *image, const char *name) {
+    char mnt[64], path[128], buf[64] = {0};
+
+    blkdev_t dev = loop_attach(name, vfs_open(image), 512);
+    check(dev != NULL, "attach loop device");
+    check(loop_attach(name, vfs_open(image), 512) == NULL, "device name is unique");
+
+    snprintf(mnt, sizeof(mnt), "/mnt-%s", name);
+    vfs_mkdir(mnt);
+    check(vfs_mount(name, vfs_open(mnt)) == 0, "mount loop device with packfs");
+
+    snprintf(path, sizeof(path), "%s/etc/motd", mnt);
+    vfs_node_t motd = vfs_open(path);
+    check(motd && vfs_read(motd, buf, 0, sizeof(buf)) == 25, "read /etc/motd");
+    check(strcmp(buf, "hello from a loop device\n") == 0, "content of /etc/motd");
+
+    snprintf(path, sizeof(path), "%s/blob", mnt);
+    vfs_node_t blob = vfs_open(path);
+    unsigned char *data = malloc(BIG_SIZE);
+    check(blob && vfs_read(blob, data, 0, BIG_SIZE) == BIG_SIZE, "read whole blob");
+    check(memcmp(data, big_data, BIG_SIZE) == 0, "blob content");
+
+    // the image is only cached once: rereading hits the buffer cache and
+    // does not reach the loop device (and thus tmpfs) again
+    u64 reads = dev->reads;
+    check(vfs_read(blob, data, 1000, 30000) == 30000, "read again");
+    check(memcmp(data, big_data + 1000, 30000) == 0, "content read again");
+    check(dev->reads == reads, "second read served from the buffer cache");
+    free(data);
+
+    check(vfs_unmount(mnt) == 0, "unmount");
+    check(loop_detach(dev) == 0, "detach loop device");
+    check(blkdev_get(name) == NULL, "device is gone");
+}
+
+static void test_write() {
+    print_separator("Write through a loop device");
+
+    vfs_mkfile("/images/disk");
+    unsigned char zero[3000] = {0};
+    vfs_write(vfs_open("/images/disk"), zero, 0, sizeof(zero));
+    blkdev_t dev = loop_attach("loop2", vfs_open("/images/disk"), 512);
+    check(dev && dev->sectors == 6, "partial last sector is rounded up");
+
+    unsigned char sector[512];
+    memset(sector, 'z', sizeof(sector));
+    check(blkdev_write(dev, sector, 2560, 512) == 512, "write the last sector");
+    check(bsync(dev) == 0, "sync");
+    vfs_node_t disk = vfs_open("/images/disk");
+    char buf[8];
+    check(vfs_read(disk, buf, 2990, 8) == 8 && memcmp(buf, "zzzzzzzz", 8) == 0, "data reached the backing file");
+    check(disk->info->size == sizeof(zero), "backing file did not grow");
+
+    // the backing file shrinks below a sector after attach
+    check(vfs_truncate(disk, 1024) == 0, "shrink the backing file");
+    check(dev->write(dev->data, sector, 4, 1) < 0, "write past the shrunk file fails");
+    check(dev->write(dev->data, sector, 1, 1) == 1, "write inside the file still works");
+    check(disk->info->size == 1024, "backing file keeps its new size");
+    check(loop_detach(dev) == 0, "detach");
+
+    check(loop_attach("loop3", vfs_open("/images"), 512) == NULL, "directories cannot be attached");
+}
+
+int main() {
+    printf(BOLD "loop test" RESET "\n");
+
+    setup();
+    print_separator("Mount uncompressed image");
+    check_image("/images/plain.pack", "loop0");
+    print_separator("Mount lz4 image");
+    check_image("/images/lz4.pack", "loop1");
+    test_write();
+    free(big_data);
+
+    if (failures) {
+        printf("\n" RED "%d check(s) failed" RESET "\n", failures);
+        return 1;
+    }
+    printf("\n" GREEN "loop test completed successfully!" RESET "\n");
+    return 0;
+}
@@ -0,0 +1,177 @@
+/*
+ * mem test - memory accounting of the node tree: every node, info, name,
+ * child link and xattr cache is counted when it is allocated and subtracted
+ * when it is freed, per category and per mount, renames and hard links keep
+ * the counters exact, and the largest subtrees are found and listed under a
+ * mounted procfs.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vfs.h>
+#include <fs/procfs.h>
+#include <fs/tmpfs.h>
+
+#define RESET   "\033[0m"
+#define RED     "\033[31m"
+#define GREEN   "\033[32m"
+#define BLUE    "\033[34m"
+#define BOLD    "\033[1m"
+
+#define FILES 100
+
+static int failures = 0;
+
+static void check(bool ok, const char *what) {
+    printf("%s %s\n", ok ? GREEN "[ OK ]" RESET : RED "[FAIL]" RESET, what);
+    if (!ok) failures++;
+}
+
+static void print_separator(const char *title) {
+    printf("\n" BOLD BLUE "=== %s ===" RESET "\n", title);
+}
+
+static vfs_mem_stats_t mem(vfs_node_t node) {
+    vfs_mem_stats_t stats;
+    vfs_mem_read(node, &stats);
+    return stats;
+}
+
+static bool same(const vfs_mem_stats_t *a, const vfs_mem_stats_t *b) {
+    return memcmp(a, b, sizeof(*a)) == 0;
+}
+
+static void test_categories() {
+    print_separator("Categories");
+
+    vfs_init();
+    tmpfs_regist();
+    procfs_regist();
+    check(strcmp(vfs_mem_name(vfs_mem_names), "names") == 0 && vfs_mem_name(vfs_mem_count) == NULL, "category names");
+    vfs_mem_stats_t s = mem(NULL);
+    check(s.objects[vfs_mem_nodes] == 1 && s.objects[vfs_mem_infos] == 1 && s.objects[vfs_mem_links] == 0,
+          "the root directory");
+    check(vfs_mount("tmpfs", rootdir) == 0, "mount tmpfs on /");
+
+    vfs_mem_stats_t before = mem(NULL);
+    vfs_mkdir("/a");
+    vfs_mkfile("/a/file");
+    s = mem(NULL);
+    check(s.objects[vfs_mem_nodes] == before.objects[vfs_mem_nodes] + 2, "two nodes");
+    check(s.bytes[vfs_mem_nodes] == before.bytes[vfs_mem_nodes] + 2 * sizeof(struct vfs_node), "node bytes");
+    check(s.objects[vfs_mem_infos] == before.objects[vfs_mem_infos] + 2, "two infos");
+    check(s.bytes[vfs_mem_names] == before.bytes[vfs_mem_names] + strlen("a") + strlen("file") + 2, "name bytes");
+    check(s.objects[vfs_mem_links] == before.objects[vfs_mem_links] + 2, "two child links");
+
+    vfs_mem_stats_t mid = mem(NULL);
+    check(vfs_rename("/a/file", "/a/a-much-longer-name") == 0, "rename");
+    s = mem(NULL);
+    check(s.bytes[vfs_mem_names] == mid.bytes[vfs_mem_names] + strlen("a-much-longer-name") - strlen("file"),
+          "a rename swaps the name");
+    check(s.objects[vfs_mem_links] == mid.objects[vfs_mem_links], "and keeps the link");
+
+    check(vfs_link("/a/a-much-longer-name", "/a/alias") == 0, "hard link");
+    s = mem(NULL);
+    check(s.objects[vfs_mem_nodes] == mid.objects[vfs_mem_nodes] + 1, "a hard link is one more node");
+    check(s.objects[vfs_mem_infos] == mid.objects[vfs_mem_infos], "sharing the info");
+
+    vfs_node_t file = vfs_open("/a/alias");
+    char value[100] = {0};
+    check(vfs_setxattr(file, "user.test", value, sizeof(value)) == 0, "set an xattr");
+    s = mem(NULL);
+    check(s.objects[vfs_mem_caches] == mid.objects[vfs_mem_caches] + 1, "one xattr cache");
+    check(s.bytes[vfs_mem_caches] >= mid.bytes[vfs_mem_caches] + sizeof(value) + strlen("user.test") + 1,
+          "holding the name and value");
+    vfs_setxattr(file, "user.test", value, 10);
+    check(mem(NULL).bytes[vfs_mem_caches] == s.bytes[vfs_mem_caches] - 90, "a shorter value");
+
+    vfs_unlink("/a/alias");
+    vfs_unlink("/a/a-much-longer-name");
+    vfs_rmdir("/a");
+    s = mem(NULL);
+    check(same(&s, &before), "everything is subtracted again");
+}
+
+static void test_mounts() {
+    print_separator("Mounts");
+
+    vfs_mkdir("/m");
+    vfs_node_t m = vfs_open("/m");
+    vfs_mem_stats_t root = mem(rootdir), total = mem(NULL);
+    check(vfs_mount("tmpfs", m) == 0, "mount tmpfs on /m");
+    char path[64];
+    for (int i = 0; i < FILES; i++) {
+        sprintf(path, "/m/file%d", i);
+        vfs_mkfile(path);
+    }
+    vfs_mem_stats_t s = mem(m);
+    check(s.objects[vfs_mem_nodes] == FILES && s.objects[vfs_mem_links] == FILES, "the files count in /m");
+    s = mem(rootdir);
+    check(same(&s, &root), "but not in /");
+    s = mem(NULL);
+    check(s.objects[vfs_mem_nodes] == total.objects[vfs_mem_nodes] + FILES, "and in the total");
+
+    check(vfs_unmount("/m") == 0, "unmount");
+    s = mem(NULL);
+    check(same(&s, &total), "the unmount frees them");
+    vfs_rmdir("/m");
+}
+
+static void test_top() {
+    print_separator("Subtrees");
+
+    char path[64];
+    vfs_mkdir("/big");
+    vfs_mkdir("/big/inner");
+    vfs_mkdir("/small");
+    for (int i = 0; i < FILES; i++) {
+        sprintf(path, "/big/inner/file%d", i);
+        vfs_mkfile(path);
+    }
+    for (int i = 0; i < 10; i++) {
+        sprintf(path, "/small/file%d", i);
+        vfs_mkfile(path);
+    }
+
+    vfs_mem_usage_t top[3];
+    check(vfs_mem_top(NULL, top, 3) == 3, "three subtrees");
+    check(top[0].node == rootdir && top[1].node == vfs_open("/big") && top[2].node == vfs_open("/big/inner"),
+          "the largest first, ancestors before descendants");
+    check(top[2].nodes == FILES + 1 && top[1].nodes == FILES + 2, "node counts");
+    check(top[1].bytes > top[2].bytes && top[2].bytes > FILES * sizeof(struct vfs_node), "byte counts");
+    vfs_mem_stats_t s = mem(NULL);
+    u64 tree = 0;
+    for (int i = 0; i <= vfs_mem_links; i++) tree += s.bytes[i];
+    check(top[0].bytes == tree, "the whole tree matches the counters");
+
+    vfs_mem_usage_t one;
+    check(vfs_mem_top(vfs_open("/small"), &one, 1) == 1 && one.nodes == 11, "a subtree of its own");
+
+    vfs_mkdir("/proc");
+    check(vfs_mount("proc", vfs_open("/proc")) == 0, "mount procfs on /proc");
+    s = mem(vfs_open("/proc"));
+    check(s.objects[vfs_mem_nodes] == 4, "nodes created while mounting count in the new mount");
+    static char buf[8192];
+    vfs_node_t memory = vfs_open("/proc/memory");
+    ssize_t n = memory ? vfs_read(memory, buf, 0, sizeof(buf) - 1) : -1;
+    buf[n > 0 ? n : 0] = '\0';
+    check(n > 0 && strstr(buf, "names") && strstr(buf, "caches"), "procfs lists the categories");
+    check(strstr(buf, "/big/inner") != NULL, "and the largest subtrees");
+    printf("%s", buf);
+}
+
+int main() {
+    printf(BOLD "mem test" RESET "\n");
+
+    test_categories();
+    test_mounts();
+    test_top();
+
+    if (failures) {
+        printf("\n" RED "%d check(s) failed" RESET "\n", failures);
+        return 1;
+    }
+    printf("\n" GREEN "mem test completed successfully!" RESET "\n");
+    return 0;
+}
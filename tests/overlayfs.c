@@ -0,0 +1,223 @@
+/*
+ * overlayfs test - stacks two lower trees and an upper tree (all in tmpfs)
+ * and checks merged lookups, whiteouts, opaque directories, partial
+ * copy-up on first write and the read-only mode.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vfs.h>
+#include <fs/overlayfs.h>
+#include <fs/tmpfs.h>
+
+#define RESET   "\033[0m"
+#define RED     "\033[31m"
+#define GREEN   "\033[32m"
+#define BLUE    "\033[34m"
+#define BOLD    "\033[1m"
+
+#define CHUNK    (64 * 1024)
+#define BIG_SIZE (3 * CHUNK + 100)
+
+static int failures = 0;
+static unsigned char *big_data;
+
+static void check(bool ok, const char *what) {
+    printf("%s %s\n", ok ? GREEN "[ OK ]" RESET : RED "[FAIL]" RESET, what);
+    if (!ok) failures++;
+}
+
+static void print_separator(const char *title) {
+    printf("\n" BOLD BLUE "=== %s ===" RESET "\n", title);
+}
+
+static void put(const char *path, const void *data, size_t size) {
+    vfs_mkfile(path);
+    vfs_write(vfs_open(path), data, 0, size);
+}
+
+static bool has(const char *path, const char *content) {
+    char buf[64] = {0};
+    vfs_node_t file = vfs_open(path);
+    return file && vfs_read(file, buf, 0, sizeof(buf) - 1) == (ssize_t)strlen(content) &&
+           strcmp(buf, content) == 0;
+}
+
+static u64 realsize(const char *path) {
+    vfs_node_t file = vfs_open(path);
+    vfs_close(file); // reopen to refresh the stat
+    vfs_update(file);
+    return file->info->realsize;
+}
+
+static void setup() {
+    print_separator("Layers");
+
+    vfs_init();
+    tmpfs_regist();
+    check(overlayfs_regist() > 0, "register overlayfs");
+    check(vfs_mount("tmpfs", rootdir) == 0, "mount tmpfs on /");
+
+    vfs_mkdir("/lower1/shared");
+    put("/lower1/a.txt", "a from lower1", 13);
+    put("/lower1/dup", "dup from lower1", 15);
+    put("/lower1/shared/x", "x", 1);
+
+    vfs_mkdir("/lower2/shared");
+    vfs_mkdir("/lower2/opq");
+    vfs_mkdir("/lower2/olddir");
+    put("/lower2/b.txt", "b from lower2", 13);
+    put("/lower2/dup", "dup from lower2", 15);
+    put("/lower2/shared/y", "y", 1);
+    put("/lower2/opq/hidden", "hidden", 6);
+    put("/lower2/olddir/stale", "stale", 5);
+    put("/lower2/gone", "gone", 4);
+    big_data = malloc(BIG_SIZE);
+    for (size_t i = 0; i < BIG_SIZE; i++) big_data[i] = i * 7 + i / 251;
+    put("/lower2/big", big_data, BIG_SIZE);
+
+    vfs_mkdir("/upper/opq");
+    vfs_mkfile("/upper/opq/" OVERLAYFS_OPAQUE);
+    put("/upper/opq/own", "own", 3);
+    vfs_mkfile("/upper/" OVERLAYFS_WHITEOUT "gone");
+    vfs_mkfile("/upper/" OVERLAYFS_WHITEOUT "olddir");
+    vfs_mkdir("/merged");
+    vfs_mkdir("/ro");
+}
+
+static void test_lookup() {
+    print_separator("Merged lookup");
+
+    check(vfs_mount("lowerdir=/missing,upperdir=/upper", vfs_open("/merged")) != 0,
+          "reject a missing lower layer");
+    check(vfs_mount("lowerdir=/lower1,bogus", vfs_open("/merged")) != 0, "reject unknown options");
+    check(vfs_mount("lowerdir=/lower1:/lower2,upperdir=/upper,sparse", vfs_open("/merged")) == 0,
+          "mount the overlay");
+
+    vfs_node_t merged = vfs_open("/merged");
+    bool whiteouts = false;
+    list_foreach(merged->info->child, it) whiteouts |= strncmp(((vfs_node_t)it->data)->name, ".wh.", 4) == 0;
+    check(list_length(merged->info->child) == 6, "root lists the union of all layers");
+    check(!whiteouts, "whiteouts are not listed");
+    check(has("/merged/a.txt", "a from lower1") && has("/merged/b.txt", "b from lower2"),
+          "files from both lower layers");
+    check(has("/merged/dup", "dup from lower1"), "upper layers take precedence");
+    check(has("/merged/shared/x", "x") && has("/merged/shared/y", "y"), "directories are merged");
+    check(vfs_open("/merged/gone") == NULL, "whiteout hides a lower file");
+    check(vfs_open("/merged/olddir") == NULL, "whiteout hides a lower directory");
+    check(vfs_open("/merged/opq/hidden") == NULL, "opaque directory is not merged");
+    check(has("/merged/opq/own", "own"), "opaque directory keeps its own entries");
+}
+
+static void test_copyup() {
+    print_separator("Copy-up");
+
+    vfs_node_t big = vfs_open("/merged/big");
+    check(big && big->info->size == BIG_SIZE, "size comes from the lower layer");
+    check(vfs_write(big, "WRITE", CHUNK + 10, 5) == 5, "write into the second chunk");
+    memcpy(big_data + CHUNK + 10, "WRITE", 5);
+
+    check(vfs_open("/upper/big") != NULL, "file copied up to the upper layer");
+    unsigned char *data = malloc(BIG_SIZE);
+    check(vfs_read(vfs_open("/lower2/big"), data, CHUNK, 16) == 16 &&
+          memcmp(data, "WRITE", 5) != 0, "lower layer is untouched");
+    check(vfs_open("/upper/big")->info->size == BIG_SIZE, "upper file has the full size");
+    // only the written chunk and the last chunk (which sets the size) are copied
+    check(realsize("/upper/big") == CHUNK + 4096, "only the touched range was copied");
+
+    memset(data, 0, BIG_SIZE);
+    check(vfs_read(big, data, 0, BIG_SIZE) == BIG_SIZE, "read mixes upper and lower chunks");
+    check(memcmp(data, big_data, BIG_SIZE) == 0, "merged content");
+
+    check(vfs_write(vfs_open("/merged/shared/y"), "Y", 0, 1) == 1, "copy up a nested file");
+    check(has("/upper/shared/y", "Y") && has("/lower2/shared/y", "y"), "parent created in the upper layer");
+    check(has("/merged/shared/y", "Y") && has("/merged/shared/x", "x"), "nested directory still merged");
+
+    check(vfs_truncate(vfs_open("/merged/a.txt"), 1) == 0, "truncate copies up first");
+    check(has("/merged/a.txt", "a") && has("/lower1/a.txt", "a from lower1"), "only the upper copy shrinks");
+    free(data);
+}
+
+static void test_create() {
+    print_separator("Create");
+
+    check(vfs_mkfile("/merged/new") == 0, "create a file");
+    check(vfs_write(vfs_open("/merged/new"), "new", 0, 3) == 3, "write the new file");
+    check(has("/upper/new", "new") && vfs_open("/lower1/new") == NULL, "created in the upper layer");
+
+    check(vfs_mkfile("/merged/shared/z") == 0, "create in a merged directory");
+    check(vfs_open("/upper/shared/z") != NULL, "created in the upper directory");
+
+    check(vfs_mkdir("/merged/olddir") == 0, "recreate a whited-out directory");
+    vfs_node_t dir = vfs_open("/merged/olddir");
+    check(dir && dir->info->type == file_dir, "directory exists");
+    check(vfs_open("/upper/olddir/" OVERLAYFS_OPAQUE) != NULL, "marked opaque");
+    check(vfs_open("/merged/olddir/stale") == NULL, "old lower entries stay hidden");
+}
+
+static void test_remove() {
+    print_separator("Remove");
+
+    check(vfs_unlink("/merged/b.txt") == 0, "unlink a lower file");
+    check(vfs_open("/merged/b.txt") == NULL, "hidden in the overlay");
+    check(vfs_open("/upper/" OVERLAYFS_WHITEOUT "b.txt") != NULL, "whiteout created");
+    check(has("/lower2/b.txt", "b from lower2"), "lower layer is untouched");
+
+    check(vfs_unlink("/merged/new") == 0, "unlink an upper-only file");
+    check(vfs_open("/upper/new") == NULL, "removed from the upper layer");
+    check(vfs_open("/upper/" OVERLAYFS_WHITEOUT "new") == NULL, "no whiteout needed");
+
+    check(vfs_unlink("/merged/shared/y") == 0, "unlink a copied-up file");
+    check(vfs_open("/upper/shared/y") == NULL && vfs_open("/upper/shared/" OVERLAYFS_WHITEOUT "y") != NULL,
+          "upper copy replaced by a whiteout");
+    check(vfs_rmdir("/merged/shared") != 0, "merged directory is not empty");
+    vfs_unlink("/merged/shared/x");
+    vfs_unlink("/merged/shared/z");
+    check(vfs_rmdir("/merged/shared") == 0, "remove the emptied merged directory");
+    check(vfs_open("/merged/shared") == NULL && vfs_open("/upper/shared") == NULL, "upper directory removed");
+    check(vfs_open("/upper/" OVERLAYFS_WHITEOUT "shared") != NULL, "lower directories hidden");
+    check(vfs_rename("/merged/a.txt", "/merged/c.txt") != 0, "rename is not supported");
+}
+
+static void test_unmount() {
+    print_separator("Unmount");
+
+    check(vfs_unmount("/merged") == 0, "unmount the overlay");
+    check(realsize("/upper/big") >= BIG_SIZE, "partial copy-up completed");
+    unsigned char *data = malloc(BIG_SIZE);
+    check(vfs_read(vfs_open("/upper/big"), data, 0, BIG_SIZE) == BIG_SIZE &&
+          memcmp(data, big_data, BIG_SIZE) == 0, "upper file is complete");
+    free(data);
+}
+
+static void test_readonly() {
+    print_separator("Read-only overlay");
+
+    check(vfs_mount("lowerdir=/lower1:/lower2", vfs_open("/ro")) == 0, "mount without an upper layer");
+    check(has("/ro/dup", "dup from lower1") && has("/ro/gone", "gone"), "lookups work");
+    check(vfs_write(vfs_open("/ro/a.txt"), "X", 0, 1) < 0, "writes are rejected");
+    check(vfs_truncate(vfs_open("/ro/b.txt"), 0) != 0, "truncate is rejected");
+    check(has("/lower1/a.txt", "a from lower1"), "lower layer is untouched");
+    check(vfs_unmount("/ro") == 0, "unmount");
+}
+
+int main() {
+    printf(BOLD "overlayfs test" RESET "\n");
+
+    setup();
+    test_lookup();
+    test_copyup();
+    test_create();
+    test_remove();
+    test_unmount();
+    test_readonly();
+    free(big_data);
+
+    if (failures) {
+        printf("\n" RED "%d check(s) failed" RESET "\n", failures);
+        return 1;
+    }
+    printf("\n" GREEN "overlayfs test completed successfully!" RESET "\n");
+    return 0;
+}
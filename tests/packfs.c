@@ -0,0 +1,261 @@
+/*
+ * packfs test - packs a host directory (through hostfs) into images with and
+ * without compression, mounts them and checks that lookups, stat and reads
+ * match the original files. Truncated and corrupt images, including ones
+ * whose inodes or dentries point outside their tables, are rejected at mount
+ * time.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <vfs.h>
+#include <fs/hostfs.h>
+#include <fs/packfs.h>
+
+#define RESET   "\033[0m"
+#define RED     "\033[31m"
+#define GREEN   "\033[32m"
+#define BLUE    "\033[34m"
+#define BOLD    "\033[1m"
+
+#define BIG_SIZE (300 * 1024)
+#define NFILES   200
+
+static int failures = 0;
+static char host_root[64];
+static char image_path[2][96];
+static unsigned char *big_data;
+
+static void check(bool ok, const char *what) {
+    printf("%s %s\n", ok ? GREEN "[ OK ]" RESET : RED "[FAIL]" RESET, what);
+    if (!ok) failures++;
+}
+
+static void print_separator(const char *title) {
+    printf("\n" BOLD BLUE "=== %s ===" RESET "\n", title);
+}
+
+static void host_write(const char *rel, const void *data, size_t size) {
+    char path[256];
+    snprintf(path, sizeof(path), "%s/%s", host_root, rel);
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    write(fd, data, size);
+    close(fd);
+}
+
+static void setup_tree() {
+    print_separator("Build host tree");
+
+    strcpy(host_root, "/tmp/packfs-XXXXXX");
+    check(mkdtemp(host_root) != NULL, "create temporary host directory");
+
+    char path[256];
+    snprintf(path, sizeof(path), "%s/etc", host_root);
+    mkdir(path, 0755);
+    snprintf(path, sizeof(path), "%s/assets", host_root);
+    mkdir(path, 0755);
+    host_write("etc/config", "key=value\n", 10);
+    host_write("empty", "", 0);
+
+    // half compressible text, half pseudo random bytes
+    big_data = malloc(BIG_SIZE);
+    unsigned seed = 12345;
+    for (size_t i = 0; i < BIG_SIZE; i++) {
+        if (i < BIG_SIZE / 2) {
+            big_data[i] = "firmware blob "[i % 14];
+        } else {
+            seed = seed * 1103515245 + 12345;
+            big_data[i] = seed >> 16;
+        }
+    }
+    host_write("firmware.bin", big_data, BIG_SIZE);
+
+    for (int i = 0; i < NFILES; i++) {
+        char name[64], data[64];
+        snprintf(name, sizeof(name), "assets/icon-%03d.png", i);
+        int n = snprintf(data, sizeof(data), "icon %d", i);
+        host_write(name, data, n);
+    }
+
+    vfs_init();
+    hostfs_regist();
+    packfs_regist();
+    check(vfs_mount(host_root, rootdir) == 0, "mount host tree on /");
+}
+
+static void test_pack() {
+    print_separator("Pack images");
+
+    const int codecs[2] = {packfs_codec_none, packfs_codec_lz4};
+    for (int i = 0; i < 2; i++) {
+        mostream_t image = mostream_alloc(4096);
+        check(packfs_pack(rootdir, image, codecs[i], 0) == 0, "packfs_pack");
+        snprintf(image_path[i], sizeof(image_path[i]), "%s.%d.pack", host_root, i);
+        int fd = open(image_path[i], O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        check(write(fd, image->buf, image->size) == (ssize_t)image->size, "write image");
+        close(fd);
+        printf("image %s: %zu bytes\n", codecs[i] == packfs_codec_lz4 ? "lz4" : "none", image->size);
+        if (i == 1) check(image->size < BIG_SIZE * 3 / 4, "lz4 image is compressed");
+        mostream_free(image);
+    }
+
+    mostream_t image = mostream_alloc(4096);
+    check(packfs_pack(rootdir, image, 99, 0) != 0, "reject unknown codec");
+    mostream_free(image);
+}
+
+static void check_mount(const char *mnt, const char *image) {
+    char path[128], buf[64];
+
+    check(vfs_mkdir(mnt) == 0, "create mount point");
+    check(vfs_mount(image, vfs_open(mnt)) == 0, "mount image");
+
+    snprintf(path, sizeof(path), "%s/etc/config", mnt);
+    vfs_node_t config = vfs_open(path);
+    check(config != NULL && config->info->size == 10, "stat /etc/config");
+    memset(buf, 0, sizeof(buf));
+    check(config && vfs_read(config, buf, 0, sizeof(buf)) == 10, "read /etc/config");
+    check(strcmp(buf, "key=value\n") == 0, "content of /etc/config");
+    check(config && vfs_write(config, "x", 0, 1) < 0, "image is read only");
+
+    snprintf(path, sizeof(path), "%s/empty", mnt);
+    vfs_node_t empty = vfs_open(path);
+    check(empty && empty->info->size == 0 && vfs_read(empty, buf, 0, 8) == 0, "empty file");
+
+    int found = 0;
+    for (int i = 0; i < NFILES; i++) {
+        char expect[64];
+        snprintf(path, sizeof(path), "%s/assets/icon-%03d.png", mnt, i);
+        int n = snprintf(expect, sizeof(expect), "icon %d", i);
+        vfs_node_t icon = vfs_open(path);
+        memset(buf, 0, sizeof(buf));
+        if (icon && vfs_read(icon, buf, 0, sizeof(buf)) == n && strcmp(buf, expect) == 0) found++;
+    }
+    check(found == NFILES, "binary search finds every asset");
+    snprintf(path, sizeof(path), "%s/assets/icon-999.png", mnt);
+    check(vfs_open(path) == NULL, "missing asset is not found");
+
+    snprintf(path, sizeof(path), "%s/firmware.bin", mnt);
+    vfs_node_t fw = vfs_open(path);
+    check(fw && fw->info->size == BIG_SIZE, "stat /firmware.bin");
+    unsigned char *data = malloc(BIG_SIZE);
+    check(fw && vfs_read(fw, data, 0, BIG_SIZE) == BIG_SIZE, "read whole firmware");
+    check(memcmp(data, big_data, BIG_SIZE) == 0, "firmware content");
+    // unaligned read across a block boundary
+    check(fw && vfs_read(fw, data, 65536 - 7, 100) == 100, "read across blocks");
+    check(memcmp(data, big_data + 65536 - 7, 100) == 0, "content across blocks");
+    free(data);
+
+    check(vfs_unmount(mnt) == 0, "unmount image");
+}
+
+static void test_mount() {
+    print_separator("Mount uncompressed image");
+    check_mount("/mnt-none", image_path[0]);
+    print_separator("Mount lz4 image");
+    check_mount("/mnt-lz4", image_path[1]);
+}
+
+// writes image 0 with a damaged header (or cut to size) and tries to mount it
+static bool mount_corrupt(const char *what, void (*damage)(struct packfs_header *), size_t size) {
+    static char path[128];
+    snprintf(path, sizeof(path), "%s.bad.pack", host_root);
+    int fd = open(image_path[0], O_RDONLY);
+    struct stat st;
+    fstat(fd, &st);
+    unsigned char *data = malloc(st.st_size);
+    bool ok = read(fd, data, st.st_size) == st.st_size;
+    close(fd);
+    if (damage) damage((struct packfs_header *)data);
+    fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    ok = ok && write(fd, data, size ? size : (size_t)st.st_size) > 0;
+    close(fd);
+    free(data);
+    vfs_node_t mnt = vfs_open("/mnt-bad");
+    bool rejected = ok && vfs_mount(path, mnt) != 0;
+    if (!rejected) vfs_unmount("/mnt-bad");
+    unlink(path);
+    check(rejected, what);
+    return rejected;
+}
+
+static void inode_past_data(struct packfs_header *h) { h->inode_off = h->data_off; }
+static void inode_count_huge(struct packfs_header *h) { h->inode_count = 0xffffffff; }
+static void dentry_wraps(struct packfs_header *h) { h->dentry_off = ~0ull - 8; }
+static void dentry_count_huge(struct packfs_header *h) { h->dentry_count = 0x7fffffff; }
+static void names_past_data(struct packfs_header *h) { h->name_off = h->data_off + 1; }
+static void inode_in_header(struct packfs_header *h) { h->inode_off = 0; }
+
+// record level damage: the header is intact but an entry points outside its table
+static struct packfs_inode *inodes_of(struct packfs_header *h) {
+    return (struct packfs_inode *)((char *)h + h->inode_off);
+}
+static struct packfs_dentry *dentries_of(struct packfs_header *h) {
+    return (struct packfs_dentry *)((char *)h + h->dentry_off);
+}
+static struct packfs_inode *first_file(struct packfs_header *h) {
+    for (u32 i = 0; i < h->inode_count; i++)
+        if (inodes_of(h)[i].type != file_dir) return &inodes_of(h)[i];
+    return NULL;
+}
+static void children_past_dentries(struct packfs_header *h) { inodes_of(h)[0].child = h->dentry_count; }
+static void dentry_inode_huge(struct packfs_header *h) { dentries_of(h)[0].inode = h->inode_count; }
+static void dentry_name_past_names(struct packfs_header *h) {
+    dentries_of(h)[0].name = h->data_off - h->name_off;
+}
+static void names_unterminated(struct packfs_header *h) {
+    memset((char *)h + h->name_off, 'a', h->data_off - h->name_off);
+}
+static void file_data_past_image(struct packfs_header *h) {
+    first_file(h)->data = h->image_size - first_file(h)->stored + 1;
+}
+static void file_stored_past_image(struct packfs_header *h) { first_file(h)->stored = h->image_size; }
+static void file_size_past_stored(struct packfs_header *h) {
+    first_file(h)->size = first_file(h)->stored + 1;
+}
+static void block_size_zero(struct packfs_header *h) { h->block_size = 0; }
+
+static void test_corrupt() {
+    print_separator("Reject corrupt images");
+    check(vfs_mkdir("/mnt-bad") == 0, "create mount point");
+    mount_corrupt("truncated image", NULL, sizeof(struct packfs_header) + 16);
+    mount_corrupt("inode table past the data offset", inode_past_data, 0);
+    mount_corrupt("inode count overflows the table", inode_count_huge, 0);
+    mount_corrupt("dentry offset wraps around", dentry_wraps, 0);
+    mount_corrupt("dentry count overflows the table", dentry_count_huge, 0);
+    mount_corrupt("name table past the data offset", names_past_data, 0);
+    mount_corrupt("inode table inside the header", inode_in_header, 0);
+    mount_corrupt("zero block size", block_size_zero, 0);
+    mount_corrupt("directory children past the dentry table", children_past_dentries, 0);
+    mount_corrupt("dentry inode past the inode table", dentry_inode_huge, 0);
+    mount_corrupt("dentry name past the name table", dentry_name_past_names, 0);
+    mount_corrupt("names without a terminator", names_unterminated, 0);
+    mount_corrupt("file data past the image", file_data_past_image, 0);
+    mount_corrupt("file stored size past the image", file_stored_past_image, 0);
+    mount_corrupt("file size past its stored data", file_size_past_stored, 0);
+}
+
+int main() {
+    printf(BOLD "packfs test" RESET "\n");
+
+    setup_tree();
+    test_pack();
+    test_mount();
+    test_corrupt();
+
+    char cmd[256];
+    snprintf(cmd, sizeof(cmd), "rm -rf %s %s %s", host_root, image_path[0], image_path[1]);
+    system(cmd);
+    free(big_data);
+
+    if (failures) {
+        printf("\n" RED "%d check(s) failed" RESET "\n", failures);
+        return 1;
+    }
+    printf("\n" GREEN "packfs test completed successfully!" RESET "\n");
+    return 0;
+}
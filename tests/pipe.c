@@ -0,0 +1,247 @@
+/*
+ * pipe test - named FIFOs in tmpfs and anonymous pipes: ordering, blocking
+ * and nonblocking reads and writes, end of stream after a shutdown, poll
+ * readiness, splicing into a regular file and several producers and
+ * consumers sharing one pipe.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <vfs.h>
+#include <fs/tmpfs.h>
+
+#define RESET   "\033[0m"
+#define RED     "\033[31m"
+#define GREEN   "\033[32m"
+#define BLUE    "\033[34m"
+#define BOLD    "\033[1m"
+
+#define WORKERS  4
+#define PER_WORKER 100000
+
+static int failures = 0;
+
+static void check(bool ok, const char *what) {
+    printf("%s %s\n", ok ? GREEN "[ OK ]" RESET : RED "[FAIL]" RESET, what);
+    if (!ok) failures++;
+}
+
+static void print_separator(const char *title) {
+    printf("\n" BOLD BLUE "=== %s ===" RESET "\n", title);
+}
+
+static void sleep_ms(int ms) {
+    struct timespec ts = {0, ms * 1000000L};
+    nanosleep(&ts, NULL);
+}
+
+static void test_fifo() {
+    print_separator("Named FIFO");
+
+    vfs_init();
+    tmpfs_regist();
+    check(vfs_mount("tmpfs", rootdir) == 0, "mount tmpfs on /");
+    vfs_mkdir("/run");
+
+    check(vfs_mkfifo("/run/fifo", 16, 0) == 0, "create a FIFO");
+    check(vfs_mkfifo("/run/fifo", 16, 0) != 0, "the name is taken");
+    vfs_node_t fifo = vfs_open("/run/fifo");
+    check(fifo && fifo->info->type == file_fifo, "opens as a FIFO");
+
+    char buf[32] = {0};
+    check(vfs_write(fifo, "hello", 100, 5) == 5, "write ignores the offset");
+    check(vfs_write(fifo, " world", 0, 6) == 6, "second write");
+    check(vfs_read(fifo, buf, 0, 3) == 3 && memcmp(buf, "hel", 3) == 0, "partial read");
+    check(vfs_read(fifo, buf, 0, sizeof(buf)) == 8 && memcmp(buf, "lo world", 8) == 0, "reads in order");
+
+    vfs_close(fifo);
+    vfs_update(fifo);
+    check(fifo->info->type == file_fifo, "still a FIFO after reopening");
+
+    check(vfs_unlink("/run/fifo") == 0, "unlink the FIFO");
+    check(vfs_open("/run/fifo") == NULL, "gone");
+}
+
+static void test_nonblock() {
+    print_separator("Nonblocking");
+
+    check(vfs_mkfifo("/run/nb", 8, vfs_pipe_nonblock) == 0, "create a nonblocking FIFO");
+    vfs_node_t fifo = vfs_open("/run/nb");
+    char buf[16];
+    check(vfs_read(fifo, buf, 0, sizeof(buf)) == -1, "empty read fails");
+    check(vfs_write(fifo, "0123456789", 0, 10) == 8, "write stops when full");
+    check(vfs_write(fifo, "x", 0, 1) == -1, "full write fails");
+    check(vfs_read(fifo, buf, 0, sizeof(buf)) == 8 && memcmp(buf, "01234567", 8) == 0, "data wraps around");
+
+    vfs_write(fifo, "tail", 0, 4);
+    check(vfs_pipe_shutdown(fifo) == 0, "shut down the write end");
+    check(vfs_write(fifo, "x", 0, 1) == -1, "writes fail after shutdown");
+    check(vfs_read(fifo, buf, 0, sizeof(buf)) == 4, "remaining data is readable");
+    check(vfs_read(fifo, buf, 0, sizeof(buf)) == 0, "then end of stream");
+}
+
+static void *slow_writer(void *arg) {
+    sleep_ms(20);
+    vfs_write(arg, "late", 0, 4);
+    sleep_ms(20);
+    vfs_pipe_shutdown(arg);
+    return NULL;
+}
+
+static void *big_writer(void *arg) {
+    char data[64];
+    for (int i = 0; i < 64; i++) data[i] = i;
+    vfs_write(arg, data, 0, sizeof(data));
+    vfs_pipe_shutdown(arg);
+    return NULL;
+}
+
+static void test_blocking() {
+    print_separator("Blocking");
+
+    vfs_node_t pipe = vfs_pipe(4, 0);
+    check(pipe != NULL && pipe->info->type == file_fifo, "create an anonymous pipe");
+
+    pthread_t thread;
+    pthread_create(&thread, NULL, slow_writer, pipe);
+    char buf[16] = {0};
+    check(vfs_read(pipe, buf, 0, sizeof(buf)) == 4 && memcmp(buf, "late", 4) == 0, "read waits for the writer");
+    check(vfs_read(pipe, buf, 0, sizeof(buf)) == 0, "read wakes up on shutdown");
+    pthread_join(thread, NULL);
+    vfs_pipe_free(pipe);
+
+    // a write larger than the buffer hands it over piece by piece
+    pipe = vfs_pipe(4, 0);
+    pthread_create(&thread, NULL, big_writer, pipe);
+    char big[64];
+    size_t got = 0;
+    ssize_t n;
+    while ((n = vfs_read(pipe, big + got, 0, sizeof(big) - got)) > 0) got += n;
+    pthread_join(thread, NULL);
+    bool ordered = true;
+    for (int i = 0; i < 64; i++) ordered &= big[i] == i;
+    check(got == 64 && ordered, "a write larger than the buffer arrives whole");
+    vfs_pipe_free(pipe);
+}
+
+static void test_poll() {
+    print_separator("Poll");
+
+    vfs_node_t pipe = vfs_pipe(8, 0);
+    struct vfs_pollfd fd = {pipe, vfs_poll_in | vfs_poll_out, 0, NULL};
+    check(vfs_poll(&fd, 1, 0) == 1 && fd.revents == vfs_poll_out, "empty pipe is writable");
+
+    vfs_pollset_t set = vfs_pollset_alloc();
+    vfs_pollset_add(set, pipe, vfs_poll_in, NULL);
+    struct vfs_pollfd out;
+    check(vfs_pollset_wait(set, &out, 1, 0) == 0, "not readable");
+    vfs_write(pipe, "12345678", 0, 8);
+    check(vfs_pollset_wait(set, &out, 1, 0) == 1 && out.revents == vfs_poll_in, "readable after a write");
+    check(vfs_poll(&fd, 1, 0) == 1 && fd.revents == vfs_poll_in, "full pipe is not writable");
+
+    char buf[8];
+    vfs_read(pipe, buf, 0, 8);
+    check(vfs_pollset_wait(set, &out, 1, 0) == 0, "drained pipe is not readable");
+    vfs_pipe_shutdown(pipe);
+    check(vfs_pollset_wait(set, &out, 1, 0) == 1 && out.revents == vfs_poll_hup, "shutdown reports hangup");
+    vfs_pipe_free(pipe);
+    check(vfs_pollset_wait(set, &out, 1, 0) == 0, "freed pipe leaves the pollset");
+    vfs_pollset_free(set);
+}
+
+static void test_splice() {
+    print_separator("Splice");
+
+    vfs_node_t pipe = vfs_pipe(16, 0);
+    vfs_mkfile("/run/log");
+    vfs_node_t log = vfs_open("/run/log");
+    vfs_write(pipe, "0123456789", 0, 10);
+    vfs_read(pipe, (char[6]){0}, 0, 6); // move the data across the end of the buffer
+    vfs_write(pipe, "abcdefghij", 0, 10);
+
+    check(vfs_splice(pipe, log, 0, 100) == 14, "splice everything buffered");
+    char buf[32] = {0};
+    check(vfs_read(log, buf, 0, sizeof(buf)) == 14 && memcmp(buf, "6789abcdefghij", 14) == 0,
+          "file has the data in order");
+    vfs_write(pipe, "xyz", 0, 3);
+    check(vfs_splice(pipe, log, 14, 2) == 2, "splice a part");
+    check(vfs_read(pipe, buf, 0, sizeof(buf)) == 1 && buf[0] == 'z', "the rest stays in the pipe");
+    check(vfs_splice(log, pipe, 0, 1) == -1, "the source must be a pipe");
+    vfs_pipe_free(pipe);
+}
+
+struct worker {
+    vfs_node_t pipe;
+    u64 sum;
+    u64 count;
+};
+
+static void *producer(void *arg) {
+    struct worker *w = arg;
+    for (u64 i = 1; i <= PER_WORKER; i++) {
+        vfs_write(w->pipe, &i, 0, sizeof(i));
+        w->sum += i;
+    }
+    return NULL;
+}
+
+static void *consumer(void *arg) {
+    struct worker *w = arg;
+    u64 v[16];
+    ssize_t n;
+    // 8-byte writes never straddle a full 4096-byte buffer, so reads
+    // always return whole values
+    while ((n = vfs_read(w->pipe, v, 0, sizeof(v))) > 0) {
+        for (ssize_t i = 0; i < n / 8; i++) w->sum += v[i];
+        w->count += n / 8;
+    }
+    return NULL;
+}
+
+static void test_mpmc() {
+    print_separator("Several producers and consumers");
+
+    vfs_node_t pipe = vfs_pipe(4096, 0);
+    pthread_t prod[WORKERS], cons[WORKERS];
+    struct worker p[WORKERS] = {0}, c[WORKERS] = {0};
+    for (int i = 0; i < WORKERS; i++) {
+        p[i].pipe = c[i].pipe = pipe;
+        pthread_create(&prod[i], NULL, producer, &p[i]);
+        pthread_create(&cons[i], NULL, consumer, &c[i]);
+    }
+    u64 sent = 0, received = 0, count = 0;
+    for (int i = 0; i < WORKERS; i++) {
+        pthread_join(prod[i], NULL);
+        sent += p[i].sum;
+    }
+    vfs_pipe_shutdown(pipe);
+    for (int i = 0; i < WORKERS; i++) {
+        pthread_join(cons[i], NULL);
+        received += c[i].sum;
+        count += c[i].count;
+    }
+    check(count == WORKERS * PER_WORKER, "every value received once");
+    check(received == sent, "no value torn or duplicated");
+    vfs_pipe_free(pipe);
+}
+
+int main() {
+    printf(BOLD "pipe test" RESET "\n");
+
+    test_fifo();
+    test_nonblock();
+    test_blocking();
+    test_poll();
+    test_splice();
+    test_mpmc();
+
+    if (failures) {
+        printf("\n" RED "%d check(s) failed" RESET "\n", failures);
+        return 1;
+    }
+    printf("\n" GREEN "pipe test completed successfully!" RESET "\n");
+    return 0;
+}
@@ -0,0 +1,254 @@
+/*
+ * poll test - a small stream driver whose devices report readiness through
+ * the poll callback and vfs_poll_wakeup. Checks vfs_poll, its timeout and a
+ * pollset that multiplexes a few thousand streams fed by another thread.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <vfs.h>
+
+#define RESET   "\033[0m"
+#define RED     "\033[31m"
+#define GREEN   "\033[32m"
+#define BLUE    "\033[34m"
+#define BOLD    "\033[1m"
+
+#define NSTREAMS   2000
+#define STREAM_CAP 256
+#define MESSAGES   20000
+
+// a stream holds up to STREAM_CAP bytes, like the buffer of a serial port
+typedef struct stream {
+    pthread_mutex_t lock;
+    char name[16];
+    vfs_node_t node;
+    size_t head, count;
+    char data[STREAM_CAP];
+} stream_t;
+
+static int failures = 0;
+static stream_t *streams[NSTREAMS];
+static size_t nstreams = 0;
+static char stream_root;
+static vfs_node_t nodes[NSTREAMS];
+
+static void check(bool ok, const char *what) {
+    printf("%s %s\n", ok ? GREEN "[ OK ]" RESET : RED "[FAIL]" RESET, what);
+    if (!ok) failures++;
+}
+
+static void print_separator(const char *title) {
+    printf("\n" BOLD BLUE "=== %s ===" RESET "\n", title);
+}
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// needs s->lock
+static int stream_state(stream_t *s) {
+    return (s->count ? vfs_poll_in : 0) | (s->count < STREAM_CAP ? vfs_poll_out : 0);
+}
+
+static int stream_mount(const char *src, vfs_node_t node) {
+    node->info->handle = &stream_root;
+    node->info->type = file_dir;
+    return 0;
+}
+
+static void stream_unmount(void *root) {}
+
+static void stream_open(void *parent, const char *name, vfs_node_t node) {
+    for (size_t i = 0; i < nstreams; i++) {
+        if (strcmp(streams[i]->name, name) != 0) continue;
+        streams[i]->node = node;
+        node->info->handle = streams[i];
+        node->info->type = file_stream;
+    }
+}
+
+static void stream_close(void *current) {}
+
+static ssize_t stream_read(void *file, void *addr, size_t offset, size_t size) {
+    stream_t *s = file;
+    pthread_mutex_lock(&s->lock);
+    size_t n = size < s->count ? size : s->count;
+    for (size_t i = 0; i < n; i++) ((char *)addr)[i] = s->data[(s->head + i) % STREAM_CAP];
+    s->head = (s->head + n) % STREAM_CAP;
+    s->count -= n;
+    if (n) vfs_poll_wakeup(s->node, stream_state(s));
+    pthread_mutex_unlock(&s->lock);
+    return n;
+}
+
+static ssize_t stream_write(void *file, const void *addr, size_t offset, size_t size) {
+    stream_t *s = file;
+    pthread_mutex_lock(&s->lock);
+    size_t n = size < STREAM_CAP - s->count ? size : STREAM_CAP - s->count;
+    for (size_t i = 0; i < n; i++) s->data[(s->head + s->count + i) % STREAM_CAP] = ((const char *)addr)[i];
+    s->count += n;
+    if (n) vfs_poll_wakeup(s->node, stream_state(s));
+    pthread_mutex_unlock(&s->lock);
+    return n;
+}
+
+static int stream_mkdir(void *parent, const char *name, vfs_node_t node) {
+    return -1;
+}
+
+static int stream_mkfile(void *parent, const char *name, vfs_node_t node) {
+    if (nstreams == NSTREAMS) return -1;
+    stream_t *s = calloc(1, sizeof(stream_t));
+    pthread_mutex_init(&s->lock, NULL);
+    snprintf(s->name, sizeof(s->name), "%s", name);
+    streams[nstreams++] = s;
+    stream_open(parent, name, node);
+    return 0;
+}
+
+static int stream_stat(void *file, vfs_node_t node) {
+    return 0;
+}
+
+static int stream_poll(void *file) {
+    stream_t *s = file;
+    pthread_mutex_lock(&s->lock);
+    int state = stream_state(s);
+    pthread_mutex_unlock(&s->lock);
+    return state;
+}
+
+static struct vfs_callback stream_callbacks = {
+    .mount = stream_mount,
+    .unmount = stream_unmount,
+    .open = stream_open,
+    .close = stream_close,
+    .read = stream_read,
+    .write = stream_write,
+    .mkdir = stream_mkdir,
+    .mkfile = stream_mkfile,
+    .stat = stream_stat,
+    .poll = stream_poll,
+};
+
+static void setup() {
+    print_separator("Streams");
+
+    vfs_init();
+    check(vfs_regist("streamfs", &stream_callbacks) > 0, "register the stream driver");
+    check(vfs_mount("streams", rootdir) == 0, "mount on /");
+    bool ok = true;
+    for (int i = 0; i < NSTREAMS; i++) {
+        char path[24];
+        snprintf(path, sizeof(path), "/tty%d", i);
+        ok &= vfs_mkfile(path) == 0 && (nodes[i] = vfs_open(path)) != NULL;
+    }
+    check(ok, "create 2000 streams");
+}
+
+static void test_poll() {
+    print_separator("vfs_poll");
+
+    struct vfs_pollfd fds[2] = {
+        {nodes[0], vfs_poll_in, 0, NULL},
+        {nodes[1], vfs_poll_in | vfs_poll_out, 0, NULL},
+    };
+    check(vfs_poll(fds, 1, 0) == 0 && fds[0].revents == 0, "empty stream is not readable");
+    check(vfs_poll(fds, 2, 0) == 1 && fds[1].revents == vfs_poll_out, "empty stream is writable");
+
+    vfs_write(nodes[0], "hi", 0, 2);
+    check(vfs_poll(fds, 1, 0) == 1 && fds[0].revents == vfs_poll_in, "readable after a write");
+    char buf[8];
+    vfs_read(nodes[0], buf, 0, sizeof(buf));
+    check(vfs_poll(fds, 1, 0) == 0, "not readable once drained");
+
+    double start = now();
+    check(vfs_poll(fds, 1, 50) == 0, "times out when nothing happens");
+    check(now() - start >= 0.045, "waited for the timeout");
+
+    vfs_poll_wakeup(nodes[0], vfs_poll_hup);
+    check(vfs_poll(fds, 1, 0) == 1 && fds[0].revents == vfs_poll_hup, "hangup is always reported");
+    vfs_poll_wakeup(nodes[0], vfs_poll_out);
+}
+
+static void *producer(void *arg) {
+    unsigned seed = 1;
+    for (int i = 0; i < MESSAGES; i++) {
+        seed = seed * 1103515245 + 12345;
+        vfs_node_t node = nodes[(seed >> 8) % NSTREAMS];
+        // a full stream makes the producer retry until the consumer reads it
+        while (vfs_write(node, "m", 0, 1) != 1) sched_yield();
+    }
+    return NULL;
+}
+
+static void test_pollset() {
+    print_separator("Pollset");
+
+    vfs_pollset_t set = vfs_pollset_alloc();
+    bool ok = set != NULL;
+    for (intptr_t i = 0; i < NSTREAMS; i++) ok &= vfs_pollset_add(set, nodes[i], vfs_poll_in, (void *)i) == 0;
+    check(ok, "add 2000 streams");
+    check(vfs_pollset_add(set, nodes[0], vfs_poll_in, NULL) != 0, "reject a node added twice");
+
+    struct vfs_pollfd out[64];
+    check(vfs_pollset_wait(set, out, 64, 0) == 0, "nothing is ready");
+
+    vfs_write(nodes[7], "x", 0, 1);
+    int n1 = vfs_pollset_wait(set, out, 64, 0);
+    check(n1 == 1 && out[0].node == nodes[7] && out[0].data == (void *)7, "the written stream is ready");
+    int n2 = vfs_pollset_wait(set, out, 64, 0);
+    check(n2 == 1 && out[0].node == nodes[7], "level-triggered until it is read");
+    char c;
+    vfs_read(nodes[7], &c, 0, 1);
+    check(vfs_pollset_wait(set, out, 64, 0) == 0, "drained stream leaves the ready list");
+
+    check(vfs_pollset_del(set, nodes[7]) == 0, "remove a stream");
+    vfs_write(nodes[7], "x", 0, 1);
+    check(vfs_pollset_wait(set, out, 64, 0) == 0, "removed stream is not reported");
+    vfs_read(nodes[7], &c, 0, 1);
+    vfs_pollset_add(set, nodes[7], vfs_poll_in, (void *)7);
+
+    // one thread multiplexes every stream while another one feeds them
+    pthread_t thread;
+    pthread_create(&thread, NULL, producer, NULL);
+    int received = 0, waits = 0;
+    double start = now();
+    while (received < MESSAGES) {
+        int n = vfs_pollset_wait(set, out, 64, 1000);
+        if (n <= 0) break;
+        waits++;
+        for (int i = 0; i < n; i++) {
+            char buf[STREAM_CAP];
+            received += vfs_read(out[i].node, buf, 0, sizeof(buf));
+        }
+    }
+    double seconds = now() - start;
+    pthread_join(thread, NULL);
+    check(received == MESSAGES, "every message delivered");
+    check(vfs_pollset_wait(set, out, 64, 0) == 0, "all streams drained");
+    printf("%d messages over %d streams in %d waits, %.1f ms\n", received, NSTREAMS, waits, seconds * 1000);
+
+    vfs_pollset_free(set);
+}
+
+int main() {
+    printf(BOLD "poll test" RESET "\n");
+
+    setup();
+    test_poll();
+    test_pollset();
+
+    if (failures) {
+        printf("\n" RED "%d check(s) failed" RESET "\n", failures);
+        return 1;
+    }
+    printf("\n" GREEN "poll test completed successfully!" RESET "\n");
+    return 0;
+}
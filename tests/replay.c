@@ -0,0 +1,196 @@
+/*
+ * replay test - recording VFS calls into a mostream and replaying them:
+ * single threaded, with one thread per recorded thread and the ordering
+ * between them kept, at the recorded pace, and against a tree mounted by
+ * the caller instead of the recorded mounts.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <vfs.h>
+#include <fs/tmpfs.h>
+
+#define RESET   "\033[0m"
+#define RED     "\033[31m"
+#define GREEN   "\033[32m"
+#define BLUE    "\033[34m"
+#define BOLD    "\033[1m"
+
+#define THREADS 4
+#define BLOCKS  64
+
+static int failures = 0;
+
+static void check(bool ok, const char *what) {
+    printf("%s %s\n", ok ? GREEN "[ OK ]" RESET : RED "[FAIL]" RESET, what);
+    if (!ok) failures++;
+}
+
+static void print_separator(const char *title) {
+    printf("\n" BOLD BLUE "=== %s ===" RESET "\n", title);
+}
+
+static mostream_t recording;
+
+static int replay(int flags, vfs_replay_result_t *r) {
+    vfs_init();
+    mistream_t in = mistream_alloc(recording->buf, recording->size);
+    int ret = vfs_replay(in, flags, r);
+    mistream_free(in);
+    return ret;
+}
+
+static u64 size_of(const char *path) {
+    vfs_node_t node = vfs_open(path);
+    return node ? node->info->size : (u64)-1;
+}
+
+static void test_single() {
+    print_separator("Record and replay");
+
+    vfs_init();
+    tmpfs_regist();
+    check(vfs_record_start() == 0, "start recording");
+    check(vfs_record_start() == -1, "only one recording at a time");
+    check(vfs_mount("tmpfs", rootdir) == 0, "mount tmpfs on /");
+    vfs_mkdir("/d");
+    vfs_mkfile("/d/f");
+    vfs_node_t file = vfs_open("/d/f");
+    char buf[4096] = {0};
+    vfs_write(file, buf, 0, sizeof(buf));
+    vfs_write(file, buf, 4096, 100);
+    vfs_read(file, buf, 0, sizeof(buf));
+    vfs_close(file);
+    vfs_open("/d/missing");
+    vfs_rename("/d/f", "/d/g"); // not recorded
+    recording = mostream_alloc(4096);
+    check(vfs_record_stop(recording) == 0, "stop recording");
+    check(vfs_record_stop(recording) == -1, "stopping twice fails");
+
+    vfs_replay_result_t r;
+    check(replay(0, &r) == 0, "replay on an empty vfs");
+    check(r.ops == 9, "every recorded call is replayed");
+    check(r.mismatches == 0, "with the recorded results");
+    check(size_of("/d/f") == 4196, "the file has the written size");
+    check(vfs_open("/d/g") == NULL, "the rename was not recorded");
+    check(r.recorded > 0 && r.elapsed > 0, "times");
+
+    mistream_t bad = mistream_alloc("garbage", 7);
+    check(vfs_replay(bad, 0, &r) == -1, "reject an invalid recording");
+    mistream_free(bad);
+}
+
+static void test_unmounted() {
+    print_separator("Replay against another mount");
+
+    vfs_init();
+    check(vfs_mount("tmpfs", rootdir) == 0, "mount tmpfs on / first");
+    vfs_replay_result_t r;
+    mistream_t in = mistream_alloc(recording->buf, recording->size);
+    check(vfs_replay(in, vfs_replay_nomount, &r) == 0 && r.ops == 8, "the recorded mount is skipped");
+    mistream_free(in);
+    check(r.mismatches == 0 && size_of("/d/f") == 4196, "the calls go to the caller's mount");
+}
+
+// the vfs tree cannot be changed by several threads at once
+static pthread_mutex_t tree = PTHREAD_MUTEX_INITIALIZER;
+
+static void *writer(void *arg) {
+    int id = (int)(size_t)arg;
+    char path[32], buf[512];
+    memset(buf, 'a' + id, sizeof(buf));
+    sprintf(path, "/t%d", id);
+    pthread_mutex_lock(&tree);
+    vfs_mkfile(path);
+    vfs_node_t file = vfs_open(path);
+    pthread_mutex_unlock(&tree);
+    for (int i = 0; i < BLOCKS; i++) vfs_write(file, buf, i * sizeof(buf), sizeof(buf));
+    return NULL;
+}
+
+static void *reader(void *arg) {
+    int id = (int)(size_t)arg;
+    char path[32], buf[512];
+    sprintf(path, "/t%d", (id + 1) % THREADS);
+    pthread_mutex_lock(&tree);
+    vfs_node_t file = vfs_open(path);
+    pthread_mutex_unlock(&tree);
+    for (int i = 0; i < BLOCKS; i++) vfs_read(file, buf, i * sizeof(buf), sizeof(buf));
+    return NULL;
+}
+
+static void test_threads() {
+    print_separator("Threads");
+
+    // the readers of the second phase read files written by other threads
+    vfs_init();
+    vfs_record_start();
+    vfs_mount("tmpfs", rootdir);
+    pthread_t threads[THREADS];
+    for (int i = 0; i < THREADS; i++) pthread_create(&threads[i], NULL, writer, (void *)(size_t)i);
+    for (int i = 0; i < THREADS; i++) pthread_join(threads[i], NULL);
+    for (int i = 0; i < THREADS; i++) pthread_create(&threads[i], NULL, reader, (void *)(size_t)i);
+    for (int i = 0; i < THREADS; i++) pthread_join(threads[i], NULL);
+    recording->size = 0;
+    vfs_record_stop(recording);
+
+    int total = 1 + THREADS * (2 + BLOCKS) + THREADS * (1 + BLOCKS);
+    for (int round = 0; round < 5; round++) {
+        vfs_replay_result_t r;
+        if (replay(vfs_replay_threads, &r) != 0 || r.ops != total || r.mismatches != 0) {
+            check(false, "replay with threads");
+            return;
+        }
+    }
+    check(true, "replay with threads, five times");
+    bool ok = true;
+    for (int i = 0; i < THREADS; i++) {
+        char path[32];
+        sprintf(path, "/t%d", i);
+        ok &= size_of(path) == BLOCKS * 512;
+    }
+    check(ok, "every file is complete");
+
+    vfs_replay_result_t r;
+    check(replay(0, &r) == 0 && r.ops == total && r.mismatches == 0, "and in one thread");
+}
+
+static void test_pace() {
+    print_separator("Pace");
+
+    vfs_init();
+    vfs_record_start();
+    vfs_mount("tmpfs", rootdir);
+    vfs_mkdir("/a");
+    usleep(30000);
+    vfs_mkdir("/b");
+    usleep(30000);
+    vfs_mkdir("/c");
+    recording->size = 0;
+    vfs_record_stop(recording);
+
+    vfs_replay_result_t r;
+    check(replay(vfs_replay_timed, &r) == 0 && r.ops == 4, "replay at the recorded pace");
+    check(r.recorded >= 60000000 && r.elapsed >= 60000000, "takes as long as the recording");
+    check(replay(0, &r) == 0 && r.elapsed < 30000000, "as fast as possible is much faster");
+    mostream_free(recording);
+}
+
+int main() {
+    printf(BOLD "replay test" RESET "\n");
+
+    test_single();
+    test_unmounted();
+    test_threads();
+    test_pace();
+
+    if (failures) {
+        printf("\n" RED "%d check(s) failed" RESET "\n", failures);
+        return 1;
+    }
+    printf("\n" GREEN "replay test completed successfully!" RESET "\n");
+    return 0;
+}
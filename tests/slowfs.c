@@ -0,0 +1,187 @@
+/*
+ * slowfs test - wraps a tmpfs directory and checks that every operation
+ * reaches it, that reads and writes take the configured latency, that
+ * bandwidth, spikes and queue depth are applied, and that the virtual mode
+ * is deterministic for a given seed.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <vfs.h>
+#include <fs/slowfs.h>
+#include <fs/tmpfs.h>
+
+#define RESET   "\033[0m"
+#define RED     "\033[31m"
+#define GREEN   "\033[32m"
+#define BLUE    "\033[34m"
+#define BOLD    "\033[1m"
+
+#define MS      1000000ull
+#define THREADS 4
+
+static int failures = 0;
+
+static void check(bool ok, const char *what) {
+    printf("%s %s\n", ok ? GREEN "[ OK ]" RESET : RED "[FAIL]" RESET, what);
+    if (!ok) failures++;
+}
+
+static void print_separator(const char *title) {
+    printf("\n" BOLD BLUE "=== %s ===" RESET "\n", title);
+}
+
+static u64 now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static bool has(const char *path, const char *content) {
+    char buf[64] = {0};
+    vfs_node_t file = vfs_open(path);
+    return file && vfs_read(file, buf, 0, sizeof(buf) - 1) == (ssize_t)strlen(content) && strcmp(buf, content) == 0;
+}
+
+// mounts a slowfs with opts over a new lower directory
+static vfs_node_t mount_slow(const char *name, const char *opts) {
+    char lower[64], upper[64], src[256];
+    sprintf(lower, "/%s-lower", name);
+    sprintf(upper, "/%s", name);
+    vfs_mkdir(lower);
+    vfs_mkdir(upper);
+    snprintf(src, sizeof(src), "slowdir=%s%s%s", lower, *opts ? "," : "", opts);
+    vfs_node_t node = vfs_open(upper);
+    return vfs_mount(src, node) == 0 ? node : NULL;
+}
+
+static void test_passthrough() {
+    print_separator("Pass-through");
+
+    vfs_init();
+    tmpfs_regist();
+    check(slowfs_regist() > 0, "register slowfs");
+    check(vfs_mount("tmpfs", rootdir) == 0, "mount tmpfs on /");
+    vfs_mkdir("/plain-lower");
+    vfs_mkdir("/plain-lower/old");
+    vfs_mkfile("/plain-lower/old/f");
+    vfs_write(vfs_open("/plain-lower/old/f"), "before", 0, 6);
+    vfs_mkdir("/plain");
+    check(vfs_mount("slowdir=/plain-lower", vfs_open("/plain")) == 0, "mount without any delay");
+    check(vfs_mount("slowdir=/missing", vfs_open("/plain")) == -1, "the lower directory must exist");
+    check(vfs_mount("slowdir=/plain-lower,read=bogus:1ms", vfs_open("/plain")) == -1, "unknown distribution");
+
+    check(has("/plain/old/f", "before"), "existing files are visible");
+    check(vfs_mkdir("/plain/dir") == 0 && vfs_mkfile("/plain/dir/g") == 0, "mkdir and mkfile");
+    vfs_write(vfs_open("/plain/dir/g"), "written", 0, 7);
+    check(has("/plain-lower/dir/g", "written"), "writes reach the lower directory");
+    check(vfs_rename("/plain/dir/g", "/plain/dir/h") == 0 && has("/plain-lower/dir/h", "written"), "rename");
+    check(vfs_truncate(vfs_open("/plain/dir/h"), 3) == 0 && has("/plain/dir/h", "wri"), "truncate");
+    check(vfs_unlink("/plain/dir/h") == 0 && vfs_open("/plain-lower/dir/h") == NULL, "unlink");
+    check(vfs_rmdir("/plain/dir") == 0 && vfs_open("/plain-lower/dir") == NULL, "rmdir");
+
+    slowfs_stat_t st;
+    check(slowfs_stat(vfs_open("/plain/old"), &st) == 0 && st.ops > 0 && st.delay == 0, "statistics");
+    check(slowfs_stat(vfs_open("/plain-lower"), &st) == -1, "only for slowfs nodes");
+}
+
+static void test_latency() {
+    print_separator("Latency");
+
+    check(mount_slow("lat", "read=fixed:20ms,write=2ms") != NULL, "mount with fixed latency");
+    vfs_mkfile("/lat/f");
+    vfs_node_t file = vfs_open("/lat/f");
+    char buf[16] = {0};
+    u64 t0 = now();
+    vfs_write(file, "x", 0, 1);
+    u64 t1 = now();
+    vfs_read(file, buf, 0, 1);
+    u64 t2 = now();
+    check(t1 - t0 >= 2 * MS && t1 - t0 < 20 * MS, "a write takes the write latency");
+    check(t2 - t1 >= 20 * MS, "a read takes the read latency");
+
+    check(mount_slow("bw", "bw=10M") != NULL, "mount with a bandwidth cap");
+    vfs_mkfile("/bw/f");
+    static char big[1024 * 1024];
+    t0 = now();
+    vfs_write(vfs_open("/bw/f"), big, 0, sizeof(big));
+    check(now() - t0 >= 100 * MS, "1 MiB at 10 MiB/s takes 100 ms");
+}
+
+static void *reader(void *arg) {
+    char buf[8];
+    vfs_read(arg, buf, 0, 1);
+    return NULL;
+}
+
+static void test_queue() {
+    print_separator("Queue depth");
+
+    check(mount_slow("qd", "read=10ms,qd=1") != NULL, "mount with one request at a time");
+    vfs_mkfile("/qd/f");
+    vfs_node_t file = vfs_open("/qd/f");
+    vfs_write(file, "x", 0, 1);
+    pthread_t threads[THREADS];
+    u64 t0 = now();
+    for (int i = 0; i < THREADS; i++) pthread_create(&threads[i], NULL, reader, file);
+    for (int i = 0; i < THREADS; i++) pthread_join(threads[i], NULL);
+    check(now() - t0 >= THREADS * 10 * MS, "concurrent reads are serialized");
+    slowfs_stat_t st;
+    slowfs_stat(file, &st);
+    check(st.waits > 0, "and counted as waits");
+}
+
+static u64 virtual_delay(const char *name, const char *opts) {
+    if (mount_slow(name, opts) == NULL) return 0;
+    char path[64];
+    sprintf(path, "/%s/f", name);
+    vfs_mkfile(path);
+    vfs_node_t file = vfs_open(path);
+    char buf[4096] = {0};
+    for (int i = 0; i < 1000; i++) vfs_write(file, buf, i * sizeof(buf) % 65536, sizeof(buf));
+    slowfs_stat_t st;
+    slowfs_stat(file, &st);
+    return st.delay;
+}
+
+static void test_virtual() {
+    print_separator("Virtual time");
+
+    u64 t0 = now();
+    u64 fixed = virtual_delay("v1", "write=1ms,virtual");
+    check(now() - t0 < 500 * MS, "virtual mode does not sleep");
+    check(fixed >= 1000 * MS && fixed < 1001 * MS, "but adds up the latency");
+    u64 a = virtual_delay("v2", "write=exp:1ms,spike=5%:50ms,seed=7,virtual");
+    u64 b = virtual_delay("v3", "write=exp:1ms,spike=5%:50ms,seed=7,virtual");
+    u64 c = virtual_delay("v4", "write=exp:1ms,spike=5%:50ms,seed=8,virtual");
+    check(a == b, "the same seed gives the same delays");
+    check(a != c, "another seed gives other delays");
+    // 1000 * (1 ms + 5% * 50 ms) = 3.5 s on average
+    check(a > 2500 * MS && a < 4500 * MS, "exponential latency and spikes have the configured mean");
+    slowfs_stat_t st;
+    slowfs_stat(vfs_open("/v2"), &st);
+    check(st.spikes > 20 && st.spikes < 90 && st.ops >= 1000, "about 5% of the requests spike");
+    u64 n = virtual_delay("v5", "write=normal:2ms:100us,virtual");
+    check(n > 1900 * MS && n < 2100 * MS, "normal distribution");
+    u64 bw = virtual_delay("v6", "bw=4M,virtual");
+    check(bw >= 976 * MS && bw < 980 * MS, "4 MB at 4 MiB/s in virtual time");
+}
+
+int main() {
+    printf(BOLD "slowfs test" RESET "\n");
+
+    test_passthrough();
+    test_latency();
+    test_queue();
+    test_virtual();
+
+    if (failures) {
+        printf("\n" RED "%d check(s) failed" RESET "\n", failures);
+        return 1;
+    }
+    printf("\n" GREEN "slowfs test completed successfully!" RESET "\n");
+    return 0;
+}
@@ -0,0 +1,265 @@
+/*
+ * stats test - per-operation counters and latency histograms: totals for
+ * the whole vfs and per mount, nested operations counted once, path walk
+ * counters, the less common operations (mount, xattrs, locks, poll, ...),
+ * sampling, several threads counting into their own shards and
+ * the tables under a mounted procfs.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <vfs.h>
+#include <fs/procfs.h>
+#include <fs/tmpfs.h>
+
+#define RESET   "\033[0m"
+#define RED     "\033[31m"
+#define GREEN   "\033[32m"
+#define BLUE    "\033[34m"
+#define BOLD    "\033[1m"
+
+#define THREADS 4
+#define READS   10000
+
+static int failures = 0;
+static vfs_stats_t stats;
+
+static void check(bool ok, const char *what) {
+    printf("%s %s\n", ok ? GREEN "[ OK ]" RESET : RED "[FAIL]" RESET, what);
+    if (!ok) failures++;
+}
+
+static void print_separator(const char *title) {
+    printf("\n" BOLD BLUE "=== %s ===" RESET "\n", title);
+}
+
+static vfs_op_stats_t *op_stats(vfs_node_t node, int op) {
+    vfs_stats_read(node, &stats);
+    return &stats.ops[op];
+}
+
+static void test_buckets() {
+    print_separator("Buckets");
+
+    bool ok = true;
+    for (int i = 0; i < VFS_STATS_BUCKETS; i++) ok &= vfs_stats_bucket(i) < vfs_stats_bucket(i + 1);
+    check(ok, "bucket bounds increase");
+    check(vfs_stats_bucket(4) == 4 && vfs_stats_bucket(8) == 8 && vfs_stats_bucket(9) == 10,
+          "four buckets per power of two");
+    check(vfs_stats_bucket(VFS_STATS_BUCKETS) > 1000000000000ull, "the histogram covers over 1000 s");
+
+    vfs_op_stats_t op = {0};
+    op.hist[20] = 50; // [64, 80)
+    op.hist[30] = 49; // [384, 448)
+    op.hist[40] = 1;  // [2048, 2560)
+    op.max = 2100;
+    check(vfs_stats_percentile(&op, 0.5) == 79, "p50 is the upper bound of its bucket");
+    check(vfs_stats_percentile(&op, 0.99) == 447, "p99");
+    check(vfs_stats_percentile(&op, 1) == 2100, "p100 is clamped to the maximum");
+    check(strcmp(vfs_stats_name(vfs_op_read), "read") == 0, "operation names");
+}
+
+static void test_counters() {
+    print_separator("Counters");
+
+    vfs_init();
+    tmpfs_regist();
+    procfs_regist();
+    check(vfs_mount("tmpfs", rootdir) == 0, "mount tmpfs on /");
+    vfs_mkdir("/data");
+    check(vfs_mount("tmpfs", vfs_open("/data")) == 0, "mount another tmpfs on /data");
+    vfs_mkfile("/data/file");
+    vfs_mkfile("/top");
+    vfs_node_t file = vfs_open("/data/file");
+    vfs_node_t top = vfs_open("/top");
+
+    vfs_stats_sample(0);
+    vfs_stats_reset();
+    char buf[4096] = {0};
+    for (int i = 0; i < 100; i++) vfs_write(file, buf, i * 4096, 4096);
+    for (int i = 0; i < 50; i++) vfs_read(file, buf, i * 4096, 4096);
+    vfs_write(top, buf, 0, 10);
+    vfs_read(vfs_open("/data"), buf, 0, 10);
+
+    vfs_op_stats_t *w = op_stats(null, vfs_op_write);
+    check(w->count == 101 && w->errors == 0 && w->bytes == 100 * 4096 + 10, "global write counters");
+    check(w->sampled == 101 && w->time > 0 && w->max > 0, "every write timed without sampling");
+    check(w->callback <= w->time, "callback time is part of the total");
+    vfs_op_stats_t *r = op_stats(null, vfs_op_read);
+    check(r->count == 51 && r->errors == 1, "reading a directory counts as an error");
+    check(vfs_stats_percentile(r, 0.5) <= vfs_stats_percentile(r, 0.99) &&
+          vfs_stats_percentile(r, 0.99) <= r->max,
+          "p50 <= p99 <= max");
+
+    w = op_stats(file, vfs_op_write);
+    check(w->count == 100 && w->bytes == 100 * 4096, "the /data mount counts only its own writes");
+    w = op_stats(top, vfs_op_write);
+    check(w->count == 1 && w->bytes == 10, "the root mount counts the other one");
+}
+
+static void test_walks() {
+    print_separator("Path walks");
+
+    vfs_stats_reset();
+    vfs_open("/data/file");
+    vfs_open("/data/missing");
+    vfs_read(vfs_open("/data/file"), (char[8]){0}, 0, 8);
+    vfs_stats_read(null, &stats);
+    check(stats.ops[vfs_op_open].count == 3 && stats.ops[vfs_op_open].errors == 1, "opens and failed opens");
+    check(stats.walks == 3 && stats.walk_steps == 6 && stats.walk_max == 2, "walk steps and depth");
+    check(stats.walk_fails == 1, "failed walks");
+    check(stats.lookup_hits == 5 && stats.lookup_misses == 0, "already opened nodes are hits");
+
+    vfs_stats_reset();
+    vfs_mkfile("/data/old");
+    check(vfs_rename("/data/old", "/data/new") == 0, "rename");
+    vfs_stats_read(null, &stats);
+    check(stats.ops[vfs_op_rename].count == 1, "one rename");
+    check(stats.ops[vfs_op_open].count == 0, "its lookups are not counted as opens");
+    check(stats.walks == 3, "but their walks are");
+    check(op_stats(vfs_open("/data"), vfs_op_rename)->count == 1, "the rename belongs to the /data mount");
+    check(vfs_unlink("/data/new") == 0 && op_stats(vfs_open("/data"), vfs_op_unlink)->count == 1,
+          "so does the unlink");
+}
+
+static void test_other_ops() {
+    print_separator("Other operations");
+
+    vfs_node_t file = vfs_open("/data/file");
+    vfs_node_t top = vfs_open("/top");
+    vfs_mkdir("/m");
+    vfs_mkdir("/alias");
+    vfs_node_t pipe = vfs_pipe(4096, 0);
+    char buf[64] = {0};
+
+    vfs_stats_reset();
+    vfs_mount("tmpfs", vfs_open("/m"));
+    vfs_bind("/data", "/alias");
+    vfs_unmount("/alias");
+    vfs_fallocate(file, 0, 0, 8192);
+    check(vfs_copy_range(file, 0, top, 0, 100) == 100, "copy a range");
+    vfs_setxattr(file, "user.a", "1", 1);
+    vfs_getxattr(file, "user.a", buf, sizeof(buf));
+    vfs_listxattr(file, buf, sizeof(buf));
+    vfs_lock(file, 0, 10, vfs_lock_exclusive, false);
+    vfs_unlock(file, 0, 10);
+    vfs_poll(&(struct vfs_pollfd){.node = file, .events = vfs_poll_in}, 1, 0);
+    vfs_write(pipe, "spliced", 0, 7);
+    vfs_splice(pipe, top, 0, 7);
+    vfs_stats_read(null, &stats);
+
+    bool once = true;
+    for (int op = vfs_op_mount; op <= vfs_op_splice; op++) {
+        once = once && stats.ops[op].count == 1;
+    }
+    check(once, "each is counted once");
+    check(stats.ops[vfs_op_copy_range].bytes == 100, "copied bytes");
+    check(strcmp(vfs_stats_name(vfs_op_copy_range), "copy_range") == 0, "and have names");
+    check(op_stats(file, vfs_op_lock)->count == 1, "locks belong to the mount of the file");
+    vfs_pipe_free(pipe);
+}
+
+static void test_switches() {
+    print_separator("Sampling and switches");
+
+    vfs_node_t file = vfs_open("/data/file");
+    char buf[64];
+    vfs_stats_sample(4);
+    vfs_stats_reset();
+    for (int i = 0; i < 16000; i++) vfs_read(file, buf, 0, sizeof(buf));
+    vfs_op_stats_t *r = op_stats(null, vfs_op_read);
+    check(r->count == 16000, "sampling keeps exact counts");
+    check(r->sampled > 500 && r->sampled < 2000, "about one in 16 reads is timed");
+    check(vfs_stats_sample(17) == -1, "reject a huge shift");
+
+    check(vfs_stats_enable(false), "disable the counters");
+    vfs_read(file, buf, 0, sizeof(buf));
+    check(op_stats(null, vfs_op_read)->count == 16000, "nothing is counted");
+    check(!vfs_stats_enable(true), "enable them again");
+    vfs_stats_sample(0);
+}
+
+static void *reader(void *arg) {
+    vfs_node_t file = arg;
+    char buf[64];
+    for (int i = 0; i < READS; i++) vfs_read(file, buf, 0, sizeof(buf));
+    return NULL;
+}
+
+static void test_threads() {
+    print_separator("Threads");
+
+    vfs_node_t file = vfs_open("/data/file");
+    vfs_stats_reset();
+    pthread_t threads[THREADS];
+    for (int i = 0; i < THREADS; i++) pthread_create(&threads[i], NULL, reader, file);
+    for (int i = 0; i < THREADS; i++) pthread_join(threads[i], NULL);
+    check(op_stats(null, vfs_op_read)->count == THREADS * READS, "no read is lost between threads");
+    check(op_stats(file, vfs_op_read)->count == THREADS * READS, "nor in the mount's counters");
+
+    // the shards of the exited threads are reused
+    for (int i = 0; i < THREADS; i++) pthread_create(&threads[i], NULL, reader, file);
+    for (int i = 0; i < THREADS; i++) pthread_join(threads[i], NULL);
+    check(op_stats(null, vfs_op_read)->count == 2 * THREADS * READS, "counts survive the threads");
+}
+
+// reads a whole procfs file into buf
+static bool read_proc(const char *path, char *buf, size_t size) {
+    vfs_node_t node = vfs_open(path);
+    if (node == NULL) return false;
+    ssize_t n = vfs_read(node, buf, 0, size - 1);
+    if (n < 0) return false;
+    buf[n] = '\0';
+    return true;
+}
+
+static void test_procfs() {
+    print_separator("procfs");
+
+    vfs_mkdir("/proc");
+    check(vfs_mount("proc", vfs_open("/proc")) == 0, "mount procfs on /proc");
+    vfs_stats_reset();
+    vfs_read(vfs_open("/data/file"), (char[8]){0}, 0, 8);
+
+    static char buf[16384];
+    check(read_proc("/proc/ops", buf, sizeof(buf)), "read /proc/ops");
+    check(strstr(buf, "p99_ns") && strstr(buf, "\nwalks "), "it has the table and the walk counters");
+    check(strstr(buf, "\nread ") && strstr(buf, "\nrename "), "one line per operation");
+    check(vfs_write(vfs_open("/proc/ops"), "x", 0, 1) < 0, "it is read-only");
+
+    check(read_proc("/proc/mounts", buf, sizeof(buf)), "read /proc/mounts");
+    int data_id = 0;
+    for (char *line = buf; *line; line = strchr(line, '\n') + 1) {
+        int id;
+        char path[64];
+        if (sscanf(line, "%d %63s", &id, path) == 2 && strcmp(path, "/data") == 0) data_id = id;
+    }
+    check(data_id > 0, "it lists /data");
+    char path[64];
+    sprintf(path, "/proc/mount/%d", data_id);
+    check(read_proc(path, buf, sizeof(buf)), "read the table of /data");
+    unsigned long long count = 0;
+    char *line = strstr(buf, "\nread ");
+    check(line && sscanf(line, " read %llu", &count) == 1 && count == 1, "with its read");
+}
+
+int main() {
+    printf(BOLD "stats test" RESET "\n");
+
+    test_buckets();
+    test_counters();
+    test_walks();
+    test_other_ops();
+    test_switches();
+    test_threads();
+    test_procfs();
+
+    if (failures) {
+        printf("\n" RED "%d check(s) failed" RESET "\n", failures);
+        return 1;
+    }
+    printf("\n" GREEN "stats test completed successfully!" RESET "\n");
+    return 0;
+}
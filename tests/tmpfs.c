@@ -0,0 +1,359 @@
+/*
+ * tmpfs test - mounts an in-memory filesystem, creates a small tree and
+ * checks reads, writes, sparse pages and reopening closed nodes. The xattr
+ * calls fail on the root before anything is mounted on it.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vfs.h>
+#include <fs/tmpfs.h>
+
+#define RESET   "\033[0m"
+#define RED     "\033[31m"
+#define GREEN   "\033[32m"
+#define BLUE    "\033[34m"
+#define BOLD    "\033[1m"
+
+static int failures = 0;
+
+static void check(bool ok, const char *what) {
+    printf("%s %s\n", ok ? GREEN "[ OK ]" RESET : RED "[FAIL]" RESET, what);
+    if (!ok) failures++;
+}
+
+static void print_separator(const char *title) {
+    printf("\n" BOLD BLUE "=== %s ===" RESET "\n", title);
+}
+
+static void test_mount() {
+    print_separator("Mount");
+
+    vfs_init();
+    // nothing is mounted yet, so the root has no driver to store attributes
+    char buf[64];
+    check(vfs_getxattr(rootdir, "user.a", buf, sizeof(buf)) == -1, "getxattr on an unmounted node");
+    check(vfs_getxattr(rootdir, "user.a", NULL, 0) == -1, "getxattr size on an unmounted node");
+    check(vfs_setxattr(rootdir, "user.a", "x", 1) == -1, "setxattr on an unmounted node");
+    check(vfs_listxattr(rootdir, buf, sizeof(buf)) == -1, "listxattr on an unmounted node");
+    check(tmpfs_regist() > 0, "register tmpfs");
+    check(vfs_mount("not-tmpfs", rootdir) != 0, "reject other sources");
+    check(vfs_mount("tmpfs", rootdir) == 0, "mount tmpfs on /");
+    check(vfs_mkdir("/etc") == 0 && vfs_mkdir("/etc/conf.d") == 0, "create directories");
+    check(vfs_mkfile("/etc/hostname") == 0, "create a file");
+    vfs_node_t dir = vfs_open("/etc/conf.d");
+    check(dir && dir->info->type == file_dir, "open a directory");
+}
+
+static void test_data() {
+    print_separator("Read and write");
+
+    vfs_node_t file = vfs_open("/etc/hostname");
+    check(file && vfs_write(file, "plant\n", 0, 6) == 6, "write");
+    char buf[64] = {0};
+    check(vfs_read(file, buf, 0, sizeof(buf)) == 6 && strcmp(buf, "plant\n") == 0, "read back");
+    check(vfs_write(file, "os\n", 5, 3) == 3 && file->info->size == 8, "overwrite and extend");
+    check(vfs_read(file, buf, 0, sizeof(buf)) == 8 && memcmp(buf, "plantos\n", 8) == 0, "content after overwrite");
+
+    // writing far past the end leaves unallocated pages in between
+    check(vfs_mkfile("/sparse") == 0, "create sparse file");
+    vfs_node_t sparse = vfs_open("/sparse");
+    check(vfs_write(sparse, "end", 10 * 4096, 3) == 3, "write at 40 KiB");
+    vfs_close(sparse); // reopen to refresh the stat
+    vfs_update(sparse);
+    check(sparse->info->size == 10 * 4096 + 3, "size covers the gap");
+    check(sparse->info->realsize == 4096, "only one page allocated");
+    unsigned char page[4096];
+    memset(page, 0xff, sizeof(page));
+    check(vfs_read(sparse, page, 4096, sizeof(page)) == sizeof(page), "read from the gap");
+    bool zero = true;
+    for (size_t i = 0; i < sizeof(page); i++) zero = zero && page[i] == 0;
+    check(zero, "gap reads as zeros");
+}
+
+static bool zeros(vfs_node_t file, size_t offset, size_t size) {
+    unsigned char *buf = malloc(size);
+    memset(buf, 0xff, size);
+    bool ok = vfs_read(file, buf, offset, size) == (ssize_t)size;
+    for (size_t i = 0; ok && i < size; i++) ok = buf[i] == 0;
+    free(buf);
+    return ok;
+}
+
+static void test_resize() {
+    print_separator("Truncate and fallocate");
+
+    check(vfs_mkfile("/log") == 0, "create log file");
+    vfs_node_t log = vfs_open("/log");
+    check(vfs_fallocate(log, vfs_falloc_keep_size, 0, 16 * 4096) == 0, "preallocate 64 KiB");
+    check(log->info->size == 0 && log->info->realsize == 16 * 4096, "space reserved, size unchanged");
+    for (int i = 0; i < 100; i++) vfs_write(log, "entry\n", i * 6, 6);
+    check(log->info->size == 600 && log->info->realsize == 16 * 4096, "appends reuse reserved pages");
+
+    check(vfs_truncate(log, 3) == 0 && log->info->size == 3, "shrink");
+    check(vfs_truncate(log, 5000) == 0 && log->info->size == 5000, "grow");
+    char buf[4] = {0};
+    check(vfs_read(log, buf, 0, 3) == 3 && memcmp(buf, "ent", 3) == 0, "kept data survives");
+    check(zeros(log, 3, 4096 - 3), "truncated data reads as zeros");
+    check(log->info->realsize == 4096, "pages past the new end are freed");
+    check(vfs_truncate(log, 0) == 0 && log->info->realsize == 0, "truncate to zero frees everything");
+
+    check(vfs_fallocate(log, 0, 0, 3 * 4096) == 0 && log->info->size == 3 * 4096,
+          "fallocate without keep_size extends the file");
+    unsigned char page[3 * 4096];
+    memset(page, 'x', sizeof(page));
+    vfs_write(log, page, 0, sizeof(page));
+    check(vfs_fallocate(log, vfs_falloc_punch_hole | vfs_falloc_keep_size, 100, 2 * 4096) == 0,
+          "punch a hole");
+    check(log->info->realsize == 2 * 4096, "fully covered page freed");
+    check(zeros(log, 100, 2 * 4096) && log->info->size == 3 * 4096, "hole reads as zeros");
+    check(vfs_read(log, buf, 96, 4) == 4 && memcmp(buf, "xxxx", 4) == 0, "data before the hole kept");
+    check(vfs_fallocate(log, vfs_falloc_punch_hole, 0, 10) != 0, "punch_hole requires keep_size");
+
+    check(vfs_fallocate(log, vfs_falloc_zero_range, 4096 * 2 + 200, 4096) == 0, "zero a range");
+    check(zeros(log, 4096 * 2 + 200, 4096) && log->info->size == 3 * 4096 + 200,
+          "range zeroed and file extended");
+    check(log->info->realsize == 3 * 4096, "zero range allocates");
+    check(vfs_truncate(vfs_open("/etc"), 0) != 0, "directories cannot be truncated");
+}
+
+static void test_extents() {
+    print_separator("Holes and extents");
+
+    const u64 gib = 1ull << 30;
+    check(vfs_mkfile("/disk.img") == 0, "create disk image");
+    vfs_node_t img = vfs_open("/disk.img");
+    vfs_write(img, "boot", 0, 4);
+    vfs_write(img, "middle", 50 * gib, 6);
+    check(vfs_truncate(img, 100 * gib) == 0 && img->info->size == 100 * gib, "grow to 100 GiB");
+    check(img->info->realsize == 2 * 4096, "holes take no memory");
+
+    check(vfs_next_data(img, 0) == 0 && vfs_next_hole(img, 0) == 4096, "first extent");
+    check(vfs_next_data(img, 4096) == (i64)(50 * gib), "skip to the next extent");
+    check(vfs_next_hole(img, 50 * gib + 3) == (i64)(50 * gib + 4096), "end of the second extent");
+    check(vfs_next_data(img, 50 * gib + 4096) == -1, "no data after the last extent");
+    check(vfs_next_hole(img, 99 * gib) == (i64)(99 * gib), "offset inside a hole");
+    check(vfs_next_data(img, 100 * gib) == -1 && vfs_next_hole(img, 100 * gib) == -1, "past the end");
+
+    // copy only the data extents, the holes are recreated by the final truncate
+    check(vfs_mkfile("/copy.img") == 0, "create copy");
+    vfs_node_t copy = vfs_open("/copy.img");
+    char buf[4096];
+    u64 pos = 0, copied = 0;
+    for (i64 data; (data = vfs_next_data(img, pos)) >= 0;) {
+        u64 hole = vfs_next_hole(img, data);
+        for (u64 off = data; off < hole;) {
+            ssize_t n = vfs_read(img, buf, off, min(sizeof(buf), hole - off));
+            vfs_write(copy, buf, off, n);
+            off += n;
+            copied += n;
+        }
+        pos = hole;
+    }
+    vfs_truncate(copy, img->info->size);
+    check(copied == 2 * 4096, "only the data extents were read");
+    check(copy->info->size == 100 * gib && copy->info->realsize == 2 * 4096, "copy is sparse too");
+    memset(buf, 0, sizeof(buf));
+    check(vfs_read(copy, buf, 50 * gib, 6) == 6 && memcmp(buf, "middle", 6) == 0, "copy content");
+    check(vfs_truncate(img, 1ull << 60) != 0, "size limit enforced");
+}
+
+static void test_copy() {
+    print_separator("Copy range");
+
+    const size_t size = 64 * 4096 + 123;
+    unsigned char *data = malloc(size), *buf = malloc(size);
+    for (size_t i = 0; i < size; i++) data[i] = i * 13 + i / 4096;
+    check(vfs_mkfile("/orig") == 0, "create source");
+    vfs_node_t orig = vfs_open("/orig");
+    vfs_write(orig, data, 0, 16 * 4096);
+    vfs_write(orig, data + 32 * 4096, 32 * 4096, size - 32 * 4096); // 16 page hole
+
+    vfs_mkfile("/clone");
+    vfs_node_t clone = vfs_open("/clone");
+    check(vfs_copy_range(orig, 0, clone, 0, 1 << 30) == (ssize_t)size, "clone clamps to the source size");
+    check(clone->info->size == size && clone->info->realsize == 49 * 4096, "pages shared, hole kept");
+    memset(data + 16 * 4096, 0, 16 * 4096);
+    check(vfs_read(clone, buf, 0, size) == (ssize_t)size && memcmp(buf, data, size) == 0, "clone content");
+
+    // copy-on-write: writing either side leaves the other untouched
+    check(vfs_write(clone, "CLONE", 100, 5) == 5, "write into the clone");
+    check(vfs_read(orig, buf, 100, 5) == 5 && memcmp(buf, data + 100, 5) == 0, "source unchanged");
+    check(vfs_write(orig, "ORIG", 40 * 4096, 4) == 4, "write into the source");
+    check(vfs_read(clone, buf, 40 * 4096, 4) == 4 && memcmp(buf, data + 40 * 4096, 4) == 0, "clone unchanged");
+    memcpy(data + 40 * 4096, "ORIG", 4);
+
+    // different offsets within a page cannot share pages, the vfs copies instead
+    vfs_mkfile("/shifted");
+    vfs_node_t shifted = vfs_open("/shifted");
+    check(vfs_copy_range(orig, 10, shifted, 7, size - 10) == (ssize_t)(size - 10), "unaligned copy");
+    check(shifted->info->size == size - 3, "destination size");
+    check(vfs_read(shifted, buf, 7, size - 10) == (ssize_t)(size - 10) && memcmp(buf, data + 10, size - 10) == 0,
+          "unaligned content");
+    check(shifted->info->realsize <= 51 * 4096, "hole skipped by the fallback");
+
+    check(vfs_copy_range(orig, 0, orig, 4096, 8192) < 0, "overlapping range in one file rejected");
+    check(vfs_copy_range(orig, size, clone, 0, 10) == 0, "nothing to copy past the end");
+    free(data);
+    free(buf);
+}
+
+static void test_rename() {
+    print_separator("Rename and remove");
+
+    vfs_mkdir("/srv/a/b");
+    vfs_mkfile("/srv/a/b/leaf");
+    vfs_write(vfs_open("/srv/a/b/leaf"), "leaf", 0, 4);
+    vfs_node_t leaf = vfs_open("/srv/a/b/leaf");
+    check(vfs_rename("/srv/a", "/moved") == 0, "move a directory to another parent");
+    check(vfs_open("/srv/a") == NULL && vfs_open("/moved/b/leaf") == leaf, "subtree moved with it");
+    char *path = vfs_get_fullpath(leaf);
+    check(strcmp(path, "/moved/b/leaf") == 0, "full path follows the move");
+    free(path);
+    char buf[16] = {0};
+    check(vfs_read(leaf, buf, 0, 4) == 4 && strcmp(buf, "leaf") == 0, "open handle still valid");
+
+    check(vfs_rename("/moved", "/moved/b/loop") != 0, "cannot move into its own subtree");
+    check(vfs_rename("/missing", "/x") != 0, "source must exist");
+    vfs_mkfile("/srv/file");
+    check(vfs_rename("/srv/file", "/moved") != 0, "file cannot replace a directory");
+    check(vfs_rmdir("/moved") != 0, "non-empty directory is kept");
+    check(vfs_unlink("/moved") != 0, "unlink rejects directories");
+    check(vfs_rmdir("/srv/file") != 0, "rmdir rejects files");
+
+    // write to a temporary file, then atomically replace the target
+    vfs_mkfile("/srv/config");
+    bool ok = true;
+    for (int i = 0; i < 10000 && ok; i++) {
+        ok = vfs_mkfile("/srv/config.tmp") == 0 &&
+             vfs_write(vfs_open("/srv/config.tmp"), &i, 0, sizeof(i)) == sizeof(i) &&
+             vfs_rename("/srv/config.tmp", "/srv/config") == 0;
+    }
+    check(ok, "replace a file 10000 times");
+    int last = 0;
+    check(vfs_read(vfs_open("/srv/config"), &last, 0, sizeof(last)) == sizeof(last) && last == 9999,
+          "target holds the last version");
+    check(list_length(vfs_open("/srv")->info->child) == 2, "replaced nodes are freed");
+
+    check(vfs_unlink("/srv/file") == 0 && vfs_open("/srv/file") == NULL, "unlink a file");
+    check(vfs_unlink("/srv/file") != 0, "unlink a missing file");
+    check(vfs_unlink("/moved/b/leaf") == 0 && vfs_rmdir("/moved/b") == 0 && vfs_rmdir("/moved") == 0,
+          "remove a tree bottom-up");
+    check(vfs_open("/moved") == NULL, "directory is gone");
+    check(vfs_rmdir("/") != 0, "cannot remove the root");
+}
+
+static void test_link() {
+    print_separator("Hard links");
+
+    vfs_mkdir("/store");
+    vfs_mkfile("/store/blob");
+    vfs_node_t blob = vfs_open("/store/blob");
+    vfs_write(blob, "blob", 0, 4);
+
+    char path[64];
+    bool ok = true;
+    for (int i = 0; i < 1000 && ok; i++) {
+        snprintf(path, sizeof(path), "/store/link%d", i);
+        ok = vfs_link("/store/blob", path) == 0;
+    }
+    check(ok, "link one file under 1000 names");
+    check(vfs_open("/store/link500")->info == blob->info, "names share one info");
+    check(blob->info->refcount == 1001 && blob->info->nlink == 1001, "reference and link counts");
+
+    check(vfs_write(vfs_open("/store/link7"), "BLOB", 0, 4) == 4, "write through a link");
+    char buf[8] = {0};
+    check(vfs_read(blob, buf, 0, 4) == 4 && strcmp(buf, "BLOB") == 0, "visible through the original");
+
+    check(vfs_link("/store/blob", "/store/link3") != 0, "target must not exist");
+    check(vfs_link("/store", "/dirlink") != 0, "directories cannot be linked");
+    check(vfs_rename("/store/link1", "/store/link2") == 0 && vfs_open("/store/link1") != NULL,
+          "rename between two links of one file does nothing");
+
+    check(vfs_unlink("/store/blob") == 0, "unlink the original name");
+    vfs_node_t link = vfs_open("/store/link999");
+    memset(buf, 0, sizeof(buf));
+    check(link && vfs_read(link, buf, 0, 4) == 4 && strcmp(buf, "BLOB") == 0, "data kept by the other names");
+    ok = true;
+    for (int i = 0; i < 1000 && ok; i++) {
+        snprintf(path, sizeof(path), "/store/link%d", i);
+        ok = vfs_unlink(path) == 0;
+    }
+    check(ok && vfs_rmdir("/store") == 0, "unlink every name");
+}
+
+static void test_xattr() {
+    print_separator("Extended attributes");
+
+    vfs_mkfile("/tagged");
+    vfs_node_t file = vfs_open("/tagged");
+    char name[32], value[32], buf[64];
+    bool ok = true;
+    for (int i = 0; i < 10 && ok; i++) {
+        snprintf(name, sizeof(name), "user.tag%d", i);
+        snprintf(value, sizeof(value), "value %d", i);
+        ok = vfs_setxattr(file, name, value, strlen(value)) == 0;
+    }
+    check(ok, "set 10 attributes");
+    for (int i = 0; i < 10 && ok; i++) {
+        snprintf(name, sizeof(name), "user.tag%d", i);
+        snprintf(value, sizeof(value), "value %d", i);
+        memset(buf, 0, sizeof(buf));
+        ok = vfs_getxattr(file, name, buf, sizeof(buf)) == (ssize_t)strlen(value) && strcmp(buf, value) == 0;
+    }
+    check(ok, "read them back (inline and spilled)");
+    check(vfs_getxattr(file, "user.tag3", NULL, 0) == 7, "query the size");
+    check(vfs_getxattr(file, "user.tag3", buf, 2) < 0, "buffer too small");
+    check(vfs_getxattr(file, "user.missing", buf, sizeof(buf)) < 0, "missing attribute");
+    check(vfs_getxattr(file, "user.missing", buf, sizeof(buf)) < 0, "missing attribute is cached");
+
+    check(vfs_setxattr(file, "user.tag8", "new", 3) == 0, "replace a value");
+    memset(buf, 0, sizeof(buf));
+    check(vfs_getxattr(file, "user.tag8", buf, sizeof(buf)) == 3 && strcmp(buf, "new") == 0, "new value");
+    check(vfs_setxattr(file, "user.empty", "", 0) == 0 && vfs_getxattr(file, "user.empty", buf, sizeof(buf)) == 0,
+          "empty value");
+
+    char list[256];
+    ssize_t n = vfs_listxattr(file, list, sizeof(list));
+    int count = 0;
+    for (ssize_t off = 0; off < n; off += strlen(list + off) + 1) count++;
+    check(n == vfs_listxattr(file, NULL, 0) && count == 11, "list every attribute");
+    check(vfs_setxattr(file, "user.late", "x", 1) == 0 && vfs_listxattr(file, NULL, 0) == n + 10,
+          "list follows new attributes");
+
+    check(vfs_link("/tagged", "/tagged2") == 0, "link the file");
+    memset(buf, 0, sizeof(buf));
+    check(vfs_getxattr(vfs_open("/tagged2"), "user.tag1", buf, sizeof(buf)) == 7, "links share the attributes");
+    check(vfs_getxattr(vfs_open("/etc"), "user.tag1", buf, sizeof(buf)) < 0, "other files have their own");
+}
+
+static void test_reopen() {
+    print_separator("Reopen");
+
+    vfs_node_t file = vfs_open("/etc/hostname");
+    check(vfs_close(file) == 0 && file->info->handle == NULL, "close the node");
+    char buf[16] = {0};
+    check(vfs_read(file, buf, 0, 8) == 8 && memcmp(buf, "plantos\n", 8) == 0, "data survives close");
+}
+
+int main() {
+    printf(BOLD "tmpfs test" RESET "\n");
+
+    test_mount();
+    test_data();
+    test_resize();
+    test_extents();
+    test_copy();
+    test_rename();
+    test_link();
+    test_xattr();
+    test_reopen();
+
+    if (failures) {
+        printf("\n" RED "%d check(s) failed" RESET "\n", failures);
+        return 1;
+    }
+    printf("\n" GREEN "tmpfs test completed successfully!" RESET "\n");
+    return 0;
+}
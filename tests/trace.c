@@ -0,0 +1,301 @@
+/*
+ * trace test - the binary operation trace: one event per operation with
+ * its node, offset, size and driver, node paths written once, the less
+ * common operations (mount, xattrs, locks, poll, ...), nested operations
+ * through overlayfs, several threads writing their own buffers
+ * and events dropped and counted when a buffer is full.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <vfs.h>
+#include <trace.h>
+#include <fs/overlayfs.h>
+#include <fs/tmpfs.h>
+
+#define RESET   "\033[0m"
+#define RED     "\033[31m"
+#define GREEN   "\033[32m"
+#define BLUE    "\033[34m"
+#define BOLD    "\033[1m"
+
+#define TRACE_FILE "/tmp/plant-vfs-trace-test.bin"
+#define THREADS    4
+#define READS      5000
+
+static int failures = 0;
+
+static void check(bool ok, const char *what) {
+    printf("%s %s\n", ok ? GREEN "[ OK ]" RESET : RED "[FAIL]" RESET, what);
+    if (!ok) failures++;
+}
+
+static void print_separator(const char *title) {
+    printf("\n" BOLD BLUE "=== %s ===" RESET "\n", title);
+}
+
+// the records of a trace file, paths as NUL terminated strings
+typedef struct {
+    unsigned thread;
+    struct trace_event e;
+    char path[TRACE_PATH_MAX + 1];
+} record_t;
+
+static record_t *records;
+static size_t nrecords;
+static bool well_formed;
+
+static void load() {
+    free(records);
+    records = NULL;
+    nrecords = 0;
+    well_formed = false;
+    FILE *fp = fopen(TRACE_FILE, "rb");
+    if (fp == NULL) return;
+    struct trace_header header;
+    if (fread(&header, sizeof(header), 1, fp) != 1 || memcmp(header.magic, TRACE_MAGIC, 8) != 0 ||
+        header.version != TRACE_VERSION) {
+        fclose(fp);
+        return;
+    }
+    size_t cap = 0;
+    struct trace_chunk chunk;
+    while (fread(&chunk, sizeof(chunk), 1, fp) == 1) {
+        for (size_t done = 0; done < chunk.size;) {
+            if (nrecords == cap) records = realloc(records, (cap = cap ? cap * 2 : 1024) * sizeof(record_t));
+            record_t *r = &records[nrecords++];
+            r->thread = chunk.thread;
+            if (fread(&r->e, sizeof(r->e), 1, fp) != 1) goto out;
+            size_t len = (r->e.pathlen + 7) & ~7;
+            if (fread(r->path, 1, len, fp) != len) goto out;
+            r->path[r->e.pathlen] = '\0';
+            done += sizeof(r->e) + len;
+        }
+    }
+    well_formed = feof(fp);
+out:
+    fclose(fp);
+}
+
+static size_t count(int op) {
+    size_t n = 0;
+    for (size_t i = 0; i < nrecords; i++) n += records[i].e.op == op;
+    return n;
+}
+
+static size_t count_depth(int op, int depth) {
+    size_t n = 0;
+    for (size_t i = 0; i < nrecords; i++) n += records[i].e.op == op && records[i].e.depth == depth;
+    return n;
+}
+
+static record_t *find(int op, size_t nth) {
+    for (size_t i = 0; i < nrecords; i++)
+        if (records[i].e.op == op && nth-- == 0) return &records[i];
+    return NULL;
+}
+
+static record_t *find_name(vfs_node_t node) {
+    for (size_t i = 0; i < nrecords; i++)
+        if (records[i].e.op == trace_name && records[i].e.node == (usize)node) return &records[i];
+    return NULL;
+}
+
+static void put(const char *path, const char *data) {
+    vfs_mkfile(path);
+    vfs_write(vfs_open(path), data, 0, strlen(data));
+}
+
+static void test_events() {
+    print_separator("Events");
+
+    vfs_init();
+    int tmpfs = tmpfs_regist();
+    overlayfs_regist();
+    check(vfs_mount("tmpfs", rootdir) == 0, "mount tmpfs on /");
+    vfs_mkdir("/dir");
+    put("/dir/file", "hello trace");
+
+    check(vfs_trace_start(TRACE_FILE, 0) == 0, "start tracing");
+    check(vfs_trace_start(TRACE_FILE, 0) == -1, "only one trace at a time");
+    vfs_node_t file = vfs_open("/dir/file");
+    char buf[16];
+    vfs_read(file, buf, 2, 5);
+    vfs_read(file, buf, 6, 16);
+    vfs_write(file, "!", 11, 1);
+    vfs_open("/dir/missing");
+    vfs_mkfile("/dir/old");
+    vfs_rename("/dir/old", "/dir/new");
+    vfs_unlink("/dir/new");
+    check(vfs_trace_stop() == 0, "stop tracing, nothing lost");
+    check(vfs_trace_stop() == -1, "stopping twice fails");
+    vfs_read(file, buf, 0, 1);
+
+    load();
+    check(well_formed, "the file is well formed");
+    check(count(vfs_op_read) == 2 && count(vfs_op_write) == 1, "one event per read and write");
+    check(count_depth(vfs_op_open, 0) == 2, "and per open");
+    check(count_depth(vfs_op_open, 1) >= 3, "rename and unlink open the parents inside");
+    record_t *r = find(vfs_op_read, 0);
+    check(r && r->e.node == (usize)file && r->e.offset == 2 && r->e.size == 5 && !r->e.failed,
+          "node, offset and size");
+    r = find(vfs_op_read, 1);
+    check(r && r->e.size == 5, "a short read records the bytes read");
+    check(r && r->e.end >= r->e.start && r->e.depth == 0 && r->e.driver == tmpfs, "times, depth and driver");
+    r = find_name(file);
+    check(r && strcmp(r->path, "/dir/file") == 0, "the node's path is written");
+    size_t names = 0;
+    for (size_t i = 0; i < nrecords; i++) names += records[i].e.op == trace_name && records[i].e.node == (usize)file;
+    check(names == 1, "only once");
+    r = NULL;
+    for (size_t i = 0; i < nrecords; i++)
+        if (records[i].e.op == vfs_op_open && records[i].e.failed) r = &records[i];
+    check(r && r->e.failed && r->e.node == 0 && strcmp(r->path, "/dir/missing") == 0,
+          "a failed open records its path");
+    r = find(vfs_op_rename, 0);
+    check(r && strcmp(r->path, "/dir/old") == 0 && r->e.driver == tmpfs, "path operations record the path");
+    check(count(vfs_op_unlink) == 1 && count(vfs_op_mkfile) == 1, "unlink and mkfile");
+    bool tmpfs_named = false;
+    for (size_t i = 0; i < nrecords; i++)
+        if (records[i].e.op == trace_driver && records[i].e.driver == tmpfs) tmpfs_named = !strcmp(records[i].path, "tmpfs");
+    check(tmpfs_named, "driver names");
+    check(count(trace_clock) >= 2, "clock records for the TSC frequency");
+}
+
+static void test_nesting() {
+    print_separator("Nested operations");
+
+    vfs_mkdir("/lower");
+    put("/lower/f", "from the lower layer");
+    vfs_mkdir("/upper");
+    vfs_mkdir("/merged");
+    check(vfs_mount("lowerdir=/lower,upperdir=/upper", vfs_open("/merged")) == 0, "mount overlayfs");
+    vfs_node_t file = vfs_open("/merged/f");
+    vfs_node_t lower = vfs_open("/lower/f");
+
+    check(vfs_trace_start(TRACE_FILE, 0) == 0, "start tracing again");
+    char buf[8];
+    vfs_read(file, buf, 0, sizeof(buf));
+    vfs_trace_stop();
+
+    load();
+    record_t *outer = find(vfs_op_read, 1), *inner = find(vfs_op_read, 0);
+    check(outer && outer->e.node == (usize)file && outer->e.depth == 0, "the overlay read ends last");
+    check(inner && inner->e.node == (usize)lower && inner->e.depth == 1, "the lower read is nested in it");
+    check(inner && outer && inner->e.start >= outer->e.start && inner->e.end <= outer->e.end,
+          "and inside its time");
+    check(inner && outer && inner->e.driver != outer->e.driver, "with another driver");
+    check(find_name(file) && find_name(lower), "a new trace writes the paths again");
+}
+
+static void test_other_ops() {
+    print_separator("Other operations");
+
+    vfs_node_t file = vfs_open("/dir/file");
+    put("/dir/copy", "");
+    vfs_node_t copy = vfs_open("/dir/copy");
+    vfs_mkdir("/m");
+    vfs_mkdir("/alias");
+    vfs_node_t pipe = vfs_pipe(4096, 0);
+    vfs_write(pipe, "spliced", 0, 7);
+    char buf[64] = {0};
+
+    check(vfs_trace_start(TRACE_FILE, 0) == 0, "start tracing");
+    vfs_mount("tmpfs", vfs_open("/m"));
+    vfs_bind("/dir", "/alias");
+    vfs_unmount("/alias");
+    vfs_fallocate(file, 0, 0, 8192);
+    vfs_copy_range(file, 0, copy, 0, 5);
+    vfs_setxattr(file, "user.a", "1", 1);
+    vfs_getxattr(file, "user.a", buf, sizeof(buf));
+    vfs_listxattr(file, buf, sizeof(buf));
+    vfs_lock(file, 10, 20, vfs_lock_exclusive, false);
+    vfs_unlock(file, 10, 20);
+    vfs_poll(&(struct vfs_pollfd){.node = file, .events = vfs_poll_in}, 1, 0);
+    vfs_splice(pipe, copy, 0, 7);
+    vfs_trace_stop();
+    vfs_pipe_free(pipe);
+
+    load();
+    bool once = true;
+    for (int op = vfs_op_mount; op <= vfs_op_splice; op++) once = once && count_depth(op, 0) == 1;
+    check(once, "one event for each");
+    record_t *r = find(vfs_op_lock, 0);
+    check(r && r->e.node == (usize)file && r->e.offset == 10 && r->e.size == 20, "a lock records its range");
+    r = find(vfs_op_copy_range, 0);
+    check(r && r->e.node == (usize)copy && r->e.size == 5, "a copy records the target and the bytes");
+    r = find(vfs_op_bind, 0);
+    check(r && strcmp(r->path, "/alias") == 0, "a bind records the mount point");
+}
+
+static void *reader(void *arg) {
+    char buf[64];
+    for (int i = 0; i < READS; i++) vfs_read(arg, buf, 0, sizeof(buf));
+    return NULL;
+}
+
+static void test_threads() {
+    print_separator("Threads");
+
+    vfs_node_t file = vfs_open("/dir/file");
+    check(vfs_trace_start(TRACE_FILE, 0) == 0, "start tracing");
+    pthread_t threads[THREADS];
+    for (int i = 0; i < THREADS; i++) pthread_create(&threads[i], NULL, reader, file);
+    for (int i = 0; i < THREADS; i++) pthread_join(threads[i], NULL);
+    check(vfs_trace_stop() == 0, "nothing lost");
+
+    load();
+    check(well_formed && count(vfs_op_read) == THREADS * READS, "every read is in the file");
+    size_t per[THREADS + 8] = {0};
+    bool ordered = true;
+    u64 last[THREADS + 8] = {0};
+    for (size_t i = 0; i < nrecords; i++) {
+        record_t *r = &records[i];
+        if (r->e.op != vfs_op_read || r->thread >= THREADS + 8) continue;
+        per[r->thread]++;
+        ordered &= r->e.start >= last[r->thread];
+        last[r->thread] = r->e.start;
+    }
+    // a thread that starts after another one exited may reuse its buffer
+    bool whole = true;
+    for (int i = 0; i < THREADS + 8; i++) whole &= per[i] % READS == 0;
+    check(whole, "threads do not share a buffer");
+    check(ordered, "events of a buffer are in order");
+}
+
+static void test_lost() {
+    print_separator("Full buffers");
+
+    vfs_node_t file = vfs_open("/dir/file");
+    check(vfs_trace_start(TRACE_FILE, 4096) == 0, "start with small buffers");
+    reader(file);
+    ssize_t lost = vfs_trace_stop();
+    check(lost > 0, "events are dropped");
+
+    load();
+    size_t reported = 0;
+    for (size_t i = 0; i < nrecords; i++)
+        if (records[i].e.op == trace_lost) reported += records[i].e.size;
+    check(reported == (size_t)lost, "and counted in the file");
+    check(count(vfs_op_read) + lost == READS, "nothing else is missing");
+    remove(TRACE_FILE);
+}
+
+int main() {
+    printf(BOLD "trace test" RESET "\n");
+
+    test_events();
+    test_nesting();
+    test_other_ops();
+    test_threads();
+    test_lost();
+
+    if (failures) {
+        printf("\n" RED "%d check(s) failed" RESET "\n", failures);
+        return 1;
+    }
+    printf("\n" GREEN "trace test completed successfully!" RESET "\n");
+    return 0;
+}
@@ -0,0 +1,132 @@
+/*
+ * watch test - registers watches on a directory and on a whole tree in
+ * tmpfs and checks the create/write/close/delete events they receive,
+ * including the coalescing of repeated writes.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#define EVENT_IMPLEMENTATION
+#include <vfs.h>
+#include <fs/tmpfs.h>
+
+#define RESET   "\033[0m"
+#define RED     "\033[31m"
+#define GREEN   "\033[32m"
+#define BLUE    "\033[34m"
+#define BOLD    "\033[1m"
+
+static int failures = 0;
+static vfs_watch_t dir_watch, tree_watch;
+
+static void check(bool ok, const char *what) {
+    printf("%s %s\n", ok ? GREEN "[ OK ]" RESET : RED "[FAIL]" RESET, what);
+    if (!ok) failures++;
+}
+
+static void print_separator(const char *title) {
+    printf("\n" BOLD BLUE "=== %s ===" RESET "\n", title);
+}
+
+// pops the next event and checks its type and path
+static bool expect(vfs_watch_t watch, int type, const char *path) {
+    vfs_event_t ev = event_pop(watch->events);
+    bool ok = ev && ev->type == type && strcmp(ev->path, path) == 0;
+    free(ev);
+    return ok;
+}
+
+static void test_events() {
+    print_separator("Events");
+
+    vfs_init();
+    tmpfs_regist();
+    check(vfs_mount("tmpfs", rootdir) == 0, "mount tmpfs on /");
+    vfs_mkdir("/conf/sub");
+
+    dir_watch = vfs_watch(vfs_open("/conf"), vfs_event_all, false);
+    tree_watch = vfs_watch(rootdir, vfs_event_create | vfs_event_delete, true);
+    check(dir_watch && tree_watch, "watch /conf and the whole tree");
+
+    vfs_mkfile("/conf/app.ini");
+    check(expect(dir_watch, vfs_event_create, "/conf/app.ini"), "directory watch sees the create");
+    check(expect(tree_watch, vfs_event_create, "/conf/app.ini"), "tree watch sees the create");
+
+    vfs_node_t file = vfs_open("/conf/app.ini");
+    vfs_write(file, "x", 0, 1);
+    check(expect(dir_watch, vfs_event_write, "/conf/app.ini"), "write event");
+    check(event_isempty(tree_watch->events), "tree watch ignores writes");
+
+    vfs_close(file);
+    check(expect(dir_watch, vfs_event_close, "/conf/app.ini"), "close event");
+
+    vfs_mkfile("/conf/sub/deep");
+    check(event_isempty(dir_watch->events), "directory watch ignores grandchildren");
+    check(expect(tree_watch, vfs_event_create, "/conf/sub/deep"), "tree watch sees grandchildren");
+}
+
+static void test_coalesce() {
+    print_separator("Coalescing");
+
+    vfs_node_t file = vfs_open("/conf/app.ini");
+    char line[16] = "key = value\n";
+    for (int i = 0; i < 1000; i++) vfs_write(file, line, i * 12, 12);
+    check(event_size(dir_watch->events) == 1, "1000 writes make one event");
+    vfs_event_t ev = event_pop(dir_watch->events);
+    check(ev && ev->offset == 0 && ev->size == 12000, "event covers every write");
+    free(ev);
+
+    vfs_write(file, line, 0, 12);
+    check(event_size(dir_watch->events) == 1, "write after the event was taken queues a new one");
+    vfs_truncate(file, 6);
+    ev = event_pop(dir_watch->events);
+    check(ev && ev->offset == 0 && ev->size == 12, "truncate merges too");
+    free(ev);
+
+    vfs_mkfile("/conf/other");
+    vfs_write(vfs_open("/conf/other"), line, 0, 12);
+    vfs_write(file, line, 0, 12);
+    check(event_size(dir_watch->events) == 3, "writes to another file are not merged");
+    for (void *e; (e = event_pop(dir_watch->events)) != NULL;) free(e);
+    for (void *e; (e = event_pop(tree_watch->events)) != NULL;) free(e);
+}
+
+static void test_rename() {
+    print_separator("Rename and delete");
+
+    vfs_mkfile("/conf/app.ini.tmp");
+    check(expect(dir_watch, vfs_event_create, "/conf/app.ini.tmp"), "temporary file created");
+    check(vfs_rename("/conf/app.ini.tmp", "/conf/app.ini") == 0, "replace the config");
+    check(expect(dir_watch, vfs_event_delete, "/conf/app.ini.tmp"), "old name deleted");
+    check(expect(dir_watch, vfs_event_create, "/conf/app.ini"), "new name created");
+
+    check(vfs_unlink("/conf/other") == 0, "unlink");
+    check(expect(dir_watch, vfs_event_delete, "/conf/other"), "delete event");
+
+    vfs_watch_t file_watch = vfs_watch(vfs_open("/conf/app.ini"), vfs_event_all, false);
+    vfs_unlink("/conf/app.ini");
+    check(expect(file_watch, vfs_event_delete, "/conf/app.ini"), "watched file reports its deletion");
+    check(file_watch->node == NULL, "watch outlives the node");
+    vfs_unwatch(file_watch);
+
+    vfs_unwatch(dir_watch);
+    vfs_unwatch(tree_watch);
+    vfs_mkfile("/conf/after");
+    check(vfs_open("/conf/after") != NULL, "operations work without watches");
+}
+
+int main() {
+    printf(BOLD "watch test" RESET "\n");
+
+    test_events();
+    test_coalesce();
+    test_rename();
+
+    if (failures) {
+        printf("\n" RED "%d check(s) failed" RESET "\n", failures);
+        return 1;
+    }
+    printf("\n" GREEN "watch test completed successfully!" RESET "\n");
+    return 0;
+}
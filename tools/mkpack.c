@@ -0,0 +1,58 @@
+/*
+ * mkpack - pack a host directory into a packfs image
+ *
+ * usage: mkpack <host dir> <image> [none|lz4|zstd] [block size]
+ *
+ * The directory is mounted into the VFS through hostfs and serialized with
+ * packfs_pack, so the image contains exactly what the VFS sees.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vfs.h>
+#include <fs/hostfs.h>
+#include <fs/packfs.h>
+
+int main(int argc, char **argv) {
+    if (argc < 3) {
+        fprintf(stderr, "usage: %s <host dir> <image> [none|lz4|zstd] [block size]\n", argv[0]);
+        return 1;
+    }
+
+    int codec = packfs_codec_none;
+    if (argc > 3) {
+        if (strcmp(argv[3], "lz4") == 0) {
+            codec = packfs_codec_lz4;
+        } else if (strcmp(argv[3], "zstd") == 0) {
+            codec = packfs_codec_zstd;
+        } else if (strcmp(argv[3], "none") != 0) {
+            fprintf(stderr, "unknown codec: %s\n", argv[3]);
+            return 1;
+        }
+    }
+    unsigned block_size = argc > 4 ? strtoul(argv[4], NULL, 0) : 0;
+
+    vfs_init();
+    hostfs_regist();
+    if (vfs_mount(argv[1], rootdir) != 0) {
+        fprintf(stderr, "cannot mount %s\n", argv[1]);
+        return 1;
+    }
+
+    mostream_t image = mostream_alloc(1 << 20);
+    if (packfs_pack(rootdir, image, codec, block_size) != 0) {
+        fprintf(stderr, "failed to pack %s\n", argv[1]);
+        return 1;
+    }
+
+    FILE *fp = fopen(argv[2], "wb");
+    if (fp == NULL || fwrite(image->buf, 1, image->size, fp) != image->size) {
+        fprintf(stderr, "cannot write %s\n", argv[2]);
+        return 1;
+    }
+    fclose(fp);
+    printf("%s: %zu bytes\n", argv[2], image->size);
+    mostream_free(image);
+    return 0;
+}
@@ -0,0 +1,184 @@
+/*
+ * vfsreplay - replay a workload recorded with vfs_record_start
+ *
+ * usage: vfsreplay [-f] [-t] [-m <src>] <recording>
+ *        vfsreplay [-o <recording>]
+ *
+ * -f        as fast as possible instead of at the recorded pace
+ * -t        one thread per recorded thread, dependencies between the calls
+ *           of different threads are kept
+ * -m <src>  mount src on / first (a host directory, "tmpfs", ...) and skip
+ *           the recorded mounts, to replay against another driver
+ *
+ * Without a recording it records a small multi-threaded sample workload on
+ * tmpfs (saved with -o) and replays it in every mode.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <vfs.h>
+#include <fs/hostfs.h>
+#include <fs/overlayfs.h>
+#include <fs/packfs.h>
+#include <fs/procfs.h>
+#include <fs/tmpfs.h>
+
+#define SAMPLE_THREADS 4
+#define SAMPLE_FILES   8
+#define SAMPLE_SIZE    (256 * 1024)
+#define SAMPLE_BLOCK   4096
+
+static void setup() {
+    vfs_init();
+    // hostfs accepts any directory, the others only their own sources
+    tmpfs_regist();
+    overlayfs_regist();
+    procfs_regist();
+    packfs_regist();
+    hostfs_regist();
+}
+
+// the vfs tree cannot be changed by several threads at once
+static pthread_mutex_t tree = PTHREAD_MUTEX_INITIALIZER;
+static pthread_barrier_t written;
+
+// creates path with create (vfs_mkdir, vfs_mkfile or NULL) and opens it
+static vfs_node_t sample_open(const char *path, int (*create)(cstr)) {
+    pthread_mutex_lock(&tree);
+    if (create != NULL) create(path);
+    vfs_node_t node = vfs_open(path);
+    pthread_mutex_unlock(&tree);
+    return node;
+}
+
+static void *sample_thread(void *arg) {
+    int id = (int)(size_t)arg;
+    static char block[SAMPLE_BLOCK];
+    char path[64];
+    sprintf(path, "/work/t%d", id);
+    sample_open(path, vfs_mkdir);
+    for (int f = 0; f < SAMPLE_FILES; f++) {
+        sprintf(path, "/work/t%d/f%d", id, f);
+        vfs_node_t file = sample_open(path, vfs_mkfile);
+        for (int off = 0; off < SAMPLE_SIZE; off += SAMPLE_BLOCK) vfs_write(file, block, off, SAMPLE_BLOCK);
+        pthread_mutex_lock(&tree);
+        vfs_close(file);
+        pthread_mutex_unlock(&tree);
+    }
+    // read what the previous thread wrote
+    pthread_barrier_wait(&written);
+    for (int f = 0; f < SAMPLE_FILES; f++) {
+        sprintf(path, "/work/t%d/f%d", (id + SAMPLE_THREADS - 1) % SAMPLE_THREADS, f);
+        vfs_node_t file = sample_open(path, NULL);
+        char buf[SAMPLE_BLOCK];
+        for (int off = 0; file && off < SAMPLE_SIZE; off += SAMPLE_BLOCK) vfs_read(file, buf, off, SAMPLE_BLOCK);
+    }
+    return NULL;
+}
+
+// records the sample: every thread writes its own files, then reads the
+// files of another thread
+static mostream_t sample() {
+    setup();
+    mostream_t out = mostream_alloc(1 << 20);
+    vfs_record_start();
+    vfs_mount("tmpfs", rootdir);
+    vfs_mkdir("/work");
+    pthread_barrier_init(&written, NULL, SAMPLE_THREADS);
+    pthread_t threads[SAMPLE_THREADS];
+    for (int i = 0; i < SAMPLE_THREADS; i++) pthread_create(&threads[i], NULL, sample_thread, (void *)(size_t)i);
+    for (int i = 0; i < SAMPLE_THREADS; i++) pthread_join(threads[i], NULL);
+    pthread_barrier_destroy(&written);
+    vfs_record_stop(out);
+    return out;
+}
+
+static int replay(const void *buf, size_t size, int flags, const char *src) {
+    setup();
+    if (src != NULL) {
+        if (vfs_mount(src, rootdir) != 0) {
+            fprintf(stderr, "cannot mount %s\n", src);
+            return -1;
+        }
+        flags |= vfs_replay_nomount;
+    }
+    mistream_t in = mistream_alloc(buf, size);
+    vfs_replay_result_t r;
+    int ret = vfs_replay(in, flags, &r);
+    mistream_free(in);
+    if (ret != 0) {
+        fprintf(stderr, "not a valid recording\n");
+        return -1;
+    }
+    printf("%-6s %-7s %8llu %10llu %12.2f %12.2f %8.2fx\n", flags & vfs_replay_timed ? "timed" : "fast",
+           flags & vfs_replay_threads ? "threads" : "single", (unsigned long long)r.ops,
+           (unsigned long long)r.mismatches, r.recorded / 1e6, r.elapsed / 1e6,
+           r.elapsed ? (double)r.recorded / r.elapsed : 0);
+    return r.mismatches != 0;
+}
+
+static void header() {
+    printf("%-6s %-7s %8s %10s %12s %12s %9s\n", "pace", "threads", "ops", "mismatch", "recorded ms", "replay ms",
+           "speedup");
+}
+
+int main(int argc, char **argv) {
+    int flags = vfs_replay_timed;
+    const char *src = NULL, *out = NULL, *in = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-f") == 0) {
+            flags &= ~vfs_replay_timed;
+        } else if (strcmp(argv[i], "-t") == 0) {
+            flags |= vfs_replay_threads;
+        } else if (strcmp(argv[i], "-m") == 0 && i + 1 < argc) {
+            src = argv[++i];
+        } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            out = argv[++i];
+        } else if (argv[i][0] != '-' && in == NULL) {
+            in = argv[i];
+        } else {
+            fprintf(stderr, "usage: %s [-f] [-t] [-m <src>] <recording>\n       %s [-o <recording>]\n", argv[0],
+                    argv[0]);
+            return 1;
+        }
+    }
+
+    if (in == NULL) {
+        mostream_t rec = sample();
+        if (out != NULL) {
+            FILE *fp = fopen(out, "wb");
+            if (fp == NULL || fwrite(rec->buf, 1, rec->size, fp) != rec->size) {
+                fprintf(stderr, "cannot write %s\n", out);
+                return 1;
+            }
+            fclose(fp);
+        }
+        printf("sample: %d threads, %zu bytes recorded\n\n", SAMPLE_THREADS, rec->size);
+        header();
+        int failed = 0;
+        for (int mode = 0; mode < 4; mode++)
+            failed |= replay(rec->buf, rec->size, (mode & 1 ? vfs_replay_threads : 0) | (mode & 2 ? 0 : vfs_replay_timed),
+                             NULL) != 0;
+        mostream_free(rec);
+        return failed;
+    }
+
+    FILE *fp = fopen(in, "rb");
+    if (fp == NULL) {
+        fprintf(stderr, "cannot open %s\n", in);
+        return 1;
+    }
+    size_t cap = 1 << 20, size = 0;
+    char *buf = malloc(cap);
+    for (size_t n; (n = fread(buf + size, 1, cap - size, fp)) > 0;) {
+        size += n;
+        if (size == cap) buf = realloc(buf, cap *= 2);
+    }
+    fclose(fp);
+    header();
+    int ret = replay(buf, size, flags, src);
+    free(buf);
+    return ret < 0 ? 1 : 0;
+}
@@ -0,0 +1,361 @@
+/*
+ * vfstrace - turn a trace written by vfs_trace_start into something readable
+ *
+ * usage: vfstrace <trace> [paths|folded]
+ *
+ * paths   (default) one line per path and operation with counts, bytes and
+ *         latency percentiles, the most expensive first
+ * folded  flamegraph folded stacks: nested operations as frames named
+ *         driver:op, the path of the innermost one as further frames and
+ *         the self time in ns as the count, ready for flamegraph.pl
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vfs.h>
+#include <trace.h>
+
+#define MAX_DEPTH 64
+
+typedef struct {
+    char *stack;
+    unsigned long long ns;
+} entry_t;
+
+typedef struct {
+    entry_t *v;
+    size_t n, cap;
+} entries_t;
+
+typedef struct {
+    const char *path;
+    int op;
+    bool failed;
+    unsigned long long bytes, ns;
+} row_t;
+
+// per buffer state for the folded stacks: the subtrees of operations whose
+// parent has not ended yet, by depth
+typedef struct {
+    entries_t pending[MAX_DEPTH + 1];
+} thread_t;
+
+static byte *data;
+static size_t data_size;
+static bool tsc;
+static double ticks_per_ns = 1;
+static char *drivers[256];
+
+// node id -> path, open addressing
+static struct {
+    unsigned long long node;
+    char *path;
+} *names;
+static size_t names_cap;
+
+static thread_t *threads;
+static size_t nthreads;
+static entries_t folded;
+static row_t *rows;
+static size_t nrows, rows_cap;
+static unsigned long long nevents, nlost;
+static unsigned long long first_start = ~0ull, last_end;
+
+static void entries_push(entries_t *e, char *stack, unsigned long long ns) {
+    if (e->n == e->cap) {
+        e->cap = e->cap ? e->cap * 2 : 16;
+        e->v = realloc(e->v, e->cap * sizeof(*e->v));
+    }
+    e->v[e->n++] = (entry_t){stack, ns};
+}
+
+static size_t name_slot(unsigned long long node) {
+    size_t i = (node >> 4) * 0x9e3779b97f4a7c15ull % names_cap;
+    while (names[i].node != 0 && names[i].node != node) i = (i + 1) % names_cap;
+    return i;
+}
+
+static void name_set(unsigned long long node, char *path) {
+    static size_t used;
+    if (2 * (used + 1) > names_cap) {
+        typeof(names) old = names;
+        size_t old_cap = names_cap;
+        names_cap = names_cap ? names_cap * 2 : 1024;
+        names = calloc(names_cap, sizeof(*names));
+        for (size_t i = 0; i < old_cap; i++)
+            if (old[i].node != 0) names[name_slot(old[i].node)] = old[i];
+        free(old);
+    }
+    size_t i = name_slot(node);
+    if (names[i].node == 0) used++;
+    free(names[i].path);
+    names[i].node = node;
+    names[i].path = path;
+}
+
+static const char *name_get(unsigned long long node) {
+    if (names_cap == 0) return "?";
+    size_t i = name_slot(node);
+    return names[i].node ? names[i].path : "?";
+}
+
+static const char *op_name(int op) {
+    const char *name = vfs_stats_name(op);
+    return name ? name : "?";
+}
+
+static const char *driver_name(int id, char *buf) {
+    if (id < 256 && drivers[id]) return drivers[id];
+    sprintf(buf, "fs%d", id);
+    return buf;
+}
+
+static thread_t *thread_get(unsigned id) {
+    if (id >= nthreads) {
+        threads = realloc(threads, (id + 1) * sizeof(*threads));
+        memset(threads + nthreads, 0, (id + 1 - nthreads) * sizeof(*threads));
+        nthreads = id + 1;
+    }
+    return &threads[id];
+}
+
+// calls fn for every record in the file, false if the file is malformed
+static bool each_record(void (*fn)(unsigned thread, struct trace_event *e, char *path)) {
+    size_t pos = sizeof(struct trace_header);
+    while (pos + sizeof(struct trace_chunk) <= data_size) {
+        struct trace_chunk chunk;
+        memcpy(&chunk, data + pos, sizeof(chunk));
+        pos += sizeof(chunk);
+        if (pos + chunk.size > data_size) return false;
+        size_t end = pos + chunk.size;
+        while (pos + sizeof(struct trace_event) <= end) {
+            struct trace_event e;
+            memcpy(&e, data + pos, sizeof(e));
+            pos += sizeof(e);
+            if (pos + e.pathlen > end) return false;
+            char *path = strndup((char *)data + pos, e.pathlen);
+            pos += (e.pathlen + 7) & ~7;
+            fn(chunk.thread, &e, path);
+        }
+        pos = end;
+    }
+    return pos == data_size;
+}
+
+static void calibrate(unsigned thread, struct trace_event *e, char *path) {
+    static unsigned long long tsc0, ns0;
+    if (e->op == trace_clock && tsc) {
+        if (ns0 == 0) {
+            tsc0 = e->start;
+            ns0 = e->end;
+        } else if (e->end > ns0 && e->start > tsc0) {
+            ticks_per_ns = (double)(e->start - tsc0) / (e->end - ns0);
+        }
+    }
+    free(path);
+}
+
+// the stack of an operation without its ancestors: driver:op and the path
+static char *frame(struct trace_event *e, const char *path) {
+    char buf[16];
+    const char *driver = driver_name(e->driver, buf);
+    size_t len = strlen(driver) + strlen(op_name(e->op)) + strlen(path) + 3;
+    char *s = malloc(len);
+    sprintf(s, "%s:%s", driver, op_name(e->op));
+    for (const char *p = path; *p; p++) {
+        if (*p == '/' && (p[1] == '/' || p[1] == '\0')) continue;
+        size_t n = strlen(s);
+        s[n] = *p == '/' ? ';' : *p;
+        s[n + 1] = '\0';
+    }
+    return s;
+}
+
+static char *prefixed(const char *prefix, const char *stack) {
+    char *s = malloc(strlen(prefix) + strlen(stack) + 2);
+    sprintf(s, "%s;%s", prefix, stack);
+    return s;
+}
+
+static void fold(thread_t *t, struct trace_event *e, const char *path, unsigned long long ns) {
+    int d = e->depth < MAX_DEPTH ? e->depth : MAX_DEPTH - 1;
+    char buf[16];
+    char *self = malloc(strlen(driver_name(e->driver, buf)) + strlen(op_name(e->op)) + 2);
+    sprintf(self, "%s:%s", driver_name(e->driver, buf), op_name(e->op));
+
+    // everything below this operation ended before it and is now complete
+    entries_t *children = &t->pending[d + 1];
+    unsigned long long child_ns = 0;
+    for (size_t i = 0; i < children->n; i++) {
+        child_ns += children->v[i].ns;
+        entries_push(&t->pending[d], prefixed(self, children->v[i].stack), children->v[i].ns);
+        free(children->v[i].stack);
+    }
+    children->n = 0;
+    entries_push(&t->pending[d], frame(e, path), ns > child_ns ? ns - child_ns : 0);
+    free(self);
+
+    if (d == 0) {
+        for (size_t i = 0; i < t->pending[0].n; i++)
+            entries_push(&folded, t->pending[0].v[i].stack, t->pending[0].v[i].ns);
+        t->pending[0].n = 0;
+    }
+}
+
+static void process(unsigned thread, struct trace_event *e, char *path) {
+    switch (e->op) {
+    case trace_name:
+        name_set(e->node, path);
+        return;
+    case trace_driver:
+        if (e->driver >= 256) break;
+        free(drivers[e->driver]);
+        drivers[e->driver] = path;
+        return;
+    case trace_lost:
+        nlost += e->size;
+        free(path);
+        return;
+    case trace_clock:
+        free(path);
+        return;
+    }
+    if (e->op >= vfs_op_count || e->op == trace_driver) {
+        free(path);
+        return;
+    }
+    nevents++;
+    if (e->start < first_start) first_start = e->start;
+    if (e->end > last_end) last_end = e->end;
+    unsigned long long ns = (e->end - e->start) / ticks_per_ns;
+    const char *p = e->node ? name_get(e->node) : path;
+    // node paths may change later, rows keep their own copy
+    if (e->node) {
+        free(path);
+        path = strdup(p);
+    }
+    fold(thread_get(thread), e, path, ns);
+    if (nrows == rows_cap) {
+        rows_cap = rows_cap ? rows_cap * 2 : 1024;
+        rows = realloc(rows, rows_cap * sizeof(*rows));
+    }
+    bool io = e->op == vfs_op_read || e->op == vfs_op_write;
+    rows[nrows++] = (row_t){path, e->op, e->failed, io && !e->failed ? e->size : 0, ns};
+}
+
+static int cmp_entry(const void *a, const void *b) {
+    return strcmp(((entry_t *)a)->stack, ((entry_t *)b)->stack);
+}
+
+static void print_folded() {
+    // operations whose outermost parent started before the trace did
+    for (size_t i = 0; i < nthreads; i++) {
+        for (int d = 0; d <= MAX_DEPTH; d++) {
+            entries_t *e = &threads[i].pending[d];
+            for (size_t j = 0; j < e->n; j++) entries_push(&folded, e->v[j].stack, e->v[j].ns);
+            e->n = 0;
+        }
+    }
+    qsort(folded.v, folded.n, sizeof(entry_t), cmp_entry);
+    for (size_t i = 0; i < folded.n;) {
+        unsigned long long ns = 0;
+        size_t j = i;
+        for (; j < folded.n && strcmp(folded.v[j].stack, folded.v[i].stack) == 0; j++) ns += folded.v[j].ns;
+        if (ns != 0) printf("%s %llu\n", folded.v[i].stack, ns);
+        i = j;
+    }
+}
+
+static int cmp_row(const void *a, const void *b) {
+    const row_t *x = a, *y = b;
+    int c = strcmp(x->path, y->path);
+    if (c != 0) return c;
+    if (x->op != y->op) return x->op - y->op;
+    return x->ns < y->ns ? -1 : x->ns > y->ns;
+}
+
+typedef struct {
+    row_t *first;
+    size_t n;
+    unsigned long long errors, bytes, total;
+} group_t;
+
+static int cmp_group(const void *a, const void *b) {
+    const group_t *x = a, *y = b;
+    return x->total < y->total ? 1 : x->total > y->total ? -1 : 0;
+}
+
+static void print_paths() {
+    printf("events %llu  lost %llu  buffers %zu  span %.3f ms\n\n", nevents, nlost,
+           nthreads ? nthreads - 1 : 0, nevents ? (last_end - first_start) / ticks_per_ns / 1e6 : 0);
+    qsort(rows, nrows, sizeof(row_t), cmp_row);
+    group_t *groups = malloc((nrows + 1) * sizeof(*groups));
+    size_t ngroups = 0;
+    for (size_t i = 0; i < nrows;) {
+        group_t g = {&rows[i]};
+        for (; i < nrows && strcmp(rows[i].path, g.first->path) == 0 && rows[i].op == g.first->op; i++) {
+            g.n++;
+            g.errors += rows[i].failed;
+            g.bytes += rows[i].bytes;
+            g.total += rows[i].ns;
+        }
+        groups[ngroups++] = g;
+    }
+    qsort(groups, ngroups, sizeof(group_t), cmp_group);
+    printf("%-10s %8s %6s %12s %10s %9s %9s %9s %9s  %s\n", "op", "count", "errors", "bytes",
+           "total_us", "avg_ns", "p50_ns", "p99_ns", "max_ns", "path");
+    for (size_t i = 0; i < ngroups; i++) {
+        group_t *g = &groups[i];
+        // the rows of a group are sorted by time
+        size_t p50 = (g->n - 1) / 2, p99 = (g->n - 1) * 99 / 100;
+        printf("%-10s %8zu %6llu %12llu %10.1f %9llu %9llu %9llu %9llu  %s\n", op_name(g->first->op), g->n,
+               g->errors, g->bytes, g->total / 1e3, g->total / g->n, g->first[p50].ns, g->first[p99].ns,
+               g->first[g->n - 1].ns, g->first->path);
+    }
+    free(groups);
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2 || (argc > 2 && strcmp(argv[2], "paths") != 0 && strcmp(argv[2], "folded") != 0)) {
+        fprintf(stderr, "usage: %s <trace> [paths|folded]\n", argv[0]);
+        return 1;
+    }
+
+    FILE *fp = fopen(argv[1], "rb");
+    if (fp == NULL) {
+        fprintf(stderr, "cannot open %s\n", argv[1]);
+        return 1;
+    }
+    size_t cap = 1 << 20;
+    data = malloc(cap);
+    for (size_t n; (n = fread(data + data_size, 1, cap - data_size, fp)) > 0;) {
+        data_size += n;
+        if (data_size == cap) data = realloc(data, cap *= 2);
+    }
+    fclose(fp);
+
+    struct trace_header header;
+    if (data_size < sizeof(header) || memcmp(data, TRACE_MAGIC, 8) != 0) {
+        fprintf(stderr, "%s: not a trace\n", argv[1]);
+        return 1;
+    }
+    memcpy(&header, data, sizeof(header));
+    if (header.version != TRACE_VERSION) {
+        fprintf(stderr, "%s: unsupported version %u\n", argv[1], header.version);
+        return 1;
+    }
+    tsc = header.tsc;
+
+    // the clock records give the TSC frequency, the first and last one span
+    // the whole trace
+    if (!each_record(calibrate)) fprintf(stderr, "%s: truncated, reading what is there\n", argv[1]);
+    each_record(process);
+
+    if (argc > 2 && strcmp(argv[2], "folded") == 0) {
+        print_folded();
+    } else {
+        print_paths();
+    }
+    return 0;
+}